@@ -0,0 +1,142 @@
+//
+// CartesianJoints.cpp : correction plugin applying Cartesian offsets to a
+//                       joint trajectory, on the robot's fixed kinematics
+//
+// A sensor posts x y z (mm) and w p r (deg, a small rotation about the world
+// x y z axes) to the mailbox, as for a Cartesian trajectory; every cycle the
+// plugin turns the offset into joint offsets at the command about to be
+// sent (one damped least squares step on the Jacobian of FixedKinematics.h)
+// and checks the corrected joints against the model's limits. A command
+// whose correction would leave the limits, or would need more than maxStep
+// deg on an axis (close to a singularity), is sent as taught and counted.
+// Replace posts are joint angles and are passed through unchanged;
+// Cartesian trajectories get the offsets added as posted.
+//
+// The robot is fixed when the plugin is built (KinGen header, see
+// FixedKinematics.h); init refuses a model file whose chain is not the
+// header's.
+//
+//   StreamITP curang.txt <ip> Joint 0 6 --correction-mailbox /dev/shm/seam
+//             --correction-plugin ./libCartesianJoints.so,v8.urdf,0.5   (max 0.5 deg per axis)
+//
+// Build: make libCartesianJoints.so (ROBOT=FanucTest2 for the other header), in Source
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "CorrectionHook.h"
+#include "RobotModel.h"
+#include "FixedKinematics.h"
+
+#ifndef FIXED_ROBOT
+#error "build with -DFIXED_ROBOT_HEADER='\"Robots/<Robot>Kinematics.h\"'"
+#endif
+
+const double StepDamping = 1.0;          // mm
+const float DefaultMaxStep = 1.0f;       // deg per axis
+
+typedef struct CartesianJoints_T {
+	float maxStep;
+	unsigned long applied;
+	unsigned long outOfLimits;
+	unsigned long tooLarge;
+} CartesianJoints_T;
+
+static bool CartesianInit(const char *args, void **context)
+{
+	char modelFile[512];
+	const char *comma = strchr(args, ',');
+	size_t length = (comma != NULL) ? (size_t)(comma - args) : strlen(args);
+	static RobotModel_T model;
+	KinematicChain_T chain;
+
+	if ((length == 0) || (length >= sizeof(modelFile))) {
+		printf("CartesianJoints: arguments are ModelFile[,maxStep]\n");
+		return false;
+	}
+	memcpy(modelFile, args, length);
+	modelFile[length] = '\0';
+	if (!LoadRobotModel(modelFile, &model) || !BuildKinematicChain(&model, &chain)) {
+		return false;
+	}
+	if (!FixedMatchesChain<FIXED_ROBOT>(&chain)) {
+		printf("CartesianJoints: %s is not the robot this plugin was built for, run KinGen again\n", modelFile);
+		return false;
+	}
+
+	CartesianJoints_T *plugin = (CartesianJoints_T *)calloc(1, sizeof(CartesianJoints_T));
+	if (plugin == NULL) {
+		return false;
+	}
+	plugin->maxStep = (comma != NULL) ? (float)atof(comma + 1) : DefaultMaxStep;
+	if (plugin->maxStep <= 0.0f) {
+		free(plugin);
+		return false;
+	}
+	*context = plugin;
+	return true;
+}
+
+static bool CartesianCycle(void *context, const CorrectionInput_T *input, float command[MaxAxisNumber])
+{
+	CartesianJoints_T *plugin = (CartesianJoints_T *)context;
+	float step[MaxAxisNumber];
+	float corrected[MaxAxisNumber];
+
+	if (!input->haveMailbox || (input->mailbox.mode == CorrectionNone)) {
+		return false;
+	}
+	if (input->mailbox.mode == CorrectionReplace) {
+		memcpy(command, input->mailbox.pose, sizeof(input->mailbox.pose));
+		return true;
+	}
+	if (input->representation == 0) {
+		for (int idx = 0; idx < MaxAxisNumber; idx++) {
+			command[idx] += input->mailbox.pose[idx];
+		}
+		return true;
+	}
+
+	bool zero = true;
+	for (int idx = 0; idx < 6; idx++) {
+		zero = zero && (input->mailbox.pose[idx] == 0.0f);
+	}
+	if (zero || !FixedCartesianStep<FIXED_ROBOT>(command, input->mailbox.pose, StepDamping, step)) {
+		return false;
+	}
+	for (int idx = 0; idx < MaxAxisNumber; idx++) {
+		if (fabsf(step[idx]) > plugin->maxStep) {
+			plugin->tooLarge++;
+			return false;
+		}
+		corrected[idx] = command[idx] + step[idx];
+	}
+	if (FixedLimitMask<FIXED_ROBOT>(corrected) != 0) {
+		plugin->outOfLimits++;
+		return false;
+	}
+	memcpy(command, corrected, sizeof(corrected));
+	plugin->applied++;
+	return true;
+}
+
+static void CartesianFree(void *context)
+{
+	CartesianJoints_T *plugin = (CartesianJoints_T *)context;
+
+	if (plugin != NULL) {
+		printf("CartesianJoints: %lu corrected, %lu sent as taught (limits %lu, step over %.2f deg %lu)\n", plugin->applied,
+			plugin->outOfLimits + plugin->tooLarge, plugin->outOfLimits, plugin->maxStep, plugin->tooLarge);
+	}
+	free(context);
+}
+
+static const CorrectionPlugin_T cartesianPlugin = { "Cartesian joints", CartesianInit, CartesianCycle, CartesianFree };
+
+extern "C" const CorrectionPlugin_T *ItpCorrectionPlugin(void)
+{
+	return &cartesianPlugin;
+}
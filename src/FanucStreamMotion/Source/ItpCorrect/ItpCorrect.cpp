@@ -0,0 +1,119 @@
+//
+// ItpCorrect.cpp : post corrections to a running StreamITP's mailbox
+//                  (--correction-mailbox), once or line by line from stdin
+//
+// Build: make ItpCorrect, in Source
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "CorrectionHook.h"
+
+using namespace std;
+
+static void Usage()
+{
+	cout << " Usage: ItpCorrect MailboxFile offset|replace v1 [v2 .. v9]" << endl;
+	cout << "        ItpCorrect MailboxFile clear|show" << endl;
+	cout << "        ItpCorrect MailboxFile -        (lines of \"offset v1 ..\", \"replace v1 ..\" or \"clear\" from stdin)" << endl;
+	cout << "   values in the representation being streamed: mm / deg (x y z w p r [ext1-3]) or deg (j1-j9), unset ones are 0" << endl;
+}
+
+/*
+ * PostWords: "offset|replace v1 ..", "clear". false if the words are not one of these.
+ */
+static bool PostWords(CorrectionMailbox_T *mailbox, istream &words)
+{
+	string kind;
+	float pose[MaxAxisNumber] = { 0.0f };
+	u_word mode;
+
+	if (!(words >> kind)) {
+		return false;
+	}
+	if (kind == "clear") {
+		mode = CorrectionNone;
+	}
+	else if ((kind == "offset") || (kind == "replace")) {
+		mode = (kind == "offset") ? CorrectionOffset : CorrectionReplace;
+		int count = 0;
+		string value;
+		while (words >> value) {
+			char *end;
+			if (count == MaxAxisNumber) {
+				return false;
+			}
+			pose[count++] = strtof(value.c_str(), &end);
+			if (*end != '\0') {
+				return false;
+			}
+		}
+		if (count == 0) {
+			return false;
+		}
+	}
+	else {
+		return false;
+	}
+	PostCorrection(mailbox, mode, pose);
+	return true;
+}
+
+/* ------------------------------------------------------------------
+* Main routine
+--------------------------------------------------------------------- */
+int main(int argc, char* argv[])
+{
+	if (argc < 3) {
+		Usage();
+		return 1;
+	}
+	CorrectionMailbox_T *mailbox = OpenCorrectionMailbox(argv[1], false);
+	if (mailbox == NULL) {
+		return 1;
+	}
+
+	int result = 0;
+	if (strcmp(argv[2], "show") == 0) {
+		MailboxEntry_T entry;
+		if (ReadCorrection(mailbox, &entry)) {
+			static const char *modeNames[] = { "none", "offset", "replace" };
+			printf("%u posts, last: %s", entry.posts, (entry.mode <= CorrectionReplace) ? modeNames[entry.mode] : "?");
+			for (int idx = 0; idx < MaxAxisNumber; idx++) {
+				printf(" %.3f", entry.pose[idx]);
+			}
+			printf("\n");
+		}
+	}
+	else if (strcmp(argv[2], "-") == 0) {
+		// one post per line as it comes, e.g. piped from a seam sensor
+		string line;
+		int lineNo = 0;
+		while (getline(cin, line)) {
+			lineNo++;
+			istringstream words(line);
+			if ((line.find_first_not_of(" \t\r") != string::npos) && !PostWords(mailbox, words)) {
+				cout << "stdin:" << lineNo << ": expected offset|replace v1 .. or clear" << endl;
+				result = 1;
+			}
+		}
+	}
+	else {
+		string words;
+		for (int argIdx = 2; argIdx < argc; argIdx++) {
+			words += string(argv[argIdx]) + " ";
+		}
+		istringstream stream(words);
+		if (!PostWords(mailbox, stream)) {
+			Usage();
+			result = 1;
+		}
+	}
+	CloseCorrectionMailbox(mailbox);
+	return result;
+}
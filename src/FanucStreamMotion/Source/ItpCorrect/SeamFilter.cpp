@@ -0,0 +1,75 @@
+//
+// SeamFilter.cpp : example correction plugin for StreamITP --correction-plugin
+//
+// A seam sensor (through ItpCorrect or its own process) posts the offset of
+// the seam from the taught path to the mailbox; this plugin moves the
+// applied offset towards the latest post by at most a set step per cycle,
+// so a jump in the sensor reading becomes a ramp the controller can follow
+// instead of a step over its thresholds. Replace posts are passed through
+// unchanged.
+//
+//   StreamITP fanuc_scan_cart.itpb <ip> --correction-mailbox /dev/shm/seam
+//             --correction-plugin ./libSeamFilter.so,0.2      (0.2 mm / deg per cycle)
+//
+// Build: make libSeamFilter.so, in Source
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "CorrectionHook.h"
+
+typedef struct SeamFilter_T {
+	float maxStep;                     // per cycle and axis
+	float applied[MaxAxisNumber];
+} SeamFilter_T;
+
+static bool SeamInit(const char *args, void **context)
+{
+	SeamFilter_T *filter = (SeamFilter_T *)calloc(1, sizeof(SeamFilter_T));
+	if (filter == NULL) {
+		return false;
+	}
+	filter->maxStep = (args[0] != '\0') ? (float)atof(args) : 0.1f;
+	if (filter->maxStep <= 0.0f) {
+		free(filter);
+		return false;
+	}
+	*context = filter;
+	return true;
+}
+
+static bool SeamCycle(void *context, const CorrectionInput_T *input, float command[MaxAxisNumber])
+{
+	SeamFilter_T *filter = (SeamFilter_T *)context;
+
+	if (!input->haveMailbox) {
+		return false;
+	}
+	if (input->mailbox.mode == CorrectionReplace) {
+		memcpy(command, input->mailbox.pose, sizeof(input->mailbox.pose));
+		return true;
+	}
+	bool moved = false;
+	for (int idx = 0; idx < MaxAxisNumber; idx++) {
+		float target = (input->mailbox.mode == CorrectionOffset) ? input->mailbox.pose[idx] : 0.0f;
+		float step = target - filter->applied[idx];
+		step = (step > filter->maxStep) ? filter->maxStep : (step < -filter->maxStep) ? -filter->maxStep : step;
+		filter->applied[idx] += step;
+		command[idx] += filter->applied[idx];
+		moved = moved || (filter->applied[idx] != 0.0f);
+	}
+	return moved;
+}
+
+static void SeamFree(void *context)
+{
+	free(context);
+}
+
+static const CorrectionPlugin_T seamPlugin = { "seam filter", SeamInit, SeamCycle, SeamFree };
+
+extern "C" const CorrectionPlugin_T *ItpCorrectionPlugin(void)
+{
+	return &seamPlugin;
+}
@@ -0,0 +1,355 @@
+//
+// J519Sim.cpp : local stand-in for the robot controller's J519 stream motion
+//               port, for loopback testing and benchmarking of StreamITP
+//
+// Build (Linux):
+//   g++ -std=c++17 -O2 -pthread -I../StreamITP -o J519Sim J519Sim.cpp
+//       ../StreamITP/SimController.cpp ../StreamITP/J519Packet.cpp ../StreamITP/RtUtil.cpp
+//       ../StreamITP/Dynamics.cpp ../StreamITP/Kinematics.cpp ../StreamITP/RobotModel.cpp
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <iostream>
+#include <string>
+
+#include "J519Packet.h"
+#include "RtUtil.h"
+#include "SimController.h"
+#include "Dynamics.h"
+
+using namespace std;
+
+const int MaxPending = 256;     // datagrams waiting out their simulated latency
+const int MaxDatagram = 256;
+const int64_t SimBumpNs = 200 * NsPerMs;   // how long a --bump pushes on its axis
+
+// one outgoing datagram held back by the simulated latency
+typedef struct PendingPacket_T {
+	bool used;
+	int64_t dueNs;
+	int size;
+	char data[MaxDatagram];
+} PendingPacket_T;
+
+// --model: motor currents from the model's dynamics instead of the crude default
+typedef struct SimDynamics_T {
+	DynamicsModel_T model;
+	DynamicsGains_T gains;
+	double joint[3][MaxAxisNumber];   // [0] newest
+	int history;
+	int64_t startNs;          // session start, for the bump
+	double bumpSec;           // --bump T,AXIS,AMPS: extra current on AXIS from T s into the session
+	int bumpAxis;             // 0 based, -1 = no bump
+	double bumpAmps;
+} SimDynamics_T;
+
+static volatile sig_atomic_t keepRunning = 1;
+
+static void StopHandler(int)
+{
+	keepRunning = 0;
+}
+
+static void QueuePacket(PendingPacket_T *pending, SimController_T *sim, const void *data, int size, int64_t nowNs)
+{
+	if (SimDrop(sim)) {
+		sim->stats.dropped++;
+		return;
+	}
+	for (int idx = 0; idx < MaxPending; idx++) {
+		if (!pending[idx].used) {
+			pending[idx].used = true;
+			pending[idx].dueNs = nowNs + SimDelayNs(sim);
+			pending[idx].size = size;
+			memcpy(pending[idx].data, data, size);
+			return;
+		}
+	}
+	// the PC is not reading: behave like a full socket buffer
+	sim->stats.dropped++;
+}
+
+static int64_t NextDue(const PendingPacket_T *pending)
+{
+	int64_t due = INT64_MAX;
+	for (int idx = 0; idx < MaxPending; idx++) {
+		if (pending[idx].used && (pending[idx].dueNs < due)) {
+			due = pending[idx].dueNs;
+		}
+	}
+	return due;
+}
+
+static void SendDue(PendingPacket_T *pending, int socketID, const struct sockaddr_in *peer, int64_t nowNs)
+{
+	for (int idx = 0; idx < MaxPending; idx++) {
+		if (pending[idx].used && (pending[idx].dueNs <= nowNs)) {
+			sendto(socketID, pending[idx].data, pending[idx].size, 0, (const struct sockaddr *)peer, sizeof(*peer));
+			pending[idx].used = false;
+		}
+	}
+}
+
+/*
+ * LoadSimDynamics: the model with the payload the simulated robot really
+ *                  carries, the default current gains
+ */
+static bool LoadSimDynamics(const char *modelFile, const Payload_T *payload, SimDynamics_T *dynamics)
+{
+	RobotModel_T *model = new RobotModel_T;
+	KinematicChain_T chain;
+	bool ok = LoadRobotModel(modelFile, model) && BuildKinematicChain(model, &chain) && BuildDynamicsModel(model, &chain, payload, &dynamics->model);
+	delete model;
+	DefaultDynamicsGains(&dynamics->gains);
+	return ok;
+}
+
+/*
+ * SimDynamicsCurrents: replace the currents of the status with the ones the
+ *                      model draws for the last three joint positions (in
+ *                      motion, held still otherwise)
+ */
+static void SimDynamicsCurrents(SimDynamics_T *dynamics, const SimController_T *sim, int64_t nowNs, RobotStatusPacket_T *status_p)
+{
+	double cycleSec = sim->config.cycleNs / 1.0e9;
+	double speed[MaxAxisNumber], acceleration[MaxAxisNumber], torque[MaxAxisNumber], current[MaxAxisNumber];
+
+	memmove(dynamics->joint[1], dynamics->joint[0], 2 * sizeof(dynamics->joint[0]));
+	for (int idx = 0; idx < MaxAxisNumber; idx++) {
+		dynamics->joint[0][idx] = sim->joint[idx];
+	}
+	if (dynamics->history == 0) {
+		memcpy(dynamics->joint[1], dynamics->joint[0], sizeof(dynamics->joint[0]));
+	}
+	if (dynamics->history <= 1) {
+		memcpy(dynamics->joint[2], dynamics->joint[1], sizeof(dynamics->joint[0]));
+	}
+	if ((status_p->status & StatusInMotion) == 0) {
+		dynamics->history = 0;     // standing: the next motion starts from where it is commanded to
+	}
+	else if (dynamics->history < 3) {
+		dynamics->history++;
+	}
+	for (int idx = 0; idx < MaxAxisNumber; idx++) {
+		speed[idx] = (dynamics->joint[0][idx] - dynamics->joint[1][idx]) / cycleSec;
+		acceleration[idx] = (dynamics->joint[0][idx] - 2.0 * dynamics->joint[1][idx] + dynamics->joint[2][idx]) / (cycleSec * cycleSec);
+	}
+	JointTorques(&dynamics->model, dynamics->joint[0], speed, acceleration, torque);
+	PredictCurrents(&dynamics->model, &dynamics->gains, torque, speed, current);
+
+	int64_t sinceStartNs = nowNs - dynamics->startNs;
+	int64_t bumpNs = (int64_t)(dynamics->bumpSec * NsPerSec);
+	if ((dynamics->bumpAxis >= 0) && (sinceStartNs >= bumpNs) && (sinceStartNs < bumpNs + SimBumpNs)) {
+		current[dynamics->bumpAxis] += dynamics->bumpAmps;
+	}
+	for (int idx = 0; idx < MaxAxisNumber; idx++) {
+		u_word bits = HostFloatToNet((float)current[idx]);
+		memcpy(&status_p->current[idx], &bits, sizeof(bits));
+	}
+}
+
+static bool ParseSimOption(int argc, char* argv[], int argIdx, SimConfig_T *config, RtConfig_T *rtConfig, int *port)
+{
+	if (argIdx + 1 >= argc) {
+		return false;
+	}
+	string option(argv[argIdx]);
+	double value = atof(argv[argIdx + 1]);
+
+	if (option.compare("--port") == 0) {
+		*port = atoi(argv[argIdx + 1]);
+	}
+	else if (option.compare("--cycle-ms") == 0) {
+		config->cycleNs = (long)(value * NsPerMs);
+		rtConfig->cycleNs = config->cycleNs;
+	}
+	else if (option.compare("--latency-ms") == 0) {
+		config->latencyNs = (long)(value * NsPerMs);
+	}
+	else if (option.compare("--jitter-ms") == 0) {
+		config->jitterNs = (long)(value * NsPerMs);
+	}
+	else if (option.compare("--loss") == 0) {
+		config->lossRate = value;
+	}
+	else if (option.compare("--buffer") == 0) {
+		config->bufferDepth = atoi(argv[argIdx + 1]);
+	}
+	else if (option.compare("--axes") == 0) {
+		config->axisCount = atoi(argv[argIdx + 1]);
+	}
+	else if (option.compare("--seed") == 0) {
+		config->seed = (uint32_t)atol(argv[argIdx + 1]);
+	}
+	else if (option.compare("--rt-priority") == 0) {
+		rtConfig->rtPriority = atoi(argv[argIdx + 1]);
+	}
+	else if (option.compare("--cpu") == 0) {
+		rtConfig->cpu = atoi(argv[argIdx + 1]);
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+/* ------------------------------------------------------------------
+* Main routine: answer J519 packets on the robot port like a controller
+* would, one status packet per ITP cycle, until interrupted.
+--------------------------------------------------------------------- */
+int main(int argc, char* argv[])
+{
+	SimConfig_T config;
+	RtConfig_T rtConfig;
+	SimController_T sim;
+	int port = ROBOT_PORT;
+	static PendingPacket_T pending[MaxPending];
+
+	SimDefaultConfig(&config);
+	RtDefaultConfig(&rtConfig);
+	rtConfig.lockMemory = false;
+
+	const char *modelFile = NULL;
+	Payload_T payload = {};
+	static SimDynamics_T dynamics;
+	dynamics.bumpAxis = -1;
+	for (int argIdx = 1; argIdx < argc; argIdx += 2) {
+		bool ok = true;
+		if ((strcmp(argv[argIdx], "--model") == 0) && (argIdx + 1 < argc)) {
+			modelFile = argv[argIdx + 1];
+		}
+		else if ((strcmp(argv[argIdx], "--payload") == 0) && (argIdx + 1 < argc)) {
+			ok = ParsePayload(argv[argIdx + 1], &payload);
+		}
+		else if ((strcmp(argv[argIdx], "--bump") == 0) && (argIdx + 1 < argc)) {
+			int axis = 0;
+			ok = (sscanf(argv[argIdx + 1], "%lf,%d,%lf", &dynamics.bumpSec, &axis, &dynamics.bumpAmps) == 3) && (axis >= 1) && (axis <= MaxAxisNumber);
+			dynamics.bumpAxis = axis - 1;
+		}
+		else {
+			ok = ParseSimOption(argc, argv, argIdx, &config, &rtConfig, &port) && (config.cycleNs > 0);
+		}
+		if (!ok) {
+			cout << " Usage: J519Sim [--port P] [--cycle-ms T] [--latency-ms L] [--jitter-ms J] [--loss RATE] [--buffer N] [--axes N] [--seed S] [--rt-priority N] [--cpu N]"
+			     << " [--model ModelFile] [--payload kg[,x,y,z]] [--bump T,AXIS,AMPS]" << endl;
+			return 1;
+		}
+	}
+	if ((modelFile != NULL) && !LoadSimDynamics(modelFile, &payload, &dynamics)) {
+		return 1;
+	}
+	if ((modelFile == NULL) && ((payload.mass > 0.0) || (dynamics.bumpAxis >= 0))) {
+		cout << "--payload and --bump need --model" << endl;
+		return 1;
+	}
+
+	int socketID = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	struct sockaddr_in local_addr;
+	memset(&local_addr, 0, sizeof(local_addr));
+	local_addr.sin_family = AF_INET;
+	local_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	local_addr.sin_port = htons(port);
+	if ((socketID < 0) || (bind(socketID, (struct sockaddr *)&local_addr, sizeof(local_addr)) != 0)) {
+		cout << "Cannot bind UDP port " << port << ": " << strerror(errno) << endl;
+		return 1;
+	}
+
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	signal(SIGINT, StopHandler);
+	signal(SIGTERM, StopHandler);
+	RtConfigureThread(&rtConfig);
+
+	SimInit(&sim, &config);
+	printf("J519 simulator on port %d: cycle %.3f ms, latency %.3f ms, jitter %.3f ms, loss %.4f, buffer %d\n",
+		port, config.cycleNs / 1.0e6, config.latencyNs / 1.0e6, config.jitterNs / 1.0e6, config.lossRate, sim.config.bufferDepth);
+
+	struct sockaddr_in peer;
+	memset(&peer, 0, sizeof(peer));
+	bool havePeer = false;
+	bool wasRunning = false;
+	int64_t nextTickNs = RtNowNs() + config.cycleNs;
+
+	while (keepRunning) {
+		int64_t nowNs = RtNowNs();
+		int64_t wakeNs = nextTickNs;
+		int64_t dueNs = NextDue(pending);
+		if (dueNs < wakeNs) {
+			wakeNs = dueNs;
+		}
+
+		struct pollfd pfd;
+		pfd.fd = socketID;
+		pfd.events = POLLIN;
+		struct timespec timeout;
+		int64_t waitNs = (wakeNs > nowNs) ? wakeNs - nowNs : 0;
+		timeout.tv_sec = waitNs / NsPerSec;
+		timeout.tv_nsec = waitNs % NsPerSec;
+
+		if (ppoll(&pfd, 1, &timeout, NULL) > 0) {
+			char packet[MaxDatagram];
+			char reply[MaxDatagram];
+			struct sockaddr_in from;
+			socklen_t fromLen = sizeof(from);
+			int receiveSize = recvfrom(socketID, packet, sizeof(packet), 0, (struct sockaddr *)&from, &fromLen);
+			nowNs = RtNowNs();
+			if (receiveSize > 0) {
+				peer = from;
+				havePeer = true;
+				if (SimDrop(&sim)) {
+					sim.stats.dropped++;
+				}
+				else {
+					int replySize = SimReceive(&sim, packet, receiveSize, nowNs, reply, sizeof(reply));
+					if (replySize > 0) {
+						QueuePacket(pending, &sim, reply, replySize, nowNs);
+					}
+				}
+			}
+		}
+
+		nowNs = RtNowNs();
+		if (!wasRunning && sim.running) {
+			// the start packet came in: the new motion starts from rest
+			dynamics.history = 0;
+			dynamics.startNs = nowNs;
+		}
+		if (nowNs >= nextTickNs) {
+			RobotStatusPacket_T statusPacket;
+			if (SimTick(&sim, nowNs, &statusPacket)) {
+				if (modelFile != NULL) {
+					SimDynamicsCurrents(&dynamics, &sim, nowNs, &statusPacket);
+				}
+				QueuePacket(pending, &sim, &statusPacket, sizeof(statusPacket), nowNs);
+			}
+			// fixed rate like the servo clock, late ticks do not shift the grid
+			while (nextTickNs <= nowNs) {
+				nextTickNs += config.cycleNs;
+			}
+		}
+
+		if (havePeer) {
+			SendDue(pending, socketID, &peer, nowNs);
+		}
+
+		// report each session once the stop packet arrived
+		if (wasRunning && !sim.running) {
+			WriteSimStats(&sim);
+		}
+		if (!wasRunning && sim.running) {
+			cout << "session started by " << inet_ntoa(peer.sin_addr) << ":" << ntohs(peer.sin_port) << endl;
+		}
+		wasRunning = sim.running;
+	}
+
+	close(socketID);
+	return 0;
+}
@@ -0,0 +1,465 @@
+//
+// KinGen.cpp : generate the fixed kinematics header of one robot model, the
+//              chain's constant transforms folded into unrolled code
+//
+// The runtime chain (Kinematics.cpp) multiplies full 3x4 matrices for every
+// joint, most of whose entries are the 0s and 1s of the axis alignments.
+// Here the same products are worked out once with every constant entry
+// known: terms that are 0 are dropped, 1 and -1 become plain copies, and
+// products of constants are folded, leaving straight line code in the
+// joint sines and cosines only. The header holds one struct per robot
+// (FixedKinematics.h has the functions that use it), so a build target
+// picks its robot with -DFIXED_ROBOT_HEADER.
+//
+// Build: make KinGen, in Source
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <ctype.h>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "RobotModel.h"
+#include "Kinematics.h"
+
+using namespace std;
+
+const double SnapTolerance = 1.0e-12;    // entries this close to 0, 1 or -1 are taken as exact
+
+// a value in the generated code: a number known now, or an expression of the joint angles
+typedef struct Term_T {
+	bool known;
+	double value;
+	string text;
+	bool sum;                 // text is a sum: parenthesize it in a product
+} Term_T;
+
+typedef struct Generator_T {
+	vector<string> lines;
+	int temps;
+} Generator_T;
+
+static Term_T Known(double value)
+{
+	if (fabs(value) < SnapTolerance) {
+		value = 0.0;
+	}
+	else if (fabs(value - 1.0) < SnapTolerance) {
+		value = 1.0;
+	}
+	else if (fabs(value + 1.0) < SnapTolerance) {
+		value = -1.0;
+	}
+	Term_T term = { true, value, "", false };
+	return term;
+}
+
+static Term_T Named(const string &name)
+{
+	Term_T term = { false, 0.0, name, false };
+	return term;
+}
+
+static string Literal(double value)
+{
+	char text[40];
+	snprintf(text, sizeof(text), "%.17g", value);
+	string literal(text);
+	if (literal.find_first_of(".en") == string::npos) {
+		literal += ".0";
+	}
+	return literal;
+}
+
+static string Text(const Term_T &term)
+{
+	if (term.known) {
+		return (term.value < 0.0) ? "(" + Literal(term.value) + ")" : Literal(term.value);
+	}
+	return term.text;
+}
+
+static Term_T Negate(const Term_T &a)
+{
+	if (a.known) {
+		return Known(-a.value);
+	}
+	if (!a.sum && (a.text[0] == '-')) {
+		return Named(a.text.substr(1));
+	}
+	Term_T term = { false, 0.0, "-" + (a.sum ? "(" + a.text + ")" : a.text), false };
+	return term;
+}
+
+static bool Negative(const Term_T &a)
+{
+	return !a.known && !a.sum && (a.text[0] == '-');
+}
+
+static Term_T Multiply(const Term_T &a, const Term_T &b)
+{
+	if (a.known && b.known) {
+		return Known(a.value * b.value);
+	}
+	if ((a.known && (a.value == 0.0)) || (b.known && (b.value == 0.0))) {
+		return Known(0.0);
+	}
+	if (a.known && (fabs(a.value) == 1.0)) {
+		return (a.value > 0.0) ? b : Negate(b);
+	}
+	if (b.known && (fabs(b.value) == 1.0)) {
+		return (b.value > 0.0) ? a : Negate(a);
+	}
+	if ((a.known && (a.value < 0.0)) || (b.known && (b.value < 0.0))) {
+		return Negate(Multiply(a.known ? Known(-a.value) : a, b.known ? Known(-b.value) : b));
+	}
+	if (Negative(a) || Negative(b)) {
+		// the sign in front of the product
+		Term_T product = Multiply(Negative(a) ? Negate(a) : a, Negative(b) ? Negate(b) : b);
+		return (Negative(a) != Negative(b)) ? Negate(product) : product;
+	}
+	string left = a.sum ? "(" + Text(a) + ")" : Text(a);
+	string right = b.sum ? "(" + Text(b) + ")" : Text(b);
+	Term_T term = { false, 0.0, left + " * " + right, false };
+	return term;
+}
+
+static Term_T Add(const Term_T &a, const Term_T &b)
+{
+	if (a.known && b.known) {
+		return Known(a.value + b.value);
+	}
+	if (a.known && (a.value == 0.0)) {
+		return b;
+	}
+	if (b.known && (b.value == 0.0)) {
+		return a;
+	}
+	if (!a.known && !b.known && !a.sum && !b.sum && (Negate(a).text == b.text)) {
+		return Known(0.0);
+	}
+	string right = Text(b);
+	Term_T term = { false, 0.0, "", true };
+	if (right[0] == '-') {
+		term.text = Text(a) + " - " + right.substr(1);
+	}
+	else if (b.known && (b.value < 0.0)) {
+		term.text = Text(a) + " - " + Literal(-b.value);
+	}
+	else {
+		term.text = Text(a) + " + " + right;
+	}
+	return term;
+}
+
+static Term_T Subtract(const Term_T &a, const Term_T &b)
+{
+	return Add(a, Negate(b));
+}
+
+// an expression used more than once gets a local of its own, names and their negations stay as they are
+static Term_T Bind(Generator_T *gen, const Term_T &term, const char *prefix)
+{
+	if (term.known || (term.text.find(' ') == string::npos)) {
+		return term;
+	}
+	string name = prefix + to_string(gen->temps++);
+	gen->lines.push_back("\t\tconst double " + name + " = " + term.text + ";");
+	return Named(name);
+}
+
+static void KnownMatrix(const double m[12], Term_T out[12])
+{
+	for (int idx = 0; idx < 12; idx++) {
+		out[idx] = Known(m[idx]);
+	}
+}
+
+// out = a * b (3x4), b constant
+static void MultiplyFrame(Generator_T *gen, const Term_T a[12], const double b[12], Term_T out[12])
+{
+	for (int row = 0; row < 3; row++) {
+		for (int col = 0; col < 4; col++) {
+			Term_T sum = (col == 3) ? a[row * 4 + 3] : Known(0.0);
+			for (int k = 0; k < 3; k++) {
+				sum = Add(sum, Multiply(a[row * 4 + k], Known(b[k * 4 + col])));
+			}
+			out[row * 4 + col] = Bind(gen, sum, "m");
+		}
+	}
+}
+
+// m = m * Rz(q), s and c of joint idx
+static void TurnFrame(Generator_T *gen, Term_T m[12], int idx)
+{
+	Term_T s = Named("s[" + to_string(idx) + "]");
+	Term_T c = Named("c[" + to_string(idx) + "]");
+	for (int row = 0; row < 3; row++) {
+		Term_T x = m[row * 4], y = m[row * 4 + 1];
+		m[row * 4] = Bind(gen, Add(Multiply(c, x), Multiply(s, y)), "m");
+		m[row * 4 + 1] = Bind(gen, Subtract(Multiply(c, y), Multiply(s, x)), "m");
+	}
+}
+
+/*
+ * GenerateChain: the unrolled chain, joint frames after each joint turned
+ *                and the faceplate frame as terms
+ */
+static void GenerateChain(Generator_T *gen, const KinematicChain_T *chain, Term_T joint[][12], Term_T end[12])
+{
+	Term_T at[12], next[12];
+	double identity[12] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0 };
+
+	KnownMatrix(identity, at);
+	for (int idx = 0; idx < chain->axisCount; idx++) {
+		gen->lines.push_back("\t\t// J" + to_string(idx + 1));
+		MultiplyFrame(gen, at, chain->frame[idx], next);
+		TurnFrame(gen, next, idx);
+		for (int k = 0; k < 12; k++) {
+			at[k] = next[k];
+			joint[idx][k] = next[k];
+		}
+	}
+	gen->lines.push_back("\t\t// faceplate");
+	MultiplyFrame(gen, at, chain->tool, end);
+}
+
+static void WriteArray(FILE *out, const char *type, const char *name, const double *values, int count)
+{
+	fprintf(out, "\tstatic constexpr %s %s[%d] = { ", type, name, count);
+	for (int idx = 0; idx < count; idx++) {
+		fprintf(out, "%s%s", Literal(values[idx]).c_str(), (idx + 1 < count) ? ", " : " };\n");
+	}
+}
+
+// the locals (m12, r3) an expression reads
+static void AddNames(const string &text, set<string> *names)
+{
+	for (size_t idx = 0; idx < text.size(); idx++) {
+		if (isalpha((unsigned char)text[idx]) && ((idx == 0) || !isalnum((unsigned char)text[idx - 1]))) {
+			size_t end = idx + 1;
+			while ((end < text.size()) && isdigit((unsigned char)text[end])) {
+				end++;
+			}
+			if (end > idx + 1) {
+				names->insert(text.substr(idx, end - idx));
+			}
+		}
+	}
+}
+
+/*
+ * WriteLines: the generated lines, less the locals nothing reads (the last
+ *             joint's frame in the Jacobian, say) and the comments left
+ *             with no code under them
+ */
+static void WriteLines(FILE *out, Generator_T *gen)
+{
+	vector<string> kept;
+	set<string> used;
+
+	for (size_t idx = gen->lines.size(); idx-- > 0;) {
+		const string &line = gen->lines[idx];
+		size_t equals = line.find(" = ");
+		if (line.compare(0, 4, "\t\t//") == 0) {
+			if (!kept.empty() && (kept.back().compare(0, 4, "\t\t//") != 0)) {
+				kept.push_back(line);
+			}
+			continue;
+		}
+		if ((line.compare(0, 15, "\t\tconst double ") == 0) && (equals != string::npos)) {
+			if (used.count(line.substr(15, equals - 15)) == 0) {
+				continue;
+			}
+			AddNames(line.substr(equals), &used);
+		}
+		else {
+			AddNames(line, &used);
+		}
+		kept.push_back(line);
+	}
+	for (size_t idx = kept.size(); idx-- > 0;) {
+		fprintf(out, "%s\n", kept[idx].c_str());
+	}
+	gen->lines.clear();
+	gen->temps = 0;
+}
+
+static bool WriteHeader(const char *fileName, const char *structName, const RobotModel_T *model, const KinematicChain_T *chain)
+{
+	FILE *out = fopen(fileName, "w");
+	Generator_T gen;
+	Term_T joint[MaxAxisNumber][12], end[12];
+	int axisCount = chain->axisCount;
+	const char *baseName = strrchr(model->fileName, '/');
+
+	if (out == NULL) {
+		cout << "Cannot create " << fileName << endl;
+		return false;
+	}
+	gen.temps = 0;
+	fprintf(out, "//\n// %s : fixed kinematics of %s, generated by KinGen - do not edit,\n", strrchr(fileName, '/') ? strrchr(fileName, '/') + 1 : fileName,
+		(baseName != NULL) ? baseName + 1 : model->fileName);
+	fprintf(out, "//     run KinGen again when the model changes (FixedMatchesChain tells)\n//\n\n");
+	fprintf(out, "#pragma once\n\n");
+	fprintf(out, "typedef struct %s {\n", structName);
+	fprintf(out, "\tstatic constexpr int AxisCount = %d;\n", axisCount);
+	fprintf(out, "\tstatic constexpr bool J23Coupled = %s;\n", chain->j23Coupled ? "true" : "false");
+	fprintf(out, "\tstatic constexpr double WorldHeight = %s;\n", Literal(chain->worldHeight).c_str());
+	WriteArray(out, "double", "Lower", chain->lower, axisCount);
+	WriteArray(out, "double", "Upper", chain->upper, axisCount);
+	fprintf(out, "\tstatic constexpr double Frame[%d][12] = {\n", axisCount);
+	for (int idx = 0; idx < axisCount; idx++) {
+		fprintf(out, "\t\t{ ");
+		for (int k = 0; k < 12; k++) {
+			fprintf(out, "%s%s", Literal(Known(chain->frame[idx][k]).value).c_str(), (k < 11) ? ", " : " }");
+		}
+		fprintf(out, "%s\n", (idx + 1 < axisCount) ? "," : "");
+	}
+	fprintf(out, "\t};\n");
+	double tool[12];
+	for (int k = 0; k < 12; k++) {
+		tool[k] = Known(chain->tool[k]).value;
+	}
+	WriteArray(out, "double", "Tool", tool, 12);
+
+	// forward: the faceplate only
+	fprintf(out, "\n\t// faceplate in the world frame, 3x4 row major (mm); model angles as sin / cos\n");
+	fprintf(out, "\tstatic inline void Forward(const double s[%d], const double c[%d], double end[12])\n\t{\n", axisCount, axisCount);
+	GenerateChain(&gen, chain, joint, end);
+	for (int k = 0; k < 12; k++) {
+		gen.lines.push_back("\t\tend[" + to_string(k) + "] = " + Text(end[k]) + ";");
+	}
+	WriteLines(out, &gen);
+	fprintf(out, "\t}\n");
+
+	// Jacobian: columns z_i x (p_end - p_i) over z_i
+	fprintf(out, "\n\t// 6 x AxisCount row major: faceplate velocity (mm/rad) over angular velocity (rad/rad), world frame\n");
+	fprintf(out, "\tstatic inline void Jacobian(const double s[%d], const double c[%d], double jac[%d])\n\t{\n", axisCount, axisCount, 6 * axisCount);
+	GenerateChain(&gen, chain, joint, end);
+	gen.lines.push_back("\t\t// columns");
+	for (int idx = 0; idx < axisCount; idx++) {
+		Term_T w[3] = { joint[idx][2], joint[idx][6], joint[idx][10] };
+		Term_T r[3];
+		for (int k = 0; k < 3; k++) {
+			r[k] = Bind(&gen, Subtract(end[k * 4 + 3], joint[idx][k * 4 + 3]), "r");
+		}
+		Term_T rows[6] = {
+			Subtract(Multiply(w[1], r[2]), Multiply(w[2], r[1])),
+			Subtract(Multiply(w[2], r[0]), Multiply(w[0], r[2])),
+			Subtract(Multiply(w[0], r[1]), Multiply(w[1], r[0])),
+			w[0], w[1], w[2] };
+		for (int row = 0; row < 6; row++) {
+			gen.lines.push_back("\t\tjac[" + to_string(row * axisCount + idx) + "] = " + Text(rows[row]) + ";");
+		}
+	}
+	WriteLines(out, &gen);
+	fprintf(out, "\t}\n");
+
+	// limits: one compare per set bound
+	fprintf(out, "\n\t// bit i set: model angle i (rad) outside its limits\n");
+	fprintf(out, "\tstatic inline unsigned LimitMask(const double q[%d])\n\t{\n\t\tunsigned mask = 0;\n", axisCount);
+	bool anyLimit = false;
+	for (int idx = 0; idx < axisCount; idx++) {
+		if ((chain->lower[idx] == 0.0) && (chain->upper[idx] == 0.0)) {
+			fprintf(out, "\t\t// J%d: no limits in the model\n", idx + 1);
+			continue;
+		}
+		fprintf(out, "\t\tmask |= ((q[%d] < %s) || (q[%d] > %s)) ? 0x%xu : 0u;\n", idx, Literal(chain->lower[idx]).c_str(), idx,
+			Literal(chain->upper[idx]).c_str(), 1u << idx);
+		anyLimit = true;
+	}
+	if (!anyLimit) {
+		fprintf(out, "\t\t(void)q;\n");
+	}
+	fprintf(out, "\t\treturn mask;\n\t}\n");
+	fprintf(out, "} %s;\n\n", structName);
+	fprintf(out, "#ifndef FIXED_ROBOT\n#define FIXED_ROBOT %s\n#endif\n", structName);
+
+	if (fclose(out) != 0) {
+		cout << "Cannot write " << fileName << endl;
+		return false;
+	}
+	return true;
+}
+
+/*
+ * StructName: "v8.urdf" -> V8Kinematics_T, "fanuc_test2.csv" -> FanucTest2Kinematics_T
+ */
+static string StructName(const char *fileName)
+{
+	const char *base = strrchr(fileName, '/');
+	string name((base != NULL) ? base + 1 : fileName);
+	size_t dot = name.rfind('.');
+	if (dot != string::npos) {
+		name.erase(dot);
+	}
+	string result;
+	bool upper = true;
+	for (size_t idx = 0; idx < name.size(); idx++) {
+		char ch = name[idx];
+		if (!isalnum((unsigned char)ch)) {
+			upper = true;
+			continue;
+		}
+		result += upper ? (char)toupper((unsigned char)ch) : ch;
+		upper = false;
+	}
+	if (result.empty() || isdigit((unsigned char)result[0])) {
+		result = "Robot" + result;
+	}
+	return result + "Kinematics_T";
+}
+
+static void Usage()
+{
+	cout << " Usage: KinGen ModelFile OutHeader [--name StructName] [--no-j23]" << endl;
+	cout << "   ModelFile: .urdf or exporter .csv; OutHeader: the generated header (e.g. ../StreamITP/Robots/V8Kinematics.h)" << endl;
+	cout << "   --name: struct of the robot, default from the model file name (v8.urdf: V8Kinematics_T)" << endl;
+}
+
+/* ------------------------------------------------------------------
+* Main routine
+--------------------------------------------------------------------- */
+int main(int argc, char* argv[])
+{
+	string structName;
+	bool j23Coupled = true;
+	RobotModel_T model;
+	KinematicChain_T chain;
+
+	if (argc < 3) {
+		Usage();
+		return 1;
+	}
+	for (int argIdx = 3; argIdx < argc; argIdx++) {
+		if ((strcmp(argv[argIdx], "--name") == 0) && (argIdx + 1 < argc)) {
+			structName = argv[++argIdx];
+		}
+		else if (strcmp(argv[argIdx], "--no-j23") == 0) {
+			j23Coupled = false;
+		}
+		else {
+			cout << "Invalid option: " << argv[argIdx] << endl;
+			Usage();
+			return 1;
+		}
+	}
+	if (!LoadRobotModel(argv[1], &model) || !BuildKinematicChain(&model, &chain)) {
+		return 1;
+	}
+	chain.j23Coupled = j23Coupled;
+	if (structName.empty()) {
+		structName = StructName(argv[1]);
+	}
+	if (!WriteHeader(argv[2], structName.c_str(), &model, &chain)) {
+		return 1;
+	}
+	printf("%s: %s, %d axes, written to %s\n", argv[1], structName.c_str(), chain.axisCount, argv[2]);
+	return 0;
+}
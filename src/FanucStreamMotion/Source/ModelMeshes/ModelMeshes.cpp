@@ -0,0 +1,106 @@
+//
+// ModelMeshes.cpp : build (or check) the mesh cache files of a robot model's
+//                   link meshes and export the simplified meshes and hulls
+//
+// Build (Linux):
+//   g++ -std=c++17 -O2 -I../StreamITP -o ModelMeshes ModelMeshes.cpp ../StreamITP/MeshCache.cpp
+//       ../StreamITP/MeshBvh.cpp ../StreamITP/CacheFile.cpp ../StreamITP/RobotModel.cpp
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <string>
+
+#include "RobotModel.h"
+#include "MeshCache.h"
+
+using namespace std;
+
+static void Usage()
+{
+	cout << " Usage: ModelMeshes ModelFile [--rebuild] [--lod-cell mm] [--export Dir]" << endl;
+	cout << "   ModelFile: .urdf or exporter .csv, meshes found through the model's package:// paths" << endl;
+	cout << "   --rebuild: build the cache files even if they are up to date" << endl;
+	cout << "   --lod-cell: grid of the simplified meshes, default " << DefaultLodCell << " mm" << endl;
+	cout << "   --export: write <link>_lod.STL and <link>_hulls.STL (meters) to Dir for display" << endl;
+}
+
+static long FileSize(const char *fileName)
+{
+	struct stat st;
+	return (stat(fileName, &st) == 0) ? (long)st.st_size : 0;
+}
+
+/* ------------------------------------------------------------------
+* Main routine
+--------------------------------------------------------------------- */
+int main(int argc, char* argv[])
+{
+	bool rebuild = false;
+	double lodCell = DefaultLodCell;
+	const char *exportDir = NULL;
+	RobotModel_T model;
+
+	if (argc < 2) {
+		Usage();
+		return 1;
+	}
+	for (int argIdx = 2; argIdx < argc; argIdx++) {
+		if (strcmp(argv[argIdx], "--rebuild") == 0) {
+			rebuild = true;
+		}
+		else if ((strcmp(argv[argIdx], "--lod-cell") == 0) && (argIdx + 1 < argc)) {
+			lodCell = atof(argv[++argIdx]);
+		}
+		else if ((strcmp(argv[argIdx], "--export") == 0) && (argIdx + 1 < argc)) {
+			exportDir = argv[++argIdx];
+		}
+		else {
+			cout << "Invalid option: " << argv[argIdx] << endl;
+			Usage();
+			return 1;
+		}
+	}
+	if (lodCell <= 0.0) {
+		cout << "--lod-cell must be above 0 mm" << endl;
+		return 1;
+	}
+
+	if (!LoadRobotModel(argv[1], &model)) {
+		return 1;
+	}
+
+	printf("%-16s %9s %9s %10s %6s %10s %10s %9s\n", "link", "triangles", "vertices", "simplified", "hulls", "STL", "cache", "load ms");
+	int failed = 0;
+	for (int idx = 0; idx < model.linkCount; idx++) {
+		const ModelLink_T *link = &model.links[idx];
+		char path[ModelPathSize * 2];
+		char cachePath[1024];
+		MeshAsset_T asset;
+
+		if (link->mesh[0] == '\0') {
+			continue;
+		}
+		ResolveModelPath(&model, link->mesh, path, sizeof(path));
+		if (!LoadMeshAsset(path, 1000.0, lodCell, rebuild, &asset)) {
+			failed++;
+			continue;
+		}
+		long cacheSize = MeshCachePath(path, cachePath, sizeof(cachePath)) ? FileSize(cachePath) : 0;
+		printf("%-16s %9zu %9zu %10zu %6d %9.1fk %9.1fk %8.1f%s\n", link->name, asset.full.triangleCount, asset.full.vertexCount,
+			asset.lod.triangleCount, asset.hullCount, FileSize(path) / 1024.0, cacheSize / 1024.0, asset.loadMs,
+			asset.fromCache ? "" : " (built)");
+
+		if (exportDir != NULL) {
+			string base = string(exportDir) + "/" + link->name;
+			if (!SaveStlMesh((base + "_lod.STL").c_str(), &asset.lod) || !SaveStlHulls((base + "_hulls.STL").c_str(), &asset)) {
+				failed++;
+			}
+		}
+		FreeMeshAsset(&asset);
+	}
+	return (failed == 0) ? 0 : 1;
+}
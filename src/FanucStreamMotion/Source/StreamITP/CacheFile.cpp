@@ -0,0 +1,77 @@
+//
+// CacheFile.cpp : per user cache directory for data kept between runs
+//                 (controller thresholds, preprocessed meshes)
+//
+
+#include "stdafx.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <string>
+
+#include "CacheFile.h"
+
+using namespace std;
+
+bool CacheDirectory(const char *subDir, char *dir, size_t dirSize)
+{
+	const char *cacheHome = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	int length;
+
+	if ((cacheHome != NULL) && (cacheHome[0] != '\0')) {
+		mkdir(cacheHome, 0755);
+		length = snprintf(dir, dirSize, "%s/StreamITP", cacheHome);
+	}
+	else if ((home != NULL) && (home[0] != '\0')) {
+		snprintf(dir, dirSize, "%s/.cache", home);
+		mkdir(dir, 0755);
+		length = snprintf(dir, dirSize, "%s/.cache/StreamITP", home);
+	}
+	else {
+		return false;
+	}
+	if ((length >= (int)dirSize) || ((mkdir(dir, 0755) != 0) && (errno != EEXIST))) {
+		return false;
+	}
+	if (subDir != NULL) {
+		length = snprintf(dir + length, dirSize - length, "/%s", subDir) + length;
+		if ((length >= (int)dirSize) || ((mkdir(dir, 0755) != 0) && (errno != EEXIST))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool WriteCacheFile(const char *path, const void *data, size_t size)
+{
+	string tmpPath = string(path) + "." + to_string(getpid()) + ".tmp";   // runs started together each write their own
+	FILE *cacheFile = fopen(tmpPath.c_str(), "wb");
+
+	if (cacheFile == NULL) {
+		cout << "Cannot write cache file " << tmpPath << ": " << strerror(errno) << endl;
+		return false;
+	}
+	bool ok = (fwrite(data, 1, size, cacheFile) == size);
+	ok = (fclose(cacheFile) == 0) && ok;
+	if (!ok || (rename(tmpPath.c_str(), path) != 0)) {
+		cout << "Cannot write cache file " << path << ": " << strerror(errno) << endl;
+		remove(tmpPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+uint64_t CacheHash(const void *data, size_t size, uint64_t hash)
+{
+	const unsigned char *bytes = (const unsigned char *)data;
+
+	for (size_t idx = 0; idx < size; idx++) {
+		hash ^= bytes[idx];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
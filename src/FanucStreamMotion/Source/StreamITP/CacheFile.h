@@ -0,0 +1,25 @@
+//
+// CacheFile.h : per user cache directory for data kept between runs
+//               (controller thresholds, preprocessed meshes)
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * CacheDirectory: $XDG_CACHE_HOME/StreamITP (or ~/.cache/StreamITP), then
+ *                 subDir if not NULL, directories created if needed.
+ */
+bool CacheDirectory(const char *subDir, char *dir, size_t dirSize);
+
+/*
+ * WriteCacheFile: write aside and rename, so a run reading the cache never
+ *                 sees half a file. On error prints the reason.
+ */
+bool WriteCacheFile(const char *path, const void *data, size_t size);
+
+// FNV-1a 64 bit of a byte range
+const uint64_t CacheHashBasis = 14695981039346656037ULL;
+uint64_t CacheHash(const void *data, size_t size, uint64_t hash = CacheHashBasis);
@@ -0,0 +1,395 @@
+//
+// CellStream.cpp : several robots of a cell streamed from one thread
+//
+
+#include "stdafx.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include "CellStream.h"
+
+using namespace std;
+
+enum CellState_T {
+	CellWaitReady,   // start packet sent, no ready status yet
+	CellReady,       // waiting for the other robots, then for its next status
+	CellMoving,
+	CellDone         // stop packet sent
+};
+
+typedef struct CellLoop_T {
+	StreamSession_T *sessions;
+	int count;
+	CellStats_T *stats;
+	vector<CellState_T> state;
+	vector<struct timespec> giveUp;       // no status by then: the robot failed
+	vector<struct timespec> firstSend;
+	int readyCount;
+	int active;                           // robots not done
+	bool gateOpen;                        // every robot was ready
+	bool ending;                          // a robot failed, the others end where they are
+} CellLoop_T;
+
+bool LoadCellFile(const char *fileName, vector<CellRobot_T> *robots)
+{
+	ifstream file(fileName);
+	string line;
+	int lineNo = 0;
+
+	robots->clear();
+	if (!file) {
+		cout << "Cannot open cell file: " << fileName << endl;
+		return false;
+	}
+	string dir(fileName);
+	size_t slash = dir.find_last_of('/');
+	dir = (slash != string::npos) ? dir.substr(0, slash + 1) : "";
+
+	while (getline(file, line)) {
+		lineNo++;
+		size_t hash = line.find('#');
+		if (hash != string::npos) {
+			line.erase(hash);
+		}
+		istringstream fields(line);
+		string address, dataFile, option;
+		if (!(fields >> address)) {
+			continue;
+		}
+		CellRobot_T robot;
+		robot.port = ROBOT_PORT;
+		robot.representation = -1;
+		robot.packetStack = 0;
+
+		size_t colon = address.find(':');
+		if (colon != string::npos) {
+			int port = atoi(address.c_str() + colon + 1);
+			if ((port <= 0) || (port > 65535)) {
+				cout << fileName << ":" << lineNo << ": bad port in " << address << endl;
+				return false;
+			}
+			robot.port = (u_short)port;
+			address.erase(colon);
+		}
+		robot.address = address;
+		if (!(fields >> dataFile)) {
+			cout << fileName << ":" << lineNo << ": expected address[:port] datafile [Joint|Cartesian] [packet stack]" << endl;
+			return false;
+		}
+		robot.dataFile = (dataFile[0] == '/') ? dataFile : dir + dataFile;
+
+		while (fields >> option) {
+			if (strcasecmp(option.c_str(), "joint") == 0) {
+				robot.representation = 1;
+			}
+			else if (strcasecmp(option.c_str(), "cartesian") == 0) {
+				robot.representation = 0;
+			}
+			else if ((option.find_first_not_of("0123456789") == string::npos) && (atoi(option.c_str()) <= 9)) {
+				robot.packetStack = atoi(option.c_str());
+			}
+			else {
+				cout << fileName << ":" << lineNo << ": expected Joint, Cartesian or a packet stack of 0-9, not " << option << endl;
+				return false;
+			}
+		}
+		robots->push_back(robot);
+	}
+	if (robots->empty()) {
+		cout << fileName << ": no robots" << endl;
+		return false;
+	}
+	return true;
+}
+
+// drop what was queued while waiting: the next status read is a fresh one
+static void FlushStatuses(StreamSession_T *session)
+{
+	RobotStatusPacket_T status;
+	int receiveSize;
+
+	while ((receiveSize = recv(session->socketID, (char *)&status, sizeof(status), MSG_DONTWAIT)) >= 0) {
+		if (receiveSize == sizeof(status)) {
+			session->statusPacket = status;
+		}
+	}
+}
+
+// next status due plus the status time out, after lastData no later than the drain time out
+static void SetGiveUp(CellLoop_T *cell, int idx)
+{
+	StreamSession_T *session = &cell->sessions[idx];
+
+	cell->giveUp[idx] = session->expected;
+	RtAddNs(&cell->giveUp[idx], session->io.statusTimeoutNs);
+	if (session->lastSent) {
+		struct timespec drainEnd = session->lastSendTime;
+		RtAddNs(&drainEnd, session->io.drainTimeoutNs);
+		if (RtDiffNs(&drainEnd, &cell->giveUp[idx]) < 0) {
+			cell->giveUp[idx] = drainEnd;
+		}
+	}
+}
+
+static void StartMotion(CellLoop_T *cell, int idx, const struct timespec *now)
+{
+	StreamSession_T *session = &cell->sessions[idx];
+	struct timespec wakeup;
+
+	BeginMotion(session, now);
+	SendCommands(session, &wakeup);
+	cell->firstSend[idx] = session->lastSendTime;
+	SetGiveUp(cell, idx);
+	cell->state[idx] = CellMoving;
+}
+
+static void FinishRobot(CellLoop_T *cell, int idx)
+{
+	StreamSession_T *session = &cell->sessions[idx];
+
+	EndMotion(session);
+	cell->state[idx] = CellDone;
+	cell->active--;
+	if (session->doDataExchange || cell->ending) {
+		return;
+	}
+
+	// this robot stopped: the others end at the pose they were sent last
+	cell->ending = true;
+	cell->stats->failedRobot = idx;
+	for (int other = 0; other < cell->count; other++) {
+		if (cell->state[other] == CellMoving) {
+			cell->sessions[other].endRequest = true;
+		}
+		else if (cell->state[other] != CellDone) {
+			cell->sessions[other].doDataExchange = false;
+			FinishRobot(cell, other);
+		}
+	}
+}
+
+// phase of this robot's status against the first robot's, and how far apart their samples are
+static void MeasureSkew(CellLoop_T *cell, int idx)
+{
+	CellStats_T *stats = cell->stats;
+	StreamSession_T *sessions = cell->sessions;
+	long cycleNs = sessions[0].rt.cycleNs;
+
+	if (cell->state[0] != CellMoving) {
+		return;
+	}
+	if (idx != 0) {
+		int64_t skewNs = RtDiffNs(&sessions[idx].statusTime, &sessions[0].statusTime) % cycleNs;
+		if (skewNs > cycleNs / 2) {
+			skewNs -= cycleNs;
+		}
+		else if (skewNs < -cycleNs / 2) {
+			skewNs += cycleNs;
+		}
+		skewNs = (skewNs < 0) ? -skewNs : skewNs;
+		stats->sumSkewNs += skewNs;
+		stats->skewSamples++;
+		if (skewNs > stats->maxSkewNs) {
+			stats->maxSkewNs = skewNs;
+		}
+		return;
+	}
+	int32_t low = INT32_MAX, high = INT32_MIN;
+	for (int other = 0; other < cell->count; other++) {
+		if (cell->state[other] == CellMoving) {
+			int32_t sample = (int32_t)(sessions[other].acked - sessions[other].firstSeq);
+			low = (sample < low) ? sample : low;
+			high = (sample > high) ? sample : high;
+		}
+	}
+	if (high - low > stats->maxSampleSpread) {
+		stats->maxSampleSpread = high - low;
+	}
+}
+
+static void ServiceRobot(CellLoop_T *cell, int idx)
+{
+	StreamSession_T *session = &cell->sessions[idx];
+	StaleStatusSink_T stale = StaleSink(session);
+
+	while ((cell->state[idx] != CellDone)
+		&& (ReadQueuedStatus(session->socketID, &session->io, &session->statusPacket, &stale) > 0)) {
+		struct timespec now;
+		RtNow(&now);
+
+		if (cell->state[idx] == CellWaitReady) {
+			if (!ReadyStatus(session)) {
+				continue;
+			}
+			cell->state[idx] = CellReady;
+			cell->readyCount++;
+			if (cell->readyCount == cell->count) {
+				// every robot starts on its next status
+				cell->gateOpen = true;
+				for (int other = 0; other < cell->count; other++) {
+					FlushStatuses(&cell->sessions[other]);
+					cell->giveUp[other] = now;
+					RtAddNs(&cell->giveUp[other], cell->sessions[other].io.statusTimeoutNs);
+				}
+			}
+		}
+		else if (cell->state[idx] == CellReady) {
+			if (cell->gateOpen) {
+				StartMotion(cell, idx, &now);
+			}
+		}
+		else {
+			HandleStatus(session, true);
+			MeasureSkew(cell, idx);
+			if (MotionDone(session)) {
+				FinishRobot(cell, idx);
+			}
+			else {
+				struct timespec wakeup;
+				SendCommands(session, &wakeup);
+				SetGiveUp(cell, idx);
+				if (MotionDone(session)) {
+					FinishRobot(cell, idx);
+				}
+			}
+		}
+	}
+}
+
+static void StreamCell(CellLoop_T *cell)
+{
+	StreamSession_T *sessions = cell->sessions;
+	int count = cell->count;
+	vector<struct epoll_event> events(count);
+	struct timespec now;
+
+	RtConfigureThread(&sessions[0].rt);
+
+	int epollID = epoll_create1(0);
+	if (epollID < 0) {
+		cout << "Cannot create epoll instance: " << strerror(errno) << endl;
+		for (int idx = 0; idx < count; idx++) {
+			sessions[idx].doDataExchange = false;
+			EndMotion(&sessions[idx]);
+		}
+		return;
+	}
+	RtNow(&now);
+	for (int idx = 0; idx < count; idx++) {
+		struct epoll_event event;
+		event.events = EPOLLIN;
+		event.data.u32 = (uint32_t)idx;
+		epoll_ctl(epollID, EPOLL_CTL_ADD, sessions[idx].socketID, &event);
+		cell->giveUp[idx] = now;
+		RtAddNs(&cell->giveUp[idx], sessions[idx].io.readyTimeoutNs);
+	}
+
+	while (cell->active > 0) {
+		// sleep until a status comes in or the nearest robot is overdue
+		RtNow(&now);
+		int64_t leftNs = sessions[0].io.readyTimeoutNs;
+		for (int idx = 0; idx < count; idx++) {
+			if (cell->state[idx] != CellDone) {
+				int64_t robotLeftNs = RtDiffNs(&cell->giveUp[idx], &now);
+				leftNs = (robotLeftNs < leftNs) ? robotLeftNs : leftNs;
+			}
+		}
+		int timeoutMs = (leftNs > 0) ? (int)((leftNs + NsPerMs - 1) / NsPerMs) : 0;
+		int ready = epoll_wait(epollID, events.data(), count, timeoutMs);
+		if ((ready < 0) && (errno != EINTR)) {
+			cout << "** EPOLL WAIT FAILED: " << strerror(errno) << " **" << endl;
+			break;
+		}
+		for (int event = 0; event < ready; event++) {
+			ServiceRobot(cell, (int)events[event].data.u32);
+		}
+
+		RtNow(&now);
+		for (int idx = 0; idx < count; idx++) {
+			if ((cell->state[idx] != CellDone) && (RtDiffNs(&now, &cell->giveUp[idx]) > 0)) {
+				if (cell->state[idx] == CellWaitReady) {
+					cout << "** ROBOT " << idx + 1 << " NOT READY **" << endl;
+				}
+				else if (sessions[idx].lastSent && (RtDiffNs(&now, &sessions[idx].lastSendTime) > sessions[idx].io.drainTimeoutNs)) {
+					cout << "** LAST COMMAND OF ROBOT " << idx + 1 << " NOT ACKNOWLEDGED, sequence ID: " << sessions[idx].lastSeq << " **" << endl;
+				}
+				else {
+					cout << "** NO STATUS FROM CONTROLLER OF ROBOT " << idx + 1 << " at sequence ID: " << sessions[idx].seqID << " **" << endl;
+				}
+				sessions[idx].doDataExchange = false;
+				FinishRobot(cell, idx);
+			}
+		}
+	}
+	for (int idx = 0; idx < count; idx++) {
+		if (cell->state[idx] != CellDone) {
+			sessions[idx].doDataExchange = false;
+			EndMotion(&sessions[idx]);
+		}
+	}
+	close(epollID);
+
+	// first command of the first robot to the first command of the last one
+	if (cell->stats->failedRobot < 0) {
+		for (int idx = 1; idx < count; idx++) {
+			int64_t spreadNs = RtDiffNs(&cell->firstSend[idx], &cell->firstSend[0]);
+			spreadNs = (spreadNs < 0) ? -spreadNs : spreadNs;
+			if (spreadNs > cell->stats->startSpreadNs) {
+				cell->stats->startSpreadNs = spreadNs;
+			}
+		}
+	}
+}
+
+bool RunCellSession(StreamSession_T *sessions, int count, CellStats_T *stats)
+{
+	CellLoop_T cell;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->failedRobot = -1;
+	cell.sessions = sessions;
+	cell.count = count;
+	cell.stats = stats;
+	cell.state.assign(count, CellWaitReady);
+	cell.giveUp.resize(count);
+	cell.firstSend.resize(count);
+	cell.readyCount = 0;
+	cell.active = count;
+	cell.gateOpen = false;
+	cell.ending = false;
+
+	if (!RtPrepareProcess(&sessions[0].rt)) {
+		cout << "Continue without locked memory" << endl;
+	}
+
+	thread cellThread(StreamCell, &cell);
+	cellThread.join();
+
+	bool completed = true;
+	for (int idx = 0; idx < count; idx++) {
+		completed = completed && sessions[idx].doDataExchange && !sessions[idx].endRequest;
+	}
+	return completed;
+}
+
+void WriteCellStats(const CellStats_T *stats, long cycleNs)
+{
+	if (stats->failedRobot >= 0) {
+		printf("** robot %d stopped, the others were ended at their last pose **\n", stats->failedRobot + 1);
+	}
+	else {
+		printf("cell: first commands within %.3f ms, ", stats->startSpreadNs / 1.0e6);
+	}
+	printf("status phase against robot 1: mean %.3f ms, max %.3f ms (cycle %.3f ms), samples apart: %d\n",
+		(stats->skewSamples > 0) ? stats->sumSkewNs / 1.0e6 / stats->skewSamples : 0.0, stats->maxSkewNs / 1.0e6, cycleNs / 1.0e6,
+		stats->maxSampleSpread);
+}
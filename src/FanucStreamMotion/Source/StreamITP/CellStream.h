@@ -0,0 +1,62 @@
+//
+// CellStream.h : several robots of a cell streamed from one thread
+//
+// Each robot keeps its own UDP session and StreamSession_T; one thread
+// waits on all of their sockets with epoll and answers each status the
+// moment it is read, so N controllers cost one core. The controllers run
+// their own ITP clocks, which the PC cannot move, so the cell is kept in
+// step by sequence instead:
+//   - the start packets go out back to back (by the caller)
+//   - no robot moves before every robot reported ready; then each one
+//     starts on its next status, so all first commands execute within one
+//     cycle of each other, and from there sample n runs on every robot in
+//     the same cycle
+//   - the status arrival phase of each robot against the first one, and
+//     the spread of the sample being executed, are measured every cycle
+//   - when a robot fails (controller error, no status) the others end at
+//     the pose they were sent last and are stopped together
+// The time outs and the socket I/O settings are each session's io; the
+// thread always waits in epoll, so IoSpin is not used here.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "J519Packet.h"
+#include "StreamEngine.h"
+
+// one line of the cell file
+typedef struct CellRobot_T {
+	std::string address;
+	u_short port;
+	std::string dataFile;         // relative to the cell file
+	int representation;           // -1 if not given: from the data file, else joint
+	int packetStack;
+} CellRobot_T;
+
+typedef struct CellStats_T {
+	int64_t maxSkewNs;            // status arrival of a robot against the first one, folded into +-cycle/2
+	int64_t sumSkewNs;            // of the absolute skew
+	unsigned long skewSamples;
+	int64_t startSpreadNs;        // first command of the first robot to the first command of the last
+	int maxSampleSpread;          // samples between the robots' executing positions
+	int failedRobot;              // index of the robot that stopped the cell, -1 if none
+} CellStats_T;
+
+/*
+ * LoadCellFile: one robot per line, "address[:port] datafile [Joint|Cartesian]
+ *               [packet stack]", # starts a comment. On error prints
+ *               "file:line: reason" and returns false.
+ */
+bool LoadCellFile(const char *fileName, std::vector<CellRobot_T> *robots);
+
+/*
+ * RunCellSession: stream every session from one real-time thread (rt of the
+ *                 first session) and wait for it to finish. The start packets
+ *                 must already be sent. True if every robot completed.
+ */
+bool RunCellSession(StreamSession_T *sessions, int count, CellStats_T *stats);
+
+void WriteCellStats(const CellStats_T *stats, long cycleNs);
@@ -0,0 +1,384 @@
+//
+// CollisionCheck.cpp : self-collision and environment contact of a joint
+//                      trajectory, with the model's link meshes
+//
+
+#include "stdafx.h"
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <atomic>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+#include "CollisionCheck.h"
+#include "RtUtil.h"
+
+using namespace std;
+
+const size_t CollisionBlock = 64;            // samples handed to a thread at a time
+const size_t SamplesPerCollisionThread = 256;
+const size_t MaxSegmentLines = 20;
+
+void InitCollisionScene(CollisionScene_T *scene)
+{
+	scene->chain = NULL;
+	scene->linkCount = 0;
+	for (int idx = 0; idx < MaxSceneLinks; idx++) {
+		InitMeshAsset(&scene->linkAssets[idx]);
+		scene->links[idx] = &scene->linkAssets[idx].full;
+	}
+	scene->coarse = false;
+	scene->rebuildCache = false;
+	scene->loadMs = 0.0;
+	scene->ignoredAtZero = 0;
+	scene->environment.clear();
+}
+
+void FreeCollisionScene(CollisionScene_T *scene)
+{
+	for (int idx = 0; idx < MaxSceneLinks; idx++) {
+		FreeMeshAsset(&scene->linkAssets[idx]);
+	}
+	for (size_t obj = 0; obj < scene->environment.size(); obj++) {
+		FreeMeshAsset(&scene->environment[obj].asset);
+	}
+	InitCollisionScene(scene);
+}
+
+// the mesh an object is checked with
+static const Mesh_T *ObjectMesh(const CollisionScene_T *scene, const CollisionObject_T *object)
+{
+	if (object->box.triangleCount > 0) {
+		return &object->box;
+	}
+	return scene->coarse ? &object->asset.lod : &object->asset.full;
+}
+
+bool LoadCollisionScene(const RobotModel_T *model, const KinematicChain_T *chain, bool coarse, bool rebuildCache, CollisionScene_T *scene)
+{
+	char path[ModelPathSize * 2];
+	int64_t start = RtNowNs();
+
+	FreeCollisionScene(scene);
+	scene->chain = chain;
+	scene->linkCount = chain->axisCount + 1;
+	scene->coarse = coarse;
+	scene->rebuildCache = rebuildCache;
+	for (int idx = 0; idx < scene->linkCount; idx++) {
+		const ModelLink_T *link = ChainLink(model, idx);
+		snprintf(scene->linkNames[idx], ModelNameSize, "%s", link->name);
+		if (link->mesh[0] == '\0') {
+			continue;
+		}
+		ResolveModelPath(model, link->mesh, path, sizeof(path));
+		if (!LoadMeshAsset(path, 1000.0, DefaultLodCell, rebuildCache, &scene->linkAssets[idx])) {
+			return false;
+		}
+		scene->links[idx] = coarse ? &scene->linkAssets[idx].lod : &scene->linkAssets[idx].full;
+	}
+	scene->loadMs = (RtNowNs() - start) / 1.0e6;
+
+	// neighbours share their joint; pairs touching at zero overlap in the model itself
+	double links[MaxSceneLinks][12];
+	float zero[MaxAxisNumber] = { 0.0f };
+	LinkTransforms(chain, zero, links);
+	for (int a = 0; a < scene->linkCount; a++) {
+		for (int b = 0; b < scene->linkCount; b++) {
+			scene->checkPair[a][b] = false;
+		}
+	}
+	for (int a = 0; a < scene->linkCount; a++) {
+		for (int b = a + 2; b < scene->linkCount; b++) {
+			if (MeshesTouch(scene->links[a], links[a], scene->links[b], links[b])) {
+				scene->ignoredAtZero++;
+				continue;
+			}
+			scene->checkPair[a][b] = scene->checkPair[b][a] = true;
+		}
+	}
+	return true;
+}
+
+// 6 numbers x y z w p r -> transform
+static bool ReadPose(istringstream &fields, double pose[12])
+{
+	float values[6];
+	for (int idx = 0; idx < 6; idx++) {
+		if (!(fields >> values[idx])) {
+			return false;
+		}
+	}
+	PoseToTransform(values, pose);
+	return true;
+}
+
+bool LoadEnvironmentFile(const char *fileName, CollisionScene_T *scene)
+{
+	ifstream file(fileName);
+	string line;
+	int lineNo = 0;
+
+	if (!file) {
+		cout << "Cannot open environment file: " << fileName << endl;
+		return false;
+	}
+	while (getline(file, line)) {
+		lineNo++;
+		size_t hash = line.find('#');
+		if (hash != string::npos) {
+			line.erase(hash);
+		}
+		istringstream fields(line);
+		string kind;
+		if (!(fields >> kind)) {
+			continue;
+		}
+
+		// built in place: the meshes point into their own storage or mapping
+		scene->environment.emplace_back();
+		CollisionObject_T &object = scene->environment.back();
+		InitMesh(&object.box);
+		InitMeshAsset(&object.asset);
+		bool ok = false;
+		if (kind == "box") {
+			double size[3];
+			ok = ReadPose(fields, object.pose) && (fields >> size[0] >> size[1] >> size[2]);
+			if (ok) {
+				BoxMesh(size, &object.box);
+				object.name = "box (line " + to_string(lineNo) + ")";
+			}
+		}
+		else if (kind == "mesh") {
+			string meshFile;
+			double scale = 1000.0;
+			ok = (fields >> meshFile) && ReadPose(fields, object.pose);
+			if (ok) {
+				fields >> scale;
+				// relative to the environment file
+				string dir(fileName);
+				size_t slash = dir.find_last_of('/');
+				if ((meshFile[0] != '/') && (slash != string::npos)) {
+					meshFile = dir.substr(0, slash + 1) + meshFile;
+				}
+				if (!LoadMeshAsset(meshFile.c_str(), scale, DefaultLodCell, scene->rebuildCache, &object.asset)) {
+					scene->environment.pop_back();
+					return false;
+				}
+				object.name = meshFile;
+			}
+		}
+		if (!ok) {
+			cout << fileName << ":" << lineNo << ": expected box x y z w p r sx sy sz or mesh file x y z w p r (scale)" << endl;
+			scene->environment.pop_back();
+			return false;
+		}
+	}
+	return true;
+}
+
+
+static string ObjectName(const CollisionScene_T *scene, int idx)
+{
+	if (idx >= 0) {
+		return scene->linkNames[idx];
+	}
+	return "environment " + scene->environment[-1 - idx].name;
+}
+
+void WriteCollisionScene(const CollisionScene_T *scene)
+{
+	size_t triangles = 0;
+	int pairs = 0, cached = 0, meshes = 0;
+
+	for (int idx = 0; idx < scene->linkCount; idx++) {
+		triangles += scene->links[idx]->triangleCount;
+		meshes += (scene->links[idx]->triangleCount > 0) ? 1 : 0;
+		cached += scene->linkAssets[idx].fromCache ? 1 : 0;
+		for (int other = idx + 1; other < scene->linkCount; other++) {
+			pairs += scene->checkPair[idx][other] ? 1 : 0;
+		}
+	}
+	printf("collision scene: %d links, %zu %striangles, %d link pairs checked (%d touching at zero left out), %zu environment objects\n",
+		scene->linkCount, triangles, scene->coarse ? "simplified " : "", pairs, scene->ignoredAtZero, scene->environment.size());
+	printf("link meshes: %d of %d from the mesh cache, loaded in %.1f ms\n", cached, meshes, scene->loadMs);
+}
+
+bool SampleCollides(const CollisionScene_T *scene, const float joints[MaxAxisNumber], CollisionHit_T *hit)
+{
+	double links[MaxSceneLinks][12];
+
+	hit->found = false;
+	LinkTransforms(scene->chain, joints, links);
+
+	// the environment first: an arm in a fixture is the likelier contact
+	for (size_t obj = 0; obj < scene->environment.size(); obj++) {
+		const CollisionObject_T *object = &scene->environment[obj];
+		const Mesh_T *mesh = ObjectMesh(scene, object);
+		for (int idx = 1; idx < scene->linkCount; idx++) {
+			if (MeshesTouch(mesh, object->pose, scene->links[idx], links[idx])) {
+				hit->found = true;
+				hit->linkA = idx;
+				hit->linkB = -1 - (int)obj;
+				return true;
+			}
+		}
+	}
+	for (int a = 0; a < scene->linkCount; a++) {
+		for (int b = a + 2; b < scene->linkCount; b++) {
+			if (scene->checkPair[a][b] && MeshesTouch(scene->links[a], links[a], scene->links[b], links[b])) {
+				hit->found = true;
+				hit->linkA = a;
+				hit->linkB = b;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+typedef struct CollisionWork_T {
+	const CollisionScene_T *scene;
+	const PositionData_T *samples;
+	size_t count;
+	bool stopAtFirst;
+	atomic<size_t> nextBlock;
+	atomic<size_t> firstHit;           // lowest colliding sample so far
+	atomic<size_t> checked;
+	atomic<size_t> colliding;
+	vector<CollisionHit_T> *hits;
+} CollisionWork_T;
+
+static void CollisionWorker(CollisionWork_T *work)
+{
+	CollisionHit_T hit;
+	size_t checked = 0, colliding = 0;
+
+	for (;;) {
+		size_t start = work->nextBlock.fetch_add(CollisionBlock);
+		if ((start >= work->count) || (work->stopAtFirst && (start > work->firstHit.load(memory_order_relaxed)))) {
+			break;
+		}
+		size_t end = (start + CollisionBlock < work->count) ? start + CollisionBlock : work->count;
+		for (size_t idx = start; idx < end; idx++) {
+			if (work->stopAtFirst && (idx > work->firstHit.load(memory_order_relaxed))) {
+				break;
+			}
+			checked++;
+			if (!SampleCollides(work->scene, work->samples[idx].data, &hit)) {
+				continue;
+			}
+			hit.sampleIdx = idx;
+			colliding++;
+			if (work->hits != NULL) {
+				(*work->hits)[idx] = hit;
+			}
+			size_t first = work->firstHit.load();
+			while ((idx < first) && !work->firstHit.compare_exchange_weak(first, idx)) {
+			}
+			if (work->stopAtFirst) {
+				break;
+			}
+		}
+	}
+	work->checked += checked;
+	work->colliding += colliding;
+}
+
+bool CheckTrajectoryCollisions(const CollisionScene_T *scene, const PositionData_T *samples, size_t count, int threadCount,
+                               bool stopAtFirst, CollisionReport_T *report)
+{
+	CollisionWork_T work;
+	int64_t start = RtNowNs();
+
+	report->first.found = false;
+	report->stoppedAtFirst = stopAtFirst;
+	report->hits.clear();
+	if (!stopAtFirst) {
+		CollisionHit_T none = { false, 0, 0, 0 };
+		report->hits.assign(count, none);
+	}
+
+	work.scene = scene;
+	work.samples = samples;
+	work.count = count;
+	work.stopAtFirst = stopAtFirst;
+	work.nextBlock = 0;
+	work.firstHit = (size_t)-1;
+	work.checked = 0;
+	work.colliding = 0;
+	work.hits = stopAtFirst ? NULL : &report->hits;
+
+	if (threadCount <= 0) {
+		threadCount = (int)thread::hardware_concurrency();
+	}
+	if ((size_t)threadCount > count / SamplesPerCollisionThread) {
+		threadCount = (int)(count / SamplesPerCollisionThread);
+	}
+	if (threadCount <= 1) {
+		threadCount = 1;
+		CollisionWorker(&work);
+	}
+	else {
+		vector<thread> workers;
+		for (int idx = 0; idx < threadCount; idx++) {
+			workers.push_back(thread(CollisionWorker, &work));
+		}
+		for (size_t idx = 0; idx < workers.size(); idx++) {
+			workers[idx].join();
+		}
+	}
+
+	// the pair of the first contact, found again (only the sample index is shared between the threads)
+	size_t first = work.firstHit.load();
+	if (first != (size_t)-1) {
+		SampleCollides(scene, samples[first].data, &report->first);
+		report->first.sampleIdx = first;
+	}
+	report->samplesChecked = work.checked.load();
+	report->collidingSamples = work.colliding.load();
+	report->elapsedMs = (RtNowNs() - start) / 1.0e6;
+	report->threads = threadCount;
+	return !report->first.found;
+}
+
+void WriteCollisionReport(const CollisionScene_T *scene, const CollisionReport_T *report)
+{
+	printf("collision check: %zu samples in %.1f ms on %d threads\n", report->samplesChecked, report->elapsedMs, report->threads);
+	if (!report->first.found) {
+		printf("no contact\n");
+		return;
+	}
+	const CollisionHit_T *first = &report->first;
+	printf("** CONTACT at sample %zu (line %zu): %s - %s\n", first->sampleIdx, first->sampleIdx + 1,
+		ObjectName(scene, first->linkA).c_str(), ObjectName(scene, first->linkB).c_str());
+	if (report->stoppedAtFirst) {
+		return;
+	}
+
+	// runs of samples with the same pair in contact
+	printf("%zu samples in contact\n", report->collidingSamples);
+	size_t lines = 0, runs = 0;
+	for (size_t idx = 0; idx < report->hits.size(); idx++) {
+		const CollisionHit_T *hit = &report->hits[idx];
+		if (!hit->found) {
+			continue;
+		}
+		size_t last = idx;
+		while ((last + 1 < report->hits.size()) && report->hits[last + 1].found
+			&& (report->hits[last + 1].linkA == hit->linkA) && (report->hits[last + 1].linkB == hit->linkB)) {
+			last++;
+		}
+		runs++;
+		if (lines++ < MaxSegmentLines) {
+			printf("  samples %zu-%zu (lines %zu-%zu): %s - %s\n", idx, last, idx + 1, last + 1,
+				ObjectName(scene, hit->linkA).c_str(), ObjectName(scene, hit->linkB).c_str());
+		}
+		idx = last;
+	}
+	if (runs > MaxSegmentLines) {
+		printf("  ... %zu segments in all\n", runs);
+	}
+}
@@ -0,0 +1,100 @@
+//
+// CollisionCheck.h : self-collision and environment contact of a joint
+//                    trajectory, with the model's link meshes
+//
+// The scene is built once: link meshes from the model (with their
+// hierarchies, mapped from the mesh cache, MeshCache.h) and environment
+// objects from an environment file. The coarse scene checks the cached
+// simplified meshes instead: faster, but a contact within about a grid cell
+// may be missed or reported. Link pairs next to each other on the chain are
+// not checked (they share the joint), nor are pairs already touching at all
+// axes zero (overlapping exporter meshes).
+// The root link (base) is not checked against the environment it stands in.
+//
+// Environment file, one object per line, world frame (mm / deg), '#' comments:
+//   box  x y z w p r  size_x size_y size_z          box centered on the pose
+//   mesh file.STL  x y z w p r  (scale)             STL placed at the pose,
+//                                                   scale 1000 (meters) if left out
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "J519Packet.h"
+#include "RobotModel.h"
+#include "Kinematics.h"
+#include "MeshBvh.h"
+#include "MeshCache.h"
+
+const int MaxSceneLinks = MaxAxisNumber + 1;
+
+typedef struct CollisionObject_T {
+	std::string name;
+	Mesh_T box;                         // box objects
+	MeshAsset_T asset;                  // mesh objects
+	double pose[12];                    // world frame, mm
+} CollisionObject_T;
+
+typedef struct CollisionScene_T {
+	const KinematicChain_T *chain;
+	int linkCount;                      // root link + one per chain joint
+	char linkNames[MaxSceneLinks][ModelNameSize];
+	MeshAsset_T linkAssets[MaxSceneLinks];
+	const Mesh_T *links[MaxSceneLinks]; // link frame, mm; empty if the link has no mesh
+	bool coarse;                        // simplified meshes checked
+	bool rebuildCache;
+	double loadMs;                      // meshes mapped or built
+	bool checkPair[MaxSceneLinks][MaxSceneLinks];
+	int ignoredAtZero;                  // pairs left out because they touch at all axes zero
+	std::vector<CollisionObject_T> environment;
+} CollisionScene_T;
+
+typedef struct CollisionHit_T {
+	bool found;
+	size_t sampleIdx;
+	int linkA;
+	int linkB;                          // link index, or -1 - environment object index
+} CollisionHit_T;
+
+typedef struct CollisionReport_T {
+	size_t samplesChecked;
+	size_t collidingSamples;            // all samples checked only
+	bool stoppedAtFirst;
+	CollisionHit_T first;
+	std::vector<CollisionHit_T> hits;   // per sample, all samples checked only
+	double elapsedMs;
+	int threads;
+} CollisionReport_T;
+
+void InitCollisionScene(CollisionScene_T *scene);
+
+// unmap the meshes
+void FreeCollisionScene(CollisionScene_T *scene);
+
+/*
+ * LoadCollisionScene: link meshes of the model's chain, checked link pairs.
+ *                     With coarse the simplified meshes are checked; with
+ *                     rebuildCache the mesh cache files are built again.
+ *                     On error prints the reason and returns false.
+ */
+bool LoadCollisionScene(const RobotModel_T *model, const KinematicChain_T *chain, bool coarse, bool rebuildCache, CollisionScene_T *scene);
+
+bool LoadEnvironmentFile(const char *fileName, CollisionScene_T *scene);
+
+void WriteCollisionScene(const CollisionScene_T *scene);
+
+// first contact of one joint position (deg), false if there is none
+bool SampleCollides(const CollisionScene_T *scene, const float joints[MaxAxisNumber], CollisionHit_T *hit);
+
+/*
+ * CheckTrajectoryCollisions: every sample on all CPUs (threadCount 0),
+ *                            blocks handed out in order. With stopAtFirst
+ *                            the check ends at the first contact, samples
+ *                            after it are not looked at. True if clear.
+ */
+bool CheckTrajectoryCollisions(const CollisionScene_T *scene, const PositionData_T *samples, size_t count, int threadCount,
+                               bool stopAtFirst, CollisionReport_T *report);
+
+void WriteCollisionReport(const CollisionScene_T *scene, const CollisionReport_T *report);
@@ -0,0 +1,87 @@
+//
+// CommandEncoder.cpp : encode a whole trajectory into wire format command packets
+//
+
+#include "stdafx.h"
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "CommandEncoder.h"
+
+using namespace std;
+
+static_assert(sizeof(CommandPacket_T) == CommandPacketAlign, "one command packet per cache line");
+
+void InitEncodedTrajectory(EncodedTrajectory_T *encoded)
+{
+	encoded->packets = NULL;
+	encoded->count = 0;
+}
+
+void FreeEncodedTrajectory(EncodedTrajectory_T *encoded)
+{
+	free(encoded->packets);
+	InitEncodedTrajectory(encoded);
+}
+
+#ifdef __SSE2__
+// byte swap the four 32-bit words of a vector
+static inline __m128i Swap32x4(__m128i x)
+{
+	__m128i mask = _mm_set1_epi32(0x00FF00FF);
+	x = _mm_or_si128(_mm_slli_epi32(x, 16), _mm_srli_epi32(x, 16));
+	return _mm_or_si128(_mm_slli_epi32(_mm_and_si128(x, mask), 8), _mm_and_si128(_mm_srli_epi32(x, 8), mask));
+}
+#endif
+
+void EncodeCommandPositions(CommandPacket_T *packets, const PositionData_T *samples, size_t count)
+{
+	for (size_t sampleIdx = 0; sampleIdx < count; sampleIdx++) {
+		const float *in = samples[sampleIdx].data;
+		u_word *out = packets[sampleIdx].commandPos;
+#ifdef __SSE2__
+		__m128i lo = _mm_loadu_si128((const __m128i *)&in[0]);
+		__m128i hi = _mm_loadu_si128((const __m128i *)&in[4]);
+		_mm_storeu_si128((__m128i *)&out[0], Swap32x4(lo));
+		_mm_storeu_si128((__m128i *)&out[4], Swap32x4(hi));
+		out[8] = HostFloatToNet(in[8]);
+#else
+		for (int idx = 0; idx < MaxAxisNumber; idx++) {
+			out[idx] = HostFloatToNet(in[idx]);
+		}
+#endif
+	}
+}
+
+bool EncodeTrajectory(EncodedTrajectory_T *encoded, const PositionData_T *samples, size_t sampleCount, u_byte dataStyle)
+{
+	static const float zeroPos[MaxAxisNumber] = { 0.0f };
+	CommandPacket_T header;
+
+	FreeEncodedTrajectory(encoded);
+	if (sampleCount == 0) {
+		return false;
+	}
+
+	encoded->packets = (CommandPacket_T *)aligned_alloc(CommandPacketAlign, sampleCount * sizeof(CommandPacket_T));
+	if (encoded->packets == NULL) {
+		cout << "Cannot allocate " << sampleCount << " command packets" << endl;
+		return false;
+	}
+	encoded->count = sampleCount;
+
+	// constant part of every packet
+	InitCommandPacket(&header, 0, zeroPos, dataStyle, 0);
+	for (size_t idx = 0; idx < sampleCount; idx++) {
+		memcpy(&encoded->packets[idx], &header, offsetof(CommandPacket_T, commandPos));
+	}
+	EncodeCommandPositions(encoded->packets, samples, sampleCount);
+
+	// this is the last command data sent to robot controller
+	encoded->packets[sampleCount - 1].lastData = 1;
+	return true;
+}
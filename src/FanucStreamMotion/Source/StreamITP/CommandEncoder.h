@@ -0,0 +1,36 @@
+//
+// CommandEncoder.h : encode a whole trajectory into wire format command packets
+//                    before streaming, so the cycle only stamps the sequence number
+//
+
+#pragma once
+
+#include <stddef.h>
+#include "J519Packet.h"
+
+// CommandPacket_T is exactly one cache line: keep the array line aligned
+const size_t CommandPacketAlign = 64;
+
+typedef struct EncodedTrajectory_T {
+	CommandPacket_T *packets;   // one per sample, CommandPacketAlign aligned, lastData set on the last one
+	size_t count;
+} EncodedTrajectory_T;
+
+void InitEncodedTrajectory(EncodedTrajectory_T *encoded);
+void FreeEncodedTrajectory(EncodedTrajectory_T *encoded);
+
+/*
+ * EncodeTrajectory: byte swap every sample into a command packet. The
+ *                   sequence number is left 0 for PatchSequenceNo.
+ */
+bool EncodeTrajectory(EncodedTrajectory_T *encoded, const PositionData_T *samples, size_t sampleCount, u_byte dataStyle);
+
+/*
+ * EncodeCommandPositions: byte swap count samples into already initialised packets
+ */
+void EncodeCommandPositions(CommandPacket_T *packets, const PositionData_T *samples, size_t count);
+
+static inline void PatchSequenceNo(CommandPacket_T *packet, u_word seqNo)
+{
+	packet->sequenceNo = htonl(seqNo);
+}
@@ -0,0 +1,340 @@
+//
+// CorrectionHook.cpp : per cycle correction of the commands being streamed
+//
+
+#include "stdafx.h"
+#include <dlfcn.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <string>
+
+#include "CorrectionHook.h"
+#include "RtUtil.h"
+
+using namespace std;
+
+static u_word FloatBits(float value)
+{
+	u_word bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static float BitsFloat(u_word bits)
+{
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+void InitCorrectionHook(CorrectionHook_T *hook, long cycleNs)
+{
+	hook->plugin = NULL;
+	hook->context = NULL;
+	hook->library = NULL;
+	hook->mailbox = NULL;
+	hook->budgetNs = cycleNs / 8;
+	for (int idx = 0; idx < MaxAxisNumber; idx++) {
+		hook->maxStep[idx] = CorrectionDefaultStep;
+	}
+	memset(&hook->scratch, 0, sizeof(hook->scratch));
+	memset(&hook->entry, 0, sizeof(hook->entry));
+	memset(hook->delta, 0, sizeof(hook->delta));
+	hook->haveDelta = false;
+	memset(hook->applied, 0, sizeof(hook->applied));
+	hook->overrunsInRow = 0;
+	hook->disabled = false;
+	hook->calls = 0;
+	hook->corrected = 0;
+	hook->overruns = 0;
+	hook->tornReads = 0;
+	hook->postsSeen = 0;
+	hook->clamped = 0;
+	InitHistogram(&hook->callTime);
+	InitHistogram(&hook->landing);
+}
+
+void SetCorrectionLimits(CorrectionHook_T *hook, const AxisLimits_T limits[MaxAxisNumber], int representation, long cycleNs)
+{
+	if (representation != 1) {
+		return;
+	}
+	for (int idx = 0; idx < MaxAxisNumber; idx++) {
+		double velocity = limits[idx].valid ? LowestLimit(&limits[idx].table[ThresholdVelocity], HUGE_VAL) : 0.0;
+		if (velocity > 0.0) {
+			hook->maxStep[idx] = (float)(CorrectionLimitScale * velocity * cycleNs / 1.0e9);
+		}
+	}
+}
+
+// ---------------------------------------------------------------- mailbox
+
+CorrectionMailbox_T *OpenCorrectionMailbox(const char *fileName, bool reset)
+{
+	int fileID = open(fileName, O_RDWR | O_CREAT, 0600);
+	struct stat st;
+
+	if ((fileID < 0) || (fstat(fileID, &st) != 0)) {
+		cout << "Cannot open correction mailbox " << fileName << ": " << strerror(errno) << endl;
+		if (fileID >= 0) {
+			close(fileID);
+		}
+		return NULL;
+	}
+	bool fresh = reset || (st.st_size < (off_t)sizeof(CorrectionMailbox_T));
+	if (fresh && (ftruncate(fileID, sizeof(CorrectionMailbox_T)) != 0)) {
+		cout << "Cannot size correction mailbox " << fileName << ": " << strerror(errno) << endl;
+		close(fileID);
+		return NULL;
+	}
+	void *mapping = mmap(NULL, sizeof(CorrectionMailbox_T), PROT_READ | PROT_WRITE, MAP_SHARED, fileID, 0);
+	close(fileID);
+	if (mapping == MAP_FAILED) {
+		cout << "Cannot map correction mailbox " << fileName << ": " << strerror(errno) << endl;
+		return NULL;
+	}
+
+	CorrectionMailbox_T *mailbox = (CorrectionMailbox_T *)mapping;
+	if (fresh) {
+		memset(mapping, 0, sizeof(CorrectionMailbox_T));
+		memcpy(mailbox->magic, CorrectionMagic, sizeof(mailbox->magic));
+		mailbox->version = CorrectionVersion;
+	}
+	else if ((memcmp(mailbox->magic, CorrectionMagic, sizeof(mailbox->magic)) != 0) || (mailbox->version != CorrectionVersion)) {
+		cout << fileName << " is not a correction mailbox" << endl;
+		munmap(mapping, sizeof(CorrectionMailbox_T));
+		return NULL;
+	}
+	return mailbox;
+}
+
+void CloseCorrectionMailbox(CorrectionMailbox_T *mailbox)
+{
+	if (mailbox != NULL) {
+		munmap(mailbox, sizeof(CorrectionMailbox_T));
+	}
+}
+
+void PostCorrection(CorrectionMailbox_T *mailbox, u_word mode, const float pose[MaxAxisNumber])
+{
+	u_word sequence = mailbox->sequence.load(memory_order_relaxed);
+	int64_t postNs = RtNowNs();
+
+	mailbox->sequence.store(sequence + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	mailbox->mode.store(mode, memory_order_relaxed);
+	mailbox->postNsLow.store((u_word)postNs, memory_order_relaxed);
+	mailbox->postNsHigh.store((u_word)(postNs >> 32), memory_order_relaxed);
+	for (int idx = 0; idx < MaxAxisNumber; idx++) {
+		mailbox->pose[idx].store(FloatBits(pose[idx]), memory_order_relaxed);
+	}
+	mailbox->posts.store(mailbox->posts.load(memory_order_relaxed) + 1, memory_order_relaxed);
+	mailbox->sequence.store(sequence + 2, memory_order_release);
+}
+
+bool ReadCorrection(const CorrectionMailbox_T *mailbox, MailboxEntry_T *entry)
+{
+	for (int attempt = 0; attempt < MailboxReadAttempts; attempt++) {
+		u_word before = mailbox->sequence.load(memory_order_acquire);
+		if (before & 1) {
+			continue;
+		}
+		MailboxEntry_T read;
+		read.posts = mailbox->posts.load(memory_order_relaxed);
+		read.mode = mailbox->mode.load(memory_order_relaxed);
+		read.postNs = (int64_t)(((uint64_t)mailbox->postNsHigh.load(memory_order_relaxed) << 32) | mailbox->postNsLow.load(memory_order_relaxed));
+		for (int idx = 0; idx < MaxAxisNumber; idx++) {
+			read.pose[idx] = BitsFloat(mailbox->pose[idx].load(memory_order_relaxed));
+		}
+		atomic_thread_fence(memory_order_acquire);
+		if (mailbox->sequence.load(memory_order_relaxed) == before) {
+			*entry = read;
+			return true;
+		}
+	}
+	return false;
+}
+
+// ---------------------------------------------------------------- plugin
+
+bool LoadCorrectionPlugin(CorrectionHook_T *hook, const char *spec)
+{
+	string library(spec), args;
+	size_t comma = library.find(',');
+	if (comma != string::npos) {
+		args = library.substr(comma + 1);
+		library.erase(comma);
+	}
+
+	hook->library = dlopen(library.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (hook->library == NULL) {
+		cout << "Cannot load correction plugin: " << dlerror() << endl;
+		return false;
+	}
+	typedef const CorrectionPlugin_T *(*PluginEntry_T)(void);
+	PluginEntry_T entry = (PluginEntry_T)dlsym(hook->library, "ItpCorrectionPlugin");
+	const CorrectionPlugin_T *plugin = (entry != NULL) ? entry() : NULL;
+	if ((plugin == NULL) || (plugin->cycle == NULL)) {
+		cout << library << " has no ItpCorrectionPlugin() with a cycle function" << endl;
+		dlclose(hook->library);
+		hook->library = NULL;
+		return false;
+	}
+	if ((plugin->init != NULL) && !plugin->init(args.c_str(), &hook->context)) {
+		cout << "correction plugin " << plugin->name << " refused to start" << endl;
+		dlclose(hook->library);
+		hook->library = NULL;
+		return false;
+	}
+	hook->plugin = plugin;
+	cout << "correction plugin: " << plugin->name << ", budget " << hook->budgetNs / 1.0e3 << " us per call" << endl;
+	return true;
+}
+
+void FreeCorrectionHook(CorrectionHook_T *hook)
+{
+	if ((hook->plugin != NULL) && (hook->plugin->free != NULL)) {
+		hook->plugin->free(hook->context);
+	}
+	if (hook->library != NULL) {
+		dlclose(hook->library);
+	}
+	CloseCorrectionMailbox(hook->mailbox);
+	hook->plugin = NULL;
+	hook->library = NULL;
+	hook->mailbox = NULL;
+}
+
+// ---------------------------------------------------------------- stream thread
+
+static void FillInput(const CorrectionHook_T *hook, const RobotStatusPacket_T *status, int64_t statusNs, const CommandPacket_T *packet,
+	bool mailboxNew, CorrectionInput_T *input)
+{
+	input->statusSeqNo = ntohl(status->sequenceNo);
+	input->commandSeqNo = ntohl(packet->sequenceNo);
+	input->timeStamp = ntohl(status->timeStamp);
+	input->status = status->status;
+	input->representation = packet->dataStyle;
+	input->readIOType = status->readIOType;
+	input->readIOIndex = ntohs(status->readIOIndex);
+	input->readIOMask = ntohs(status->readIOMask);
+	input->readIOValue = ntohs(status->readIOValue);
+	for (int idx = 0; idx < MaxAxisNumber; idx++) {
+		input->position[idx] = NetFloatField(status->position[idx]);
+		input->jointAngle[idx] = NetToHostFloat(status->jontAngle[idx]);
+		input->current[idx] = NetFloatField(status->current[idx]);
+	}
+	input->statusNs = statusNs;
+	input->haveMailbox = (hook->mailbox != NULL);
+	input->mailboxNew = mailboxNew;
+	input->mailbox = hook->entry;
+}
+
+CommandPacket_T *CorrectCommand(CorrectionHook_T *hook, const RobotStatusPacket_T *status, int64_t statusNs, CommandPacket_T *packet)
+{
+	float original[MaxAxisNumber];
+	bool mailboxNew = false;
+
+	for (int idx = 0; idx < MaxAxisNumber; idx++) {
+		original[idx] = NetToHostFloat(packet->commandPos[idx]);
+	}
+	if (hook->mailbox != NULL) {
+		MailboxEntry_T entry;
+		if (!ReadCorrection(hook->mailbox, &entry)) {
+			hook->tornReads++;
+		}
+		else if (entry.posts != hook->entry.posts) {
+			hook->entry = entry;
+			hook->postsSeen++;
+			mailboxNew = true;
+		}
+	}
+
+	if ((hook->plugin != NULL) && !hook->disabled) {
+		CorrectionInput_T input;
+		float command[MaxAxisNumber];
+
+		FillInput(hook, status, statusNs, packet, mailboxNew, &input);
+		memcpy(command, original, sizeof(command));
+		int64_t startNs = RtNowNs();
+		bool changed = hook->plugin->cycle(hook->context, &input, command);
+		int64_t callNs = RtNowNs() - startNs;
+		HistogramRecord(&hook->callTime, callNs);
+		hook->calls++;
+		if (callNs > hook->budgetNs) {
+			// too late to trust: the previous correction stands
+			hook->overruns++;
+			hook->overrunsInRow++;
+			hook->disabled = (hook->overrunsInRow >= MaxCorrectionOverruns);
+		}
+		else {
+			hook->overrunsInRow = 0;
+			hook->haveDelta = changed;
+			for (int idx = 0; idx < MaxAxisNumber; idx++) {
+				hook->delta[idx] = changed ? command[idx] - original[idx] : 0.0f;
+			}
+		}
+	}
+	else if (hook->plugin == NULL) {
+		// no plugin: the mailbox entry as posted
+		const MailboxEntry_T *entry = &hook->entry;
+		hook->haveDelta = (entry->mode == CorrectionOffset) || (entry->mode == CorrectionReplace);
+		for (int idx = 0; idx < MaxAxisNumber; idx++) {
+			hook->delta[idx] = (entry->mode == CorrectionOffset) ? entry->pose[idx]
+				: (entry->mode == CorrectionReplace) ? entry->pose[idx] - original[idx] : 0.0f;
+		}
+	}
+
+	// the correction sent moves toward the one asked for by at most maxStep
+	bool held = false, moved = false;
+	for (int idx = 0; idx < MaxAxisNumber; idx++) {
+		float target = hook->haveDelta ? hook->delta[idx] : 0.0f;
+		float step = target - hook->applied[idx];
+		if (fabsf(step) > hook->maxStep[idx]) {
+			hook->applied[idx] += (step > 0.0f) ? hook->maxStep[idx] : -hook->maxStep[idx];
+			held = true;
+		}
+		else {
+			hook->applied[idx] = target;
+		}
+		moved = moved || (hook->applied[idx] != 0.0f);
+	}
+	if (held) {
+		hook->clamped++;
+	}
+	if (!moved) {
+		return packet;
+	}
+	hook->scratch = *packet;
+	for (int idx = 0; idx < MaxAxisNumber; idx++) {
+		hook->scratch.commandPos[idx] = HostFloatToNet(original[idx] + hook->applied[idx]);
+	}
+	hook->corrected++;
+	if (mailboxNew) {
+		HistogramRecord(&hook->landing, RtNowNs() - hook->entry.postNs);
+	}
+	return &hook->scratch;
+}
+
+void WriteCorrectionStats(const CorrectionHook_T *hook)
+{
+	printf("correction: %lu commands changed, %lu held to the step limit", hook->corrected, hook->clamped);
+	if (hook->mailbox != NULL) {
+		printf(", %lu mailbox posts used, %lu torn reads", hook->postsSeen, hook->tornReads);
+	}
+	printf("\n");
+	if (hook->plugin != NULL) {
+		printf("  plugin %s: %lu calls, %lu over the %.3f ms budget\n", hook->plugin->name, hook->calls, hook->overruns, hook->budgetNs / 1.0e6);
+		WriteHistogramLine("call", &hook->callTime);
+		if (hook->disabled) {
+			printf("** CORRECTION PLUGIN STOPPED after %d overruns in a row, its last correction was kept **\n", MaxCorrectionOverruns);
+		}
+	}
+	WriteHistogramLine("post->sent", &hook->landing);
+}
@@ -0,0 +1,174 @@
+//
+// CorrectionHook.h : per cycle correction of the commands being streamed
+//
+// On every status the stream thread hands the decoded status and the pose
+// of the command about to be sent (sequence number already known, not yet
+// put on the wire) to the correction, which may offset or replace it. The
+// command goes out the same cycle, so a correction read from a status is
+// executed the next cycle (with a packet stack, that many cycles later).
+//
+// Corrections come from two places, either or both:
+//   - a mailbox: a small shared memory file another thread or process posts
+//     offsets or replacement poses to. Posting and reading are lock free
+//     (a sequence lock: the reader retries a torn read a few times, then
+//     keeps the previous correction), so a slow or stopped writer never
+//     holds up the stream.
+//   - a plugin: a shared library exporting ItpCorrectionPlugin(), called
+//     with the status, the command and the latest mailbox entry. Without a
+//     plugin the mailbox entry is applied as posted.
+//
+// Each call has a time budget. A call that ran over it is counted and its
+// result thrown away; the command gets the previous call's correction
+// instead, and after MaxCorrectionOverruns overruns in a row the plugin is
+// no longer called (its last correction is kept to the end of the motion).
+//
+// Whatever its source, the correction sent moves toward the one asked for by
+// at most a step per cycle and axis, so a jump in a post or a plugin result
+// (or a correction cleared) is ramped in rather than put on the wire in one
+// cycle. The step is a share of the lowest velocity threshold of the axis
+// when the thresholds are known and the data is joint, a fixed step else.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include "J519Packet.h"
+#include "CycleMetrics.h"
+#include "LimitCheck.h"
+
+const char CorrectionMagic[4] = { 'I', 'T', 'P', 'C' };
+const u_word CorrectionVersion = 1;
+const int MaxCorrectionOverruns = 3;
+const int MailboxReadAttempts = 4;
+const double CorrectionLimitScale = 0.25;  // share of the velocity threshold a correction may move at
+const float CorrectionDefaultStep = 0.5f;  // mm / deg per cycle without a threshold
+
+// what a mailbox entry does to the command
+const u_word CorrectionNone = 0;
+const u_word CorrectionOffset = 1;     // added to the commanded pose
+const u_word CorrectionReplace = 2;    // sent instead of the commanded pose
+
+static_assert(std::atomic<u_word>::is_always_lock_free, "the mailbox is shared between processes");
+
+// layout of the mailbox file, shared by the stream and the posting processes
+typedef struct CorrectionMailbox_T {
+	char magic[4];                         // "ITPC"
+	u_word version;
+	std::atomic<u_word> sequence;          // odd while a post is being written
+	std::atomic<u_word> posts;             // posts so far
+	std::atomic<u_word> mode;
+	std::atomic<u_word> postNsLow;         // CLOCK_MONOTONIC of the post, same host
+	std::atomic<u_word> postNsHigh;
+	std::atomic<u_word> pose[MaxAxisNumber];   // float bits, mm / deg
+} CorrectionMailbox_T;
+
+typedef struct MailboxEntry_T {
+	u_word posts;
+	u_word mode;
+	int64_t postNs;
+	float pose[MaxAxisNumber];
+} MailboxEntry_T;
+
+// what a correction is called with
+typedef struct CorrectionInput_T {
+	u_word statusSeqNo;
+	u_word commandSeqNo;       // of the command being corrected
+	u_word timeStamp;          // controller clock, ms
+	u_byte status;
+	u_byte representation;     // of the command: Cartesian position = 0, joint angle = 1
+	u_byte readIOType;
+	u_short readIOIndex;
+	u_short readIOMask;
+	u_short readIOValue;
+	float position[MaxAxisNumber];
+	float jointAngle[MaxAxisNumber];
+	float current[MaxAxisNumber];
+	int64_t statusNs;          // status read, CLOCK_MONOTONIC
+	bool haveMailbox;          // mailbox set: entry is its latest post
+	bool mailboxNew;           // posted since the last call
+	MailboxEntry_T mailbox;
+} CorrectionInput_T;
+
+/*
+ * A correction plugin, C linkage so it can be built on its own:
+ *   extern "C" const CorrectionPlugin_T *ItpCorrectionPlugin(void);
+ * init gets the text after the first ',' of --correction-plugin and returns
+ * false to refuse the run. cycle changes command[] (the pose about to be
+ * sent) in place and returns true, or returns false to leave it as it is;
+ * it runs on the stream thread, so no blocking calls, allocation or I/O.
+ */
+typedef struct CorrectionPlugin_T {
+	const char *name;
+	bool (*init)(const char *args, void **context);
+	bool (*cycle)(void *context, const CorrectionInput_T *input, float command[MaxAxisNumber]);
+	void (*free)(void *context);
+} CorrectionPlugin_T;
+
+typedef struct CorrectionHook_T {
+	const CorrectionPlugin_T *plugin;
+	void *context;
+	void *library;             // dlopen handle
+	CorrectionMailbox_T *mailbox;
+	size_t mailboxSize;
+	int64_t budgetNs;
+	float maxStep[MaxAxisNumber];  // change of the sent correction per cycle, mm / deg
+
+	// stream thread state
+	CommandPacket_T scratch;   // corrected copy of the command
+	MailboxEntry_T entry;      // last mailbox entry read whole
+	float delta[MaxAxisNumber];   // last accepted correction, corrected - commanded
+	bool haveDelta;
+	float applied[MaxAxisNumber]; // correction sent last cycle, moving toward delta
+	int overrunsInRow;
+	bool disabled;
+
+	// accounting
+	unsigned long calls;
+	unsigned long corrected;   // commands sent changed
+	unsigned long overruns;    // calls over the budget, result not used
+	unsigned long tornReads;   // mailbox post being written every attempt, previous entry used
+	unsigned long postsSeen;
+	unsigned long clamped;     // commands whose correction was held to maxStep
+	LatencyHistogram_T callTime;
+	LatencyHistogram_T landing;   // mailbox post -> first command carrying it sent
+} CorrectionHook_T;
+
+void InitCorrectionHook(CorrectionHook_T *hook, long cycleNs);
+
+/*
+ * SetCorrectionLimits: size the step per cycle from the velocity thresholds
+ *                      for joint data (representation 1); axes without a
+ *                      threshold, and Cartesian data, keep the fixed step
+ */
+void SetCorrectionLimits(CorrectionHook_T *hook, const AxisLimits_T limits[MaxAxisNumber], int representation, long cycleNs);
+
+/*
+ * OpenCorrectionMailbox: map the mailbox file, created (and emptied) if
+ *                        reset. Created readable and writable by its owner
+ *                        only: whoever can post to it moves the robot.
+ *                        On error prints the reason and returns NULL.
+ */
+CorrectionMailbox_T *OpenCorrectionMailbox(const char *fileName, bool reset);
+void CloseCorrectionMailbox(CorrectionMailbox_T *mailbox);
+
+// post an entry: one writer per mailbox
+void PostCorrection(CorrectionMailbox_T *mailbox, u_word mode, const float pose[MaxAxisNumber]);
+
+// latest whole entry, false if every attempt met a post being written
+bool ReadCorrection(const CorrectionMailbox_T *mailbox, MailboxEntry_T *entry);
+
+/*
+ * LoadCorrectionPlugin: "library.so[,args]": load it and run its init.
+ *                       On error prints the reason and returns false.
+ */
+bool LoadCorrectionPlugin(CorrectionHook_T *hook, const char *spec);
+void FreeCorrectionHook(CorrectionHook_T *hook);
+
+/*
+ * CorrectCommand: the packet to send instead of packet (hook->scratch, or
+ *                 packet itself if nothing changed), on the stream thread
+ */
+CommandPacket_T *CorrectCommand(CorrectionHook_T *hook, const RobotStatusPacket_T *status, int64_t statusNs, CommandPacket_T *packet);
+
+void WriteCorrectionStats(const CorrectionHook_T *hook);
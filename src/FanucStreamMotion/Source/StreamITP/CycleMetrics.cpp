@@ -0,0 +1,291 @@
+//
+// CycleMetrics.cpp : latency, jitter and status bookkeeping of the stream cycle
+//
+
+#include "stdafx.h"
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <iostream>
+
+#include "CycleMetrics.h"
+#include "RtUtil.h"
+
+using namespace std;
+
+const long LiveIntervalMs = 1000;
+static const char *StatusBitNames[StatusBitCount] = { "ready", "command_received", "system_ready", "in_motion", "bit4", "bit5", "bit6", "bit7" };
+static const double ReportedPercentiles[] = { 50.0, 90.0, 99.0, 99.9, 99.99 };
+static const char *PercentileNames[] = { "p50", "p90", "p99", "p99_9", "p99_99" };
+const int ReportedPercentileCount = 5;
+
+void InitHistogram(LatencyHistogram_T *histogram)
+{
+	for (int idx = 0; idx < HistogramBuckets; idx++) {
+		histogram->counts[idx].store(0, memory_order_relaxed);
+	}
+	histogram->count.store(0, memory_order_relaxed);
+	histogram->sum.store(0, memory_order_relaxed);
+	histogram->min.store(INT64_MAX, memory_order_relaxed);
+	histogram->max.store(0, memory_order_relaxed);
+}
+
+void InitCycleMetrics(CycleMetrics_T *metrics, long cycleNs)
+{
+	struct timespec wallClock;
+
+	clock_gettime(CLOCK_REALTIME, &wallClock);
+	metrics->cycleNs = cycleNs;
+	metrics->startNs = 0;
+	metrics->startUnix = wallClock.tv_sec + wallClock.tv_nsec / 1.0e9;
+	InitHistogram(&metrics->reply);
+	InitHistogram(&metrics->roundTrip);
+	InitHistogram(&metrics->jitter);
+	InitHistogram(&metrics->wakeup);
+	metrics->statuses.store(0);
+	metrics->sequenceGaps.store(0);
+	metrics->missingSequences.store(0);
+	metrics->repeatedSequences.store(0);
+	metrics->timestampGaps.store(0);
+	metrics->lateStatuses.store(0);
+	for (int bit = 0; bit < StatusBitCount; bit++) {
+		metrics->transitions[bit][0].store(0);
+		metrics->transitions[bit][1].store(0);
+	}
+	metrics->transitionCount.store(0);
+	memset(metrics->transitionLog, 0, sizeof(metrics->transitionLog));
+	metrics->haveStatus = false;
+	metrics->lastSequenceNo = 0;
+	metrics->lastTimeStamp = 0;
+	metrics->lastStatus = 0;
+	metrics->lastStatusNs = 0;
+	metrics->lastSendNs = 0;
+	metrics->liveFile = NULL;
+	metrics->liveStop.store(false);
+}
+
+int64_t HistogramPercentile(const LatencyHistogram_T *histogram, double percentile)
+{
+	uint64_t count = histogram->count.load(memory_order_relaxed);
+	if (count == 0) {
+		return 0;
+	}
+	uint64_t target = (uint64_t)ceil(percentile / 100.0 * count);
+	target = (target < 1) ? 1 : target;
+	uint64_t seen = 0;
+	for (int idx = 0; idx < HistogramBuckets; idx++) {
+		seen += histogram->counts[idx].load(memory_order_relaxed);
+		if (seen >= target) {
+			// upper edge of the bucket, never above the largest value seen
+			int64_t upper;
+			if (idx < 2 * HistogramHalf) {
+				upper = idx;
+			}
+			else {
+				int shift = idx / HistogramHalf - 1;
+				upper = ((int64_t)(idx - shift * HistogramHalf + 1) << shift) - 1;
+			}
+			int64_t max = histogram->max.load(memory_order_relaxed);
+			return (upper < max) ? upper : max;
+		}
+	}
+	return histogram->max.load(memory_order_relaxed);
+}
+
+void MetricsStatus(CycleMetrics_T *metrics, const RobotStatusPacket_T *status, int64_t nowNs)
+{
+	u_word sequenceNo = ntohl(status->sequenceNo);
+	u_word timeStamp = ntohl(status->timeStamp);
+	u_byte bits = status->status;
+
+	Bump(&metrics->statuses, (uint64_t)1);
+	if (!metrics->haveStatus) {
+		metrics->startNs = nowNs;
+		metrics->haveStatus = true;
+	}
+	else {
+		// sequence numbers count up by one per status
+		int32_t step = (int32_t)(sequenceNo - metrics->lastSequenceNo);
+		if (step > 1) {
+			Bump(&metrics->sequenceGaps, (uint64_t)1);
+			Bump(&metrics->missingSequences, (uint64_t)(step - 1));
+		}
+		else if (step < 1) {
+			Bump(&metrics->repeatedSequences, (uint64_t)1);
+		}
+
+		// controller clock in ms: more than 1.5 cycles between two statuses is a gap
+		int64_t clockStepNs = (int64_t)(int32_t)(timeStamp - metrics->lastTimeStamp) * NsPerMs;
+		if (clockStepNs * 2 > metrics->cycleNs * 3) {
+			Bump(&metrics->timestampGaps, (uint64_t)1);
+		}
+
+		int64_t intervalNs = nowNs - metrics->lastStatusNs;
+		HistogramRecord(&metrics->jitter, (intervalNs > metrics->cycleNs) ? intervalNs - metrics->cycleNs : metrics->cycleNs - intervalNs);
+		if (intervalNs * 2 > metrics->cycleNs * 3) {
+			Bump(&metrics->lateStatuses, (uint64_t)1);
+		}
+
+		u_byte changed = bits ^ metrics->lastStatus;
+		if (changed != 0) {
+			for (int bit = 0; bit < StatusBitCount; bit++) {
+				if (changed & (1 << bit)) {
+					Bump(&metrics->transitions[bit][(bits >> bit) & 1], (uint64_t)1);
+				}
+			}
+			uint64_t logged = metrics->transitionCount.load(memory_order_relaxed);
+			if (logged < (uint64_t)MaxTransitionLog) {
+				StatusTransition_T *entry = &metrics->transitionLog[logged];
+				entry->sequenceNo = sequenceNo;
+				entry->timeNs = nowNs - metrics->startNs;
+				entry->before = metrics->lastStatus;
+				entry->after = bits;
+			}
+			metrics->transitionCount.store(logged + 1, memory_order_release);
+		}
+	}
+	if (metrics->lastSendNs != 0) {
+		HistogramRecord(&metrics->roundTrip, nowNs - metrics->lastSendNs);
+		metrics->lastSendNs = 0;
+	}
+	metrics->lastSequenceNo = sequenceNo;
+	metrics->lastTimeStamp = timeStamp;
+	metrics->lastStatus = bits;
+	metrics->lastStatusNs = nowNs;
+}
+
+// ---------------------------------------------------------------- reports
+
+static void WriteHistogramJson(FILE *out, const char *name, const LatencyHistogram_T *histogram)
+{
+	uint64_t count = histogram->count.load(memory_order_relaxed);
+
+	fprintf(out, "\"%s\": {\"count\": %llu", name, (unsigned long long)count);
+	if (count > 0) {
+		fprintf(out, ", \"min_us\": %.3f, \"mean_us\": %.3f", histogram->min.load(memory_order_relaxed) / 1.0e3,
+			histogram->sum.load(memory_order_relaxed) / 1.0e3 / count);
+		for (int idx = 0; idx < ReportedPercentileCount; idx++) {
+			fprintf(out, ", \"%s_us\": %.3f", PercentileNames[idx], HistogramPercentile(histogram, ReportedPercentiles[idx]) / 1.0e3);
+		}
+		fprintf(out, ", \"max_us\": %.3f", histogram->max.load(memory_order_relaxed) / 1.0e3);
+	}
+	fprintf(out, "}");
+}
+
+void WriteMetricsJson(FILE *out, const CycleMetrics_T *metrics)
+{
+	fprintf(out, "\"start_unix\": %.3f, \"cycle_ms\": %.3f, \"statuses\": %llu,\n", metrics->startUnix, metrics->cycleNs / 1.0e6,
+		(unsigned long long)metrics->statuses.load());
+	fprintf(out, "\"sequence_gaps\": %llu, \"missing_sequences\": %llu, \"repeated_sequences\": %llu, \"timestamp_gaps\": %llu, \"late_statuses\": %llu,\n",
+		(unsigned long long)metrics->sequenceGaps.load(), (unsigned long long)metrics->missingSequences.load(),
+		(unsigned long long)metrics->repeatedSequences.load(), (unsigned long long)metrics->timestampGaps.load(),
+		(unsigned long long)metrics->lateStatuses.load());
+	WriteHistogramJson(out, "reply", &metrics->reply);
+	fprintf(out, ",\n");
+	WriteHistogramJson(out, "round_trip", &metrics->roundTrip);
+	fprintf(out, ",\n");
+	WriteHistogramJson(out, "jitter", &metrics->jitter);
+	fprintf(out, ",\n");
+	WriteHistogramJson(out, "wakeup", &metrics->wakeup);
+	fprintf(out, ",\n\"status_transitions\": {");
+	for (int bit = 0; bit < StatusBitCount; bit++) {
+		fprintf(out, "%s\"%s\": {\"set\": %llu, \"cleared\": %llu}", (bit > 0) ? ", " : "", StatusBitNames[bit],
+			(unsigned long long)metrics->transitions[bit][1].load(), (unsigned long long)metrics->transitions[bit][0].load());
+	}
+	uint64_t logged = metrics->transitionCount.load(memory_order_acquire);
+	logged = (logged < (uint64_t)MaxTransitionLog) ? logged : MaxTransitionLog;
+	fprintf(out, "},\n\"first_transitions\": [");
+	for (uint64_t idx = 0; idx < logged; idx++) {
+		const StatusTransition_T *entry = &metrics->transitionLog[idx];
+		fprintf(out, "%s{\"sequence\": %u, \"time_ms\": %.3f, \"before\": %u, \"after\": %u}", (idx > 0) ? ", " : "",
+			entry->sequenceNo, entry->timeNs / 1.0e6, entry->before, entry->after);
+	}
+	fprintf(out, "]");
+}
+
+void WriteHistogramLine(const char *name, const LatencyHistogram_T *histogram)
+{
+	if (histogram->count.load() == 0) {
+		return;
+	}
+	printf("  %-10s p50 %8.3f  p99 %8.3f  p99.9 %8.3f  max %8.3f ms\n", name, HistogramPercentile(histogram, 50.0) / 1.0e6,
+		HistogramPercentile(histogram, 99.0) / 1.0e6, HistogramPercentile(histogram, 99.9) / 1.0e6, histogram->max.load() / 1.0e6);
+}
+
+void WriteCycleMetrics(const CycleMetrics_T *metrics)
+{
+	printf("cycle metrics: %llu statuses, %llu sequence gaps (%llu missing), %llu repeated, %llu timestamp gaps, %llu late\n",
+		(unsigned long long)metrics->statuses.load(), (unsigned long long)metrics->sequenceGaps.load(),
+		(unsigned long long)metrics->missingSequences.load(), (unsigned long long)metrics->repeatedSequences.load(),
+		(unsigned long long)metrics->timestampGaps.load(), (unsigned long long)metrics->lateStatuses.load());
+	WriteHistogramLine("reply", &metrics->reply);
+	WriteHistogramLine("round trip", &metrics->roundTrip);
+	WriteHistogramLine("jitter", &metrics->jitter);
+	WriteHistogramLine("wake-up", &metrics->wakeup);
+	for (int bit = 0; bit < StatusBitCount; bit++) {
+		uint64_t set = metrics->transitions[bit][1].load(), cleared = metrics->transitions[bit][0].load();
+		if (set + cleared > 0) {
+			printf("  status %s: set %llu, cleared %llu times\n", StatusBitNames[bit], (unsigned long long)set, (unsigned long long)cleared);
+		}
+	}
+}
+
+// ---------------------------------------------------------------- live
+
+static void LiveReporter(CycleMetrics_T *metrics)
+{
+	struct timespec next;
+	uint64_t lastStatuses = 0, lastGaps = 0, lastLate = 0;
+	int64_t startNs = RtNowNs();
+
+	RtNow(&next);
+	while (!metrics->liveStop.load(memory_order_acquire)) {
+		RtAddNs(&next, LiveIntervalMs * NsPerMs);
+		RtSleepUntil(&next);
+
+		uint64_t statuses = metrics->statuses.load(memory_order_relaxed);
+		uint64_t gaps = metrics->sequenceGaps.load(memory_order_relaxed);
+		uint64_t late = metrics->lateStatuses.load(memory_order_relaxed);
+		fprintf(metrics->liveFile, "{\"t\": %.3f, \"statuses\": %llu, \"new_statuses\": %llu, \"new_sequence_gaps\": %llu, \"new_late_statuses\": %llu, "
+			"\"reply_p99_us\": %.3f, \"reply_max_us\": %.3f, \"jitter_p99_us\": %.3f, \"jitter_max_us\": %.3f, \"status\": %u}\n",
+			(RtNowNs() - startNs) / 1.0e9, (unsigned long long)statuses, (unsigned long long)(statuses - lastStatuses),
+			(unsigned long long)(gaps - lastGaps), (unsigned long long)(late - lastLate),
+			HistogramPercentile(&metrics->reply, 99.0) / 1.0e3, metrics->reply.max.load(memory_order_relaxed) / 1.0e3,
+			HistogramPercentile(&metrics->jitter, 99.0) / 1.0e3, metrics->jitter.max.load(memory_order_relaxed) / 1.0e3,
+			(unsigned)metrics->lastStatus);
+		fflush(metrics->liveFile);
+		lastStatuses = statuses;
+		lastGaps = gaps;
+		lastLate = late;
+	}
+}
+
+bool StartLiveMetrics(CycleMetrics_T *metrics, const char *fileName)
+{
+	if (strcmp(fileName, "-") == 0) {
+		metrics->liveFile = stdout;
+	}
+	else {
+		metrics->liveFile = fopen(fileName, "w");
+		if (metrics->liveFile == NULL) {
+			cout << "Cannot create " << fileName << ": " << strerror(errno) << endl;
+			return false;
+		}
+	}
+	metrics->liveStop.store(false);
+	metrics->live = thread(LiveReporter, metrics);
+	return true;
+}
+
+void StopLiveMetrics(CycleMetrics_T *metrics)
+{
+	metrics->liveStop.store(true, memory_order_release);
+	if (metrics->live.joinable()) {
+		metrics->live.join();
+	}
+	if ((metrics->liveFile != NULL) && (metrics->liveFile != stdout)) {
+		fclose(metrics->liveFile);
+	}
+	metrics->liveFile = NULL;
+}
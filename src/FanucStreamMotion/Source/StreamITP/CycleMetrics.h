@@ -0,0 +1,154 @@
+//
+// CycleMetrics.h : latency, jitter and status bookkeeping of the stream cycle
+//
+// The stream thread hands each cycle's timestamps (status read, command
+// sent, wake-up) and the status packet to the inline Metrics* calls below:
+// a few compares and counter updates, no locks, no allocation. Times go
+// into fixed size log-linear histograms (HDR style: 64 linear steps per
+// power of two, about 1.6 % resolution from 1 ns to 17 s, 7.5 KB each).
+//
+// Every counter has a single writer, the stream thread, and is stored with
+// relaxed atomics so the live reporter thread can read it at any time
+// without tearing; a live snapshot may mix two cycles, the summary at the
+// end of the run is exact.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include "J519Packet.h"
+
+const int HistogramSubBits = 7;                           // 128 linear buckets below 128 ns
+const int HistogramHalf = 1 << (HistogramSubBits - 1);
+const int HistogramBuckets = 30 * HistogramHalf;           // up to 2^35 ns
+const int StatusBitCount = 8;
+const int MaxTransitionLog = 32;
+
+typedef struct LatencyHistogram_T {
+	std::atomic<uint32_t> counts[HistogramBuckets];
+	std::atomic<uint64_t> count;
+	std::atomic<int64_t> sum;
+	std::atomic<int64_t> min;
+	std::atomic<int64_t> max;
+} LatencyHistogram_T;
+
+typedef struct StatusTransition_T {
+	u_word sequenceNo;
+	int64_t timeNs;           // since the first status
+	u_byte before;
+	u_byte after;
+} StatusTransition_T;
+
+typedef struct CycleMetrics_T {
+	long cycleNs;
+	int64_t startNs;          // first status read, CLOCK_MONOTONIC
+	double startUnix;
+
+	LatencyHistogram_T reply;          // status read -> command sent
+	LatencyHistogram_T roundTrip;      // command sent -> next status read
+	LatencyHistogram_T jitter;         // |status interval - cycle|
+	LatencyHistogram_T wakeup;         // late wake-up from the cycle sleep
+
+	// sequence and timestamps of the status packets
+	std::atomic<uint64_t> statuses;
+	std::atomic<uint64_t> sequenceGaps;       // statuses that skipped sequence numbers
+	std::atomic<uint64_t> missingSequences;   // sequence numbers skipped in all
+	std::atomic<uint64_t> repeatedSequences;  // same or older sequence number again
+	std::atomic<uint64_t> timestampGaps;      // controller clock moved by more than 1.5 cycles
+	std::atomic<uint64_t> lateStatuses;       // read more than 1.5 cycles after the previous one
+	std::atomic<uint64_t> transitions[StatusBitCount][2];   // bit went to 0 / to 1
+	std::atomic<uint64_t> transitionCount;
+	StatusTransition_T transitionLog[MaxTransitionLog];
+
+	// stream thread state
+	bool haveStatus;
+	u_word lastSequenceNo;
+	u_word lastTimeStamp;
+	u_byte lastStatus;
+	int64_t lastStatusNs;
+	int64_t lastSendNs;
+
+	// live reporter
+	FILE *liveFile;
+	std::thread live;
+	std::atomic<bool> liveStop;
+} CycleMetrics_T;
+
+void InitCycleMetrics(CycleMetrics_T *metrics, long cycleNs);
+void InitHistogram(LatencyHistogram_T *histogram);
+
+static inline int HistogramIndex(int64_t value)
+{
+	if (value < 2 * HistogramHalf) {
+		return (value < 0) ? 0 : (int)value;
+	}
+	int shift = (63 - __builtin_clzll((uint64_t)value)) - (HistogramSubBits - 1);
+	int idx = shift * HistogramHalf + (int)(value >> shift);
+	return (idx < HistogramBuckets) ? idx : HistogramBuckets - 1;
+}
+
+// single writer: plain load + store, no locked instruction
+template <typename T>
+static inline void Bump(std::atomic<T> *counter, T amount = 1)
+{
+	counter->store(counter->load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+static inline void HistogramRecord(LatencyHistogram_T *histogram, int64_t valueNs)
+{
+	Bump(&histogram->counts[HistogramIndex(valueNs)], 1u);
+	Bump(&histogram->count, (uint64_t)1);
+	Bump(&histogram->sum, valueNs);
+	if (valueNs < histogram->min.load(std::memory_order_relaxed)) {
+		histogram->min.store(valueNs, std::memory_order_relaxed);
+	}
+	if (valueNs > histogram->max.load(std::memory_order_relaxed)) {
+		histogram->max.store(valueNs, std::memory_order_relaxed);
+	}
+}
+
+// upper edge of the bucket holding the given percentile (0-100), 0 if empty
+int64_t HistogramPercentile(const LatencyHistogram_T *histogram, double percentile);
+
+/*
+ * MetricsStatus: a status packet (network order) was read at nowNs
+ */
+void MetricsStatus(CycleMetrics_T *metrics, const RobotStatusPacket_T *status, int64_t nowNs);
+
+// the command answering the last status went out at nowNs
+static inline void MetricsSend(CycleMetrics_T *metrics, int64_t nowNs)
+{
+	if (metrics->haveStatus) {
+		HistogramRecord(&metrics->reply, nowNs - metrics->lastStatusNs);
+	}
+	metrics->lastSendNs = nowNs;
+}
+
+static inline void MetricsWakeup(CycleMetrics_T *metrics, int64_t lateNs)
+{
+	HistogramRecord(&metrics->wakeup, (lateNs > 0) ? lateNs : 0);
+}
+
+/*
+ * StartLiveMetrics: one JSON line per second to the file (stdout if "-")
+ *                   from a reporter thread. On error prints the reason and
+ *                   returns false.
+ */
+bool StartLiveMetrics(CycleMetrics_T *metrics, const char *fileName);
+void StopLiveMetrics(CycleMetrics_T *metrics);
+
+// human readable summary
+void WriteCycleMetrics(const CycleMetrics_T *metrics);
+
+// p50, p99, p99.9 and max of a histogram in ms on one line, nothing if empty
+void WriteHistogramLine(const char *name, const LatencyHistogram_T *histogram);
+
+/*
+ * WriteMetricsJson: the metrics as JSON object members ("name": value, ...),
+ *                   for the caller to put inside its own object
+ */
+void WriteMetricsJson(FILE *out, const CycleMetrics_T *metrics);
@@ -0,0 +1,574 @@
+//
+// DryRun.cpp : a library of trajectory files through the streaming code
+//              against the simulated controller, faster than real time
+//
+
+#include "stdafx.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include "DryRun.h"
+#include "StreamEngine.h"
+#include "CommandEncoder.h"
+#include "TrajectoryFile.h"
+#include "WaypointPath.h"
+
+using namespace std;
+
+const int DryRunReadyCycles = 100;         // statuses without the ready bit before the file is given up
+const int DryRunSocketBuffer = 256 * 1024;
+
+
+bool LoadDryRunFile(const char *fileName, vector<DryRunJob_T> *jobs)
+{
+	ifstream file(fileName);
+	string line;
+	int lineNo = 0;
+
+	jobs->clear();
+	if (!file) {
+		cout << "Cannot open run file: " << fileName << endl;
+		return false;
+	}
+	string dir(fileName);
+	size_t slash = dir.find_last_of('/');
+	dir = (slash != string::npos) ? dir.substr(0, slash + 1) : "";
+
+	while (getline(file, line)) {
+		lineNo++;
+		size_t hash = line.find('#');
+		if (hash != string::npos) {
+			line.erase(hash);
+		}
+		istringstream fields(line);
+		string dataFile, option;
+		if (!(fields >> dataFile)) {
+			continue;
+		}
+		DryRunJob_T job;
+		job.dataFile = (dataFile[0] == '/') ? dataFile : dir + dataFile;
+		job.representation = -1;
+		job.packetStack = 0;
+		job.ignoreLimits = false;
+		job.waypoints = false;
+		memset(job.waypointLimit, 0, sizeof(job.waypointLimit));
+
+		while (fields >> option) {
+			if (strcasecmp(option.c_str(), "joint") == 0) {
+				job.representation = 1;
+			}
+			else if (strcasecmp(option.c_str(), "cartesian") == 0) {
+				job.representation = 0;
+			}
+			else if ((option.find_first_not_of("0123456789") == string::npos) && (atoi(option.c_str()) <= 9)) {
+				job.packetStack = atoi(option.c_str());
+			}
+			else if (strcasecmp(option.c_str(), "ignorelimits") == 0) {
+				job.ignoreLimits = true;
+			}
+			else if (strcasecmp(option.c_str(), "waypoints") == 0) {
+				job.waypoints = true;
+			}
+			else if (job.waypoints && (option.find(',') != string::npos)) {
+				if ((sscanf(option.c_str(), "%lf,%lf,%lf", &job.waypointLimit[ThresholdVelocity], &job.waypointLimit[ThresholdAcceleration],
+					&job.waypointLimit[ThresholdJerk]) != 3) || (job.waypointLimit[ThresholdVelocity] <= 0.0)
+					|| (job.waypointLimit[ThresholdAcceleration] <= 0.0) || (job.waypointLimit[ThresholdJerk] <= 0.0)) {
+					cout << fileName << ":" << lineNo << ": Waypoints takes velocity,acceleration,jerk, all above 0, not " << option << endl;
+					return false;
+				}
+			}
+			else {
+				cout << fileName << ":" << lineNo << ": expected Joint, Cartesian, a packet stack of 0-9, IgnoreLimits or Waypoints [V,A,J], not "
+				     << option << endl;
+				return false;
+			}
+		}
+		jobs->push_back(job);
+	}
+	if (jobs->empty()) {
+		cout << fileName << ": no data files" << endl;
+		return false;
+	}
+	return true;
+}
+
+void DryRunDefaultConfig(DryRunConfig_T *config)
+{
+	memset(config, 0, sizeof(*config));
+	config->cycleNs = DefaultCycleNs;
+	IoDefaultConfig(&config->io);
+	SimDefaultConfig(&config->sim);
+	config->sim.cycleNs = config->cycleNs;
+	SimThresholds(&config->sim, &config->thresholds);
+	config->threadCount = 0;
+	config->reportDir = NULL;
+}
+
+void SimThresholds(const SimConfig_T *simConfig, ThresholdSet_T *thresholds)
+{
+	SimController_T *sim = new SimController_T;
+
+	SimInit(sim, simConfig);
+	InitThresholdSet(thresholds);
+	for (int axis = 0; axis < MaxAxisNumber; axis++) {
+		for (int type = 0; type < ThresholdTypeCount; type++) {
+			ThresholdPacket_T request;
+			InitThresholdPacket(&request, axis + 1, type);
+			if (SimReceive(sim, &request, sizeof(request), 0, &thresholds->packet[axis][type], sizeof(RobotThresholdPacket_T)) > 0) {
+				thresholds->have[axis][type] = true;
+			}
+		}
+	}
+	delete sim;
+}
+
+static void Fail(DryRunResult_T *result, const char *reason)
+{
+	if (result->passed) {
+		result->passed = false;
+		snprintf(result->reason, sizeof(result->reason), "%s", reason);
+	}
+}
+
+/*
+ * DeliverCommands: every datagram the engine sent since the last call, to
+ *                  the controller as arrived at nowNs (or lost)
+ */
+static void DeliverCommands(SimController_T *sim, int socketID, int64_t nowNs)
+{
+	CommandPacket_T packet;
+	RobotThresholdPacket_T reply;
+	ssize_t size;
+
+	while ((size = recv(socketID, (char *)&packet, sizeof(packet), MSG_DONTWAIT)) > 0) {
+		if ((sim->config.lossRate > 0.0) && SimDrop(sim)) {
+			sim->stats.dropped++;
+			continue;
+		}
+		SimReceive(sim, &packet, (int)size, nowNs, &reply, sizeof(reply));
+	}
+}
+
+/*
+ * NextStatus: tick the controller to the next status that is not lost and
+ *             hand it to the engine's socket. false if the controller
+ *             stopped.
+ */
+static bool NextStatus(SimController_T *sim, int socketID, int64_t *simNs, DryRunResult_T *result)
+{
+	RobotStatusPacket_T status;
+
+	while (true) {
+		*simNs += sim->config.cycleNs;
+		if (!SimTick(sim, *simNs, &status)) {
+			return false;
+		}
+		if ((sim->config.lossRate > 0.0) && SimDrop(sim)) {
+			sim->stats.dropped++;
+			result->statusesDropped++;
+			continue;
+		}
+		return send(socketID, (const char *)&status, sizeof(status), 0) == (ssize_t)sizeof(status);
+	}
+}
+
+/*
+ * CheckExecuted: after a tick, the pose the controller just executed
+ *                against the file's sample of that cycle
+ */
+static void CheckExecuted(const SimController_T *sim, const Trajectory_T *trajectory, int representation, unsigned long *executed,
+	DryRunResult_T *result)
+{
+	if (sim->stats.commandsExecuted == *executed) {
+		return;
+	}
+	// several cycles when statuses were lost: the newest one
+	*executed = sim->stats.commandsExecuted;
+	size_t sampleIdx = *executed - 1;
+	const float *pose = (representation == 1) ? sim->joint : sim->position;
+	bool same = (sampleIdx < trajectory->sampleCount);
+	for (int idx = 0; same && (idx < MaxAxisNumber); idx++) {
+		same = (pose[idx] == trajectory->samples[sampleIdx].data[idx]);
+	}
+	if (!same) {
+		if (result->poseMismatches == 0) {
+			result->firstMismatch = sampleIdx;
+		}
+		result->poseMismatches++;
+	}
+}
+
+/*
+ * StreamDryRun: the session against the controller on the virtual clock,
+ *               the loop of StreamMotion with the waits taken out
+ */
+static void StreamDryRun(StreamSession_T *session, SimController_T *sim, int engineSocket, int simSocket, const Trajectory_T *trajectory,
+	DryRunResult_T *result)
+{
+	long cycleNs = session->rt.cycleNs;
+	int64_t simNs = 0;
+	unsigned long executed = 0;
+	bool waited;
+	struct timespec now, giveUp;
+	StaleStatusSink_T stale = StaleSink(session);
+
+	// the start packet, as StreamITP sends it before the thresholds
+	StartPacket_T startPacket;
+	InitStartPacket(&startPacket);
+	send(engineSocket, (const char *)&startPacket, sizeof(startPacket), 0);
+	DeliverCommands(sim, simSocket, simNs);
+
+	int readyCycles = 0;
+	while (true) {
+		if (!NextStatus(sim, simSocket, &simNs, result) || (readyCycles++ > DryRunReadyCycles)) {
+			Fail(result, "controller never ready");
+			session->doDataExchange = false;
+			EndMotion(session);
+			return;
+		}
+		RtNow(&giveUp);
+		RtAddNs(&giveUp, session->io.statusTimeoutNs);
+		if ((ReceiveStatusPacket(engineSocket, &session->io, &giveUp, &session->statusPacket, &waited, &stale) > 0)
+			&& ReadyStatus(session)) {
+			break;
+		}
+	}
+	RtNow(&now);
+	BeginMotion(session, &now);
+	int64_t motionStartNs = simNs;
+
+	unsigned long drainCycles = 0;
+	while (!MotionDone(session)) {
+		struct timespec wakeup;
+		SendCommands(session, &wakeup);
+		if (MotionDone(session)) {
+			break;
+		}
+		DeliverCommands(sim, simSocket, simNs + SimDelayNs(sim));
+
+		// the controller had its time to execute the last command
+		if (session->lastSent && ((int64_t)++drainCycles * cycleNs > session->io.drainTimeoutNs)) {
+			Fail(result, "last command not acknowledged");
+			session->doDataExchange = false;
+			break;
+		}
+		if (!NextStatus(sim, simSocket, &simNs, result)) {
+			Fail(result, "controller stopped sending statuses");
+			session->doDataExchange = false;
+			break;
+		}
+		CheckExecuted(sim, trajectory, session->representation, &executed, result);
+
+		RtNow(&giveUp);
+		RtAddNs(&giveUp, session->io.statusTimeoutNs);
+		if (ReceiveStatusPacket(engineSocket, &session->io, &giveUp, &session->statusPacket, &waited, &stale) <= 0) {
+			Fail(result, "no status from the controller");
+			session->doDataExchange = false;
+			break;
+		}
+		HandleStatus(session, true);
+	}
+	EndMotion(session);
+	DeliverCommands(sim, simSocket, simNs);
+	result->motionNs = simNs - motionStartNs;
+}
+
+/*
+ * SampleWaypoints: plan the path through the waypoints of the file as
+ *                  --waypoints does and put all of its samples in place of
+ *                  them, so the rest of the run sees a sample file
+ */
+static bool SampleWaypoints(const DryRunJob_T *job, const AxisLimits_T axisLimits[MaxAxisNumber], long cycleNs, Trajectory_T *trajectory)
+{
+	WaypointLimits_T limits;
+	WaypointPath_T path;
+
+	InitWaypointLimits(&limits, job->waypointLimit[ThresholdVelocity], job->waypointLimit[ThresholdAcceleration],
+		job->waypointLimit[ThresholdJerk]);
+	CapWaypointLimits(&limits, axisLimits, WaypointThresholdScale);
+	if (!PlanWaypointPath(&path, trajectory->samples, trajectory->sampleCount, trajectory->axisCount, &limits, cycleNs)) {
+		return false;
+	}
+	vector<PositionData_T> samples(path.sampleCount);
+	size_t count = 0;
+	int read;
+	while ((read = ReadWaypointSamples(&path, samples.data() + count, (int)(samples.size() - count))) > 0) {
+		count += read;
+	}
+	samples.resize(count);
+	int axisCount = trajectory->axisCount;
+	int representation = trajectory->representation;
+	FreeTrajectory(trajectory);
+	trajectory->axisCount = axisCount;
+	trajectory->representation = representation;
+	trajectory->positions.swap(samples);
+	trajectory->samples = trajectory->positions.data();
+	trajectory->sampleCount = trajectory->positions.size();
+	return true;
+}
+
+bool RunDryRun(const DryRunJob_T *job, const DryRunConfig_T *config, DryRunResult_T *result)
+{
+	Trajectory_T trajectory;
+	EncodedTrajectory_T encoded;
+	struct timespec start, end;
+
+	RtNow(&start);
+	memset(result, 0, sizeof(*result));
+	result->passed = true;
+	InitTrajectory(&trajectory);
+	InitEncodedTrajectory(&encoded);
+
+	if (!LoadTrajectoryFile(job->dataFile.c_str(), &trajectory)) {
+		Fail(result, "cannot load the data file");
+		return false;
+	}
+	result->sampleCount = trajectory.sampleCount;
+	u_byte representation = (job->representation == 0) ? 0 : 1;
+	if (trajectory.representation != RepresentationUnknown) {
+		if ((job->representation >= 0) && (trajectory.representation != job->representation)) {
+			Fail(result, "data representation does not match the binary data file");
+			FreeTrajectory(&trajectory);
+			return false;
+		}
+		representation = (u_byte)trajectory.representation;
+	}
+	result->representation = representation;
+
+	AxisLimits_T axisLimits[MaxAxisNumber];
+	InitAxisLimits(axisLimits);
+	if (representation == 1) {
+		SetThresholdLimits(&config->thresholds, axisLimits, config->fullPayload);
+	}
+	if (job->waypoints) {
+		result->waypointCount = trajectory.sampleCount;
+		if (!SampleWaypoints(job, axisLimits, config->cycleNs, &trajectory)) {
+			Fail(result, "cannot plan the waypoint path");
+			FreeTrajectory(&trajectory);
+			return false;
+		}
+		result->sampleCount = trajectory.sampleCount;
+	}
+
+	// the whole path before the first command, as a real run
+	if (representation == 1) {
+		result->limitsChecked = true;
+		result->withinLimits = CheckTrajectoryLimits(trajectory.samples, trajectory.sampleCount, config->cycleNs, axisLimits, &result->limits);
+		result->limitsIgnored = !result->withinLimits && (config->ignoreLimits || job->ignoreLimits);
+		if (!result->withinLimits && !result->limitsIgnored) {
+			Fail(result, "over the thresholds");
+			FreeTrajectory(&trajectory);
+			RtNow(&end);
+			result->wallNs = RtDiffNs(&end, &start);
+			return false;
+		}
+	}
+	if (!EncodeTrajectory(&encoded, trajectory.samples, trajectory.sampleCount, representation)) {
+		Fail(result, "cannot encode the trajectory");
+		FreeTrajectory(&trajectory);
+		return false;
+	}
+
+	int sockets[2];
+	if (socketpair(AF_UNIX, SOCK_DGRAM, 0, sockets) != 0) {
+		Fail(result, "cannot create the socket pair");
+		FreeTrajectory(&trajectory);
+		FreeEncodedTrajectory(&encoded);
+		return false;
+	}
+	for (int idx = 0; idx < 2; idx++) {
+		setsockopt(sockets[idx], SOL_SOCKET, SO_SNDBUF, &DryRunSocketBuffer, sizeof(DryRunSocketBuffer));
+		setsockopt(sockets[idx], SOL_SOCKET, SO_RCVBUF, &DryRunSocketBuffer, sizeof(DryRunSocketBuffer));
+	}
+
+	SimConfig_T simConfig = config->sim;
+	simConfig.cycleNs = config->cycleNs;
+	SimController_T *sim = new SimController_T;
+	SimInit(sim, &simConfig);
+
+	StreamSession_T *session = new StreamSession_T;
+	CycleMetrics_T *metrics = new CycleMetrics_T;
+	InitStreamSession(session);
+	InitCycleMetrics(metrics, config->cycleNs);
+	session->socketID = sockets[0];
+	session->rt.cycleNs = config->cycleNs;
+	session->io = config->io;
+	session->io.mode = IoWait;
+	session->packets = encoded.packets;
+	session->packetCount = encoded.count;
+	session->representation = representation;
+	session->packetStack = job->packetStack;
+	session->metrics = metrics;
+
+	result->streamed = true;
+	StreamDryRun(session, sim, sockets[0], sockets[1], &trajectory, result);
+
+	result->completed = session->doDataExchange;
+	result->lastDataExecuted = sim->finished;
+	result->firstSeq = session->firstSeq;
+	result->lastSeq = session->lastSeq;
+	result->sim = sim->stats;
+	result->cycles = session->stats.cycles;
+	result->minBuffered = session->stats.minBuffered;
+	result->replyP50Ns = HistogramPercentile(&metrics->reply, 50.0);
+	result->replyP99Ns = HistogramPercentile(&metrics->reply, 99.0);
+	result->replyMaxNs = metrics->reply.max.load();
+
+	// what the controller saw, in the order the checks matter
+	if (!result->completed) {
+		Fail(result, sim->error ? "controller error" : "motion not completed");
+	}
+	if (!result->lastDataExecuted) {
+		Fail(result, "lastData not executed");
+	}
+	if (result->sim.commandsExecuted != trajectory.sampleCount) {
+		Fail(result, "executed commands do not match the samples");
+	}
+	if (result->poseMismatches > 0) {
+		Fail(result, "executed pose differs from the file");
+	}
+	if ((result->sim.lateCommands > 0) || (result->sim.duplicates > 0) || (result->sim.overflows > 0) || (result->sim.underruns > 0)) {
+		Fail(result, "controller saw late, duplicated, overflowing or missing commands");
+	}
+
+	close(sockets[0]);
+	close(sockets[1]);
+	delete metrics;
+	delete session;
+	delete sim;
+	FreeTrajectory(&trajectory);
+	FreeEncodedTrajectory(&encoded);
+	RtNow(&end);
+	result->wallNs = RtDiffNs(&end, &start);
+	return result->passed;
+}
+
+static string ReportName(const char *reportDir, size_t jobIdx, const DryRunJob_T *job)
+{
+	string base(job->dataFile);
+	size_t slash = base.find_last_of('/');
+	if (slash != string::npos) {
+		base = base.substr(slash + 1);
+	}
+	char prefix[32];
+	snprintf(prefix, sizeof(prefix), "%03zu_", jobIdx + 1);
+	return string(reportDir) + "/" + prefix + base + ".json";
+}
+
+bool RunDryRuns(const vector<DryRunJob_T> &jobs, const DryRunConfig_T *config, vector<DryRunResult_T> *results)
+{
+	int threadCount = (config->threadCount > 0) ? config->threadCount : (int)thread::hardware_concurrency();
+	atomic<size_t> nextJob(0);
+	atomic<bool> allPassed(true);
+
+	results->assign(jobs.size(), DryRunResult_T());
+	threadCount = (threadCount < 1) ? 1 : (threadCount > (int)jobs.size()) ? (int)jobs.size() : threadCount;
+
+	auto worker = [&]() {
+		size_t jobIdx;
+		while ((jobIdx = nextJob.fetch_add(1)) < jobs.size()) {
+			DryRunResult_T *result = &(*results)[jobIdx];
+			if (!RunDryRun(&jobs[jobIdx], config, result)) {
+				allPassed = false;
+			}
+			if (config->reportDir != NULL) {
+				SaveDryRunReport(ReportName(config->reportDir, jobIdx, &jobs[jobIdx]).c_str(), &jobs[jobIdx], result, config->cycleNs);
+			}
+		}
+	};
+	vector<thread> workers;
+	for (int idx = 1; idx < threadCount; idx++) {
+		workers.push_back(thread(worker));
+	}
+	worker();
+	for (size_t idx = 0; idx < workers.size(); idx++) {
+		workers[idx].join();
+	}
+	return allPassed;
+}
+
+static void WriteViolationJson(FILE *out, const char *name, const LimitViolation_T *violation)
+{
+	if (!violation->found) {
+		fprintf(out, "\"%s\": null", name);
+		return;
+	}
+	fprintf(out, "\"%s\": {\"sample\": %zu, \"axis\": %d, \"type\": %d, \"value\": %.6g, \"limit\": %.6g, \"margin\": %.6g}", name,
+		violation->sampleIdx, violation->axis, violation->thresholdType, violation->value, violation->limit, violation->margin);
+}
+
+bool SaveDryRunReport(const char *fileName, const DryRunJob_T *job, const DryRunResult_T *result, long cycleNs)
+{
+	FILE *out = fopen(fileName, "w");
+
+	if (out == NULL) {
+		cout << "Cannot create " << fileName << ": " << strerror(errno) << endl;
+		return false;
+	}
+	fprintf(out, "{\"file\": \"%s\", \"passed\": %s, \"reason\": \"%s\",\n", job->dataFile.c_str(), result->passed ? "true" : "false",
+		result->passed ? "" : result->reason);
+	fprintf(out, "\"samples\": %zu, \"waypoints\": %zu, \"representation\": \"%s\", \"packet_stack\": %d, \"cycle_ms\": %.3f,\n",
+		result->sampleCount, result->waypointCount, (result->representation == 1) ? "joint" : "cartesian", job->packetStack, cycleNs / 1.0e6);
+
+	fprintf(out, "\"limits\": {\"checked\": %s, \"within\": %s, \"ignored\": %s, \"violations\": %lu, ", result->limitsChecked ? "true" : "false",
+		result->withinLimits ? "true" : "false", result->limitsIgnored ? "true" : "false", result->limits.totalViolations);
+	WriteViolationJson(out, "first", &result->limits.first);
+	fprintf(out, ", ");
+	WriteViolationJson(out, "worst", &result->limits.worst);
+	fprintf(out, "},\n");
+
+	fprintf(out, "\"streamed\": %s, \"completed\": %s, \"last_data_executed\": %s, \"first_sequence\": %u, \"last_data_sequence\": %u,\n",
+		result->streamed ? "true" : "false", result->completed ? "true" : "false", result->lastDataExecuted ? "true" : "false",
+		result->firstSeq, result->lastSeq);
+	fprintf(out, "\"pose_mismatches\": %lu, \"first_mismatch\": %zd,\n", result->poseMismatches,
+		(result->poseMismatches > 0) ? (ssize_t)result->firstMismatch : (ssize_t)-1);
+	fprintf(out, "\"controller\": {\"statuses\": %lu, \"received\": %lu, \"executed\": %lu, \"duplicates\": %lu, \"late\": %lu,"
+		" \"overflows\": %lu, \"underruns\": %lu, \"dropped\": %lu, \"statuses_dropped\": %lu},\n", result->sim.statusSent,
+		result->sim.commandsReceived, result->sim.commandsExecuted, result->sim.duplicates, result->sim.lateCommands, result->sim.overflows,
+		result->sim.underruns, result->sim.dropped, result->statusesDropped);
+	fprintf(out, "\"cycles\": %lu, \"min_buffered\": %d, \"reply_p50_us\": %.3f, \"reply_p99_us\": %.3f, \"reply_max_us\": %.3f,\n",
+		result->cycles, result->minBuffered, result->replyP50Ns / 1.0e3, result->replyP99Ns / 1.0e3, result->replyMaxNs / 1.0e3);
+	fprintf(out, "\"motion_s\": %.3f, \"wall_ms\": %.3f}\n", result->motionNs / 1.0e9, result->wallNs / 1.0e6);
+	if (fclose(out) != 0) {
+		cout << "Cannot write " << fileName << endl;
+		return false;
+	}
+	return true;
+}
+
+void WriteDryRunSummary(const vector<DryRunJob_T> &jobs, const vector<DryRunResult_T> &results, int64_t wallNs)
+{
+	int passed = 0;
+	int64_t motionNs = 0;
+
+	for (size_t idx = 0; idx < jobs.size(); idx++) {
+		const DryRunResult_T *result = &results[idx];
+		printf("%s %s: %zu samples", result->passed ? "  ok  " : "  FAIL", jobs[idx].dataFile.c_str(), result->sampleCount);
+		if (result->waypointCount > 0) {
+			printf(" from %zu waypoints", result->waypointCount);
+		}
+		printf(", %s, stack %d", (result->representation == 1) ? "Joint" : "Cartesian", jobs[idx].packetStack);
+		if (result->streamed) {
+			printf(", %.1f s motion in %.1f ms, reply p99 %.1f us", result->motionNs / 1.0e9, result->wallNs / 1.0e6, result->replyP99Ns / 1.0e3);
+		}
+		if (result->limitsIgnored) {
+			printf(", over the thresholds (ignored)");
+		}
+		if (!result->passed) {
+			printf(" -- %s", result->reason);
+		}
+		printf("\n");
+		passed += result->passed ? 1 : 0;
+		motionNs += result->motionNs;
+	}
+	printf("dry run: %d of %zu files passed, %.1f s of motion in %.1f ms\n", passed, jobs.size(), motionNs / 1.0e9, wallNs / 1.0e6);
+}
@@ -0,0 +1,124 @@
+//
+// DryRun.h : a library of trajectory files through the streaming code
+//            against the simulated controller, faster than real time
+//
+// Each file goes the way a real run takes it: loaded, a waypoint file
+// planned and sampled as --waypoints does, checked against the threshold
+// tables (joint data), encoded, then streamed by the engine's
+// cycle steps (ReadyStatus .. EndMotion, as CellStream drives them) to a
+// SimController in the same process. The two ends talk over a socketpair,
+// so the commands leave through the engine's own send and the statuses come
+// in through ReceiveStatusPacket. The controller's clock is virtual: the
+// next status is made as soon as the last one was answered, a command
+// arrives the simulated latency after its status, and nothing sleeps: a
+// 15 000 sample file (two minutes of robot time) streams in about 60 ms.
+//
+// Files are run on a pool of worker threads, one session each. The result
+// of a file is checked, not only printed:
+//   - the engine completed, the controller executed the lastData command
+//     and reported no error
+//   - every sample was executed once, in order, as encoded: the pose the
+//     controller executed each cycle is compared with the file's sample
+//   - no late, duplicated, overflowing or missing (underrun) command
+//   - the path is within the thresholds: a path over them is not streamed,
+//     as in a real run; with ignoreLimits it is, and only reported
+// Timing in a dry run: the reply times (status read -> command sent) are
+// the engine's real CPU time; deadlines, wake-ups and jitter are not, since
+// nothing waits for the clock.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "J519Packet.h"
+#include "LimitCheck.h"
+#include "ThresholdFetch.h"
+#include "SimController.h"
+#include "SocketIo.h"
+
+const int DryRunReasonSize = 128;
+
+// one line of the run file
+typedef struct DryRunJob_T {
+	std::string dataFile;         // relative to the run file
+	int representation;           // -1 if not given: from the data file, else joint
+	int packetStack;
+	bool ignoreLimits;            // IgnoreLimits on the line: over the thresholds is reported, not failed
+	bool waypoints;               // Waypoints on the line: the data file holds waypoints
+	double waypointLimit[ThresholdTypeCount];   // V,A,J on the line (as --waypoint-limits), 0 = from the thresholds
+} DryRunJob_T;
+
+typedef struct DryRunConfig_T {
+	long cycleNs;
+	IoConfig_T io;                // batch is used; statuses are always waited for (IoWait)
+	SimConfig_T sim;              // latency, jitter, loss and buffer of the controller
+	ThresholdSet_T thresholds;    // tables the joint paths are checked against
+	bool fullPayload;
+	bool ignoreLimits;
+	int threadCount;              // 0 = one per CPU
+	const char *reportDir;        // a JSON report per file here, NULL for none
+} DryRunConfig_T;
+
+typedef struct DryRunResult_T {
+	bool passed;
+	char reason[DryRunReasonSize];   // the first check that failed
+	size_t sampleCount;
+	size_t waypointCount;         // waypoints of the file, 0 if it holds samples
+	int representation;
+	bool limitsChecked;
+	bool withinLimits;
+	bool limitsIgnored;           // over the thresholds but streamed (--ignore-limits or the line's IgnoreLimits)
+	LimitReport_T limits;
+	bool streamed;
+	bool completed;               // the engine's view: no error, lastData acknowledged
+	bool lastDataExecuted;        // the controller's view
+	u_word firstSeq;
+	u_word lastSeq;
+	unsigned long poseMismatches; // executed pose != the file's sample
+	size_t firstMismatch;         // sample index
+	SimStats_T sim;
+	unsigned long cycles;         // statuses answered
+	unsigned long statusesDropped;   // lost on purpose (sim loss rate)
+	int minBuffered;
+	int64_t replyP50Ns;
+	int64_t replyP99Ns;
+	int64_t replyMaxNs;
+	int64_t motionNs;             // robot time of the motion, virtual clock
+	int64_t wallNs;               // load to report
+} DryRunResult_T;
+
+/*
+ * LoadDryRunFile: one data file per line, "datafile [Joint|Cartesian]
+ *                 [packet stack] [IgnoreLimits] [Waypoints [V,A,J]]", #
+ *                 starts a comment. On error prints "file:line: reason"
+ *                 and returns false.
+ */
+bool LoadDryRunFile(const char *fileName, std::vector<DryRunJob_T> *jobs);
+
+void DryRunDefaultConfig(DryRunConfig_T *config);
+
+// the threshold tables the simulated controller answers with
+void SimThresholds(const SimConfig_T *simConfig, ThresholdSet_T *thresholds);
+
+/*
+ * RunDryRun: one file, on the calling thread. Returns result->passed.
+ */
+bool RunDryRun(const DryRunJob_T *job, const DryRunConfig_T *config, DryRunResult_T *result);
+
+/*
+ * RunDryRuns: every job on config->threadCount workers, results in job
+ *             order. True if all passed.
+ */
+bool RunDryRuns(const std::vector<DryRunJob_T> &jobs, const DryRunConfig_T *config, std::vector<DryRunResult_T> *results);
+
+/*
+ * SaveDryRunReport: the result of one file as a JSON object. On error
+ *                   prints the reason and returns false.
+ */
+bool SaveDryRunReport(const char *fileName, const DryRunJob_T *job, const DryRunResult_T *result, long cycleNs);
+
+// one line per file and the totals
+void WriteDryRunSummary(const std::vector<DryRunJob_T> &jobs, const std::vector<DryRunResult_T> &results, int64_t wallNs);
@@ -0,0 +1,698 @@
+//
+// Dynamics.cpp : joint torques and motor currents of the robot model's chain
+//                (recursive Newton-Euler)
+//
+
+#include "stdafx.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Dynamics.h"
+#include "LaneMath.h"
+#include "RtUtil.h"
+
+using namespace std;
+
+const double DegToRad = M_PI / 180.0;
+const size_t SamplesPerThread = 16384;      // below this a batch is not split
+
+// placeholders of the right size for an arm of the M-20iD/25 class, N m per A at the joint
+static const double DefaultTorquePerAmp[MaxAxisNumber] = { 80.0, 100.0, 60.0, 12.0, 12.0, 6.0, 20.0, 20.0, 20.0 };
+static const double DefaultCoulombAmps = 0.3;
+static const double DefaultViscousAmps = 0.002;    // per deg/s
+
+bool ParsePayload(const char *text, Payload_T *payload)
+{
+	memset(payload, 0, sizeof(*payload));
+	int fields = sscanf(text, "%lf,%lf,%lf,%lf", &payload->mass, &payload->com[0], &payload->com[1], &payload->com[2]);
+	return ((fields == 1) || (fields == 4)) && (payload->mass >= 0.0);
+}
+
+// ---------------------------------------------------------------- model
+
+// out = a * b * a^T, 3x3 row major
+static void RotateTensor(const double a[9], const double b[9], double out[9])
+{
+	double ab[9];
+	for (int row = 0; row < 3; row++) {
+		for (int col = 0; col < 3; col++) {
+			ab[row * 3 + col] = a[row * 3] * b[col] + a[row * 3 + 1] * b[3 + col] + a[row * 3 + 2] * b[6 + col];
+		}
+	}
+	for (int row = 0; row < 3; row++) {
+		for (int col = 0; col < 3; col++) {
+			out[row * 3 + col] = ab[row * 3] * a[col * 3] + ab[row * 3 + 1] * a[col * 3 + 1] + ab[row * 3 + 2] * a[col * 3 + 2];
+		}
+	}
+}
+
+// rotation and translation (mm -> m) of a 3x4 transform applied to a point
+static void TransformPoint(const double m[12], const double in[3], double scale, double out[3])
+{
+	for (int row = 0; row < 3; row++) {
+		out[row] = m[row * 4] * in[0] + m[row * 4 + 1] * in[1] + m[row * 4 + 2] * in[2] + m[row * 4 + 3] * scale;
+	}
+}
+
+// inertia of a point mass at d from the reference point, added to tensor
+static void AddPointInertia(double tensor[9], double mass, const double d[3])
+{
+	double squared = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+	for (int row = 0; row < 3; row++) {
+		for (int col = 0; col < 3; col++) {
+			tensor[row * 3 + col] += mass * (((row == col) ? squared : 0.0) - d[row] * d[col]);
+		}
+	}
+}
+
+bool BuildDynamicsModel(const RobotModel_T *model, const KinematicChain_T *chain, const Payload_T *payload, DynamicsModel_T *dyn)
+{
+	double totalMass = 0.0;
+
+	memset(dyn, 0, sizeof(*dyn));
+	dyn->axisCount = chain->axisCount;
+	dyn->j23Coupled = chain->j23Coupled;
+	dyn->gravity[2] = -StandardGravity;
+	for (int idx = 0; idx < chain->axisCount; idx++) {
+		const ModelLink_T *link = ChainLink(model, idx + 1);
+		DynamicsLink_T *out = &dyn->links[idx];
+		const double *frame = chain->frame[idx];
+		const double *linkFrame = chain->linkFrame[idx];
+
+		for (int row = 0; row < 3; row++) {
+			out->rotation[row * 3] = frame[row * 4];
+			out->rotation[row * 3 + 1] = frame[row * 4 + 1];
+			out->rotation[row * 3 + 2] = frame[row * 4 + 2];
+			out->origin[row] = frame[row * 4 + 3] / 1000.0;
+		}
+		dyn->effort[idx] = model->joints[model->chain[idx]].effort;
+
+		// the link's inertial is given in its own frame, the joint frame turns with it
+		double tensor[9] = { link->inertia[0], link->inertia[1], link->inertia[2],
+		                     link->inertia[1], link->inertia[3], link->inertia[4],
+		                     link->inertia[2], link->inertia[4], link->inertia[5] };
+		double linkRotation[9];
+		for (int row = 0; row < 3; row++) {
+			for (int col = 0; col < 3; col++) {
+				linkRotation[row * 3 + col] = linkFrame[row * 4 + col];
+			}
+		}
+		out->mass = link->mass;
+		TransformPoint(linkFrame, link->com, 1.0 / 1000.0, out->com);
+		RotateTensor(linkRotation, tensor, out->inertia);
+		totalMass += link->mass;
+	}
+	if (totalMass <= 0.0) {
+		cout << model->fileName << ": the links of the chain have no mass, no dynamics" << endl;
+		return false;
+	}
+
+	// payload: point mass on the faceplate, merged into the last link about their common com
+	if ((payload != NULL) && (payload->mass > 0.0) && (chain->axisCount > 0)) {
+		DynamicsLink_T *last = &dyn->links[chain->axisCount - 1];
+		double at[3], comMm[3] = { payload->com[0], payload->com[1], payload->com[2] };
+		TransformPoint(chain->tool, comMm, 1.0, at);
+		for (int idx = 0; idx < 3; idx++) {
+			at[idx] /= 1000.0;
+		}
+		double mass = last->mass + payload->mass;
+		double com[3], linkOffset[3], payloadOffset[3];
+		for (int idx = 0; idx < 3; idx++) {
+			com[idx] = (last->mass * last->com[idx] + payload->mass * at[idx]) / mass;
+			linkOffset[idx] = last->com[idx] - com[idx];
+			payloadOffset[idx] = at[idx] - com[idx];
+		}
+		AddPointInertia(last->inertia, last->mass, linkOffset);
+		AddPointInertia(last->inertia, payload->mass, payloadOffset);
+		last->mass = mass;
+		memcpy(last->com, com, sizeof(com));
+	}
+	return true;
+}
+
+// ---------------------------------------------------------------- Newton-Euler
+
+// the same code runs on double (one sample) and on four float lanes
+#ifdef __SSE2__
+typedef struct Lane4_T {
+	__m128 v;
+	Lane4_T() {}
+	Lane4_T(__m128 value) : v(value) {}
+	Lane4_T(double value) : v(_mm_set1_ps((float)value)) {}
+} Lane4_T;
+
+static inline Lane4_T operator+(Lane4_T a, Lane4_T b) { return _mm_add_ps(a.v, b.v); }
+static inline Lane4_T operator-(Lane4_T a, Lane4_T b) { return _mm_sub_ps(a.v, b.v); }
+static inline Lane4_T operator*(Lane4_T a, Lane4_T b) { return _mm_mul_ps(a.v, b.v); }
+#endif
+
+template <typename V> struct Vec3_T {
+	V x, y, z;
+};
+
+template <typename V> static inline Vec3_T<V> operator+(const Vec3_T<V> &a, const Vec3_T<V> &b)
+{
+	return { a.x + b.x, a.y + b.y, a.z + b.z };
+}
+
+template <typename V> static inline Vec3_T<V> Cross(const Vec3_T<V> &a, const Vec3_T<V> &b)
+{
+	return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+}
+
+// constant vector (link data) x lanes
+template <typename V> static inline Vec3_T<V> Cross(const double a[3], const Vec3_T<V> &b)
+{
+	return { V(a[1]) * b.z - V(a[2]) * b.y, V(a[2]) * b.x - V(a[0]) * b.z, V(a[0]) * b.y - V(a[1]) * b.x };
+}
+
+template <typename V> static inline Vec3_T<V> Cross(const Vec3_T<V> &a, const double b[3])
+{
+	return { a.y * V(b[2]) - a.z * V(b[1]), a.z * V(b[0]) - a.x * V(b[2]), a.x * V(b[1]) - a.y * V(b[0]) };
+}
+
+template <typename V> static inline Vec3_T<V> Scale(double s, const Vec3_T<V> &a)
+{
+	return { V(s) * a.x, V(s) * a.y, V(s) * a.z };
+}
+
+// m * a, m constant row major 3x3
+template <typename V> static inline Vec3_T<V> Rotate(const double m[9], const Vec3_T<V> &a)
+{
+	return { V(m[0]) * a.x + V(m[1]) * a.y + V(m[2]) * a.z,
+	         V(m[3]) * a.x + V(m[4]) * a.y + V(m[5]) * a.z,
+	         V(m[6]) * a.x + V(m[7]) * a.y + V(m[8]) * a.z };
+}
+
+// m^T * a
+template <typename V> static inline Vec3_T<V> RotateBack(const double m[9], const Vec3_T<V> &a)
+{
+	return { V(m[0]) * a.x + V(m[3]) * a.y + V(m[6]) * a.z,
+	         V(m[1]) * a.x + V(m[4]) * a.y + V(m[7]) * a.z,
+	         V(m[2]) * a.x + V(m[5]) * a.y + V(m[8]) * a.z };
+}
+
+// Rz(q) * a and Rz(q)^T * a
+template <typename V> static inline Vec3_T<V> TurnZ(const Vec3_T<V> &a, V s, V c)
+{
+	return { c * a.x - s * a.y, s * a.x + c * a.y, a.z };
+}
+
+template <typename V> static inline Vec3_T<V> TurnZBack(const Vec3_T<V> &a, V s, V c)
+{
+	return { c * a.x + s * a.y, c * a.y - s * a.x, a.z };
+}
+
+/*
+ * NewtonEuler: joint torques in the model's joint coordinates (rad). Joint i
+ *              frame = joint i-1 frame * rotation/origin * Rz(q_i); link i
+ *              hangs on joint i. Outwards: velocities and accelerations, the
+ *              base accelerating up against gravity. Inwards: forces and
+ *              moments, each joint takes the z component of its moment.
+ */
+template <typename V>
+static void NewtonEuler(const DynamicsModel_T *dyn, const V sinQ[], const V cosQ[], const V speed[], const V acceleration[], V torque[])
+{
+	int axisCount = dyn->axisCount;
+	Vec3_T<V> force[MaxAxisNumber], moment[MaxAxisNumber];
+	V zero(0.0);
+	Vec3_T<V> w = { zero, zero, zero };
+	Vec3_T<V> wd = { zero, zero, zero };
+	Vec3_T<V> a = { V(-dyn->gravity[0]), V(-dyn->gravity[1]), V(-dyn->gravity[2]) };
+
+	for (int idx = 0; idx < axisCount; idx++) {
+		const DynamicsLink_T *link = &dyn->links[idx];
+
+		// joint origin in the parent frame, then everything into this joint's frame
+		Vec3_T<V> origin = a + Cross(wd, link->origin) + Cross(w, Cross(w, link->origin));
+		Vec3_T<V> wIn = TurnZBack(RotateBack(link->rotation, w), sinQ[idx], cosQ[idx]);
+		Vec3_T<V> wdIn = TurnZBack(RotateBack(link->rotation, wd), sinQ[idx], cosQ[idx]);
+		a = TurnZBack(RotateBack(link->rotation, origin), sinQ[idx], cosQ[idx]);
+		w = { wIn.x, wIn.y, wIn.z + speed[idx] };
+		wd = { wdIn.x + wIn.y * speed[idx], wdIn.y - wIn.x * speed[idx], wdIn.z + acceleration[idx] };
+
+		Vec3_T<V> comAcceleration = a + Cross(wd, link->com) + Cross(w, Cross(w, link->com));
+		force[idx] = Scale(link->mass, comAcceleration);
+		moment[idx] = Rotate(link->inertia, wd) + Cross(w, Rotate(link->inertia, w));
+	}
+
+	Vec3_T<V> f = { zero, zero, zero };
+	Vec3_T<V> n = { zero, zero, zero };
+	for (int idx = axisCount - 1; idx >= 0; idx--) {
+		const DynamicsLink_T *link = &dyn->links[idx];
+		Vec3_T<V> nextForce = { zero, zero, zero };
+		Vec3_T<V> nextMoment = { zero, zero, zero };
+		if (idx + 1 < axisCount) {
+			const DynamicsLink_T *next = &dyn->links[idx + 1];
+			nextForce = Rotate(next->rotation, TurnZ(f, sinQ[idx + 1], cosQ[idx + 1]));
+			nextMoment = Rotate(next->rotation, TurnZ(n, sinQ[idx + 1], cosQ[idx + 1])) + Cross(next->origin, nextForce);
+		}
+		f = force[idx] + nextForce;
+		n = moment[idx] + nextMoment + Cross(link->com, force[idx]);
+		torque[idx] = n.z;
+	}
+}
+
+// FANUC angles -> model angles: with J2/J3 coupling the model's J3 is J3 + J2
+static void ToModel(const DynamicsModel_T *dyn, const double in[MaxAxisNumber], double out[MaxAxisNumber])
+{
+	for (int idx = 0; idx < dyn->axisCount; idx++) {
+		out[idx] = in[idx] * DegToRad;
+	}
+	if (dyn->j23Coupled && (dyn->axisCount >= 3)) {
+		out[2] += out[1];
+	}
+}
+
+// model joint torques -> FANUC axes (same power: J2 drives the model's J3 as well)
+static void FromModel(const DynamicsModel_T *dyn, const double in[MaxAxisNumber], double out[MaxAxisNumber])
+{
+	for (int idx = 0; idx < MaxAxisNumber; idx++) {
+		out[idx] = (idx < dyn->axisCount) ? in[idx] : 0.0;
+	}
+	if (dyn->j23Coupled && (dyn->axisCount >= 3)) {
+		out[1] += in[2];
+	}
+}
+
+void JointTorques(const DynamicsModel_T *dyn, const double joints[MaxAxisNumber], const double speed[MaxAxisNumber],
+	const double acceleration[MaxAxisNumber], double torque[MaxAxisNumber])
+{
+	double q[MaxAxisNumber], qd[MaxAxisNumber], qdd[MaxAxisNumber];
+	double sinQ[MaxAxisNumber], cosQ[MaxAxisNumber], modelTorque[MaxAxisNumber];
+
+	ToModel(dyn, joints, q);
+	ToModel(dyn, speed, qd);
+	ToModel(dyn, acceleration, qdd);
+	for (int idx = 0; idx < dyn->axisCount; idx++) {
+		sinQ[idx] = sin(q[idx]);
+		cosQ[idx] = cos(q[idx]);
+	}
+	NewtonEuler<double>(dyn, sinQ, cosQ, qd, qdd, modelTorque);
+	FromModel(dyn, modelTorque, torque);
+}
+
+void JointMotion(const PositionData_T *joints, size_t idx, int axisCount, double cycleSec,
+	double speed[MaxAxisNumber], double acceleration[MaxAxisNumber])
+{
+	const float *now = joints[idx].data;
+	const float *prev = (idx >= 1) ? joints[idx - 1].data : now;
+	const float *prev2 = (idx >= 2) ? joints[idx - 2].data : prev;
+
+	for (int axis = 0; axis < MaxAxisNumber; axis++) {
+		if (axis < axisCount) {
+			speed[axis] = ((double)now[axis] - prev[axis]) / cycleSec;
+			acceleration[axis] = ((double)now[axis] - 2.0 * prev[axis] + prev2[axis]) / (cycleSec * cycleSec);
+		}
+		else {
+			speed[axis] = 0.0;
+			acceleration[axis] = 0.0;
+		}
+	}
+}
+
+static void SampleTorques(const DynamicsModel_T *dyn, const PositionData_T *joints, size_t idx, double cycleSec, PositionData_T *torques)
+{
+	double q[MaxAxisNumber], speed[MaxAxisNumber], acceleration[MaxAxisNumber], torque[MaxAxisNumber];
+
+	for (int axis = 0; axis < MaxAxisNumber; axis++) {
+		q[axis] = joints[idx].data[axis];
+	}
+	JointMotion(joints, idx, dyn->axisCount, cycleSec, speed, acceleration);
+	JointTorques(dyn, q, speed, acceleration, torque);
+	for (int axis = 0; axis < MaxAxisNumber; axis++) {
+		torques[idx].data[axis] = (float)torque[axis];
+	}
+}
+
+#ifdef __SSE2__
+// samples idx .. idx + 3, one per lane
+static void SampleTorques4(const DynamicsModel_T *dyn, const PositionData_T *joints, size_t idx, double cycleSec, PositionData_T *torques)
+{
+	float q[MaxAxisNumber][4], qd[MaxAxisNumber][4], qdd[MaxAxisNumber][4];
+	double model[3][MaxAxisNumber], fanuc[3][MaxAxisNumber];
+
+	for (int lane = 0; lane < 4; lane++) {
+		for (int axis = 0; axis < MaxAxisNumber; axis++) {
+			fanuc[0][axis] = joints[idx + lane].data[axis];
+		}
+		JointMotion(joints, idx + lane, dyn->axisCount, cycleSec, fanuc[1], fanuc[2]);
+		for (int kind = 0; kind < 3; kind++) {
+			ToModel(dyn, fanuc[kind], model[kind]);
+		}
+		for (int axis = 0; axis < dyn->axisCount; axis++) {
+			q[axis][lane] = (float)model[0][axis];
+			qd[axis][lane] = (float)model[1][axis];
+			qdd[axis][lane] = (float)model[2][axis];
+		}
+	}
+
+	Lane4_T sinQ[MaxAxisNumber], cosQ[MaxAxisNumber], laneSpeed[MaxAxisNumber], laneAcceleration[MaxAxisNumber], laneTorque[MaxAxisNumber];
+	for (int axis = 0; axis < dyn->axisCount; axis++) {
+		SinCos4(_mm_loadu_ps(q[axis]), &sinQ[axis].v, &cosQ[axis].v);
+		laneSpeed[axis] = _mm_loadu_ps(qd[axis]);
+		laneAcceleration[axis] = _mm_loadu_ps(qdd[axis]);
+	}
+	NewtonEuler<Lane4_T>(dyn, sinQ, cosQ, laneSpeed, laneAcceleration, laneTorque);
+
+	float out[MaxAxisNumber][4];
+	for (int axis = 0; axis < dyn->axisCount; axis++) {
+		_mm_storeu_ps(out[axis], laneTorque[axis].v);
+	}
+	for (int lane = 0; lane < 4; lane++) {
+		double modelTorque[MaxAxisNumber], torque[MaxAxisNumber];
+		for (int axis = 0; axis < dyn->axisCount; axis++) {
+			modelTorque[axis] = out[axis][lane];
+		}
+		FromModel(dyn, modelTorque, torque);
+		for (int axis = 0; axis < MaxAxisNumber; axis++) {
+			torques[idx + lane].data[axis] = (float)torque[axis];
+		}
+	}
+}
+#endif
+
+static void TorquesRange(const DynamicsModel_T *dyn, const PositionData_T *joints, size_t start, size_t end, double cycleSec, PositionData_T *torques)
+{
+	size_t idx = start;
+
+#ifdef __SSE2__
+	for (; idx + 4 <= end; idx += 4) {
+		SampleTorques4(dyn, joints, idx, cycleSec, torques);
+	}
+#endif
+	for (; idx < end; idx++) {
+		SampleTorques(dyn, joints, idx, cycleSec, torques);
+	}
+}
+
+void TrajectoryTorques(const DynamicsModel_T *dyn, const PositionData_T *joints, size_t count, long cycleNs, PositionData_T *torques, int threadCount)
+{
+	double cycleSec = cycleNs / 1.0e9;
+
+	if (threadCount <= 0) {
+		threadCount = (int)thread::hardware_concurrency();
+	}
+	if ((size_t)threadCount > count / SamplesPerThread) {
+		threadCount = (int)(count / SamplesPerThread);
+	}
+	if (threadCount <= 1) {
+		TorquesRange(dyn, joints, 0, count, cycleSec, torques);
+		return;
+	}
+
+	// contiguous chunks, multiples of four samples; the differences read back over the chunk start
+	size_t chunk = ((count / threadCount) + 3) & ~(size_t)3;
+	vector<thread> workers;
+	for (size_t start = 0; start < count; start += chunk) {
+		size_t end = (count - start < chunk) ? count : start + chunk;
+		workers.push_back(thread(TorquesRange, dyn, joints, start, end, cycleSec, torques));
+	}
+	for (size_t idx = 0; idx < workers.size(); idx++) {
+		workers[idx].join();
+	}
+}
+
+// ---------------------------------------------------------------- currents
+
+void DefaultDynamicsGains(DynamicsGains_T *gains)
+{
+	for (int axis = 0; axis < MaxAxisNumber; axis++) {
+		gains->torquePerAmp[axis] = DefaultTorquePerAmp[axis];
+		gains->coulomb[axis] = DefaultCoulombAmps;
+		gains->viscous[axis] = DefaultViscousAmps;
+		gains->offset[axis] = 0.0;
+	}
+}
+
+bool LoadDynamicsGains(const char *fileName, DynamicsGains_T *gains)
+{
+	ifstream file(fileName);
+	string line;
+	int lineNo = 0;
+
+	if (!file) {
+		cout << "Cannot open gains file: " << fileName << endl;
+		return false;
+	}
+	while (getline(file, line)) {
+		lineNo++;
+		size_t hash = line.find('#');
+		if (hash != string::npos) {
+			line.erase(hash);
+		}
+		istringstream fields(line);
+		int axis;
+		double torquePerAmp, coulomb, viscous, offset;
+		if (!(fields >> axis)) {
+			continue;
+		}
+		if (!(fields >> torquePerAmp >> coulomb >> viscous >> offset) || (axis < 1) || (axis > MaxAxisNumber) || (torquePerAmp <= 0.0)) {
+			cout << fileName << ":" << lineNo << ": expected axis (1-9) torque_per_amp (above 0) coulomb viscous offset" << endl;
+			return false;
+		}
+		gains->torquePerAmp[axis - 1] = torquePerAmp;
+		gains->coulomb[axis - 1] = coulomb;
+		gains->viscous[axis - 1] = viscous;
+		gains->offset[axis - 1] = offset;
+	}
+	return true;
+}
+
+bool SaveDynamicsGains(const char *fileName, const DynamicsGains_T *gains, int axisCount)
+{
+	FILE *out = fopen(fileName, "w");
+
+	if (out == NULL) {
+		cout << "Cannot create " << fileName << ": " << strerror(errno) << endl;
+		return false;
+	}
+	fprintf(out, "# axis  torque_per_amp (N m/A)  coulomb (A)  viscous (A per deg/s)  offset (A)\n");
+	for (int axis = 0; axis < axisCount; axis++) {
+		fprintf(out, "%d %.6g %.6g %.6g %.6g\n", axis + 1, gains->torquePerAmp[axis], gains->coulomb[axis], gains->viscous[axis], gains->offset[axis]);
+	}
+	if (fclose(out) != 0) {
+		cout << "Cannot write " << fileName << endl;
+		return false;
+	}
+	return true;
+}
+
+void PredictCurrents(const DynamicsModel_T *dyn, const DynamicsGains_T *gains, const double torque[MaxAxisNumber],
+	const double speed[MaxAxisNumber], double current[MaxAxisNumber])
+{
+	for (int axis = 0; axis < MaxAxisNumber; axis++) {
+		if (axis >= dyn->axisCount) {
+			current[axis] = 0.0;
+			continue;
+		}
+		double direction = (speed[axis] > FrictionDeadband) ? 1.0 : ((speed[axis] < -FrictionDeadband) ? -1.0 : 0.0);
+		current[axis] = torque[axis] / gains->torquePerAmp[axis] + gains->coulomb[axis] * direction + gains->viscous[axis] * speed[axis]
+			+ gains->offset[axis];
+	}
+}
+
+bool WriteDynamicsReport(const DynamicsModel_T *dyn, const PositionData_T *torques, const PositionData_T *currents, size_t count, long cycleNs)
+{
+	bool withinLimits = true;
+
+	printf("axis  peak torque (N m)   at sample  peak current (A)   at sample  over effort limit\n");
+	for (int axis = 0; axis < dyn->axisCount; axis++) {
+		size_t torqueAt = 0, currentAt = 0;
+		unsigned long over = 0;
+		for (size_t idx = 0; idx < count; idx++) {
+			if (fabs(torques[idx].data[axis]) > fabs(torques[torqueAt].data[axis])) {
+				torqueAt = idx;
+			}
+			if ((currents != NULL) && (fabs(currents[idx].data[axis]) > fabs(currents[currentAt].data[axis]))) {
+				currentAt = idx;
+			}
+			if ((dyn->effort[axis] > 0.0) && (fabs(torques[idx].data[axis]) > dyn->effort[axis])) {
+				over++;
+			}
+		}
+		printf("  J%d %12.2f %14zu", axis + 1, (count > 0) ? torques[torqueAt].data[axis] : 0.0f, torqueAt + 1);
+		if (currents != NULL) {
+			printf(" %15.2f %13zu", (count > 0) ? currents[currentAt].data[axis] : 0.0f, currentAt + 1);
+		}
+		else {
+			printf(" %15s %13s", "-", "-");
+		}
+		if (dyn->effort[axis] > 0.0) {
+			printf("  %lu (limit %.1f)\n", over, dyn->effort[axis]);
+		}
+		else {
+			printf("  - (no limit in the model)\n");
+		}
+		if (over > 0) {
+			withinLimits = false;
+		}
+	}
+	printf("%zu samples, %.3f s\n", count, count * cycleNs / 1.0e9);
+	return withinLimits;
+}
+
+// ---------------------------------------------------------------- monitor
+
+void InitDynamicsMonitor(DynamicsMonitor_T *monitor, const DynamicsModel_T *dyn, const DynamicsGains_T *gains, long cycleNs)
+{
+	memset(monitor, 0, sizeof(*monitor));
+	monitor->model = dyn;
+	monitor->gains = *gains;
+	monitor->cycleNs = cycleNs;
+	monitor->collisionAmps = DefaultCollisionAmps;
+	monitor->collisionCycles = DefaultCollisionCycles;
+	monitor->payloadAmps = DefaultPayloadAmps;
+	monitor->payloadSec = DefaultPayloadSec;
+}
+
+static void LogEvent(DynamicsMonitor_T *monitor, u_word sequenceNo, int kind, int axis, double residual)
+{
+	monitor->flagged |= kind;
+	if (monitor->eventCount < MaxDynamicsEvents) {
+		DynamicsEvent_T *event = &monitor->events[monitor->eventCount];
+		event->sequenceNo = sequenceNo;
+		event->kind = kind;
+		event->axis = axis + 1;
+		event->residual = (float)residual;
+	}
+	monitor->eventCount++;
+}
+
+int MonitorSample(DynamicsMonitor_T *monitor, u_word sequenceNo, u_word timeStamp, u_byte status, const float joints[MaxAxisNumber],
+	const float currents[MaxAxisNumber])
+{
+	const DynamicsModel_T *dyn = monitor->model;
+	double cycleSec = monitor->cycleNs / 1.0e9;
+	long cycleMs = (monitor->cycleNs + NsPerMs / 2) / NsPerMs;
+
+	if (cycleMs < 1) {
+		cycleMs = 1;
+	}
+
+	if ((status & MotionStatusBit) == 0) {
+		monitor->history = 0;
+		return 0;
+	}
+
+	// the differences need statuses one controller cycle apart (the ms clock rounded to cycles)
+	long gapCycles = ((long)(u_word)(timeStamp - monitor->lastTimeStamp) * 2 + cycleMs) / (2 * cycleMs);
+	if ((monitor->history > 0) && (gapCycles != 1)) {
+		monitor->history = 0;
+		monitor->restarts++;
+	}
+	monitor->lastTimeStamp = timeStamp;
+	memmove(monitor->joint[1], monitor->joint[0], 2 * sizeof(monitor->joint[0]));
+	for (int axis = 0; axis < MaxAxisNumber; axis++) {
+		monitor->joint[0][axis] = joints[axis];
+	}
+	if (monitor->history < 3) {
+		monitor->history++;
+		if (monitor->history < 3) {
+			return 0;
+		}
+	}
+
+	double speed[MaxAxisNumber], acceleration[MaxAxisNumber], torque[MaxAxisNumber], predicted[MaxAxisNumber];
+	for (int axis = 0; axis < MaxAxisNumber; axis++) {
+		speed[axis] = (monitor->joint[0][axis] - monitor->joint[1][axis]) / cycleSec;
+		acceleration[axis] = (monitor->joint[0][axis] - 2.0 * monitor->joint[1][axis] + monitor->joint[2][axis]) / (cycleSec * cycleSec);
+	}
+	JointTorques(dyn, monitor->joint[0], speed, acceleration, torque);
+	PredictCurrents(dyn, &monitor->gains, torque, speed, predicted);
+
+	int started = 0;
+	double filterGain = (monitor->payloadSec > cycleSec) ? cycleSec / monitor->payloadSec : 1.0;
+	monitor->checks++;
+	for (int axis = 0; axis < dyn->axisCount; axis++) {
+		double residual = currents[axis] - predicted[axis];
+		double size = fabs(residual);
+		if (size > monitor->maxResidual[axis]) {
+			monitor->maxResidual[axis] = size;
+		}
+		monitor->sumSquares[axis] += residual * residual;
+		if (monitor->checks == 1) {
+			monitor->filtered[axis] = residual;   // a payload offset is there from the start
+		}
+
+		// collision: a run of residuals well off the steady offset, flagged once per run
+		double sudden = residual - monitor->filtered[axis];
+		monitor->overCount[axis] = (fabs(sudden) > monitor->collisionAmps) ? monitor->overCount[axis] + 1 : 0;
+		if (monitor->overCount[axis] == monitor->collisionCycles) {
+			LogEvent(monitor, sequenceNo, DynamicsCollision, axis, sudden);
+			started |= DynamicsCollision;
+		}
+
+		// payload: a steady offset, flagged again only after it went back below half
+		monitor->filtered[axis] += filterGain * (residual - monitor->filtered[axis]);
+		double offset = fabs(monitor->filtered[axis]);
+		if (!monitor->payloadOver[axis] && (offset > monitor->payloadAmps)) {
+			monitor->payloadOver[axis] = true;
+			LogEvent(monitor, sequenceNo, DynamicsPayload, axis, monitor->filtered[axis]);
+			started |= DynamicsPayload;
+		}
+		else if (monitor->payloadOver[axis] && (offset < monitor->payloadAmps / 2.0)) {
+			monitor->payloadOver[axis] = false;
+		}
+	}
+	return started;
+}
+
+int MonitorStatus(DynamicsMonitor_T *monitor, const RobotStatusPacket_T *status)
+{
+	struct timespec start, end;
+	float joints[MaxAxisNumber], currents[MaxAxisNumber];
+
+	RtNow(&start);
+	for (int axis = 0; axis < MaxAxisNumber; axis++) {
+		currents[axis] = NetFloatField(status->current[axis]);
+		joints[axis] = NetToHostFloat(status->jontAngle[axis]);
+	}
+	int started = MonitorSample(monitor, ntohl(status->sequenceNo), ntohl(status->timeStamp), status->status, joints, currents);
+	RtNow(&end);
+	int64_t checkNs = RtDiffNs(&end, &start);
+	if (checkNs > monitor->maxCheckNs) {
+		monitor->maxCheckNs = checkNs;
+	}
+	return started;
+}
+
+void WriteDynamicsMonitor(const DynamicsMonitor_T *monitor)
+{
+	static const char *kindName[] = { "", "collision", "payload", "" };
+
+	printf("dynamics monitor: %lu statuses checked, %lu restarts", monitor->checks, monitor->restarts);
+	if (monitor->maxCheckNs > 0) {
+		printf(", worst check %.1f us", monitor->maxCheckNs / 1.0e3);
+	}
+	printf("\n");
+	printf("  residual (A)  ");
+	for (int axis = 0; axis < monitor->model->axisCount; axis++) {
+		printf("    J%d", axis + 1);
+	}
+	printf("\n  max           ");
+	for (int axis = 0; axis < monitor->model->axisCount; axis++) {
+		printf(" %5.2f", monitor->maxResidual[axis]);
+	}
+	printf("\n  rms           ");
+	for (int axis = 0; axis < monitor->model->axisCount; axis++) {
+		printf(" %5.2f", (monitor->checks > 0) ? sqrt(monitor->sumSquares[axis] / monitor->checks) : 0.0);
+	}
+	printf("\n");
+	int logged = (monitor->eventCount < MaxDynamicsEvents) ? monitor->eventCount : MaxDynamicsEvents;
+	for (int idx = 0; idx < logged; idx++) {
+		const DynamicsEvent_T *event = &monitor->events[idx];
+		printf("  ** %s at sequence ID %u: J%d %+.2f A off the model **\n", kindName[event->kind], event->sequenceNo, event->axis, event->residual);
+	}
+	if (monitor->eventCount > logged) {
+		printf("  ... %d more\n", monitor->eventCount - logged);
+	}
+}
@@ -0,0 +1,195 @@
+//
+// Dynamics.h : joint torques and motor currents of the robot model's chain
+//              (recursive Newton-Euler), for whole trajectories before
+//              streaming and for every status while streaming
+//
+// Mass, center of mass and inertia of each moving link come from the model
+// file (the inertial of each chain joint's child link), moved into the
+// joint frames of KinematicChain_T. A payload is a point mass on the
+// faceplate. Speeds and accelerations are backward differences of the
+// samples at the ITP cycle, the robot at rest before the first one, the
+// way LimitCheck and the controller take them. Torques are N m per FANUC
+// axis: with j23Coupled the J2 torque carries the J3 torque as well.
+//
+// The current of an axis is modelled as torque / torquePerAmp plus Coulomb
+// and viscous friction and an offset (DynamicsGains_T). The defaults are
+// placeholders of the right size only; TrajDynamics fit finds the real
+// ones from a telemetry recording of the robot.
+//
+// The batch version runs the same Newton-Euler code on four samples at a
+// time (SSE lanes, one sample per lane) and splits big trajectories over
+// all CPUs, like the forward kinematics batch. One sample takes well under
+// a microsecond, so the monitor below checks every status on the stream
+// thread.
+//
+// Monitor: every status is checked after its reply went out. The measured
+// joint angles of the last three statuses give speed and acceleration, the
+// model the current each axis should draw, and the residual (measured -
+// predicted) is watched two ways:
+//   collision  the residual off its low-passed value by more than
+//              collisionAmps for collisionCycles statuses in a row: a
+//              sudden extra load
+//   payload    the residual low-passed over payloadSec over payloadAmps:
+//              the steady offset of a payload heavier or lighter than the
+//              model's (the filter starts at the first residual)
+// Only statuses with the in_motion bit are checked: the position reported
+// before the first command is not necessarily where the motion starts.
+// A status that does not follow the previous one by one controller cycle
+// (lost, or dropped as stale; the ms time stamp rounded to cycles) restarts
+// the differences.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "J519Packet.h"
+#include "RobotModel.h"
+#include "Kinematics.h"
+
+const double StandardGravity = 9.80665;            // m/s^2, along -z of the model's base frame
+const double FrictionDeadband = 0.1;               // deg/s, slower is standing for the Coulomb friction
+const double DefaultCollisionAmps = 2.0;
+const int DefaultCollisionCycles = 2;
+const double DefaultPayloadAmps = 0.5;
+const double DefaultPayloadSec = 0.5;
+const int MaxDynamicsEvents = 16;
+const u_byte MotionStatusBit = 0x8;                // in_motion: a command was executed this cycle
+
+// DynamicsEvent_T.kind, bits returned by MonitorSample
+const int DynamicsCollision = 0x1;
+const int DynamicsPayload = 0x2;
+
+typedef struct DynamicsLink_T {
+	double rotation[9];       // parent joint frame -> this joint frame before it turns, row major
+	double origin[3];         // m, joint origin in the parent joint frame
+	double mass;              // kg, the child link of the joint (payload included on the last)
+	double com[3];            // m, joint frame
+	double inertia[9];        // kg m^2 about the com, joint frame axes
+} DynamicsLink_T;
+
+typedef struct DynamicsModel_T {
+	int axisCount;
+	bool j23Coupled;
+	double gravity[3];        // m/s^2 in the base frame
+	double effort[MaxAxisNumber];   // model torque limits (N m), 0 = not set
+	DynamicsLink_T links[MaxAxisNumber];
+} DynamicsModel_T;
+
+typedef struct Payload_T {
+	double mass;              // kg
+	double com[3];            // mm, faceplate frame
+} Payload_T;
+
+typedef struct DynamicsGains_T {
+	double torquePerAmp[MaxAxisNumber];   // N m at the joint per A, gear included
+	double coulomb[MaxAxisNumber];        // A
+	double viscous[MaxAxisNumber];        // A per deg/s
+	double offset[MaxAxisNumber];         // A
+} DynamicsGains_T;
+
+/*
+ * ParsePayload: "kg[,x,y,z]", center of mass in mm on the faceplate.
+ *               false if it does not read.
+ */
+bool ParsePayload(const char *text, Payload_T *payload);
+
+/*
+ * BuildDynamicsModel: link inertials of the model's chain in the chain's
+ *                     joint frames, payload (may be NULL) on the last link.
+ *                     On error prints the reason and returns false.
+ */
+bool BuildDynamicsModel(const RobotModel_T *model, const KinematicChain_T *chain, const Payload_T *payload, DynamicsModel_T *dyn);
+
+/*
+ * JointTorques: torques (N m) of one state, FANUC joint angles, speeds and
+ *               accelerations in deg, deg/s, deg/s^2. Double precision.
+ */
+void JointTorques(const DynamicsModel_T *dyn, const double joints[MaxAxisNumber], const double speed[MaxAxisNumber],
+	const double acceleration[MaxAxisNumber], double torque[MaxAxisNumber]);
+
+/*
+ * JointMotion: speed and acceleration of sample idx by backward differences,
+ *              at rest before sample 0
+ */
+void JointMotion(const PositionData_T *joints, size_t idx, int axisCount, double cycleSec,
+	double speed[MaxAxisNumber], double acceleration[MaxAxisNumber]);
+
+/*
+ * TrajectoryTorques: torques of every sample. threadCount 0 = one per CPU,
+ *                    small batches stay on the calling thread.
+ */
+void TrajectoryTorques(const DynamicsModel_T *dyn, const PositionData_T *joints, size_t count, long cycleNs, PositionData_T *torques, int threadCount);
+
+void DefaultDynamicsGains(DynamicsGains_T *gains);
+
+/*
+ * LoadDynamicsGains: one axis per line, "axis torque_per_amp coulomb viscous
+ *                    offset", # starts a comment; axes not listed keep the
+ *                    defaults. On error prints "file:line: reason".
+ */
+bool LoadDynamicsGains(const char *fileName, DynamicsGains_T *gains);
+bool SaveDynamicsGains(const char *fileName, const DynamicsGains_T *gains, int axisCount);
+
+// current (A) of each axis for its torque and speed (deg/s)
+void PredictCurrents(const DynamicsModel_T *dyn, const DynamicsGains_T *gains, const double torque[MaxAxisNumber],
+	const double speed[MaxAxisNumber], double current[MaxAxisNumber]);
+
+/*
+ * WriteDynamicsReport: peak torque and current of each axis and where, and
+ *                      samples over the model's effort limits. Returns false
+ *                      if any axis is over its limit.
+ */
+bool WriteDynamicsReport(const DynamicsModel_T *dyn, const PositionData_T *torques, const PositionData_T *currents, size_t count, long cycleNs);
+
+// ---------------------------------------------------------------- monitor
+
+typedef struct DynamicsEvent_T {
+	u_word sequenceNo;
+	int kind;                 // DynamicsCollision / DynamicsPayload
+	int axis;                 // 1 based
+	float residual;           // A, measured - predicted (collision: off the low-passed residual)
+} DynamicsEvent_T;
+
+typedef struct DynamicsMonitor_T {
+	const DynamicsModel_T *model;
+	DynamicsGains_T gains;
+	long cycleNs;
+	double collisionAmps;
+	int collisionCycles;
+	double payloadAmps;
+	double payloadSec;
+	bool stopOnFlag;          // the caller ends the motion on the first event
+
+	// state
+	int history;              // statuses in a row, up to 3
+	u_word lastTimeStamp;     // controller clock, ms
+	double joint[3][MaxAxisNumber];   // measured, [0] newest
+	double filtered[MaxAxisNumber];   // low-passed residual
+	int overCount[MaxAxisNumber];     // statuses in a row over collisionAmps
+	bool payloadOver[MaxAxisNumber];
+
+	// results
+	unsigned long checks;
+	unsigned long restarts;           // status gaps
+	double maxResidual[MaxAxisNumber];
+	double sumSquares[MaxAxisNumber];
+	int64_t maxCheckNs;
+	int flagged;                      // DynamicsCollision | DynamicsPayload seen
+	int eventCount;
+	DynamicsEvent_T events[MaxDynamicsEvents];
+} DynamicsMonitor_T;
+
+void InitDynamicsMonitor(DynamicsMonitor_T *monitor, const DynamicsModel_T *dyn, const DynamicsGains_T *gains, long cycleNs);
+
+/*
+ * MonitorSample: check one status, host order values. returns the event
+ *                kinds that started with it, 0 if none.
+ */
+int MonitorSample(DynamicsMonitor_T *monitor, u_word sequenceNo, u_word timeStamp, u_byte status, const float joints[MaxAxisNumber],
+	const float currents[MaxAxisNumber]);
+
+// MonitorSample on a status packet as received, timing the check
+int MonitorStatus(DynamicsMonitor_T *monitor, const RobotStatusPacket_T *status);
+
+void WriteDynamicsMonitor(const DynamicsMonitor_T *monitor);
@@ -0,0 +1,214 @@
+//
+// FixedKinematics.h : forward kinematics, Jacobian and joint limits of one
+//                     robot fixed at build time, for checks and corrections
+//                     inside the stream cycle
+//
+// KinGen turns a model file into a header with one struct per robot: its
+// constant transforms and its chain unrolled into straight line code, the
+// 0s and 1s of the axis alignments folded away. The build target picks the
+// robot,
+//   g++ ... -DFIXED_ROBOT_HEADER='"Robots/V8Kinematics.h"'
+// and FIXED_ROBOT is then its struct. The functions here are templates on
+// that struct: no loop over the joints, no branch on the joint type, no
+// multiply by a constant that was known when the header was made.
+//
+// Angles are FANUC degrees as in the packets (J3 from the horizontal if the
+// robot is J23Coupled), poses and the Jacobian's position rows mm, as in
+// Kinematics.h; the results equal the runtime chain's to rounding. A header
+// generated from an older revision of the model would silently be wrong:
+// FixedMatchesChain compares it with the chain of the model file.
+//
+
+#pragma once
+
+#include <math.h>
+#include "J519Packet.h"
+#include "Kinematics.h"
+
+#ifdef FIXED_ROBOT_HEADER
+#include FIXED_ROBOT_HEADER
+#endif
+
+const double FixedMatchTolerance = 1.0e-6;       // mm, and per unit of a rotation entry
+const double FixedOrientationScale = 500.0;      // mm per rad: orientation rows against position rows in a step
+
+/*
+ * FixedJointAngles: model angles (rad) of FANUC joint angles (deg), and
+ *                   their sines and cosines
+ */
+template <typename Robot>
+inline void FixedJointAngles(const float joints[MaxAxisNumber], double q[Robot::AxisCount], double s[Robot::AxisCount], double c[Robot::AxisCount])
+{
+	for (int idx = 0; idx < Robot::AxisCount; idx++) {
+		q[idx] = joints[idx] * (M_PI / 180.0);
+	}
+	if (Robot::J23Coupled && (Robot::AxisCount >= 3)) {
+		q[2] += q[1];
+	}
+	for (int idx = 0; idx < Robot::AxisCount; idx++) {
+		s[idx] = sin(q[idx]);
+		c[idx] = cos(q[idx]);
+	}
+}
+
+// faceplate in the world frame, 3x4 row major (mm), like ForwardTransform
+template <typename Robot>
+inline void FixedForwardTransform(const float joints[MaxAxisNumber], double transform[12])
+{
+	double q[Robot::AxisCount], s[Robot::AxisCount], c[Robot::AxisCount];
+
+	FixedJointAngles<Robot>(joints, q, s, c);
+	Robot::Forward(s, c, transform);
+}
+
+// x y z w p r of the faceplate, external axes copied through, like ForwardKinematics
+template <typename Robot>
+inline void FixedForwardKinematics(const float joints[MaxAxisNumber], float pose[MaxAxisNumber])
+{
+	double transform[12];
+
+	FixedForwardTransform<Robot>(joints, transform);
+	TransformToPose(transform, pose);
+	for (int idx = 6; idx < MaxAxisNumber; idx++) {
+		pose[idx] = (idx < Robot::AxisCount) ? 0.0f : joints[idx];
+	}
+}
+
+/*
+ * FixedJacobian: 6 x AxisCount row major, faceplate velocity (mm/rad) over
+ *                angular velocity (rad/rad) in the world frame, per radian
+ *                of each FANUC axis: with J23Coupled the J2 column moves
+ *                the model's J3 as well.
+ */
+template <typename Robot>
+inline void FixedJacobian(const float joints[MaxAxisNumber], double jac[6 * Robot::AxisCount])
+{
+	double q[Robot::AxisCount], s[Robot::AxisCount], c[Robot::AxisCount];
+
+	FixedJointAngles<Robot>(joints, q, s, c);
+	Robot::Jacobian(s, c, jac);
+	if (Robot::J23Coupled && (Robot::AxisCount >= 3)) {
+		for (int row = 0; row < 6; row++) {
+			jac[row * Robot::AxisCount + 1] += jac[row * Robot::AxisCount + 2];
+		}
+	}
+}
+
+// bit i set: axis i + 1 outside the model's joint limits
+template <typename Robot>
+inline unsigned FixedLimitMask(const float joints[MaxAxisNumber])
+{
+	double q[Robot::AxisCount];
+
+	for (int idx = 0; idx < Robot::AxisCount; idx++) {
+		q[idx] = joints[idx] * (M_PI / 180.0);
+	}
+	if (Robot::J23Coupled && (Robot::AxisCount >= 3)) {
+		q[2] += q[1];
+	}
+	return Robot::LimitMask(q);
+}
+
+/*
+ * FixedMatchesChain: the generated constants against the chain of the model
+ *                    file (BuildKinematicChain); false if the header is of
+ *                    another robot or revision.
+ */
+template <typename Robot>
+bool FixedMatchesChain(const KinematicChain_T *chain)
+{
+	if ((chain->axisCount != Robot::AxisCount) || (chain->j23Coupled != Robot::J23Coupled)
+		|| (fabs(chain->worldHeight - Robot::WorldHeight) > FixedMatchTolerance)) {
+		return false;
+	}
+	for (int idx = 0; idx < Robot::AxisCount; idx++) {
+		if ((fabs(chain->lower[idx] - Robot::Lower[idx]) > FixedMatchTolerance) || (fabs(chain->upper[idx] - Robot::Upper[idx]) > FixedMatchTolerance)) {
+			return false;
+		}
+		for (int k = 0; k < 12; k++) {
+			if (fabs(chain->frame[idx][k] - Robot::Frame[idx][k]) > FixedMatchTolerance) {
+				return false;
+			}
+		}
+	}
+	for (int k = 0; k < 12; k++) {
+		if (fabs(chain->tool[k] - Robot::Tool[k]) > FixedMatchTolerance) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * FixedCartesianStep: joint offsets (deg) that move the faceplate by offset,
+ *                     x y z (mm) and a small rotation w p r (deg) about the
+ *                     world x y z axes: one damped least squares step on the
+ *                     Jacobian at joints (damping in mm). Offsets of a few mm
+ *                     are met to their square over the arm's reach. false if
+ *                     the solve failed.
+ */
+template <typename Robot>
+bool FixedCartesianStep(const float joints[MaxAxisNumber], const float offset[6], double damping, float step[MaxAxisNumber])
+{
+	const int N = Robot::AxisCount;
+	double jac[6 * N];
+	double a[36];
+	double e[6];
+
+	FixedJacobian<Robot>(joints, jac);
+	for (int row = 0; row < 6; row++) {
+		double scale = (row < 3) ? 1.0 : FixedOrientationScale;
+		for (int col = 0; col < N; col++) {
+			jac[row * N + col] *= scale;
+		}
+		e[row] = (row < 3) ? offset[row] : offset[row] * (M_PI / 180.0) * FixedOrientationScale;
+	}
+
+	// (J J' + damping^2 I) y = e, Cholesky in place (lower triangle), then step = J' y
+	for (int row = 0; row < 6; row++) {
+		for (int col = 0; col <= row; col++) {
+			double sum = (row == col) ? damping * damping : 0.0;
+			for (int k = 0; k < N; k++) {
+				sum += jac[row * N + k] * jac[col * N + k];
+			}
+			a[row * 6 + col] = sum;
+		}
+	}
+	for (int col = 0; col < 6; col++) {
+		double diagonal = a[col * 6 + col];
+		for (int k = 0; k < col; k++) {
+			diagonal -= a[col * 6 + k] * a[col * 6 + k];
+		}
+		if (diagonal <= 0.0) {
+			return false;
+		}
+		a[col * 6 + col] = sqrt(diagonal);
+		for (int row = col + 1; row < 6; row++) {
+			double sum = a[row * 6 + col];
+			for (int k = 0; k < col; k++) {
+				sum -= a[row * 6 + k] * a[col * 6 + k];
+			}
+			a[row * 6 + col] = sum / a[col * 6 + col];
+		}
+	}
+	for (int row = 0; row < 6; row++) {
+		for (int k = 0; k < row; k++) {
+			e[row] -= a[row * 6 + k] * e[k];
+		}
+		e[row] /= a[row * 6 + row];
+	}
+	for (int row = 5; row >= 0; row--) {
+		for (int k = row + 1; k < 6; k++) {
+			e[row] -= a[k * 6 + row] * e[k];
+		}
+		e[row] /= a[row * 6 + row];
+	}
+	for (int col = 0; col < MaxAxisNumber; col++) {
+		double sum = 0.0;
+		for (int row = 0; (row < 6) && (col < N); row++) {
+			sum += jac[row * N + col] * e[row];
+		}
+		step[col] = (float)(sum * (180.0 / M_PI));
+	}
+	return true;
+}
@@ -0,0 +1,280 @@
+//
+// IoEvents.cpp : I/O writes and reads tied to the samples of a trajectory
+//
+
+#include "stdafx.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "IoEvents.h"
+
+using namespace std;
+
+typedef struct IoTypeName_T {
+	const char *name;
+	u_byte type;
+	bool output;              // can be written
+} IoTypeName_T;
+
+static const IoTypeName_T IoTypeNames[] = {
+	{ "DI", IoTypeDI, false }, { "DO", IoTypeDO, true }, { "RI", IoTypeRI, false }, { "RO", IoTypeRO, true },
+	{ "UI", IoTypeUI, false }, { "UO", IoTypeUO, true }, { "F", IoTypeFlag, true },
+};
+static const int IoTypeNameCount = sizeof(IoTypeNames) / sizeof(IoTypeNames[0]);
+
+static const char *IoTypeText(u_byte type)
+{
+	for (int idx = 0; idx < IoTypeNameCount; idx++) {
+		if (IoTypeNames[idx].type == type) {
+			return IoTypeNames[idx].name;
+		}
+	}
+	return "?";
+}
+
+/*
+ * ParseIoType: a name of IoTypeNames or a type code of 1-255; *output false
+ *              for the named inputs, a code is taken as writable
+ */
+static bool ParseIoType(const string &text, u_byte *type, bool *output)
+{
+	for (int idx = 0; idx < IoTypeNameCount; idx++) {
+		if (strcasecmp(text.c_str(), IoTypeNames[idx].name) == 0) {
+			*type = IoTypeNames[idx].type;
+			*output = IoTypeNames[idx].output;
+			return true;
+		}
+	}
+	char *end;
+	long code = strtol(text.c_str(), &end, 10);
+	if (text.empty() || (*end != '\0') || (code < 1) || (code > 255)) {
+		return false;
+	}
+	*type = (u_byte)code;
+	*output = true;
+	return true;
+}
+
+// decimal or 0x hex, within 0 .. limit
+static bool ParseIoNumber(const string &text, long limit, long *number)
+{
+	char *end;
+	*number = strtol(text.c_str(), &end, 0);
+	return !text.empty() && (*end == '\0') && (*number >= 0) && (*number <= limit);
+}
+
+static bool WriteBySample(const IoWrite_T &a, const IoWrite_T &b)
+{
+	return a.sample < b.sample;
+}
+
+static bool ReadBySample(const IoRead_T &a, const IoRead_T &b)
+{
+	return a.sample < b.sample;
+}
+
+bool LoadIoEvents(const char *fileName, IoEvents_T *events)
+{
+	ifstream file(fileName);
+	string line;
+	int lineNo = 0;
+	vector<int> writeLines;   // line of each write, for the merge errors
+	vector<int> readLines;
+
+	events->writes.clear();
+	events->reads.clear();
+	if (!file) {
+		cout << "Cannot open I/O event file: " << fileName << endl;
+		return false;
+	}
+	while (getline(file, line)) {
+		lineNo++;
+		size_t hash = line.find('#');
+		if (hash != string::npos) {
+			line.erase(hash);
+		}
+		istringstream fields(line);
+		string sampleText, action, typeText, indexText, maskText, valueText, extra;
+		if (!(fields >> sampleText)) {
+			continue;
+		}
+		long sample;
+		char *end;
+		sample = strtol(sampleText.c_str(), &end, 10);
+		if ((*end != '\0') || (sample < 0)) {
+			cout << fileName << ":" << lineNo << ": sample must be a number of 0 or more, not " << sampleText << endl;
+			return false;
+		}
+		fields >> action >> typeText;
+
+		bool isWrite = (strcasecmp(action.c_str(), "write") == 0);
+		if (!isWrite && (strcasecmp(action.c_str(), "read") == 0) && (strcasecmp(typeText.c_str(), "none") == 0)) {
+			if (fields >> extra) {
+				cout << fileName << ":" << lineNo << ": nothing goes after read none" << endl;
+				return false;
+			}
+			IoRead_T read = { (size_t)sample, IoTypeNone, 0, 0 };
+			events->reads.push_back(read);
+			readLines.push_back(lineNo);
+			continue;
+		}
+		if (!isWrite && (strcasecmp(action.c_str(), "read") != 0)) {
+			cout << fileName << ":" << lineNo << ": expected write or read, not " << action << endl;
+			return false;
+		}
+
+		u_byte type;
+		bool output;
+		long index, mask, value = 0;
+		fields >> indexText >> maskText;
+		if (isWrite) {
+			fields >> valueText;
+		}
+		if (!ParseIoType(typeText, &type, &output)) {
+			cout << fileName << ":" << lineNo << ": unknown I/O type " << typeText << " (DI DO RI RO UI UO F or a code of 1-255)" << endl;
+			return false;
+		}
+		if (!ParseIoNumber(indexText, 65535, &index) || (index < 1) || !ParseIoNumber(maskText, 65535, &mask) || (mask == 0)
+			|| (isWrite && !ParseIoNumber(valueText, 65535, &value)) || (fields >> extra)) {
+			cout << fileName << ":" << lineNo << (isWrite ? ": expected write type index mask value" : ": expected read type index mask")
+			     << ", index 1-65535, mask 1-0xFFFF" << endl;
+			return false;
+		}
+		if (isWrite && !output) {
+			cout << fileName << ":" << lineNo << ": " << typeText << " is an input, it cannot be written" << endl;
+			return false;
+		}
+		if ((value & ~mask) != 0) {
+			cout << fileName << ":" << lineNo << ": value sets signals outside the mask" << endl;
+			return false;
+		}
+		if (isWrite) {
+			IoWrite_T write = { (size_t)sample, type, (u_short)index, (u_short)mask, (u_short)value };
+			events->writes.push_back(write);
+			writeLines.push_back(lineNo);
+		}
+		else {
+			IoRead_T read = { (size_t)sample, type, (u_short)index, (u_short)mask };
+			events->reads.push_back(read);
+			readLines.push_back(lineNo);
+		}
+	}
+	if (events->writes.empty() && events->reads.empty()) {
+		cout << fileName << ": no I/O events" << endl;
+		return false;
+	}
+
+	// one write per packet: writes of a sample are merged
+	vector<size_t> order(events->writes.size());
+	for (size_t idx = 0; idx < order.size(); idx++) {
+		order[idx] = idx;
+	}
+	stable_sort(order.begin(), order.end(), [events](size_t a, size_t b) { return WriteBySample(events->writes[a], events->writes[b]); });
+	vector<IoWrite_T> merged;
+	for (size_t idx : order) {
+		const IoWrite_T *write = &events->writes[idx];
+		if (merged.empty() || (merged.back().sample != write->sample)) {
+			merged.push_back(*write);
+			continue;
+		}
+		IoWrite_T *into = &merged.back();
+		if ((into->type != write->type) || (into->index != write->index)) {
+			cout << fileName << ":" << writeLines[idx] << ": sample " << write->sample
+			     << " has a write already, a packet carries one (same type and index to merge)" << endl;
+			return false;
+		}
+		if ((into->mask & write->mask) != 0) {
+			cout << fileName << ":" << writeLines[idx] << ": sample " << write->sample << " sets the same signal twice" << endl;
+			return false;
+		}
+		into->mask |= write->mask;
+		into->value |= write->value;
+	}
+	events->writes = merged;
+
+	stable_sort(events->reads.begin(), events->reads.end(), ReadBySample);
+	for (size_t idx = 1; idx < events->reads.size(); idx++) {
+		if (events->reads[idx].sample == events->reads[idx - 1].sample) {
+			cout << fileName << ": sample " << events->reads[idx].sample << " has two reads, a packet asks for one" << endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ApplyIoEvents(CommandPacket_T *packets, size_t count, const IoEvents_T *events, const size_t *source, size_t firstSample,
+	size_t sampleCount, IoApplyStats_T *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	if (!events->writes.empty() && (events->writes.back().sample >= sampleCount)) {
+		printf("I/O events: write at sample %zu, the trajectory has %zu samples\n", events->writes.back().sample, sampleCount);
+		return false;
+	}
+	if (!events->reads.empty() && (events->reads.back().sample >= sampleCount)) {
+		printf("I/O events: read from sample %zu, the trajectory has %zu samples\n", events->reads.back().sample, sampleCount);
+		return false;
+	}
+
+	// packets and events both go by sample: one pass over each
+	size_t writeIdx = 0;
+	size_t readIdx = 0;
+	const IoRead_T *reading = NULL;
+	while ((writeIdx < events->writes.size()) && (events->writes[writeIdx].sample < firstSample)) {
+		writeIdx++;
+		stats->done++;
+	}
+	for (size_t packetIdx = 0; packetIdx < count; packetIdx++) {
+		CommandPacket_T *packet = &packets[packetIdx];
+		size_t sample = (source != NULL) ? source[packetIdx] : packetIdx;
+
+		ClearIoWrite(packet);
+		if ((writeIdx < events->writes.size()) && (events->writes[writeIdx].sample <= sample)) {
+			const IoWrite_T *write = &events->writes[writeIdx++];
+			packet->writeIOType = write->type;
+			packet->writeIOIndex = htons(write->index);
+			packet->writeIOMask = htons(write->mask);
+			packet->writeIOValue = htons(write->value);
+			stats->writes++;
+			if (write->sample < sample) {
+				stats->delayed++;
+			}
+		}
+
+		while ((readIdx < events->reads.size()) && (events->reads[readIdx].sample <= sample)) {
+			reading = &events->reads[readIdx++];
+		}
+		bool read = (reading != NULL) && (reading->type != IoTypeNone);
+		packet->readIOType = read ? reading->type : IoTypeNone;
+		packet->readIOIndex = htons(read ? reading->index : 0);
+		packet->readIOMask = htons(read ? reading->mask : 0);
+		if (read) {
+			stats->readPackets++;
+		}
+	}
+	return true;
+}
+
+void WriteIoEvents(const IoEvents_T *events, const IoApplyStats_T *stats)
+{
+	printf("I/O events: %zu writes, %zu read changes; %zu packets write", events->writes.size(), events->reads.size(), stats->writes);
+	if (stats->done > 0) {
+		printf(" (%zu done before the fault)", stats->done);
+	}
+	if (stats->delayed > 0) {
+		printf(" (%zu a packet later)", stats->delayed);
+	}
+	printf(", %zu read\n", stats->readPackets);
+	for (size_t idx = 0; (idx < events->writes.size()) && (idx < 4); idx++) {
+		const IoWrite_T *write = &events->writes[idx];
+		printf("  sample %zu: %s[%u] mask 0x%04x = 0x%04x\n", write->sample, IoTypeText(write->type), write->index, write->mask, write->value);
+	}
+	if (events->writes.size() > 4) {
+		printf("  ...\n");
+	}
+}
@@ -0,0 +1,92 @@
+//
+// IoEvents.h : I/O writes and reads tied to the samples of a trajectory
+//
+// Every command packet can write up to 16 signals of one I/O type and ask
+// for 16 signals to be read back in the status. The controller writes when
+// it executes the command, so a write carried by the packet of sample k
+// happens in the ITP cycle the robot is at sample k, not some cycles later
+// as through a separate I/O path. An event file (--io-events) says what
+// goes into which packet; one event per line:
+//
+//   sample  write  type  index  mask  value   signals index .. index + 15 under mask set to value
+//   sample  read   type  index  mask          from this sample on, every status returns these signals
+//   sample  read   none                       no more reads
+//
+// sample is the 0 based sample (line) of the data file, type DI DO RI RO UI
+// UO F or the controller's I/O type code, index the first signal (1 based),
+// mask and value 16 bits, decimal or 0x hex; # starts a comment. A packet
+// carries one write: two writes on a sample must be of the same type and
+// index and not set the same signals. The read values come back in the
+// statuses, and with the receive time and the controller's time stamp in
+// the telemetry log (--record).
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+#include "J519Packet.h"
+
+// I/O type codes of the packets, the controller's (KAREL) numbering
+const u_byte IoTypeNone = 0;
+const u_byte IoTypeDI = 1;
+const u_byte IoTypeDO = 2;
+const u_byte IoTypeRI = 8;
+const u_byte IoTypeRO = 9;
+const u_byte IoTypeUI = 20;
+const u_byte IoTypeUO = 21;
+const u_byte IoTypeFlag = 35;
+
+typedef struct IoWrite_T {
+	size_t sample;
+	u_byte type;
+	u_short index;
+	u_short mask;
+	u_short value;
+} IoWrite_T;
+
+typedef struct IoRead_T {
+	size_t sample;            // first sample of the subscription, until the next one
+	u_byte type;              // IoTypeNone ends reading
+	u_short index;
+	u_short mask;
+} IoRead_T;
+
+typedef struct IoEvents_T {
+	std::vector<IoWrite_T> writes;   // by sample, one per sample
+	std::vector<IoRead_T> reads;     // by sample, one per sample
+} IoEvents_T;
+
+typedef struct IoApplyStats_T {
+	size_t writes;            // packets given a write
+	size_t delayed;           // resumed trajectory: write moved to the next packet, its own had one
+	size_t done;              // resumed trajectory: executed before the fault, not sent again
+	size_t readPackets;       // packets asking for a read
+} IoApplyStats_T;
+
+/*
+ * LoadIoEvents: the event file, sorted and merged by sample. On error
+ *               prints "file:line: reason" and returns false.
+ */
+bool LoadIoEvents(const char *fileName, IoEvents_T *events);
+
+/*
+ * ApplyIoEvents: stamp the events into encoded command packets. source (NULL
+ *                for the packets of the trajectory itself) gives the sample
+ *                each packet stands for, as after a resume; writes of samples
+ *                before firstSample were executed already and are left out.
+ *                false (reason printed) if an event is past the trajectory.
+ */
+bool ApplyIoEvents(CommandPacket_T *packets, size_t count, const IoEvents_T *events, const size_t *source, size_t firstSample,
+	size_t sampleCount, IoApplyStats_T *stats);
+
+// clear the write of a packet that is sent again (hold, end of motion)
+static inline void ClearIoWrite(CommandPacket_T *packet)
+{
+	packet->writeIOType = IoTypeNone;
+	packet->writeIOIndex = 0;
+	packet->writeIOMask = 0;
+	packet->writeIOValue = 0;
+}
+
+void WriteIoEvents(const IoEvents_T *events, const IoApplyStats_T *stats);
@@ -0,0 +1,89 @@
+//
+// J519Packet.cpp : build/decode the J519 stream motion packets
+//
+
+#include "stdafx.h"
+#include <string.h>
+#include "J519Packet.h"
+
+
+/* ---------------------------------------------------
+ *
+ -----------------------------------------------------*/
+void InitThresholdPacket(ThresholdPacket_T *packet_p, u_word axisNumber, u_word thresholdType) {
+	packet_p->packetType = htonl(3);
+	packet_p->versionNo = htonl(1);
+	packet_p->axisNumber = htonl(axisNumber);
+	packet_p->thresholdType = htonl(thresholdType);
+}
+
+void InitCommandPacket(CommandPacket_T *packet, u_word seqNo, const float commandPos[MaxAxisNumber], u_byte dStyle, u_byte lastD) {
+	packet->packetType = htonl(1);
+	packet->versionNo = htonl(1);
+	packet->sequenceNo = htonl(seqNo);
+	packet->lastData = lastD;
+	packet->readIOType = 0;
+	packet->readIOIndex = htons(0);
+	packet->readIOMask = htons(0);
+	packet->dataStyle = dStyle;
+	packet->writeIOType = 0;
+	packet->writeIOIndex = htons(0);
+	packet->writeIOMask = htons(0);
+	packet->writeIOValue = htons(0);
+	packet->unused = htons(0);
+	for (int idx = 0; idx < MaxAxisNumber; idx++){
+		packet->commandPos[idx] = HostFloatToNet(commandPos[idx]);
+	}
+	// printf("seq ID: %d \n", seqNo);
+}
+
+void InitStartPacket(StartPacket_T *packet) {
+	packet->packetType = htonl(0L);
+	//cout << "StartPacket packtetType (htonl): " << packet->packetType <<endl;
+	packet->versionNo = htonl(1L);
+	//cout << "StartPacket versionNum (htonl): " << packet->versionNo << endl;
+}
+
+void InitStopPacket(StopPacket_T *packet)
+{
+	packet->packetType = htonl(2L);
+	packet->versionNo = htonl(1L);
+}
+
+uint32_t Swap32(uint32_t x)
+{
+	return static_cast<uint32_t> ((x << 24) | ((x << 8) & 0x00FF0000) | ((x >> 8) & 0x0000FF00) | (x >> 24));
+}
+
+float SwapFloat(float x)
+{
+	union {
+		float f;
+		uint32_t u32;
+	} swapper;
+	swapper.f = x;
+	swapper.u32 = Swap32(swapper.u32);
+	return swapper.f;
+}
+
+u_word HostFloatToNet(float value)
+{
+	u_word bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return htonl(bits);
+}
+
+float NetToHostFloat(u_word value)
+{
+	u_word bits = ntohl(value);
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+float NetFloatField(float field)
+{
+	u_word bits;
+	memcpy(&bits, &field, sizeof(bits));
+	return NetToHostFloat(bits);
+}
@@ -0,0 +1,112 @@
+//
+// J519Packet.h : wire format of the J519 stream motion packets
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <arpa/inet.h>
+
+typedef uint8_t  u_byte;    // replace char for clarity.
+typedef uint32_t u_word;    // 32-bit packet word, u_long is 64-bit on Linux
+
+// define some constants here
+
+const u_short ROBOT_PORT = 60015;
+const int MaxAxisNumber = 9;  // data file can have  either 9 axis (or xyzwpr ext) data per each position
+const int MinAxisNumber = 6;  // Or can have 6 axis (or xyzwpr) data
+
+
+// store read in position data from data file.
+struct PositionData_T {
+	float data[MaxAxisNumber];
+};
+
+// Data exchange start packet, send to robot controller
+typedef struct StartPacket_T {
+	u_word packetType;
+	u_word versionNo;
+} StartPacket_T;
+
+
+// Motion command packet send to robot controller
+typedef struct CommandPacket_T {
+	u_word packetType;
+	u_word versionNo;
+	u_word sequenceNo;
+	u_byte lastData;
+	u_byte readIOType;
+	u_short readIOIndex;
+	u_short readIOMask;
+	u_byte dataStyle;
+	u_byte writeIOType;
+	u_short writeIOIndex;
+	u_short writeIOMask;
+	u_short writeIOValue;
+	u_short unused;
+	u_word commandPos[MaxAxisNumber];  // could be either cartesian position or joint angle, based on dataStyle
+} CommandPacket_T;
+
+// data exchange complete,s end to robot controller
+typedef struct StopPacket_T {
+	u_word packetType;
+	u_word versionNo;
+} StopPacket_T;
+
+// Receive packet from robot controller
+typedef struct RobotStatusPacket_T {
+	u_word packetType;
+	u_word versionNo;
+	u_word sequenceNo;
+	u_byte status;
+	u_byte readIOType;
+	u_short readIOIndex;
+	u_short readIOMask;
+	u_short readIOValue;
+	u_word timeStamp;
+	float position[MaxAxisNumber];
+	u_word jontAngle[MaxAxisNumber];
+	float current[MaxAxisNumber];
+} RobotStatusPacket_T;
+
+typedef struct RobotThresholdPacket_T {
+	u_word packetType;
+	u_word versionNo;
+	u_word axisNumber;
+	u_word thresholdType;
+	u_word maxCartesianSpeed;
+	u_word interval;
+
+	float noPayload[20];
+	float fullPayload[20];
+} RobotThresholdPacket_T;
+
+
+// Threshold request packet
+typedef struct ThresholdPacket_T {
+	u_word packetType; /* = 3*/
+	u_word versionNo;  /* = 2 */
+	u_word axisNumber;  /* from 1-9 */
+	u_word thresholdType;  /* 0: velocity, 1: acceleration, 2: Jerk */
+} ThresholdPacket_T;
+
+// the controller rejects anything that is not exactly these sizes
+static_assert(sizeof(CommandPacket_T) == 64, "CommandPacket_T must be 64 bytes on the wire");
+static_assert(sizeof(RobotStatusPacket_T) == 132, "RobotStatusPacket_T must be 132 bytes on the wire");
+static_assert(sizeof(RobotThresholdPacket_T) == 184, "RobotThresholdPacket_T must be 184 bytes on the wire");
+
+void InitThresholdPacket(ThresholdPacket_T *packet_p, u_word axisNumber, u_word thresholdType);
+void InitCommandPacket(CommandPacket_T *packet, u_word seqNo, const float commandPos[MaxAxisNumber], u_byte dStyle, u_byte lastD);
+void InitStartPacket(StartPacket_T *packet);
+void InitStopPacket(StopPacket_T *packet);
+
+uint32_t Swap32(uint32_t x);
+float SwapFloat(float x);
+
+/*
+ * float <-> network order conversion. The J519 packets carry IEEE floats
+ * in big endian, same as the integer fields.
+ */
+u_word HostFloatToNet(float value);
+float NetToHostFloat(u_word value);
+float NetFloatField(float field);   // a status field declared float but holding network order bits
@@ -0,0 +1,998 @@
+//
+// Kinematics.cpp : forward kinematics of the robot model's joint chain, one
+//                  pose at a time or for whole trajectories
+//
+
+#include "stdafx.h"
+#include <string.h>
+#include <math.h>
+#include <thread>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "Kinematics.h"
+#include "LaneMath.h"
+
+using namespace std;
+
+const double DegToRad = M_PI / 180.0;
+const double RadToDeg = 180.0 / M_PI;
+const double GimbalLockCos = 1.0e-6;        // cos(p) below this: p = +-90, r taken as 0
+const size_t SamplesPerThread = 16384;      // below this a batch is not split
+
+// ---------------------------------------------------------------- 3x4 transforms
+
+static void Identity34(double m[12])
+{
+	memset(m, 0, 12 * sizeof(double));
+	m[0] = m[5] = m[10] = 1.0;
+}
+
+// out = a * b, out may not be a or b
+static void Multiply34(const double a[12], const double b[12], double out[12])
+{
+	for (int row = 0; row < 3; row++) {
+		for (int col = 0; col < 4; col++) {
+			out[row * 4 + col] = a[row * 4] * b[col] + a[row * 4 + 1] * b[4 + col] + a[row * 4 + 2] * b[8 + col];
+		}
+		out[row * 4 + 3] += a[row * 4 + 3];
+	}
+}
+
+// rotation part transposed, no translation
+static void TransposeRotation(const double m[12], double out[12])
+{
+	Identity34(out);
+	for (int row = 0; row < 3; row++) {
+		for (int col = 0; col < 3; col++) {
+			out[row * 4 + col] = m[col * 4 + row];
+		}
+	}
+	out[3] = out[7] = out[11] = 0.0;
+}
+
+static void RotateZ(double m[12], double angle)
+{
+	double c = cos(angle), s = sin(angle);
+	for (int row = 0; row < 3; row++) {
+		double x = m[row * 4], y = m[row * 4 + 1];
+		m[row * 4] = c * x + s * y;
+		m[row * 4 + 1] = c * y - s * x;
+	}
+}
+
+// rotation taking z onto axis (unit)
+static void AlignZ(const double axis[3], double m[12])
+{
+	Identity34(m);
+	if (axis[2] > 1.0 - 1.0e-12) {
+		return;
+	}
+	if (axis[2] < -1.0 + 1.0e-12) {
+		m[5] = m[10] = -1.0;   // half turn about x
+		return;
+	}
+	// Rodrigues about k = z x axis
+	double kx = -axis[1], ky = axis[0];
+	double s = sqrt(kx * kx + ky * ky);
+	double c = axis[2];
+	kx /= s;
+	ky /= s;
+	double v = 1.0 - c;
+	m[0] = c + kx * kx * v;  m[1] = kx * ky * v;      m[2] = ky * s;
+	m[4] = kx * ky * v;      m[5] = c + ky * ky * v;  m[6] = -kx * s;
+	m[8] = -ky * s;          m[9] = kx * s;           m[10] = c;
+}
+
+static void Normalize(double v[3])
+{
+	double norm = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	if (norm > 0.0) {
+		v[0] /= norm;
+		v[1] /= norm;
+		v[2] /= norm;
+	}
+}
+
+// joint frames in the world (after the joint turned) and the faceplate, model angles (rad)
+static void ChainFrames(const KinematicChain_T *chain, const double q[MaxAxisNumber], double joint[][12], double end[12])
+{
+	double at[12], next[12];
+
+	Identity34(at);
+	for (int idx = 0; idx < chain->axisCount; idx++) {
+		Multiply34(at, chain->frame[idx], next);
+		RotateZ(next, q[idx]);
+		memcpy(at, next, sizeof(at));
+		if (joint != NULL) {
+			memcpy(joint[idx], at, sizeof(at));
+		}
+	}
+	Multiply34(at, chain->tool, end);
+}
+
+// ---------------------------------------------------------------- chain
+
+bool BuildKinematicChain(const RobotModel_T *model, KinematicChain_T *chain)
+{
+	double alignBack[12];     // undoes the previous joint's axis alignment
+	double origin[12];
+	double align[12];
+	double tmp[12];
+
+	memset(chain, 0, sizeof(*chain));
+	chain->axisCount = model->chainLength;
+	chain->j23Coupled = true;
+
+	// each joint turns about its own z: fold the axis alignment into the constant frames
+	Identity34(alignBack);
+	for (int idx = 0; idx < model->chainLength; idx++) {
+		const ModelJoint_T *joint = &model->joints[model->chain[idx]];
+		double rotation[9];
+		RpyToMatrix(joint->rpy, rotation);
+		for (int row = 0; row < 3; row++) {
+			origin[row * 4] = rotation[row * 3];
+			origin[row * 4 + 1] = rotation[row * 3 + 1];
+			origin[row * 4 + 2] = rotation[row * 3 + 2];
+			origin[row * 4 + 3] = joint->xyz[row] * 1000.0;
+		}
+		AlignZ(joint->axis, align);
+		Multiply34(alignBack, origin, tmp);
+		Multiply34(tmp, align, chain->frame[idx]);
+		TransposeRotation(align, alignBack);
+		memcpy(chain->linkFrame[idx], alignBack, sizeof(alignBack));
+	}
+	memcpy(chain->tool, alignBack, sizeof(chain->tool));
+
+	// joint origins at all axes zero
+	double position[MaxAxisNumber][3];
+	double at[12], next[12];
+	Identity34(at);
+	for (int idx = 0; idx < chain->axisCount; idx++) {
+		Multiply34(at, chain->frame[idx], next);
+		memcpy(at, next, sizeof(at));
+		position[idx][0] = at[3];
+		position[idx][1] = at[7];
+		position[idx][2] = at[11];
+	}
+
+	// world frame at the height of J2, like the controller's
+	if (chain->axisCount >= 2) {
+		chain->worldHeight = position[1][2];
+		chain->frame[0][11] -= position[1][2];
+	}
+	for (int idx = 0; idx < chain->axisCount; idx++) {
+		const ModelJoint_T *joint = &model->joints[model->chain[idx]];
+		chain->lower[idx] = joint->lower;
+		chain->upper[idx] = joint->upper;
+	}
+
+	// faceplate: z along the last axis pointing away from the wrist, x up
+	Multiply34(at, chain->tool, next);   // last link frame
+	double zTool[3] = { next[2], next[6], next[10] };
+	if (chain->axisCount >= 2) {
+		int last = chain->axisCount - 1;
+		double offset = 0.0;
+		for (int idx = 0; idx < 3; idx++) {
+			offset += zTool[idx] * (position[last][idx] - position[last - 1][idx]);
+		}
+		if (offset < 0.0) {
+			zTool[0] = -zTool[0];
+			zTool[1] = -zTool[1];
+			zTool[2] = -zTool[2];
+		}
+	}
+	double xTool[3] = { -zTool[2] * zTool[0], -zTool[2] * zTool[1], 1.0 - zTool[2] * zTool[2] };
+	if (xTool[2] < 1.0e-6) {
+		xTool[0] = 1.0 - zTool[0] * zTool[0];
+		xTool[1] = -zTool[0] * zTool[1];
+		xTool[2] = -zTool[0] * zTool[2];
+	}
+	Normalize(xTool);
+	double yTool[3] = { zTool[1] * xTool[2] - zTool[2] * xTool[1], zTool[2] * xTool[0] - zTool[0] * xTool[2], zTool[0] * xTool[1] - zTool[1] * xTool[0] };
+
+	double faceplate[12], linkBack[12];
+	Identity34(faceplate);
+	for (int row = 0; row < 3; row++) {
+		faceplate[row * 4] = xTool[row];
+		faceplate[row * 4 + 1] = yTool[row];
+		faceplate[row * 4 + 2] = zTool[row];
+	}
+	TransposeRotation(next, linkBack);
+	Multiply34(linkBack, faceplate, tmp);
+	Multiply34(alignBack, tmp, chain->tool);
+
+	// arm configuration reference: where the wrist is seen from J1 at zero
+	if (chain->axisCount >= 6) {
+		double q[MaxAxisNumber] = { 0.0 };
+		double joint[MaxAxisNumber][12];
+		float zero[MaxAxisNumber] = { 0.0f };
+		ChainFrames(chain, q, joint, next);
+		double d[3] = { joint[4][3] - joint[0][3], joint[4][7] - joint[0][7], joint[4][11] - joint[0][11] };
+		for (int row = 0; row < 3; row++) {
+			chain->forward[row] = joint[0][row] * d[0] + joint[0][4 + row] * d[1] + joint[0][8 + row] * d[2];
+		}
+		chain->forward[2] = 0.0;
+		Normalize(chain->forward);
+		chain->zeroConfig = 0;
+		chain->zeroConfig = ArmConfiguration(chain, zero) & (ArmConfigElbow | ArmConfigBack);
+	}
+	return true;
+}
+
+static void JointRadians(const KinematicChain_T *chain, const float joints[MaxAxisNumber], double q[MaxAxisNumber])
+{
+	for (int idx = 0; idx < chain->axisCount; idx++) {
+		q[idx] = joints[idx] * DegToRad;
+	}
+	if (chain->j23Coupled && (chain->axisCount >= 3)) {
+		q[2] += q[1];
+	}
+}
+
+void ForwardTransform(const KinematicChain_T *chain, const float joints[MaxAxisNumber], double transform[12])
+{
+	double q[MaxAxisNumber];
+
+	JointRadians(chain, joints, q);
+	ChainFrames(chain, q, NULL, transform);
+}
+
+void TransformToPose(const double m[12], float pose[6])
+{
+	double cp = sqrt(m[0] * m[0] + m[4] * m[4]);
+
+	pose[0] = (float)m[3];
+	pose[1] = (float)m[7];
+	pose[2] = (float)m[11];
+	pose[4] = (float)(atan2(-m[8], cp) * RadToDeg);
+	if (cp > GimbalLockCos) {
+		pose[3] = (float)(atan2(m[9], m[10]) * RadToDeg);
+		pose[5] = (float)(atan2(m[4], m[0]) * RadToDeg);
+	}
+	else {
+		pose[3] = (float)(atan2(-m[8] * m[1], m[5]) * RadToDeg);
+		pose[5] = 0.0f;
+	}
+}
+
+void PoseToTransform(const float pose[6], double m[12])
+{
+	double rpy[3] = { pose[3] * DegToRad, pose[4] * DegToRad, pose[5] * DegToRad };
+	double rotation[9];
+
+	RpyToMatrix(rpy, rotation);
+	for (int row = 0; row < 3; row++) {
+		m[row * 4] = rotation[row * 3];
+		m[row * 4 + 1] = rotation[row * 3 + 1];
+		m[row * 4 + 2] = rotation[row * 3 + 2];
+		m[row * 4 + 3] = pose[row];
+	}
+}
+
+void LinkTransforms(const KinematicChain_T *chain, const float joints[MaxAxisNumber], double links[MaxAxisNumber + 1][12])
+{
+	double q[MaxAxisNumber];
+	double joint[MaxAxisNumber][12];
+	double end[12];
+
+	JointRadians(chain, joints, q);
+	ChainFrames(chain, q, joint, end);
+	Identity34(links[0]);
+	links[0][11] = -chain->worldHeight;
+	for (int idx = 0; idx < chain->axisCount; idx++) {
+		Multiply34(joint[idx], chain->linkFrame[idx], links[idx + 1]);
+	}
+}
+
+void ForwardKinematics(const KinematicChain_T *chain, const float joints[MaxAxisNumber], float pose[MaxAxisNumber])
+{
+	double transform[12];
+
+	ForwardTransform(chain, joints, transform);
+	TransformToPose(transform, pose);
+	for (int idx = 6; idx < MaxAxisNumber; idx++) {
+		pose[idx] = (idx < chain->axisCount) ? 0.0f : joints[idx];
+	}
+}
+
+// ---------------------------------------------------------------- batch
+
+#ifdef __SSE2__
+typedef struct LaneChain_T {
+	__m128 frame[MaxAxisNumber][12];     // chain constants broadcast to the four lanes
+	__m128 tool[12];
+} LaneChain_T;
+
+// m = m * c (constant 3x4), lanes
+static inline void MultiplyConstant4(__m128 m[12], const __m128 c[12])
+{
+	__m128 out[12];
+	for (int row = 0; row < 3; row++) {
+		const __m128 *r = &m[row * 4];
+		for (int col = 0; col < 4; col++) {
+			out[row * 4 + col] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r[0], c[col]), _mm_mul_ps(r[1], c[4 + col])), _mm_mul_ps(r[2], c[8 + col]));
+		}
+		out[row * 4 + 3] = _mm_add_ps(out[row * 4 + 3], r[3]);
+	}
+	memcpy(m, out, sizeof(out));
+}
+
+static inline void RotateZ4(__m128 m[12], __m128 s, __m128 c)
+{
+	for (int row = 0; row < 3; row++) {
+		__m128 x = m[row * 4], y = m[row * 4 + 1];
+		m[row * 4] = _mm_add_ps(_mm_mul_ps(c, x), _mm_mul_ps(s, y));
+		m[row * 4 + 1] = _mm_sub_ps(_mm_mul_ps(c, y), _mm_mul_ps(s, x));
+	}
+}
+
+static void ForwardKinematics4(const KinematicChain_T *chain, const LaneChain_T *lanes, const PositionData_T *joints, PositionData_T *poses)
+{
+	const __m128 degToRad = _mm_set1_ps((float)DegToRad);
+	const __m128 radToDeg = _mm_set1_ps((float)RadToDeg);
+	__m128 q[MaxAxisNumber];
+	__m128 m[12];
+
+	// four samples -> one lane each
+	for (int idx = 0; idx < chain->axisCount; idx++) {
+		q[idx] = _mm_mul_ps(_mm_setr_ps(joints[0].data[idx], joints[1].data[idx], joints[2].data[idx], joints[3].data[idx]), degToRad);
+	}
+	if (chain->j23Coupled && (chain->axisCount >= 3)) {
+		q[2] = _mm_add_ps(q[2], q[1]);
+	}
+
+	memcpy(m, lanes->frame[0], sizeof(m));
+	for (int idx = 0; idx < chain->axisCount; idx++) {
+		if (idx > 0) {
+			MultiplyConstant4(m, lanes->frame[idx]);
+		}
+		__m128 s, c;
+		SinCos4(q[idx], &s, &c);
+		RotateZ4(m, s, c);
+	}
+	MultiplyConstant4(m, lanes->tool);
+
+	// x y z w p r, gimbal lock lanes like TransformToPose
+	__m128 cp = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(m[0], m[0]), _mm_mul_ps(m[4], m[4])));
+	__m128 negR20 = _mm_xor_ps(m[8], _mm_castsi128_ps(_mm_set1_epi32(0x80000000)));
+	__m128 locked = _mm_cmple_ps(cp, _mm_set1_ps((float)GimbalLockCos));
+	__m128 p = Atan2_4(negR20, cp);
+	__m128 w = Atan2_4(m[9], m[10]);
+	__m128 r = Atan2_4(m[4], m[0]);
+	__m128 wLocked = Atan2_4(_mm_mul_ps(negR20, m[1]), m[5]);
+	w = _mm_or_ps(_mm_and_ps(locked, wLocked), _mm_andnot_ps(locked, w));
+	r = _mm_andnot_ps(locked, r);
+
+	float out[6][4];
+	_mm_storeu_ps(out[0], m[3]);
+	_mm_storeu_ps(out[1], m[7]);
+	_mm_storeu_ps(out[2], m[11]);
+	_mm_storeu_ps(out[3], _mm_mul_ps(w, radToDeg));
+	_mm_storeu_ps(out[4], _mm_mul_ps(p, radToDeg));
+	_mm_storeu_ps(out[5], _mm_mul_ps(r, radToDeg));
+	for (int lane = 0; lane < 4; lane++) {
+		for (int idx = 0; idx < 6; idx++) {
+			poses[lane].data[idx] = out[idx][lane];
+		}
+		for (int idx = 6; idx < MaxAxisNumber; idx++) {
+			poses[lane].data[idx] = (idx < chain->axisCount) ? 0.0f : joints[lane].data[idx];
+		}
+	}
+}
+#endif
+
+static void ForwardKinematicsRange(const KinematicChain_T *chain, const PositionData_T *joints, size_t count, PositionData_T *poses)
+{
+	size_t idx = 0;
+
+#ifdef __SSE2__
+	LaneChain_T lanes;
+	for (int axis = 0; axis < chain->axisCount; axis++) {
+		for (int idx = 0; idx < 12; idx++) {
+			lanes.frame[axis][idx] = _mm_set1_ps((float)chain->frame[axis][idx]);
+		}
+	}
+	for (int idx = 0; idx < 12; idx++) {
+		lanes.tool[idx] = _mm_set1_ps((float)chain->tool[idx]);
+	}
+	for (; idx + 4 <= count; idx += 4) {
+		ForwardKinematics4(chain, &lanes, &joints[idx], &poses[idx]);
+	}
+#endif
+	for (; idx < count; idx++) {
+		ForwardKinematics(chain, joints[idx].data, poses[idx].data);
+	}
+}
+
+void ForwardKinematicsBatch(const KinematicChain_T *chain, const PositionData_T *joints, size_t count, PositionData_T *poses, int threadCount)
+{
+	if (threadCount <= 0) {
+		threadCount = (int)thread::hardware_concurrency();
+	}
+	if ((size_t)threadCount > count / SamplesPerThread) {
+		threadCount = (int)(count / SamplesPerThread);
+	}
+	if (threadCount <= 1) {
+		ForwardKinematicsRange(chain, joints, count, poses);
+		return;
+	}
+
+	// contiguous chunks, multiples of four samples
+	size_t chunk = ((count / threadCount) + 3) & ~(size_t)3;
+	vector<thread> workers;
+	for (size_t start = 0; start < count; start += chunk) {
+		size_t length = (count - start < chunk) ? count - start : chunk;
+		workers.push_back(thread(ForwardKinematicsRange, chain, joints + start, length, poses + start));
+	}
+	for (size_t idx = 0; idx < workers.size(); idx++) {
+		workers[idx].join();
+	}
+}
+
+// ---------------------------------------------------------------- inverse kinematics
+
+const int IkAxisCount = 6;
+const double OrientationScale = 500.0;      // mm per rad, weighs orientation errors against position errors
+const double IkStartDamping = 1.0;          // damped least squares lambda (mm)
+const double IkMinDamping = 1.0e-3;
+const double IkMaxDamping = 1.0e6;
+const double IkMaxStep = 0.3;               // rad per iteration, largest joint step
+const int HomotopySteps = 16;               // straight line from the seed to the first pose
+const double ChunkMatch = 1.0e-3;           // rad, chunk start solved both ways must agree
+const size_t SamplesPerIkThread = 1024;
+
+IkConfig_T IkDefaultConfig()
+{
+	IkConfig_T config;
+
+	config.maxIterations = 50;
+	config.positionTolerance = 0.01;
+	config.orientationTolerance = 0.001;
+	config.singularLimit = 20.0;
+	config.maxJointStep = 2.0;
+	config.threadCount = 0;
+	return config;
+}
+
+// joint angles (deg) from model angles (rad)
+static void JointDegrees(const KinematicChain_T *chain, const double q[MaxAxisNumber], float joints[MaxAxisNumber])
+{
+	for (int idx = 0; idx < chain->axisCount; idx++) {
+		joints[idx] = (float)(q[idx] * RadToDeg);
+	}
+	if (chain->j23Coupled && (chain->axisCount >= 3)) {
+		joints[2] = (float)((q[2] - q[1]) * RadToDeg);
+	}
+}
+
+// rotation vector (world frame) turning the current orientation onto the target
+static void RotationError(const double target[12], const double current[12], double v[3])
+{
+	double e[3][3];
+
+	for (int row = 0; row < 3; row++) {
+		for (int col = 0; col < 3; col++) {
+			e[row][col] = target[row * 4] * current[col * 4] + target[row * 4 + 1] * current[col * 4 + 1] + target[row * 4 + 2] * current[col * 4 + 2];
+		}
+	}
+	double c = (e[0][0] + e[1][1] + e[2][2] - 1.0) * 0.5;
+	c = (c > 1.0) ? 1.0 : ((c < -1.0) ? -1.0 : c);
+	double s[3] = { e[2][1] - e[1][2], e[0][2] - e[2][0], e[1][0] - e[0][1] };   // 2 sin(angle) axis
+	double angle = acos(c);
+
+	if (angle < 1.0e-6) {
+		v[0] = 0.5 * s[0];
+		v[1] = 0.5 * s[1];
+		v[2] = 0.5 * s[2];
+		return;
+	}
+	if (angle < M_PI - 1.0e-3) {
+		double k = angle / (2.0 * sin(angle));
+		v[0] = k * s[0];
+		v[1] = k * s[1];
+		v[2] = k * s[2];
+		return;
+	}
+
+	// about a half turn: axis from the symmetric part
+	int big = 0;
+	for (int idx = 1; idx < 3; idx++) {
+		if (e[idx][idx] > e[big][big]) {
+			big = idx;
+		}
+	}
+	double axis[3];
+	axis[big] = sqrt((e[big][big] - c) / (1.0 - c));
+	for (int idx = 0; idx < 3; idx++) {
+		if (idx != big) {
+			axis[idx] = (e[big][idx] + e[idx][big]) / (2.0 * (1.0 - c) * axis[big]);
+		}
+	}
+	if (axis[0] * s[0] + axis[1] * s[1] + axis[2] * s[2] < 0.0) {
+		angle = -angle;
+	}
+	v[0] = angle * axis[0];
+	v[1] = angle * axis[1];
+	v[2] = angle * axis[2];
+}
+
+// rotation part of m turned by the rotation vector v (world frame)
+static void RotateByVector(const double v[3], double m[12])
+{
+	double angle = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	if (angle < 1.0e-12) {
+		return;
+	}
+	double k[3] = { v[0] / angle, v[1] / angle, v[2] / angle };
+	double c = cos(angle), s = sin(angle), t = 1.0 - c;
+	double r[3][3] = {
+		{ c + k[0] * k[0] * t, k[0] * k[1] * t - k[2] * s, k[0] * k[2] * t + k[1] * s },
+		{ k[0] * k[1] * t + k[2] * s, c + k[1] * k[1] * t, k[1] * k[2] * t - k[0] * s },
+		{ k[0] * k[2] * t - k[1] * s, k[1] * k[2] * t + k[0] * s, c + k[2] * k[2] * t } };
+	double out[9];
+	for (int row = 0; row < 3; row++) {
+		for (int col = 0; col < 3; col++) {
+			out[row * 3 + col] = r[row][0] * m[col] + r[row][1] * m[4 + col] + r[row][2] * m[8 + col];
+		}
+	}
+	for (int row = 0; row < 3; row++) {
+		for (int col = 0; col < 3; col++) {
+			m[row * 4 + col] = out[row * 3 + col];
+		}
+	}
+}
+
+// position (mm) and scaled orientation error, the least squares right hand side
+static double PoseError(const double target[12], const double end[12], double e[6])
+{
+	e[0] = target[3] - end[3];
+	e[1] = target[7] - end[7];
+	e[2] = target[11] - end[11];
+	RotationError(target, end, &e[3]);
+	e[3] *= OrientationScale;
+	e[4] *= OrientationScale;
+	e[5] *= OrientationScale;
+	return e[0] * e[0] + e[1] * e[1] + e[2] * e[2] + e[3] * e[3] + e[4] * e[4] + e[5] * e[5];
+}
+
+// 6x6 Jacobian, row major, orientation rows scaled like PoseError
+static void Jacobian(const double joint[][12], const double end[12], double jac[36])
+{
+	for (int col = 0; col < IkAxisCount; col++) {
+		const double *f = joint[col];
+		double w[3] = { f[2], f[6], f[10] };
+		double r[3] = { end[3] - f[3], end[7] - f[7], end[11] - f[11] };
+		jac[col] = w[1] * r[2] - w[2] * r[1];
+		jac[6 + col] = w[2] * r[0] - w[0] * r[2];
+		jac[12 + col] = w[0] * r[1] - w[1] * r[0];
+		jac[18 + col] = w[0] * OrientationScale;
+		jac[24 + col] = w[1] * OrientationScale;
+		jac[30 + col] = w[2] * OrientationScale;
+	}
+}
+
+// a = J J' + shift I, lower triangle
+static void Gram(const double jac[36], double shift, double a[36])
+{
+	for (int row = 0; row < 6; row++) {
+		for (int col = 0; col <= row; col++) {
+			double sum = 0.0;
+			for (int k = 0; k < IkAxisCount; k++) {
+				sum += jac[row * 6 + k] * jac[col * 6 + k];
+			}
+			a[row * 6 + col] = sum;
+		}
+		a[row * 6 + row] += shift;
+	}
+}
+
+// in place Cholesky factor of the lower triangle, false if not positive definite
+static bool Cholesky6(double a[36])
+{
+	for (int col = 0; col < 6; col++) {
+		double d = a[col * 6 + col];
+		for (int k = 0; k < col; k++) {
+			d -= a[col * 6 + k] * a[col * 6 + k];
+		}
+		if (d <= 0.0) {
+			return false;
+		}
+		d = sqrt(d);
+		a[col * 6 + col] = d;
+		for (int row = col + 1; row < 6; row++) {
+			double sum = a[row * 6 + col];
+			for (int k = 0; k < col; k++) {
+				sum -= a[row * 6 + k] * a[col * 6 + k];
+			}
+			a[row * 6 + col] = sum / d;
+		}
+	}
+	return true;
+}
+
+// dq = J' (J J' + lambda^2 I)^-1 e, false if the system cannot be solved
+static bool DampedStep(const double jac[36], const double e[6], double lambda, double dq[IkAxisCount])
+{
+	double a[36];
+	double y[6];
+
+	Gram(jac, lambda * lambda, a);
+	if (!Cholesky6(a)) {
+		return false;
+	}
+	for (int row = 0; row < 6; row++) {
+		double sum = e[row];
+		for (int k = 0; k < row; k++) {
+			sum -= a[row * 6 + k] * y[k];
+		}
+		y[row] = sum / a[row * 6 + row];
+	}
+	for (int row = 5; row >= 0; row--) {
+		double sum = y[row];
+		for (int k = row + 1; k < 6; k++) {
+			sum -= a[k * 6 + row] * y[k];
+		}
+		y[row] = sum / a[row * 6 + row];
+	}
+	for (int col = 0; col < IkAxisCount; col++) {
+		dq[col] = 0.0;
+		for (int row = 0; row < 6; row++) {
+			dq[col] += jac[row * 6 + col] * y[row];
+		}
+	}
+	return true;
+}
+
+// all singular values of the Jacobian above limit: J J' - limit^2 I positive definite
+static bool AboveSingularLimit(const double jac[36], double limit)
+{
+	double a[36];
+
+	Gram(jac, -limit * limit, a);
+	return Cholesky6(a);
+}
+
+// smallest singular value of the 6x6 Jacobian, cyclic Jacobi on J'J
+static double SmallestSingularValue(const double jac[36])
+{
+	double a[6][6];
+
+	for (int row = 0; row < 6; row++) {
+		for (int col = 0; col < 6; col++) {
+			double sum = 0.0;
+			for (int k = 0; k < 6; k++) {
+				sum += jac[k * 6 + row] * jac[k * 6 + col];
+			}
+			a[row][col] = sum;
+		}
+	}
+	for (int sweep = 0; sweep < 12; sweep++) {
+		double off = 0.0, diag = 0.0;
+		for (int p = 0; p < 6; p++) {
+			diag += a[p][p] * a[p][p];
+			for (int q = p + 1; q < 6; q++) {
+				off += a[p][q] * a[p][q];
+			}
+		}
+		if (off <= 1.0e-24 * diag) {
+			break;
+		}
+		for (int p = 0; p < 5; p++) {
+			for (int q = p + 1; q < 6; q++) {
+				if (fabs(a[p][q]) < 1.0e-300) {
+					continue;
+				}
+				double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+				double t = ((theta >= 0.0) ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+				double c = 1.0 / sqrt(t * t + 1.0), s = t * c;
+				for (int k = 0; k < 6; k++) {
+					double akp = a[k][p], akq = a[k][q];
+					a[k][p] = c * akp - s * akq;
+					a[k][q] = s * akp + c * akq;
+				}
+				for (int k = 0; k < 6; k++) {
+					double apk = a[p][k], aqk = a[q][k];
+					a[p][k] = c * apk - s * aqk;
+					a[q][k] = s * apk + c * aqk;
+				}
+			}
+		}
+	}
+	double smallest = a[0][0];
+	for (int idx = 1; idx < 6; idx++) {
+		smallest = (a[idx][idx] < smallest) ? a[idx][idx] : smallest;
+	}
+	return (smallest > 0.0) ? sqrt(smallest) : 0.0;
+}
+
+// configuration bits of model angles, joint frames already known
+static int ConfigurationOf(const KinematicChain_T *chain, const double q[MaxAxisNumber], const double joint[][12])
+{
+	int config = 0;
+	const double *f1 = joint[0], *f2 = joint[1], *f3 = joint[2], *f5 = joint[4];
+
+	if (sin(q[4]) < 0.0) {
+		config |= ArmConfigWrist;
+	}
+
+	// elbow: side of the J2 - J3 line the wrist is on, about J2's axis
+	double a[3] = { f3[3] - f2[3], f3[7] - f2[7], f3[11] - f2[11] };
+	double b[3] = { f5[3] - f3[3], f5[7] - f3[7], f5[11] - f3[11] };
+	double side = f2[2] * (a[1] * b[2] - a[2] * b[1]) + f2[6] * (a[2] * b[0] - a[0] * b[2]) + f2[10] * (a[0] * b[1] - a[1] * b[0]);
+	if (side < 0.0) {
+		config |= ArmConfigElbow;
+	}
+
+	// front / back: wrist center along the direction J1 points the arm to
+	double forward[3];
+	for (int row = 0; row < 3; row++) {
+		forward[row] = f1[row * 4] * chain->forward[0] + f1[row * 4 + 1] * chain->forward[1] + f1[row * 4 + 2] * chain->forward[2];
+	}
+	double reach = (f5[3] - f1[3]) * forward[0] + (f5[7] - f1[7]) * forward[1] + (f5[11] - f1[11]) * forward[2];
+	if (reach < 0.0) {
+		config |= ArmConfigBack;
+	}
+	return config ^ chain->zeroConfig;
+}
+
+int ArmConfiguration(const KinematicChain_T *chain, const float joints[MaxAxisNumber])
+{
+	double q[MaxAxisNumber];
+	double joint[MaxAxisNumber][12];
+	double end[12];
+
+	if (chain->axisCount < IkAxisCount) {
+		return 0;
+	}
+	JointRadians(chain, joints, q);
+	ChainFrames(chain, q, joint, end);
+	return ConfigurationOf(chain, q, joint);
+}
+
+/*
+ * SolvePose: damped least squares from q (model angles, rad) to the target
+ *            transform, damping raised on steps that do not lower the error
+ *            (Levenberg-Marquardt). q holds the closest joints found.
+ */
+static bool SolvePose(const KinematicChain_T *chain, const double target[12], const IkConfig_T *config, double q[MaxAxisNumber], IkSample_T *info)
+{
+	double joint[MaxAxisNumber][12], trialJoint[MaxAxisNumber][12];
+	double end[12], trialEnd[12];
+	double e[6], trialE[6];
+	double jac[36];
+	double dq[IkAxisCount];
+	double trial[MaxAxisNumber];
+	double lambda = IkStartDamping;
+	double positionLimit = config->positionTolerance * config->positionTolerance;
+	double orientationLimit = config->orientationTolerance * DegToRad * OrientationScale;
+	orientationLimit *= orientationLimit;
+	int iteration = 0;
+	bool converged = false;
+
+	ChainFrames(chain, q, joint, end);
+	double cost = PoseError(target, end, e);
+	for (;;) {
+		Jacobian(joint, end, jac);
+		if ((e[0] * e[0] + e[1] * e[1] + e[2] * e[2] <= positionLimit) && (e[3] * e[3] + e[4] * e[4] + e[5] * e[5] <= orientationLimit)) {
+			converged = true;
+			break;
+		}
+		if ((iteration >= config->maxIterations) || (lambda > IkMaxDamping)) {
+			break;
+		}
+		iteration++;
+		if (!DampedStep(jac, e, lambda, dq)) {
+			lambda *= 10.0;
+			continue;
+		}
+		double largest = 0.0;
+		for (int idx = 0; idx < IkAxisCount; idx++) {
+			largest = (fabs(dq[idx]) > largest) ? fabs(dq[idx]) : largest;
+		}
+		double scale = (largest > IkMaxStep) ? IkMaxStep / largest : 1.0;
+		memcpy(trial, q, sizeof(trial));
+		for (int idx = 0; idx < IkAxisCount; idx++) {
+			trial[idx] += dq[idx] * scale;
+		}
+		ChainFrames(chain, trial, trialJoint, trialEnd);
+		double trialCost = PoseError(target, trialEnd, trialE);
+		if (trialCost < cost) {
+			memcpy(q, trial, sizeof(trial));
+			memcpy(joint, trialJoint, sizeof(joint));
+			memcpy(end, trialEnd, sizeof(end));
+			memcpy(e, trialE, sizeof(e));
+			cost = trialCost;
+			lambda = (lambda * 0.1 > IkMinDamping) ? lambda * 0.1 : IkMinDamping;
+		}
+		else {
+			lambda *= 10.0;
+		}
+	}
+
+	info->flags = converged ? 0 : IkUnreachable;
+	info->iterations = (unsigned char)iteration;
+	info->positionError = (float)sqrt(e[0] * e[0] + e[1] * e[1] + e[2] * e[2]);
+	info->orientationError = (float)(sqrt(e[3] * e[3] + e[4] * e[4] + e[5] * e[5]) / OrientationScale * RadToDeg);
+	info->config = (unsigned char)ConfigurationOf(chain, q, joint);
+	info->sigma = 0.0f;
+	if (!AboveSingularLimit(jac, config->singularLimit)) {
+		info->sigma = (float)SmallestSingularValue(jac);
+		info->flags |= IkSingular;
+	}
+	for (int idx = 0; idx < IkAxisCount; idx++) {
+		if (((chain->lower[idx] != 0.0) || (chain->upper[idx] != 0.0)) && ((q[idx] < chain->lower[idx]) || (q[idx] > chain->upper[idx]))) {
+			info->flags |= IkJointLimit;
+		}
+	}
+	return converged;
+}
+
+/*
+ * SolveFromSeed: move the target from the seed's pose to the wanted one in
+ *                a few straight steps, so the solution stays on the seed's
+ *                configuration instead of jumping to whichever is closest.
+ */
+static bool SolveFromSeed(const KinematicChain_T *chain, const double target[12], const IkConfig_T *config, double q[MaxAxisNumber], IkSample_T *info)
+{
+	double start[12], step[12];
+	double turn[3], part[3];
+
+	ChainFrames(chain, q, NULL, start);
+	RotationError(target, start, turn);
+	for (int idx = 1; idx < HomotopySteps; idx++) {
+		double fraction = (double)idx / HomotopySteps;
+		memcpy(step, start, sizeof(step));
+		for (int axis = 0; axis < 3; axis++) {
+			part[axis] = turn[axis] * fraction;
+			step[axis * 4 + 3] = start[axis * 4 + 3] + (target[axis * 4 + 3] - start[axis * 4 + 3]) * fraction;
+		}
+		RotateByVector(part, step);
+		SolvePose(chain, step, config, q, info);
+	}
+	return SolvePose(chain, target, config, q, info);
+}
+
+bool InverseKinematics(const KinematicChain_T *chain, const float pose[6], const float seed[MaxAxisNumber],
+                       const IkConfig_T *config, float joints[MaxAxisNumber], IkSample_T *info)
+{
+	double target[12];
+	double q[MaxAxisNumber];
+
+	PoseToTransform(pose, target);
+	JointRadians(chain, seed, q);
+	bool converged = SolvePose(chain, target, config, q, info);
+	JointDegrees(chain, q, joints);
+	return converged;
+}
+
+// solve poses[start, end) in order, q the model angles to start from (updated)
+static void SolveRange(const KinematicChain_T *chain, const PositionData_T *poses, size_t start, size_t end,
+                       const IkConfig_T *config, double q[MaxAxisNumber], PositionData_T *joints, IkSample_T *info)
+{
+	double target[12];
+
+	for (size_t idx = start; idx < end; idx++) {
+		PoseToTransform(poses[idx].data, target);
+		SolvePose(chain, target, config, q, &info[idx]);
+		JointDegrees(chain, q, joints[idx].data);
+		for (int axis = IkAxisCount; axis < MaxAxisNumber; axis++) {
+			joints[idx].data[axis] = poses[idx].data[axis];
+		}
+	}
+}
+
+// a chunk solved on its own: the start from the first sample's solution, then in order
+static void SolveChunk(const KinematicChain_T *chain, const PositionData_T *poses, size_t start, size_t end,
+                       const IkConfig_T *config, const double *firstQ, PositionData_T *joints, IkSample_T *info)
+{
+	double q[MaxAxisNumber];
+	double target[12];
+
+	memcpy(q, firstQ, sizeof(q));
+	PoseToTransform(poses[start].data, target);
+	SolveFromSeed(chain, target, config, q, &info[start]);
+	SolveRange(chain, poses, start, end, config, q, joints, info);
+}
+
+bool InverseKinematicsBatch(const KinematicChain_T *chain, const PositionData_T *poses, size_t count, const float seed[MaxAxisNumber],
+                            const IkConfig_T *config, PositionData_T *joints, IkSample_T *info, IkStats_T *stats)
+{
+	double q[MaxAxisNumber] = { 0.0 };
+	double target[12];
+
+	memset(stats, 0, sizeof(*stats));
+	if (chain->axisCount != IkAxisCount) {
+		printf("inverse kinematics needs a %d axis chain, the model has %d\n", IkAxisCount, chain->axisCount);
+		return false;
+	}
+	if (count == 0) {
+		return true;
+	}
+
+	// first sample from the seed, its configuration is kept
+	JointRadians(chain, seed, q);
+	PoseToTransform(poses[0].data, target);
+	SolveFromSeed(chain, target, config, q, &info[0]);
+	double firstQ[MaxAxisNumber];
+	memcpy(firstQ, q, sizeof(firstQ));
+
+	int threadCount = config->threadCount;
+	if (threadCount <= 0) {
+		threadCount = (int)thread::hardware_concurrency();
+	}
+	if ((size_t)threadCount > count / SamplesPerIkThread) {
+		threadCount = (int)(count / SamplesPerIkThread);
+	}
+	if (threadCount < 1) {
+		threadCount = 1;
+	}
+
+	// chunks solved independently, each start reached from the first sample
+	size_t chunk = (count + threadCount - 1) / threadCount;
+	vector<size_t> chunkStart;
+	for (size_t start = 0; start < count; start += chunk) {
+		chunkStart.push_back(start);
+	}
+	chunkStart.push_back(count);
+	stats->chunks = (int)chunkStart.size() - 1;
+
+	SolveRange(chain, poses, 0, chunkStart[1], config, q, joints, info);
+	if (stats->chunks > 1) {
+		vector<thread> workers;
+		for (int idx = 1; idx < stats->chunks; idx++) {
+			workers.push_back(thread(SolveChunk, chain, poses, chunkStart[idx], chunkStart[idx + 1], config, firstQ, joints, info));
+		}
+		for (size_t idx = 0; idx < workers.size(); idx++) {
+			workers[idx].join();
+		}
+	}
+
+	// where chunks meet: the chunk start warm started from the previous chunk's
+	// end must give the same joints, otherwise the chunk is solved again from there
+	for (int idx = 1; idx < stats->chunks; idx++) {
+		size_t start = chunkStart[idx];
+		double solved[MaxAxisNumber];
+		IkSample_T check;
+		JointRadians(chain, joints[start - 1].data, q);
+		PoseToTransform(poses[start].data, target);
+		SolvePose(chain, target, config, q, &check);
+		JointRadians(chain, joints[start].data, solved);
+		bool match = true;
+		for (int axis = 0; axis < IkAxisCount; axis++) {
+			if (fabs(q[axis] - solved[axis]) > ChunkMatch) {
+				match = false;
+			}
+		}
+		if (!match) {
+			JointRadians(chain, joints[start - 1].data, q);
+			SolveRange(chain, poses, start, chunkStart[idx + 1], config, q, joints, info);
+			stats->chunksRedone++;
+		}
+	}
+
+	// flags that need the previous sample
+	for (size_t idx = 0; idx < count; idx++) {
+		if (idx > 0) {
+			if (info[idx].config != info[idx - 1].config) {
+				info[idx].flags |= IkConfigChange;
+			}
+			if (config->maxJointStep > 0.0) {
+				for (int axis = 0; axis < IkAxisCount; axis++) {
+					if (fabs(joints[idx].data[axis] - joints[idx - 1].data[axis]) > config->maxJointStep) {
+						info[idx].flags |= IkJointJump;
+					}
+				}
+			}
+		}
+		stats->iterations += info[idx].iterations;
+		for (int bit = 0; bit < IkFlagCount; bit++) {
+			if (info[idx].flags & (1 << bit)) {
+				stats->flagged[bit]++;
+			}
+		}
+	}
+	return true;
+}
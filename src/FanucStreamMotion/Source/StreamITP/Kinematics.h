@@ -0,0 +1,135 @@
+//
+// Kinematics.h : forward kinematics of the robot model's joint chain, one
+//                pose at a time or for whole trajectories
+//
+// Joint angles are degrees as in the data files and the J519 packets. Poses
+// are FANUC style x y z (mm) w p r (deg, R = Rz(r) * Ry(p) * Rx(w)) of the
+// faceplate in the world frame, so they stream as Cartesian data as is:
+//   - world frame: the model's base frame moved up to the height of J2
+//   - faceplate: z out of the flange along J6, x up at all axes zero
+// With j23Coupled (FANUC controllers) J3 is measured from the horizontal, so
+// the model's J3 angle is J3 + J2.
+//
+// The batch version transposes groups of samples into lanes (structure of
+// arrays) and runs the chain with SSE on four samples at a time, splitting
+// big trajectories over all CPUs. It works in float; the scalar version is
+// the double precision reference.
+//
+// Inverse kinematics (6 axis chains) is damped least squares on the chain's
+// Jacobian, warm started from the previous sample so the arm stays in the
+// configuration it started in. Trajectories are cut into chunks solved on
+// all CPUs and checked for continuity where the chunks meet.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include "J519Packet.h"
+#include "RobotModel.h"
+
+typedef struct KinematicChain_T {
+	int axisCount;                      // joints in the chain, the remaining data columns pass through
+	double frame[MaxAxisNumber][12];    // row major 3x4 (mm) applied before joint i turns about its z
+	double tool[12];                    // last joint frame -> faceplate
+	double linkFrame[MaxAxisNumber][12];  // joint frame -> the model's child link frame (meshes, inertials)
+	bool j23Coupled;
+
+	double worldHeight;                 // world frame origin above the model's base frame (mm)
+	double lower[MaxAxisNumber];        // model joint limits (rad, J3 from the model), both 0 = not set
+	double upper[MaxAxisNumber];
+	double forward[3];                  // J1 frame direction the arm points to at all axes zero
+	int zeroConfig;                     // ArmConfiguration bits of the zero pose (elbow, front)
+} KinematicChain_T;
+
+/*
+ * BuildKinematicChain: constant transforms of the model's chain, j23Coupled
+ *                      set (FANUC joint angles).
+ */
+bool BuildKinematicChain(const RobotModel_T *model, KinematicChain_T *chain);
+
+// 3x4 row major transform of the faceplate in the world frame (mm)
+void ForwardTransform(const KinematicChain_T *chain, const float joints[MaxAxisNumber], double transform[12]);
+
+// transform -> x y z w p r
+void TransformToPose(const double transform[12], float pose[6]);
+void PoseToTransform(const float pose[6], double transform[12]);
+
+/*
+ * LinkTransforms: model link frames in the world (mm), 0 = root link, i = the
+ *                 child link of joint i, for meshes and inertials
+ */
+void LinkTransforms(const KinematicChain_T *chain, const float joints[MaxAxisNumber], double links[MaxAxisNumber + 1][12]);
+
+/*
+ * ForwardKinematics: pose of one sample, external axes (past axisCount)
+ *                    copied through, double precision
+ */
+void ForwardKinematics(const KinematicChain_T *chain, const float joints[MaxAxisNumber], float pose[MaxAxisNumber]);
+
+/*
+ * ForwardKinematicsBatch: poses of a whole trajectory. threadCount 0 = one
+ *                         per CPU, small batches stay on the calling thread.
+ */
+void ForwardKinematicsBatch(const KinematicChain_T *chain, const PositionData_T *joints, size_t count, PositionData_T *poses, int threadCount);
+
+// ---------------------------------------------------------------- inverse kinematics
+
+// ArmConfiguration bits
+const int ArmConfigWrist = 0x01;     // J5 below zero
+const int ArmConfigElbow = 0x02;     // elbow on the other side than at all axes zero (down)
+const int ArmConfigBack = 0x04;      // wrist center behind J1
+
+// IkSample_T.flags
+const unsigned char IkUnreachable = 0x01;     // no joints reach the pose, the closest ones are kept
+const unsigned char IkSingular = 0x02;        // Jacobian close to singular
+const unsigned char IkConfigChange = 0x04;    // arm configuration differs from the previous sample
+const unsigned char IkJointLimit = 0x08;      // outside the model's joint limits
+const unsigned char IkJointJump = 0x10;       // a joint moves more than maxJointStep from the previous sample
+const int IkFlagCount = 5;
+
+typedef struct IkConfig_T {
+	int maxIterations;              // per sample
+	double positionTolerance;       // mm
+	double orientationTolerance;    // deg
+	double singularLimit;           // smallest singular value of the Jacobian (mm/rad, orientation rows x 500 mm)
+	double maxJointStep;            // deg per sample, 0 = not checked
+	int threadCount;                // 0 = one per CPU
+} IkConfig_T;
+
+typedef struct IkSample_T {
+	unsigned char flags;
+	unsigned char config;           // ArmConfiguration bits
+	unsigned char iterations;
+	float positionError;            // mm
+	float orientationError;         // deg
+	float sigma;                    // smallest singular value of the Jacobian, IkSingular samples only
+} IkSample_T;
+
+typedef struct IkStats_T {
+	int chunks;
+	int chunksRedone;               // solved again from the previous chunk's end
+	size_t iterations;
+	size_t flagged[IkFlagCount];    // samples per IkSample_T.flags bit
+} IkStats_T;
+
+IkConfig_T IkDefaultConfig();
+
+// ArmConfig bits of a joint position
+int ArmConfiguration(const KinematicChain_T *chain, const float joints[MaxAxisNumber]);
+
+/*
+ * InverseKinematics: joints of one pose, damped least squares started from
+ *                    seed. Returns false (IkUnreachable) if the tolerances
+ *                    are not met; joints are then the closest found.
+ */
+bool InverseKinematics(const KinematicChain_T *chain, const float pose[6], const float seed[MaxAxisNumber],
+                       const IkConfig_T *config, float joints[MaxAxisNumber], IkSample_T *info);
+
+/*
+ * InverseKinematicsBatch: joints of a whole Cartesian trajectory. The first
+ *                         sample is reached from seed along a straight line
+ *                         so it keeps the seed's configuration, each next one
+ *                         starts from the previous. External axes are copied.
+ */
+bool InverseKinematicsBatch(const KinematicChain_T *chain, const PositionData_T *poses, size_t count, const float seed[MaxAxisNumber],
+                            const IkConfig_T *config, PositionData_T *joints, IkSample_T *info, IkStats_T *stats);
@@ -0,0 +1,89 @@
+//
+// LaneMath.h : single precision math on four SSE lanes, for the batch
+//              versions that run one sample per lane
+//
+
+#pragma once
+
+#ifdef __SSE2__
+#include <math.h>
+#include <emmintrin.h>
+
+/*
+ * SinCos4: Cephes single precision sin/cos, four lanes. Good to a few ulp
+ *          for the joint angles the robot can reach.
+ */
+static inline void SinCos4(__m128 x, __m128 *sinOut, __m128 *cosOut)
+{
+	const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+	__m128 sinSign = _mm_and_ps(x, signMask);
+	x = _mm_andnot_ps(signMask, x);
+
+	// octant, rounded up to even
+	__m128i j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.27323954473516f)));
+	j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+	__m128 y = _mm_cvtepi32_ps(j);
+
+	// x - y * pi/4 in three steps for precision
+	x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(0.78515625f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(2.4187564849853515625e-4f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(3.77489497744594108e-8f)));
+
+	__m128i swap = _mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_set1_epi32(2));
+	__m128i sinFlip = _mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(4)), 29);
+	__m128i cosFlip = _mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(j, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29);
+
+	__m128 z = _mm_mul_ps(x, x);
+	__m128 cosPoly = _mm_set1_ps(2.443315711809948e-5f);
+	cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, z), _mm_set1_ps(-1.388731625493765e-3f));
+	cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, z), _mm_set1_ps(4.166664568298827e-2f));
+	cosPoly = _mm_mul_ps(_mm_mul_ps(cosPoly, z), z);
+	cosPoly = _mm_add_ps(_mm_sub_ps(cosPoly, _mm_mul_ps(z, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+
+	__m128 sinPoly = _mm_set1_ps(-1.9515295891e-4f);
+	sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, z), _mm_set1_ps(8.3321608736e-3f));
+	sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, z), _mm_set1_ps(-1.6666654611e-1f));
+	sinPoly = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sinPoly, z), x), x);
+
+	__m128 swapMask = _mm_castsi128_ps(swap);
+	__m128 s = _mm_or_ps(_mm_and_ps(swapMask, cosPoly), _mm_andnot_ps(swapMask, sinPoly));
+	__m128 c = _mm_or_ps(_mm_and_ps(swapMask, sinPoly), _mm_andnot_ps(swapMask, cosPoly));
+	*sinOut = _mm_xor_ps(s, _mm_xor_ps(sinSign, _mm_castsi128_ps(sinFlip)));
+	*cosOut = _mm_xor_ps(c, _mm_castsi128_ps(cosFlip));
+}
+
+// Cephes single precision atan2, four lanes
+static inline __m128 Atan2_4(__m128 y, __m128 x)
+{
+	const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+	const __m128 zero = _mm_setzero_ps();
+	__m128 ratio = _mm_div_ps(y, x);
+	__m128 sign = _mm_and_ps(ratio, signMask);
+	__m128 a = _mm_andnot_ps(signMask, ratio);
+
+	__m128 big = _mm_cmpgt_ps(a, _mm_set1_ps(2.414213562373095f));
+	__m128 mid = _mm_andnot_ps(big, _mm_cmpgt_ps(a, _mm_set1_ps(0.4142135623730950f)));
+	__m128 xBig = _mm_div_ps(_mm_set1_ps(-1.0f), a);
+	__m128 xMid = _mm_div_ps(_mm_sub_ps(a, _mm_set1_ps(1.0f)), _mm_add_ps(a, _mm_set1_ps(1.0f)));
+	__m128 t = _mm_or_ps(_mm_and_ps(big, xBig), _mm_andnot_ps(big, _mm_or_ps(_mm_and_ps(mid, xMid), _mm_andnot_ps(mid, a))));
+	__m128 base = _mm_or_ps(_mm_and_ps(big, _mm_set1_ps((float)M_PI_2)), _mm_and_ps(mid, _mm_set1_ps((float)M_PI_4)));
+
+	__m128 z = _mm_mul_ps(t, t);
+	__m128 poly = _mm_set1_ps(8.05374449538e-2f);
+	poly = _mm_sub_ps(_mm_mul_ps(poly, z), _mm_set1_ps(1.38776856032e-1f));
+	poly = _mm_add_ps(_mm_mul_ps(poly, z), _mm_set1_ps(1.99777106478e-1f));
+	poly = _mm_sub_ps(_mm_mul_ps(poly, z), _mm_set1_ps(3.33329491539e-1f));
+	poly = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(poly, z), t), t);
+	__m128 angle = _mm_xor_ps(_mm_add_ps(base, poly), sign);
+
+	// quadrant from the signs of x and y
+	__m128 xNegative = _mm_cmplt_ps(x, zero);
+	__m128 halfTurn = _mm_or_ps(_mm_set1_ps((float)M_PI), _mm_and_ps(y, signMask));
+	angle = _mm_add_ps(angle, _mm_and_ps(xNegative, halfTurn));
+	__m128 xZero = _mm_cmpeq_ps(x, zero);
+	__m128 quarterTurn = _mm_or_ps(_mm_set1_ps((float)M_PI_2), _mm_and_ps(y, signMask));
+	angle = _mm_or_ps(_mm_and_ps(xZero, quarterTurn), _mm_andnot_ps(xZero, angle));
+	__m128 bothZero = _mm_and_ps(xZero, _mm_cmpeq_ps(y, zero));
+	return _mm_andnot_ps(bothZero, angle);
+}
+#endif
@@ -0,0 +1,288 @@
+//
+// LimitCheck.cpp : pre-flight check of a joint trajectory against the
+//                  controller's velocity / acceleration / jerk thresholds
+//
+
+#include "stdafx.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "LimitCheck.h"
+
+using namespace std;
+
+const size_t LimitBlock = 1024;     // samples per axis differenced at a time
+const int DifferenceHistory = 3;    // jerk needs the 3 samples before
+
+static const char *ThresholdName[ThresholdTypeCount] = { "velocity", "acceleration", "jerk" };
+
+void InitAxisLimits(AxisLimits_T limits[MaxAxisNumber])
+{
+	memset(limits, 0, MaxAxisNumber * sizeof(AxisLimits_T));
+}
+
+static void DecodeLimitTable(LimitTable_T *table, const RobotThresholdPacket_T *pkt_p, bool fullPayload)
+{
+	const float *values = fullPayload ? pkt_p->fullPayload : pkt_p->noPayload;
+
+	table->interval = (double)ntohl(pkt_p->interval);
+	for (int idx = 0; idx < ThresholdTableSize; idx++) {
+		table->value[idx] = SwapFloat(values[idx]);
+	}
+}
+
+static bool TableIsSet(const LimitTable_T *table)
+{
+	for (int idx = 0; idx < ThresholdTableSize; idx++) {
+		if (table->value[idx] > 0.0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void SetAxisLimits(AxisLimits_T *limits, const RobotThresholdPacket_T *velPkt_p,
+	const RobotThresholdPacket_T *accPkt_p, const RobotThresholdPacket_T *jerkPkt_p, bool fullPayload)
+{
+	DecodeLimitTable(&limits->table[ThresholdVelocity], velPkt_p, fullPayload);
+	DecodeLimitTable(&limits->table[ThresholdAcceleration], accPkt_p, fullPayload);
+	DecodeLimitTable(&limits->table[ThresholdJerk], jerkPkt_p, fullPayload);
+
+	// axes the robot does not have come back with empty tables
+	limits->valid = true;
+	for (int type = 0; type < ThresholdTypeCount; type++) {
+		limits->valid = limits->valid && TableIsSet(&limits->table[type]);
+	}
+}
+
+double InterpolateLimit(const LimitTable_T *table, double speed)
+{
+	if (table->interval <= 0.0) {
+		return table->value[0];
+	}
+	double pos = speed / table->interval;
+	if (pos >= ThresholdTableSize - 1) {
+		return table->value[ThresholdTableSize - 1];
+	}
+	int entry = (int)pos;
+	double frac = pos - entry;
+	return table->value[entry] + (table->value[entry + 1] - table->value[entry]) * frac;
+}
+
+double LowestLimit(const LimitTable_T *table, double topSpeed)
+{
+	double lowest = 0.0;
+
+	for (int entry = 0; entry < ThresholdTableSize; entry++) {
+		if ((entry > 0) && (entry * table->interval > topSpeed)) {
+			break;
+		}
+		if ((table->value[entry] > 0.0) && ((lowest == 0.0) || (table->value[entry] < lowest))) {
+			lowest = table->value[entry];
+		}
+	}
+	double atTop = InterpolateLimit(table, topSpeed);
+	if ((atTop > 0.0) && ((lowest == 0.0) || (atTop < lowest))) {
+		lowest = atTop;
+	}
+	return lowest;
+}
+
+/*
+ * TableIndexBlock: table entry and fraction to the next one for each speed,
+ *                  the per sample part of InterpolateLimit without divides
+ *                  or branches so it vectorizes
+ */
+static void TableIndexBlock(const double *speed, size_t count, double invInterval, int *entry, double *frac)
+{
+	const double lastEntry = ThresholdTableSize - 1;
+	size_t idx = 0;
+
+#ifdef __SSE2__
+	const __m128d scale = _mm_set1_pd(invInterval);
+	const __m128d last = _mm_set1_pd(lastEntry);
+	for (; idx + 2 <= count; idx += 2) {
+		__m128d pos = _mm_min_pd(_mm_mul_pd(_mm_loadu_pd(&speed[idx]), scale), last);
+		__m128i whole = _mm_cvttpd_epi32(pos);
+		_mm_storel_epi64((__m128i *)&entry[idx], whole);
+		_mm_storeu_pd(&frac[idx], _mm_sub_pd(pos, _mm_cvtepi32_pd(whole)));
+	}
+#endif
+	for (; idx < count; idx++) {
+		double pos = speed[idx] * invInterval;
+		pos = (pos < lastEntry) ? pos : lastEntry;
+		entry[idx] = (int)pos;
+		frac[idx] = pos - entry[idx];
+	}
+}
+
+/*
+ * DifferenceBlock: |1st|, |2nd| and |3rd| backward difference of x, scaled
+ *                  to per second units. x has DifferenceHistory samples in
+ *                  front of the count samples differenced.
+ */
+static void DifferenceBlock(const double *x, size_t count, double cycleSec,
+	double *vel, double *acc, double *jerk)
+{
+	const double invDt = 1.0 / cycleSec;
+	const double invDt2 = invDt * invDt;
+	const double invDt3 = invDt2 * invDt;
+	size_t idx = 0;
+
+#ifdef __SSE2__
+	const __m128d absMask = _mm_castsi128_pd(_mm_set1_epi64x(0x7FFFFFFFFFFFFFFFLL));
+	const __m128d scale1 = _mm_set1_pd(invDt);
+	const __m128d scale2 = _mm_set1_pd(invDt2);
+	const __m128d scale3 = _mm_set1_pd(invDt3);
+	for (; idx + 2 <= count; idx += 2) {
+		__m128d x0 = _mm_loadu_pd(&x[idx + 3]);
+		__m128d x1 = _mm_loadu_pd(&x[idx + 2]);
+		__m128d x2 = _mm_loadu_pd(&x[idx + 1]);
+		__m128d x3 = _mm_loadu_pd(&x[idx]);
+		__m128d d1 = _mm_sub_pd(x0, x1);
+		__m128d d1prev = _mm_sub_pd(x1, x2);
+		__m128d d2 = _mm_sub_pd(d1, d1prev);
+		__m128d d2prev = _mm_sub_pd(d1prev, _mm_sub_pd(x2, x3));
+		__m128d d3 = _mm_sub_pd(d2, d2prev);
+		_mm_storeu_pd(&vel[idx], _mm_and_pd(_mm_mul_pd(d1, scale1), absMask));
+		_mm_storeu_pd(&acc[idx], _mm_and_pd(_mm_mul_pd(d2, scale2), absMask));
+		_mm_storeu_pd(&jerk[idx], _mm_and_pd(_mm_mul_pd(d3, scale3), absMask));
+	}
+#endif
+	for (; idx < count; idx++) {
+		const double *p = &x[idx + DifferenceHistory];
+		double d1 = p[0] - p[-1];
+		double d1prev = p[-1] - p[-2];
+		double d2 = d1 - d1prev;
+		double d3 = d2 - (d1prev - (p[-2] - p[-3]));
+		vel[idx] = fabs(d1 * invDt);
+		acc[idx] = fabs(d2 * invDt2);
+		jerk[idx] = fabs(d3 * invDt3);
+	}
+}
+
+static inline void CheckValue(LimitReport_T *report, size_t sampleIdx, int axisIdx, int type, double value, double limit)
+{
+	if (limit <= 0.0) {
+		return;
+	}
+	double ratio = value / limit;
+	LimitViolation_T *worst = &report->worst;
+	if (!worst->found || (ratio > worst->value / worst->limit)) {
+		worst->found = true;
+		worst->sampleIdx = sampleIdx;
+		worst->axis = axisIdx + 1;
+		worst->thresholdType = type;
+		worst->value = value;
+		worst->limit = limit;
+		worst->margin = limit - value;
+	}
+	if (ratio > 1.0) {
+		report->violations[axisIdx][type]++;
+		report->totalViolations++;
+		LimitViolation_T *first = &report->first;
+		// axes are checked one after the other, keep the earliest sample
+		if (!first->found || (sampleIdx < first->sampleIdx)) {
+			first->found = true;
+			first->sampleIdx = sampleIdx;
+			first->axis = axisIdx + 1;
+			first->thresholdType = type;
+			first->value = value;
+			first->limit = limit;
+			first->margin = limit - value;
+		}
+	}
+}
+
+bool CheckTrajectoryLimits(const PositionData_T *samples, size_t sampleCount, long cycleNs,
+	const AxisLimits_T limits[MaxAxisNumber], LimitReport_T *report)
+{
+	double x[LimitBlock + DifferenceHistory];
+	double vel[LimitBlock];
+	double acc[LimitBlock];
+	double jerk[LimitBlock];
+	int entry[LimitBlock];
+	double frac[LimitBlock];
+	double cycleSec = cycleNs / 1.0e9;
+	double cutoff = -1.0;    // value / limit that can change the report
+
+	memset(report, 0, sizeof(*report));
+	report->samplesChecked = sampleCount;
+
+	for (int axisIdx = 0; axisIdx < MaxAxisNumber; axisIdx++) {
+		const AxisLimits_T *axis = &limits[axisIdx];
+		if (!axis->valid) {
+			continue;
+		}
+		report->axesChecked++;
+		double invInterval[ThresholdTypeCount];
+		double slope[ThresholdTypeCount][ThresholdTableSize];   // per entry, the last one is flat
+		for (int type = 0; type < ThresholdTypeCount; type++) {
+			const LimitTable_T *table = &axis->table[type];
+			invInterval[type] = (table->interval > 0.0) ? 1.0 / table->interval : 0.0;
+			for (int idx = 0; idx < ThresholdTableSize - 1; idx++) {
+				slope[type][idx] = table->value[idx + 1] - table->value[idx];
+			}
+			slope[type][ThresholdTableSize - 1] = 0.0;
+		}
+
+		for (size_t start = 0; start < sampleCount; start += LimitBlock) {
+			size_t count = sampleCount - start;
+			if (count > LimitBlock) {
+				count = LimitBlock;
+			}
+			// at rest on the first sample: history before it repeats it
+			for (size_t idx = 0; idx < count + DifferenceHistory; idx++) {
+				size_t sampleIdx = (start + idx >= DifferenceHistory) ? start + idx - DifferenceHistory : 0;
+				x[idx] = samples[sampleIdx].data[axisIdx];
+			}
+			DifferenceBlock(x, count, cycleSec, vel, acc, jerk);
+
+			// most samples are well inside the limits and the worst so far: one multiply and compare each
+			const double *value[ThresholdTypeCount] = { vel, acc, jerk };
+			for (int type = 0; type < ThresholdTypeCount; type++) {
+				const LimitTable_T *table = &axis->table[type];
+				TableIndexBlock(vel, count, invInterval[type], entry, frac);
+				for (size_t idx = 0; idx < count; idx++) {
+					double limit = table->value[entry[idx]] + slope[type][entry[idx]] * frac[idx];
+					if (value[type][idx] > limit * cutoff) {
+						CheckValue(report, start + idx, axisIdx, type, value[type][idx], limit);
+						if (report->worst.found) {
+							cutoff = fmin(1.0, report->worst.value / report->worst.limit);
+						}
+					}
+				}
+			}
+		}
+	}
+	return report->totalViolations == 0;
+}
+
+static void WriteViolation(const char *label, const LimitViolation_T *violation)
+{
+	printf("%s: sample %zu (line %zu), axis %d %s %.3f, limit %.3f, margin %.3f (%.1f%%)\n",
+		label, violation->sampleIdx, violation->sampleIdx + 1, violation->axis, ThresholdName[violation->thresholdType],
+		violation->value, violation->limit, violation->margin, 100.0 * violation->margin / violation->limit);
+}
+
+void WriteLimitReport(const LimitReport_T *report)
+{
+	printf("limit check: %zu samples, %d axes, %lu values over the limit\n", report->samplesChecked, report->axesChecked, report->totalViolations);
+	for (int axisIdx = 0; axisIdx < MaxAxisNumber; axisIdx++) {
+		const unsigned long *count = report->violations[axisIdx];
+		if (count[ThresholdVelocity] + count[ThresholdAcceleration] + count[ThresholdJerk] > 0) {
+			printf("  axis %d over: velocity %lu, acceleration %lu, jerk %lu\n", axisIdx + 1,
+				count[ThresholdVelocity], count[ThresholdAcceleration], count[ThresholdJerk]);
+		}
+	}
+	if (report->first.found) {
+		WriteViolation("first violation", &report->first);
+	}
+	if (report->worst.found) {
+		WriteViolation(report->totalViolations > 0 ? "worst violation" : "tightest margin", &report->worst);
+	}
+}
@@ -0,0 +1,80 @@
+//
+// LimitCheck.h : pre-flight check of a joint trajectory against the
+//                controller's velocity / acceleration / jerk thresholds
+//
+// The controller reports one 20 entry table per axis and threshold type.
+// Entry n applies at a joint speed of n * interval, values in between are
+// interpolated linearly and speeds past the last entry use the last one.
+// Velocity, acceleration and jerk are the 1st, 2nd and 3rd backward
+// differences of the samples; the robot is taken to be at rest on the
+// first sample, the same as when streaming starts.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include "J519Packet.h"
+
+const int ThresholdTableSize = 20;
+
+// thresholdType of the request and reply packets
+const int ThresholdVelocity = 0;
+const int ThresholdAcceleration = 1;
+const int ThresholdJerk = 2;
+const int ThresholdTypeCount = 3;
+
+typedef struct LimitTable_T {
+	double interval;                       // joint speed step between entries
+	double value[ThresholdTableSize];
+} LimitTable_T;
+
+typedef struct AxisLimits_T {
+	bool valid;                            // tables fetched and not all zero
+	LimitTable_T table[ThresholdTypeCount];  // indexed by ThresholdVelocity/Acceleration/Jerk
+} AxisLimits_T;
+
+typedef struct LimitViolation_T {
+	bool found;
+	size_t sampleIdx;
+	int axis;                              // 1 based like the controller
+	int thresholdType;
+	double value;                          // |velocity|, |acceleration| or |jerk|
+	double limit;                          // interpolated threshold at that speed
+	double margin;                         // limit - value, negative when over
+} LimitViolation_T;
+
+typedef struct LimitReport_T {
+	size_t samplesChecked;
+	int axesChecked;
+	unsigned long violations[MaxAxisNumber][ThresholdTypeCount];
+	unsigned long totalViolations;
+	LimitViolation_T first;                // lowest sample index over the limit
+	LimitViolation_T worst;                // highest value / limit, over the limit or not
+} LimitReport_T;
+
+void InitAxisLimits(AxisLimits_T limits[MaxAxisNumber]);
+
+/*
+ * SetAxisLimits: decode one axis's vel/acc/jerk reply packets (network order).
+ *                fullPayload selects the full payload tables instead of no payload.
+ */
+void SetAxisLimits(AxisLimits_T *limits, const RobotThresholdPacket_T *velPkt_p,
+	const RobotThresholdPacket_T *accPkt_p, const RobotThresholdPacket_T *jerkPkt_p, bool fullPayload);
+
+double InterpolateLimit(const LimitTable_T *table, double speed);
+
+/*
+ * LowestLimit: lowest value of the table at joint speeds up to topSpeed
+ *              (HUGE_VAL for the whole table), 0 if it has none (entries of
+ *              0 are not checked)
+ */
+double LowestLimit(const LimitTable_T *table, double topSpeed);
+
+/*
+ * CheckTrajectoryLimits: check every axis with valid limits over the whole
+ *                        joint trajectory. returns true if nothing is over.
+ */
+bool CheckTrajectoryLimits(const PositionData_T *samples, size_t sampleCount, long cycleNs,
+	const AxisLimits_T limits[MaxAxisNumber], LimitReport_T *report);
+
+void WriteLimitReport(const LimitReport_T *report);
@@ -0,0 +1,546 @@
+//
+// MeshBvh.cpp : STL link meshes with a bounding volume hierarchy for contact
+//               queries between two meshes
+//
+
+#include "stdafx.h"
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <iostream>
+
+#include "MeshBvh.h"
+
+using namespace std;
+
+const size_t StlHeaderSize = 84;           // 80 byte header + triangle count
+const size_t StlTriangleSize = 50;         // normal, 3 corners, attribute word
+const int MaxQueryDepth = 128;             // pair stack per node level
+
+// ---------------------------------------------------------------- loading
+
+static bool ReadWholeFile(const char *fileName, vector<char> *data)
+{
+	FILE *fp = fopen(fileName, "rb");
+	if (fp == NULL) {
+		cout << "Cannot open mesh file: " << fileName << endl;
+		return false;
+	}
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	data->resize((size > 0) ? (size_t)size : 0);
+	bool ok = (size >= 0) && (fread(data->data(), 1, data->size(), fp) == data->size());
+	fclose(fp);
+	if (!ok) {
+		cout << "Cannot read mesh file: " << fileName << endl;
+	}
+	return ok;
+}
+
+// ASCII STL: every "vertex x y z" line is a corner, three per facet
+static bool ParseAsciiStl(const char *fileName, const vector<char> &data, vector<float> *triangles)
+{
+	string text(data.begin(), data.end());
+	size_t pos = 0;
+
+	while ((pos = text.find("vertex", pos)) != string::npos) {
+		const char *p = text.c_str() + pos + 6;
+		char *end;
+		for (int idx = 0; idx < 3; idx++) {
+			float value = strtof(p, &end);
+			if (end == p) {
+				cout << fileName << ": invalid vertex at byte " << pos << endl;
+				return false;
+			}
+			triangles->push_back(value);
+			p = end;
+		}
+		pos = p - text.c_str();
+	}
+	if ((triangles->size() == 0) || (triangles->size() % 9 != 0)) {
+		cout << fileName << ": not a binary STL file and no complete ASCII facets" << endl;
+		return false;
+	}
+	return true;
+}
+
+bool ReadStlTriangles(const char *fileName, double scale, vector<float> *triangles)
+{
+	vector<char> data;
+
+	triangles->clear();
+	if (!ReadWholeFile(fileName, &data)) {
+		return false;
+	}
+
+	u_word count = 0;
+	if (data.size() >= StlHeaderSize) {
+		memcpy(&count, &data[80], sizeof(count));   // little endian like the file, x86 hosts
+	}
+	if ((data.size() >= StlHeaderSize) && (data.size() == StlHeaderSize + (size_t)count * StlTriangleSize)) {
+		triangles->resize((size_t)count * 9);
+		for (size_t idx = 0; idx < count; idx++) {
+			memcpy(&(*triangles)[idx * 9], &data[StlHeaderSize + idx * StlTriangleSize + 12], 9 * sizeof(float));
+		}
+	}
+	else if ((data.size() >= 5) && (memcmp(data.data(), "solid", 5) == 0)) {
+		if (!ParseAsciiStl(fileName, data, triangles)) {
+			return false;
+		}
+	}
+	else {
+		cout << fileName << ": size does not match a binary STL file" << endl;
+		return false;
+	}
+
+	for (size_t idx = 0; idx < triangles->size(); idx++) {
+		(*triangles)[idx] = (float)((*triangles)[idx] * scale);
+	}
+	return true;
+}
+
+bool LoadStlMesh(const char *fileName, double scale, Mesh_T *mesh)
+{
+	vector<float> triangles;
+
+	if (!ReadStlTriangles(fileName, scale, &triangles)) {
+		return false;
+	}
+	BuildMesh(triangles.data(), triangles.size() / 9, mesh);
+	return true;
+}
+
+void InitMesh(Mesh_T *mesh)
+{
+	mesh->vertices = NULL;
+	mesh->indices = NULL;
+	mesh->nodes = NULL;
+	mesh->vertexCount = 0;
+	mesh->triangleCount = 0;
+	mesh->nodeCount = 0;
+	mesh->vertexData.clear();
+	mesh->indexData.clear();
+	mesh->nodeData.clear();
+}
+
+void TriangleCorners(const Mesh_T *mesh, size_t tri, float corners[9])
+{
+	for (int k = 0; k < 3; k++) {
+		memcpy(&corners[k * 3], &mesh->vertices[(size_t)mesh->indices[tri * 3 + k] * 3], 3 * sizeof(float));
+	}
+}
+
+// ---------------------------------------------------------------- hierarchy
+
+typedef struct BuildState_T {
+	const float *vertices;
+	const u_word *indices;
+	vector<float> centroid;        // 3 per triangle
+	vector<u_word> order;          // triangle ids, leaf order when done
+	vector<BvhNode_T> *nodes;
+} BuildState_T;
+
+static void SplitNode(BuildState_T *state, size_t nodeIdx, size_t first, size_t count)
+{
+	float lo[3] = { 1.0e30f, 1.0e30f, 1.0e30f }, hi[3] = { -1.0e30f, -1.0e30f, -1.0e30f };
+	float centerLo[3] = { 1.0e30f, 1.0e30f, 1.0e30f }, centerHi[3] = { -1.0e30f, -1.0e30f, -1.0e30f };
+
+	for (size_t idx = first; idx < first + count; idx++) {
+		u_word tri = state->order[idx];
+		for (int k = 0; k < 3; k++) {
+			const float *corner = &state->vertices[(size_t)state->indices[(size_t)tri * 3 + k] * 3];
+			for (int axis = 0; axis < 3; axis++) {
+				lo[axis] = min(lo[axis], corner[axis]);
+				hi[axis] = max(hi[axis], corner[axis]);
+			}
+		}
+		for (int axis = 0; axis < 3; axis++) {
+			centerLo[axis] = min(centerLo[axis], state->centroid[tri * 3 + axis]);
+			centerHi[axis] = max(centerHi[axis], state->centroid[tri * 3 + axis]);
+		}
+	}
+	BvhNode_T *node = &(*state->nodes)[nodeIdx];
+	memcpy(node->lo, lo, sizeof(lo));
+	memcpy(node->hi, hi, sizeof(hi));
+	if (count <= (size_t)BvhLeafTriangles) {
+		node->index = (u_word)first;
+		node->count = (u_word)count;
+		return;
+	}
+
+	// median of the centroids along the longest side
+	int axis = 0;
+	for (int k = 1; k < 3; k++) {
+		if (centerHi[k] - centerLo[k] > centerHi[axis] - centerLo[axis]) {
+			axis = k;
+		}
+	}
+	size_t mid = first + count / 2;
+	const float *centroid = state->centroid.data();
+	nth_element(state->order.begin() + first, state->order.begin() + mid, state->order.begin() + first + count,
+		[centroid, axis](u_word a, u_word b) { return centroid[a * 3 + axis] < centroid[b * 3 + axis]; });
+
+	size_t child = state->nodes->size();
+	state->nodes->resize(child + 2);
+	(*state->nodes)[nodeIdx].index = (u_word)child;
+	(*state->nodes)[nodeIdx].count = 0;
+	SplitNode(state, child, first, mid - first);
+	SplitNode(state, child + 1, mid, first + count - mid);
+}
+
+void BuildIndexedMesh(vector<float> *vertices, vector<u_word> *indices, Mesh_T *mesh)
+{
+	BuildState_T state;
+	size_t triangleCount = indices->size() / 3;
+
+	InitMesh(mesh);
+	mesh->vertexData.swap(*vertices);
+	if (triangleCount > 0) {
+		state.vertices = mesh->vertexData.data();
+		state.indices = indices->data();
+		state.nodes = &mesh->nodeData;
+		state.centroid.resize(triangleCount * 3);
+		state.order.resize(triangleCount);
+		for (size_t tri = 0; tri < triangleCount; tri++) {
+			state.order[tri] = (u_word)tri;
+			for (int axis = 0; axis < 3; axis++) {
+				float sum = 0.0f;
+				for (int k = 0; k < 3; k++) {
+					sum += state.vertices[(size_t)(*indices)[tri * 3 + k] * 3 + axis];
+				}
+				state.centroid[tri * 3 + axis] = sum / 3.0f;
+			}
+		}
+		mesh->nodeData.reserve(2 * triangleCount / BvhLeafTriangles + 1);
+		mesh->nodeData.resize(1);
+		SplitNode(&state, 0, 0, triangleCount);
+
+		mesh->indexData.resize(triangleCount * 3);
+		for (size_t idx = 0; idx < triangleCount; idx++) {
+			memcpy(&mesh->indexData[idx * 3], &(*indices)[(size_t)state.order[idx] * 3], 3 * sizeof(u_word));
+		}
+	}
+	indices->clear();
+
+	mesh->vertices = mesh->vertexData.data();
+	mesh->indices = mesh->indexData.data();
+	mesh->nodes = mesh->nodeData.data();
+	mesh->vertexCount = mesh->vertexData.size() / 3;
+	mesh->triangleCount = triangleCount;
+	mesh->nodeCount = mesh->nodeData.size();
+}
+
+void BuildMesh(const float *triangles, size_t triangleCount, Mesh_T *mesh)
+{
+	vector<float> vertices;
+	vector<u_word> indices(triangleCount * 3);
+	vector<u_word> order(triangleCount * 3);
+
+	// merge equal corners: sort the corner ids by position, give each run one vertex
+	for (size_t idx = 0; idx < order.size(); idx++) {
+		order[idx] = (u_word)idx;
+	}
+	sort(order.begin(), order.end(), [triangles](u_word a, u_word b) {
+		return memcmp(&triangles[(size_t)a * 3], &triangles[(size_t)b * 3], 3 * sizeof(float)) < 0; });
+	for (size_t idx = 0; idx < order.size(); idx++) {
+		const float *corner = &triangles[(size_t)order[idx] * 3];
+		if ((idx == 0) || (memcmp(corner, &triangles[(size_t)order[idx - 1] * 3], 3 * sizeof(float)) != 0)) {
+			vertices.insert(vertices.end(), corner, corner + 3);
+		}
+		indices[order[idx]] = (u_word)(vertices.size() / 3 - 1);
+	}
+	BuildIndexedMesh(&vertices, &indices, mesh);
+}
+
+void BoxMesh(const double size[3], Mesh_T *mesh)
+{
+	static const u_word faces[12][3] = {
+		{ 0, 2, 1 }, { 1, 2, 3 }, { 4, 5, 6 }, { 5, 7, 6 },     // z- / z+
+		{ 0, 1, 4 }, { 1, 5, 4 }, { 2, 6, 3 }, { 3, 6, 7 },     // y- / y+
+		{ 0, 4, 2 }, { 2, 4, 6 }, { 1, 3, 5 }, { 3, 7, 5 } };   // x- / x+
+	vector<float> vertices(8 * 3);
+	vector<u_word> indices(&faces[0][0], &faces[0][0] + 12 * 3);
+
+	for (int idx = 0; idx < 8; idx++) {
+		vertices[idx * 3] = (float)(((idx & 1) ? 0.5 : -0.5) * size[0]);
+		vertices[idx * 3 + 1] = (float)(((idx & 2) ? 0.5 : -0.5) * size[1]);
+		vertices[idx * 3 + 2] = (float)(((idx & 4) ? 0.5 : -0.5) * size[2]);
+	}
+	BuildIndexedMesh(&vertices, &indices, mesh);
+}
+
+// ---------------------------------------------------------------- contact
+
+static inline void Sub(const float a[3], const float b[3], float out[3])
+{
+	out[0] = a[0] - b[0];
+	out[1] = a[1] - b[1];
+	out[2] = a[2] - b[2];
+}
+
+static inline void Cross(const float a[3], const float b[3], float out[3])
+{
+	out[0] = a[1] * b[2] - a[2] * b[1];
+	out[1] = a[2] * b[0] - a[0] * b[2];
+	out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static inline float Dot(const float a[3], const float b[3])
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// segment p-q against triangle tri (Moller-Trumbore, t within the segment)
+static bool SegmentCrossesTriangle(const float p[3], const float q[3], const float *tri)
+{
+	float dir[3], e1[3], e2[3], h[3], s[3], k[3];
+
+	Sub(q, p, dir);
+	Sub(&tri[3], &tri[0], e1);
+	Sub(&tri[6], &tri[0], e2);
+	Cross(dir, e2, h);
+	float det = Dot(e1, h);
+	if (fabsf(det) < 1.0e-12f) {
+		return false;      // parallel to the plane
+	}
+	float inv = 1.0f / det;
+	Sub(p, &tri[0], s);
+	float u = Dot(s, h) * inv;
+	if ((u < 0.0f) || (u > 1.0f)) {
+		return false;
+	}
+	Cross(s, e1, k);
+	float v = Dot(dir, k) * inv;
+	if ((v < 0.0f) || (u + v > 1.0f)) {
+		return false;
+	}
+	float t = Dot(e2, k) * inv;
+	return (t >= 0.0f) && (t <= 1.0f);
+}
+
+// all corners of b strictly on one side of a's plane
+static bool OneSide(const float *a, const float *b)
+{
+	float e1[3], e2[3], n[3], d[3];
+
+	Sub(&a[3], &a[0], e1);
+	Sub(&a[6], &a[0], e2);
+	Cross(e1, e2, n);
+	float side[3];
+	for (int k = 0; k < 3; k++) {
+		Sub(&b[k * 3], &a[0], d);
+		side[k] = Dot(n, d);
+	}
+	return ((side[0] > 0.0f) && (side[1] > 0.0f) && (side[2] > 0.0f)) || ((side[0] < 0.0f) && (side[1] < 0.0f) && (side[2] < 0.0f));
+}
+
+// two triangles cross: an edge of one goes through the other (touching planes are not contact)
+static bool TrianglesCross(const float *a, const float *b)
+{
+	if (OneSide(a, b) || OneSide(b, a)) {
+		return false;
+	}
+	for (int k = 0; k < 3; k++) {
+		if (SegmentCrossesTriangle(&a[k * 3], &a[((k + 1) % 3) * 3], b) || SegmentCrossesTriangle(&b[k * 3], &b[((k + 1) % 3) * 3], a)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// b's box moved into a's frame (box around the turned box) against a's box
+static inline bool BoxesOverlap(const BvhNode_T *a, const BvhNode_T *b, const float r[9], const float t[3])
+{
+	float center[3], extent[3];
+
+	for (int axis = 0; axis < 3; axis++) {
+		center[axis] = 0.5f * (b->lo[axis] + b->hi[axis]);
+		extent[axis] = 0.5f * (b->hi[axis] - b->lo[axis]);
+	}
+	for (int row = 0; row < 3; row++) {
+		float c = r[row * 3] * center[0] + r[row * 3 + 1] * center[1] + r[row * 3 + 2] * center[2] + t[row];
+		float e = fabsf(r[row * 3]) * extent[0] + fabsf(r[row * 3 + 1]) * extent[1] + fabsf(r[row * 3 + 2]) * extent[2];
+		if ((c + e < a->lo[row]) || (c - e > a->hi[row])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool LeavesTouch(const Mesh_T *a, const BvhNode_T *leafA, const Mesh_T *b, const BvhNode_T *leafB, const float r[9], const float t[3])
+{
+	float moved[BvhLeafTriangles * 9];
+	float triA[9], corner[9];
+
+	for (u_word idx = 0; idx < leafB->count; idx++) {
+		TriangleCorners(b, (size_t)leafB->index + idx, corner);
+		for (int k = 0; k < 3; k++) {
+			for (int row = 0; row < 3; row++) {
+				moved[idx * 9 + k * 3 + row] = r[row * 3] * corner[k * 3] + r[row * 3 + 1] * corner[k * 3 + 1] + r[row * 3 + 2] * corner[k * 3 + 2] + t[row];
+			}
+		}
+	}
+	for (u_word ia = 0; ia < leafA->count; ia++) {
+		TriangleCorners(a, (size_t)leafA->index + ia, triA);
+		for (u_word ib = 0; ib < leafB->count; ib++) {
+			if (TrianglesCross(triA, &moved[ib * 9])) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// ray origin + t dir, t >= 0, through triangle tri
+static bool RayCrossesTriangle(const float origin[3], const float dir[3], const float *tri)
+{
+	float e1[3], e2[3], h[3], s[3], k[3];
+
+	Sub(&tri[3], &tri[0], e1);
+	Sub(&tri[6], &tri[0], e2);
+	Cross(dir, e2, h);
+	float det = Dot(e1, h);
+	if (fabsf(det) < 1.0e-12f) {
+		return false;
+	}
+	float inv = 1.0f / det;
+	Sub(origin, &tri[0], s);
+	float u = Dot(s, h) * inv;
+	if ((u < 0.0f) || (u > 1.0f)) {
+		return false;
+	}
+	Cross(s, e1, k);
+	float v = Dot(dir, k) * inv;
+	if ((v < 0.0f) || (u + v > 1.0f)) {
+		return false;
+	}
+	return Dot(e2, k) * inv >= 0.0f;
+}
+
+static bool RayHitsBox(const BvhNode_T *node, const float origin[3], const float inverse[3])
+{
+	float near = 0.0f, far = 1.0e30f;
+
+	for (int axis = 0; axis < 3; axis++) {
+		float t1 = (node->lo[axis] - origin[axis]) * inverse[axis];
+		float t2 = (node->hi[axis] - origin[axis]) * inverse[axis];
+		near = max(near, min(t1, t2));
+		far = min(far, max(t1, t2));
+	}
+	return near <= far;
+}
+
+/*
+ * PointInside: the point is inside the (closed) mesh if a ray from it crosses
+ *              the surface an odd number of times. The ray direction is
+ *              skewed so it does not run along the exporter's mostly axis
+ *              aligned edges.
+ */
+static bool PointInside(const Mesh_T *mesh, const float point[3])
+{
+	static const float dir[3] = { 0.8018f, 0.5345f, 0.2673f };
+	static const float inverse[3] = { 1.0f / 0.8018f, 1.0f / 0.5345f, 1.0f / 0.2673f };
+	u_word stack[MaxQueryDepth];
+	int depth = 0;
+	int crossings = 0;
+
+	const BvhNode_T *root = &mesh->nodes[0];
+	for (int axis = 0; axis < 3; axis++) {
+		if ((point[axis] < root->lo[axis]) || (point[axis] > root->hi[axis])) {
+			return false;
+		}
+	}
+	stack[depth++] = 0;
+	while (depth > 0) {
+		const BvhNode_T *node = &mesh->nodes[stack[--depth]];
+		if (!RayHitsBox(node, point, inverse)) {
+			continue;
+		}
+		if (node->count > 0) {
+			for (u_word idx = 0; idx < node->count; idx++) {
+				float corners[9];
+				TriangleCorners(mesh, (size_t)node->index + idx, corners);
+				crossings += RayCrossesTriangle(point, dir, corners) ? 1 : 0;
+			}
+		}
+		else if (depth + 2 <= MaxQueryDepth) {
+			stack[depth++] = node->index;
+			stack[depth++] = node->index + 1;
+		}
+	}
+	return (crossings & 1) != 0;
+}
+
+static inline float BoxSize(const BvhNode_T *node)
+{
+	return (node->hi[0] - node->lo[0]) + (node->hi[1] - node->lo[1]) + (node->hi[2] - node->lo[2]);
+}
+
+bool MeshesTouch(const Mesh_T *a, const double poseA[12], const Mesh_T *b, const double poseB[12])
+{
+	float r[9], t[3];
+	u_word stack[MaxQueryDepth * 2][2];
+	int depth = 0;
+
+	if ((a->nodeCount == 0) || (b->nodeCount == 0)) {
+		return false;
+	}
+
+	// b in a's frame: poseA^-1 * poseB
+	for (int row = 0; row < 3; row++) {
+		for (int col = 0; col < 3; col++) {
+			r[row * 3 + col] = (float)(poseA[row] * poseB[col] + poseA[4 + row] * poseB[4 + col] + poseA[8 + row] * poseB[8 + col]);
+		}
+		t[row] = (float)(poseA[row] * (poseB[3] - poseA[3]) + poseA[4 + row] * (poseB[7] - poseA[7]) + poseA[8 + row] * (poseB[11] - poseA[11]));
+	}
+
+	if (!BoxesOverlap(&a->nodes[0], &b->nodes[0], r, t)) {
+		return false;
+	}
+	stack[depth][0] = 0;
+	stack[depth][1] = 0;
+	depth++;
+	while (depth > 0) {
+		depth--;
+		u_word idxA = stack[depth][0], idxB = stack[depth][1];
+		const BvhNode_T *nodeA = &a->nodes[idxA];
+		const BvhNode_T *nodeB = &b->nodes[idxB];
+		if (!BoxesOverlap(nodeA, nodeB, r, t)) {
+			continue;
+		}
+		if ((nodeA->count > 0) && (nodeB->count > 0)) {
+			if (LeavesTouch(a, nodeA, b, nodeB, r, t)) {
+				return true;
+			}
+			continue;
+		}
+		// open the bigger box (or the one that is not a leaf)
+		bool openA = (nodeB->count > 0) || ((nodeA->count == 0) && (BoxSize(nodeA) >= BoxSize(nodeB)));
+		if (depth + 2 > MaxQueryDepth * 2) {
+			return true;    // cannot happen with balanced trees, err on the safe side
+		}
+		for (u_word child = 0; child < 2; child++) {
+			stack[depth][0] = openA ? nodeA->index + child : idxA;
+			stack[depth][1] = openA ? idxB : nodeB->index + child;
+			depth++;
+		}
+	}
+
+	// no surfaces cross: one mesh may still be wholly inside the other
+	float corner[3];
+	const float *cornerB = &b->vertices[0];
+	for (int row = 0; row < 3; row++) {
+		corner[row] = r[row * 3] * cornerB[0] + r[row * 3 + 1] * cornerB[1] + r[row * 3 + 2] * cornerB[2] + t[row];
+	}
+	if (PointInside(a, corner)) {
+		return true;
+	}
+	const float *cornerA = &a->vertices[0];
+	for (int row = 0; row < 3; row++) {
+		float d[3] = { cornerA[0] - t[0], cornerA[1] - t[1], cornerA[2] - t[2] };
+		corner[row] = r[row] * d[0] + r[3 + row] * d[1] + r[6 + row] * d[2];
+	}
+	return PointInside(b, corner);
+}
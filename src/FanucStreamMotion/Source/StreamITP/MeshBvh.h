@@ -0,0 +1,78 @@
+//
+// MeshBvh.h : STL link meshes with a bounding volume hierarchy for contact
+//             queries between two meshes
+//
+// The exporter writes binary STL in meters in the link frame, every corner
+// repeated for each facet; meshes are kept in mm, float, with the corners
+// merged into indexed vertices. The hierarchy is a flat array of axis aligned
+// boxes: node 0 is the root, an inner node's children are nodes index and
+// index + 1, a leaf holds the triangles [index, index + count) of the index
+// array, which is stored in leaf order.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+#include "J519Packet.h"
+
+const int BvhLeafTriangles = 4;
+
+typedef struct BvhNode_T {
+	float lo[3];            // box, mm
+	float hi[3];
+	u_word index;           // first child (inner node) or first triangle (leaf)
+	u_word count;           // triangles in a leaf, 0 for an inner node
+} BvhNode_T;
+
+static_assert(sizeof(BvhNode_T) == 32, "BvhNode_T is 32 bytes");
+
+typedef struct Mesh_T {
+	const float *vertices;            // 3 floats per vertex, mm, no duplicates
+	const u_word *indices;            // 3 vertices per triangle, leaf order
+	const BvhNode_T *nodes;
+	size_t vertexCount;
+	size_t triangleCount;
+	size_t nodeCount;
+
+	// storage of a mesh built in memory, empty when the pointers are into a
+	// mapped cache file (MeshCache.h); the struct is not copied, moved only
+	std::vector<float> vertexData;
+	std::vector<u_word> indexData;
+	std::vector<BvhNode_T> nodeData;
+} Mesh_T;
+
+void InitMesh(Mesh_T *mesh);
+
+/*
+ * ReadStlTriangles: the corners of a binary (or ASCII) STL file, 9 floats
+ *                   per triangle, times scale. On error prints the reason
+ *                   and returns false.
+ */
+bool ReadStlTriangles(const char *fileName, double scale, std::vector<float> *triangles);
+
+/*
+ * LoadStlMesh: read a binary STL file, scale (1000 for the exporter's meters)
+ *              and build the hierarchy. On error prints the reason and
+ *              returns false.
+ */
+bool LoadStlMesh(const char *fileName, double scale, Mesh_T *mesh);
+
+// mesh from triangles already in mm (9 floats each): corners merged, hierarchy built
+void BuildMesh(const float *triangles, size_t triangleCount, Mesh_T *mesh);
+
+// mesh from indexed vertices (taken over), hierarchy built, triangles reordered
+void BuildIndexedMesh(std::vector<float> *vertices, std::vector<u_word> *indices, Mesh_T *mesh);
+
+// corners of triangle tri, 9 floats
+void TriangleCorners(const Mesh_T *mesh, size_t tri, float corners[9]);
+
+// a box of the given size centered on the origin, 12 triangles
+void BoxMesh(const double size[3], Mesh_T *mesh);
+
+/*
+ * MeshesTouch: true if any triangle of a, placed at poseA (3x4 row major,
+ *              mm), crosses a triangle of b placed at poseB, or one mesh is
+ *              inside the other (closed meshes).
+ */
+bool MeshesTouch(const Mesh_T *a, const double poseA[12], const Mesh_T *b, const double poseB[12]);
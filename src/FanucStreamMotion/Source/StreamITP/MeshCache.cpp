@@ -0,0 +1,774 @@
+//
+// MeshCache.cpp : preprocessed link meshes, kept in the user cache directory
+//                 and mapped straight into memory on later runs
+//
+
+#include "stdafx.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <unordered_map>
+#include <iostream>
+#include <string>
+
+#include "MeshCache.h"
+#include "CacheFile.h"
+#include "RtUtil.h"
+
+using namespace std;
+
+static_assert(sizeof(MeshCacheHeader_T) == 192, "MeshCacheHeader_T is 192 bytes on disk");
+
+const size_t SectionAlign = 64;
+const double HullEpsilon = 1.0e-6;        // of the part size
+
+void InitMeshAsset(MeshAsset_T *asset)
+{
+	InitMesh(&asset->full);
+	InitMesh(&asset->lod);
+	asset->faceNormals = NULL;
+	asset->vertexNormals = NULL;
+	asset->hulls = NULL;
+	asset->hullVertices = NULL;
+	asset->hullIndices = NULL;
+	asset->hullCount = 0;
+	asset->fromCache = false;
+	asset->loadMs = 0.0;
+	asset->mapping = NULL;
+	asset->mappingSize = 0;
+	asset->image.clear();
+}
+
+void FreeMeshAsset(MeshAsset_T *asset)
+{
+	if (asset->mapping != NULL) {
+		munmap(asset->mapping, asset->mappingSize);
+	}
+	InitMeshAsset(asset);
+}
+
+bool MeshCachePath(const char *stlFile, char *path, size_t pathSize)
+{
+	char dir[512];
+	char absolute[PATH_MAX];
+
+	if (!CacheDirectory("meshes", dir, sizeof(dir))) {
+		return false;
+	}
+	// the same STL name shows up in every model package: tell them apart by path
+	const char *source = (realpath(stlFile, absolute) != NULL) ? absolute : stlFile;
+	string name(source);
+	size_t slash = name.find_last_of('/');
+	name = (slash == string::npos) ? name : name.substr(slash + 1);
+	size_t dot = name.find_last_of('.');
+	name = (dot == string::npos) ? name : name.substr(0, dot);
+	return snprintf(path, pathSize, "%s/%s-%016llx.itpm", dir, name.c_str(),
+		(unsigned long long)CacheHash(source, strlen(source))) < (int)pathSize;
+}
+
+// FNV-1a and size of a file, through a read only mapping
+static bool HashFile(const char *fileName, uint64_t *hash, uint64_t *size)
+{
+	int fd = open(fileName, O_RDONLY);
+	struct stat st;
+
+	if (fd < 0) {
+		cout << "Cannot open mesh file: " << fileName << endl;
+		return false;
+	}
+	if ((fstat(fd, &st) != 0) || (st.st_size == 0)) {
+		cout << "Cannot read mesh file: " << fileName << endl;
+		close(fd);
+		return false;
+	}
+	void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		cout << "Cannot map mesh file: " << fileName << endl;
+		return false;
+	}
+	*hash = CacheHash(data, (size_t)st.st_size);
+	*size = (uint64_t)st.st_size;
+	munmap(data, (size_t)st.st_size);
+	return true;
+}
+
+// ---------------------------------------------------------------- building
+
+static void FaceNormal(const float *a, const float *b, const float *c, double n[3])
+{
+	double u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	double v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+	n[0] = u[1] * v[2] - u[2] * v[1];
+	n[1] = u[2] * v[0] - u[0] * v[2];
+	n[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+// face normals (unit) and vertex normals (area weighted face normals)
+static void ComputeNormals(const Mesh_T *mesh, vector<float> *faceNormals, vector<float> *vertexNormals)
+{
+	vector<double> sum(mesh->vertexCount * 3, 0.0);
+
+	faceNormals->resize(mesh->triangleCount * 3);
+	for (size_t tri = 0; tri < mesh->triangleCount; tri++) {
+		const u_word *v = &mesh->indices[tri * 3];
+		double n[3];
+		FaceNormal(&mesh->vertices[v[0] * 3], &mesh->vertices[v[1] * 3], &mesh->vertices[v[2] * 3], n);
+		double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		for (int axis = 0; axis < 3; axis++) {
+			(*faceNormals)[tri * 3 + axis] = (length > 0.0) ? (float)(n[axis] / length) : 0.0f;
+			for (int k = 0; k < 3; k++) {
+				sum[(size_t)v[k] * 3 + axis] += n[axis];     // |n| is twice the area
+			}
+		}
+	}
+	vertexNormals->resize(mesh->vertexCount * 3);
+	for (size_t idx = 0; idx < mesh->vertexCount; idx++) {
+		double length = sqrt(sum[idx * 3] * sum[idx * 3] + sum[idx * 3 + 1] * sum[idx * 3 + 1] + sum[idx * 3 + 2] * sum[idx * 3 + 2]);
+		for (int axis = 0; axis < 3; axis++) {
+			(*vertexNormals)[idx * 3 + axis] = (length > 0.0) ? (float)(sum[idx * 3 + axis] / length) : 0.0f;
+		}
+	}
+}
+
+/*
+ * Simplify: vertex clustering, every vertex moved to the mean of the
+ *           vertices in its cell x cell x cell grid cell. Triangles that
+ *           lose an edge, and repeated ones, are dropped.
+ */
+static void Simplify(const Mesh_T *mesh, double cell, Mesh_T *coarse)
+{
+	unordered_map<uint64_t, u_word> cellIndex;
+	vector<u_word> cluster(mesh->vertexCount);
+	vector<double> sum;
+	vector<u_word> members;
+
+	for (size_t idx = 0; idx < mesh->vertexCount; idx++) {
+		const float *p = &mesh->vertices[idx * 3];
+		uint64_t key = 0;
+		for (int axis = 0; axis < 3; axis++) {
+			int64_t c = (int64_t)floor(p[axis] / cell) + (1 << 20);
+			key = (key << 21) | ((uint64_t)c & 0x1FFFFF);
+		}
+		auto found = cellIndex.find(key);
+		u_word id;
+		if (found == cellIndex.end()) {
+			id = (u_word)members.size();
+			cellIndex[key] = id;
+			members.push_back(0);
+			sum.insert(sum.end(), 3, 0.0);
+		}
+		else {
+			id = found->second;
+		}
+		cluster[idx] = id;
+		members[id]++;
+		sum[(size_t)id * 3] += p[0];
+		sum[(size_t)id * 3 + 1] += p[1];
+		sum[(size_t)id * 3 + 2] += p[2];
+	}
+
+	vector<float> vertices(members.size() * 3);
+	for (size_t id = 0; id < members.size(); id++) {
+		for (int axis = 0; axis < 3; axis++) {
+			vertices[id * 3 + axis] = (float)(sum[id * 3 + axis] / members[id]);
+		}
+	}
+
+	vector<u_word> indices;
+	vector<uint64_t> seen;
+	for (size_t tri = 0; tri < mesh->triangleCount; tri++) {
+		u_word v[3] = { cluster[mesh->indices[tri * 3]], cluster[mesh->indices[tri * 3 + 1]], cluster[mesh->indices[tri * 3 + 2]] };
+		if ((v[0] == v[1]) || (v[1] == v[2]) || (v[0] == v[2])) {
+			continue;
+		}
+		indices.insert(indices.end(), v, v + 3);
+		u_word s[3] = { v[0], v[1], v[2] };
+		sort(s, s + 3);
+		seen.push_back(((uint64_t)s[0] * 2654435761ULL) ^ ((uint64_t)s[1] << 21) ^ ((uint64_t)s[2] << 42));
+	}
+	// repeated triangles (both sides of a wall thinner than a cell)
+	vector<size_t> order(seen.size());
+	for (size_t idx = 0; idx < order.size(); idx++) {
+		order[idx] = idx;
+	}
+	sort(order.begin(), order.end(), [&seen](size_t a, size_t b) { return (seen[a] < seen[b]) || ((seen[a] == seen[b]) && (a < b)); });
+	vector<bool> keep(seen.size(), true);
+	for (size_t idx = 1; idx < order.size(); idx++) {
+		if (seen[order[idx]] != seen[order[idx - 1]]) {
+			continue;
+		}
+		u_word a[3], b[3];
+		memcpy(a, &indices[order[idx] * 3], sizeof(a));
+		memcpy(b, &indices[order[idx - 1] * 3], sizeof(b));
+		sort(a, a + 3);
+		sort(b, b + 3);
+		if (memcmp(a, b, sizeof(a)) == 0) {
+			keep[order[idx]] = false;
+		}
+	}
+	vector<u_word> kept;
+	for (size_t tri = 0; tri < keep.size(); tri++) {
+		if (keep[tri]) {
+			kept.insert(kept.end(), &indices[tri * 3], &indices[tri * 3] + 3);
+		}
+	}
+	BuildIndexedMesh(&vertices, &kept, coarse);
+}
+
+typedef struct HullFace_T {
+	int v[3];
+	double n[3];
+	double d;
+	bool alive;
+	bool sliver;       // no area to speak of, normal meaningless
+} HullFace_T;
+
+// face a b c, normal by the winding; turned outward (away from inside) if inside is given
+static bool MakeHullFace(const vector<double> &p, int a, int b, int c, const double *inside, double minArea, HullFace_T *face)
+{
+	const double *pa = &p[a * 3], *pb = &p[b * 3], *pc = &p[c * 3];
+	double u[3] = { pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2] };
+	double v[3] = { pc[0] - pa[0], pc[1] - pa[1], pc[2] - pa[2] };
+	double n[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+	double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+	face->v[0] = a;
+	face->v[1] = b;
+	face->v[2] = c;
+	for (int axis = 0; axis < 3; axis++) {
+		face->n[axis] = (length > 0.0) ? n[axis] / length : 0.0;
+	}
+	face->sliver = (length <= 2.0 * minArea);
+	face->d = face->n[0] * pa[0] + face->n[1] * pa[1] + face->n[2] * pa[2];
+	face->alive = true;
+	if ((inside != NULL) && (face->n[0] * inside[0] + face->n[1] * inside[1] + face->n[2] * inside[2] > face->d)) {
+		swap(face->v[1], face->v[2]);
+		for (int axis = 0; axis < 3; axis++) {
+			face->n[axis] = -face->n[axis];
+		}
+		face->d = -face->d;
+	}
+	return !face->sliver;
+}
+
+static inline uint64_t EdgeKey(int a, int b)
+{
+	return ((uint64_t)(uint32_t)a << 32) | (uint32_t)b;
+}
+
+static double PointDistance(const vector<double> &p, int idx, const HullFace_T *face)
+{
+	return face->n[0] * p[idx * 3] + face->n[1] * p[idx * 3 + 1] + face->n[2] * p[idx * 3 + 2] - face->d;
+}
+
+// rim edges (a, b) that chain into one loop, each vertex once
+static bool SingleLoop(const vector<pair<int, int> > &rim, unordered_map<int, int> *next)
+{
+	next->clear();
+	for (size_t e = 0; e < rim.size(); e++) {
+		if (!next->insert(make_pair(rim[e].first, rim[e].second)).second) {
+			return false;
+		}
+	}
+	int vertex = rim[0].first;
+	for (size_t e = 0; e < rim.size(); e++) {
+		auto found = next->find(vertex);
+		if (found == next->end()) {
+			return false;
+		}
+		vertex = found->second;
+		if ((vertex == rim[0].first) && (e + 1 < rim.size())) {
+			return false;
+		}
+	}
+	return vertex == rim[0].first;
+}
+
+/*
+ * ConvexHull: incremental hull of the points (3 doubles each). Each point
+ *             outside removes the faces it sees and closes the hole to the
+ *             horizon. False for flat or degenerate point sets.
+ */
+static bool ConvexHull(const vector<double> &p, vector<float> *hullVertices, vector<u_word> *hullIndices)
+{
+	int count = (int)(p.size() / 3);
+	if (count < 4) {
+		return false;
+	}
+
+	double lo[3] = { 1.0e30, 1.0e30, 1.0e30 }, hi[3] = { -1.0e30, -1.0e30, -1.0e30 };
+	int first = 0;
+	for (int idx = 0; idx < count; idx++) {
+		for (int axis = 0; axis < 3; axis++) {
+			lo[axis] = min(lo[axis], p[idx * 3 + axis]);
+			hi[axis] = max(hi[axis], p[idx * 3 + axis]);
+		}
+		first = (p[idx * 3] < p[first * 3]) ? idx : first;
+	}
+	double size = sqrt((hi[0] - lo[0]) * (hi[0] - lo[0]) + (hi[1] - lo[1]) * (hi[1] - lo[1]) + (hi[2] - lo[2]) * (hi[2] - lo[2]));
+	double eps = HullEpsilon * size;
+
+	// starting tetrahedron: farthest point, farthest from the line, farthest from the plane
+	int simplex[4] = { first, first, first, first };
+	double best = 0.0;
+	for (int idx = 0; idx < count; idx++) {
+		double d[3] = { p[idx * 3] - p[first * 3], p[idx * 3 + 1] - p[first * 3 + 1], p[idx * 3 + 2] - p[first * 3 + 2] };
+		double dist = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+		if (dist > best) {
+			best = dist;
+			simplex[1] = idx;
+		}
+	}
+	const double *a = &p[simplex[0] * 3], *b = &p[simplex[1] * 3];
+	double line[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	best = 0.0;
+	for (int idx = 0; idx < count; idx++) {
+		double d[3] = { p[idx * 3] - a[0], p[idx * 3 + 1] - a[1], p[idx * 3 + 2] - a[2] };
+		double c[3] = { line[1] * d[2] - line[2] * d[1], line[2] * d[0] - line[0] * d[2], line[0] * d[1] - line[1] * d[0] };
+		double dist = c[0] * c[0] + c[1] * c[1] + c[2] * c[2];
+		if (dist > best) {
+			best = dist;
+			simplex[2] = idx;
+		}
+	}
+	double center[3] = { 0.0, 0.0, 0.0 };
+	HullFace_T base;
+	if (!MakeHullFace(p, simplex[0], simplex[1], simplex[2], center, eps * eps, &base)) {
+		return false;
+	}
+	best = 0.0;
+	for (int idx = 0; idx < count; idx++) {
+		double dist = fabs(PointDistance(p, idx, &base));
+		if (dist > best) {
+			best = dist;
+			simplex[3] = idx;
+		}
+	}
+	if (best <= eps) {
+		return false;
+	}
+	for (int k = 0; k < 4; k++) {
+		for (int axis = 0; axis < 3; axis++) {
+			center[axis] += p[simplex[k] * 3 + axis] / 4.0;
+		}
+	}
+
+	vector<HullFace_T> faces(4);
+	unordered_map<uint64_t, int> edgeFace;      // directed edge -> face on its left
+	static const int start[4][3] = { { 0, 1, 2 }, { 0, 3, 1 }, { 1, 3, 2 }, { 2, 3, 0 } };
+	for (int k = 0; k < 4; k++) {
+		MakeHullFace(p, simplex[start[k][0]], simplex[start[k][1]], simplex[start[k][2]], center, eps * eps, &faces[k]);
+		for (int e = 0; e < 3; e++) {
+			edgeFace[EdgeKey(faces[k].v[e], faces[k].v[(e + 1) % 3])] = k;
+		}
+	}
+
+	// each outside point removes the faces it sees, flooded from the one it
+	// sees best so the hole stays one piece, and is joined to the hole's rim
+	vector<int> seen, flood;
+	unordered_map<int, int> rimNext;
+	vector<pair<int, int> > rim;
+	vector<int> seenBy(faces.size(), -1);
+	for (int idx = 0; idx < count; idx++) {
+		if ((idx == simplex[0]) || (idx == simplex[1]) || (idx == simplex[2]) || (idx == simplex[3])) {
+			continue;
+		}
+		int best = -1;
+		double farthest = eps;
+		for (size_t f = 0; f < faces.size(); f++) {
+			double dist = (faces[f].alive && !faces[f].sliver) ? PointDistance(p, idx, &faces[f]) : 0.0;
+			if (dist > farthest) {
+				farthest = dist;
+				best = (int)f;
+			}
+		}
+		if (best < 0) {
+			continue;    // inside
+		}
+
+		seen.clear();
+		rim.clear();
+		flood.assign(1, best);
+		seenBy[best] = idx;
+		while (!flood.empty()) {
+			int f = flood.back();
+			flood.pop_back();
+			seen.push_back(f);
+			for (int e = 0; e < 3; e++) {
+				int a = faces[f].v[e], b = faces[f].v[(e + 1) % 3];
+				int other = edgeFace[EdgeKey(b, a)];
+				if (seenBy[other] == idx) {
+					continue;
+				}
+				// faces in the point's plane go too (else the new faces fold over
+				// them), as do slivers
+				if (faces[other].sliver || (PointDistance(p, idx, &faces[other]) > -eps)) {
+					seenBy[other] = idx;
+					flood.push_back(other);
+				}
+				else {
+					rim.push_back(make_pair(a, b));
+				}
+			}
+		}
+		// the seen faces must make one patch without holes, a rim that is a
+		// single loop; else (nearly flat there, rounding) the point is left out
+		if (!SingleLoop(rim, &rimNext)) {
+			continue;
+		}
+		for (size_t f = 0; f < seen.size(); f++) {
+			faces[seen[f]].alive = false;
+		}
+		for (size_t e = 0; e < rim.size(); e++) {
+			HullFace_T face;
+			MakeHullFace(p, rim[e].first, rim[e].second, idx, NULL, eps * eps, &face);
+			int id = (int)faces.size();
+			faces.push_back(face);
+			seenBy.push_back(-1);
+			for (int k = 0; k < 3; k++) {
+				edgeFace[EdgeKey(face.v[k], face.v[(k + 1) % 3])] = id;
+			}
+		}
+	}
+
+	// compact: only the points the faces use
+	vector<int> remap(count, -1);
+	u_word firstVertex = (u_word)(hullVertices->size() / 3);
+	for (size_t f = 0; f < faces.size(); f++) {
+		if (!faces[f].alive) {
+			continue;
+		}
+		for (int k = 0; k < 3; k++) {
+			int v = faces[f].v[k];
+			if (remap[v] < 0) {
+				remap[v] = (int)(hullVertices->size() / 3 - firstVertex);
+				for (int axis = 0; axis < 3; axis++) {
+					hullVertices->push_back((float)p[v * 3 + axis]);
+				}
+			}
+			hullIndices->push_back((u_word)remap[v]);
+		}
+	}
+	return true;
+}
+
+// the coarse mesh cut along its box tree into parts, one hull each
+static void ConvexDecomposition(const Mesh_T *mesh, vector<ConvexHull_T> *hulls, vector<float> *hullVertices, vector<u_word> *hullIndices)
+{
+	vector<u_word> parts(1, 0);
+	while (parts.size() < (size_t)MeshHullParts) {
+		vector<u_word> next;
+		for (size_t idx = 0; idx < parts.size(); idx++) {
+			const BvhNode_T *node = &mesh->nodes[parts[idx]];
+			if (node->count > 0) {
+				next.push_back(parts[idx]);
+			}
+			else {
+				next.push_back(node->index);
+				next.push_back(node->index + 1);
+			}
+		}
+		if (next.size() == parts.size()) {
+			break;
+		}
+		parts.swap(next);
+	}
+
+	for (size_t part = 0; part < parts.size(); part++) {
+		// triangles under the node: the leaves' ranges are contiguous
+		u_word lowest = 0xFFFFFFFF, highest = 0;
+		vector<u_word> stack(1, parts[part]);
+		while (!stack.empty()) {
+			const BvhNode_T *node = &mesh->nodes[stack.back()];
+			stack.pop_back();
+			if (node->count > 0) {
+				lowest = min(lowest, node->index);
+				highest = max(highest, node->index + node->count);
+			}
+			else {
+				stack.push_back(node->index);
+				stack.push_back(node->index + 1);
+			}
+		}
+		vector<u_word> used;
+		for (size_t tri = lowest; tri < highest; tri++) {
+			used.insert(used.end(), &mesh->indices[tri * 3], &mesh->indices[tri * 3] + 3);
+		}
+		sort(used.begin(), used.end());
+		used.erase(unique(used.begin(), used.end()), used.end());
+		vector<double> points(used.size() * 3);
+		for (size_t idx = 0; idx < used.size(); idx++) {
+			for (int axis = 0; axis < 3; axis++) {
+				points[idx * 3 + axis] = mesh->vertices[(size_t)used[idx] * 3 + axis];
+			}
+		}
+
+		ConvexHull_T hull;
+		hull.firstVertex = (u_word)(hullVertices->size() / 3);
+		hull.firstIndex = (u_word)hullIndices->size();
+		if (ConvexHull(points, hullVertices, hullIndices)) {
+			hull.vertexCount = (u_word)(hullVertices->size() / 3 - hull.firstVertex);
+			hull.triangleCount = (u_word)((hullIndices->size() - hull.firstIndex) / 3);
+			hulls->push_back(hull);
+		}
+	}
+}
+
+// ---------------------------------------------------------------- file image
+
+static uint64_t AppendSection(vector<char> *image, const void *data, size_t size)
+{
+	size_t offset = (image->size() + SectionAlign - 1) & ~(SectionAlign - 1);
+	image->resize(offset + size);
+	if (size > 0) {
+		memcpy(image->data() + offset, data, size);
+	}
+	return offset;
+}
+
+static void AppendMesh(vector<char> *image, const Mesh_T *mesh, MeshSection_T *section)
+{
+	section->vertexOffset = AppendSection(image, mesh->vertices, mesh->vertexCount * 3 * sizeof(float));
+	section->indexOffset = AppendSection(image, mesh->indices, mesh->triangleCount * 3 * sizeof(u_word));
+	section->nodeOffset = AppendSection(image, mesh->nodes, mesh->nodeCount * sizeof(BvhNode_T));
+	section->vertexCount = (u_word)mesh->vertexCount;
+	section->triangleCount = (u_word)mesh->triangleCount;
+	section->nodeCount = (u_word)mesh->nodeCount;
+	section->reserved = 0;
+}
+
+static bool BuildMeshImage(const char *stlFile, double scale, double lodCell, uint64_t sourceHash, uint64_t sourceSize, vector<char> *image)
+{
+	vector<float> triangles;
+	Mesh_T full, lod;
+	vector<float> faceNormals, vertexNormals;
+	vector<ConvexHull_T> hulls;
+	vector<float> hullVertices;
+	vector<u_word> hullIndices;
+	MeshCacheHeader_T header;
+
+	if (!ReadStlTriangles(stlFile, scale, &triangles)) {
+		return false;
+	}
+	BuildMesh(triangles.data(), triangles.size() / 9, &full);
+	ComputeNormals(&full, &faceNormals, &vertexNormals);
+	Simplify(&full, lodCell, &lod);
+	ConvexDecomposition(&lod, &hulls, &hullVertices, &hullIndices);
+
+	memset(&header, 0, sizeof(header));
+	image->assign(sizeof(header), 0);
+	AppendMesh(image, &full, &header.full);
+	AppendMesh(image, &lod, &header.lod);
+	header.faceNormalOffset = AppendSection(image, faceNormals.data(), faceNormals.size() * sizeof(float));
+	header.vertexNormalOffset = AppendSection(image, vertexNormals.data(), vertexNormals.size() * sizeof(float));
+	header.hullOffset = AppendSection(image, hulls.data(), hulls.size() * sizeof(ConvexHull_T));
+	header.hullVertexOffset = AppendSection(image, hullVertices.data(), hullVertices.size() * sizeof(float));
+	header.hullIndexOffset = AppendSection(image, hullIndices.data(), hullIndices.size() * sizeof(u_word));
+	header.hullCount = (u_word)hulls.size();
+	header.hullVertexCount = (u_word)(hullVertices.size() / 3);
+	header.hullIndexCount = (u_word)hullIndices.size();
+
+	memcpy(header.magic, MeshCacheMagic, sizeof(header.magic));
+	header.version = MeshCacheVersion;
+	header.headerSize = sizeof(header);
+	header.byteOrder = 0x01020304;
+	header.sourceHash = sourceHash;
+	header.sourceSize = sourceSize;
+	header.scale = scale;
+	header.lodCell = lodCell;
+	header.fileSize = image->size();
+	memcpy(image->data(), &header, sizeof(header));
+	return true;
+}
+
+static bool SectionFits(uint64_t offset, uint64_t size, uint64_t fileSize)
+{
+	return (offset % sizeof(float) == 0) && (offset <= fileSize) && (size <= fileSize - offset);
+}
+
+static bool AttachMesh(const char *base, uint64_t fileSize, const MeshSection_T *section, Mesh_T *mesh)
+{
+	InitMesh(mesh);
+	if (!SectionFits(section->vertexOffset, (uint64_t)section->vertexCount * 3 * sizeof(float), fileSize)
+		|| !SectionFits(section->indexOffset, (uint64_t)section->triangleCount * 3 * sizeof(u_word), fileSize)
+		|| !SectionFits(section->nodeOffset, (uint64_t)section->nodeCount * sizeof(BvhNode_T), fileSize)) {
+		return false;
+	}
+	mesh->vertices = (const float *)(base + section->vertexOffset);
+	mesh->indices = (const u_word *)(base + section->indexOffset);
+	mesh->nodes = (const BvhNode_T *)(base + section->nodeOffset);
+	mesh->vertexCount = section->vertexCount;
+	mesh->triangleCount = section->triangleCount;
+	mesh->nodeCount = section->nodeCount;
+	return true;
+}
+
+/*
+ * AttachImage: point the asset into a file image (mapped or in memory) if it
+ *              is complete and was built from this source with these settings
+ */
+static bool AttachImage(const char *base, size_t size, uint64_t sourceHash, uint64_t sourceSize, double scale, double lodCell, MeshAsset_T *asset)
+{
+	MeshCacheHeader_T header;
+
+	if (size < sizeof(header)) {
+		return false;
+	}
+	memcpy(&header, base, sizeof(header));
+	if ((memcmp(header.magic, MeshCacheMagic, sizeof(header.magic)) != 0) || (header.version != MeshCacheVersion)
+		|| (header.headerSize != sizeof(header)) || (header.byteOrder != 0x01020304) || (header.fileSize != size)
+		|| (header.sourceHash != sourceHash) || (header.sourceSize != sourceSize) || (header.scale != scale) || (header.lodCell != lodCell)) {
+		return false;
+	}
+	if (!AttachMesh(base, size, &header.full, &asset->full) || !AttachMesh(base, size, &header.lod, &asset->lod)
+		|| !SectionFits(header.faceNormalOffset, (uint64_t)header.full.triangleCount * 3 * sizeof(float), size)
+		|| !SectionFits(header.vertexNormalOffset, (uint64_t)header.full.vertexCount * 3 * sizeof(float), size)
+		|| !SectionFits(header.hullOffset, (uint64_t)header.hullCount * sizeof(ConvexHull_T), size)
+		|| !SectionFits(header.hullVertexOffset, (uint64_t)header.hullVertexCount * 3 * sizeof(float), size)
+		|| !SectionFits(header.hullIndexOffset, (uint64_t)header.hullIndexCount * sizeof(u_word), size)) {
+		return false;
+	}
+	asset->faceNormals = (const float *)(base + header.faceNormalOffset);
+	asset->vertexNormals = (const float *)(base + header.vertexNormalOffset);
+	asset->hulls = (const ConvexHull_T *)(base + header.hullOffset);
+	asset->hullVertices = (const float *)(base + header.hullVertexOffset);
+	asset->hullIndices = (const u_word *)(base + header.hullIndexOffset);
+	asset->hullCount = (int)header.hullCount;
+	return true;
+}
+
+// map a cache file read only, false if missing or unreadable
+static bool MapCacheFile(const char *path, void **mapping, size_t *size)
+{
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+
+	if (fd < 0) {
+		return false;
+	}
+	if ((fstat(fd, &st) != 0) || (st.st_size == 0)) {
+		close(fd);
+		return false;
+	}
+	void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return false;
+	}
+	*mapping = data;
+	*size = (size_t)st.st_size;
+	return true;
+}
+
+bool LoadMeshAsset(const char *stlFile, double scale, double lodCell, bool rebuild, MeshAsset_T *asset)
+{
+	char path[1024];
+	uint64_t sourceHash, sourceSize;
+	int64_t start = RtNowNs();
+
+	InitMeshAsset(asset);
+	if (!HashFile(stlFile, &sourceHash, &sourceSize)) {
+		return false;
+	}
+	bool havePath = MeshCachePath(stlFile, path, sizeof(path));
+
+	if (havePath && !rebuild && MapCacheFile(path, &asset->mapping, &asset->mappingSize)) {
+		if (AttachImage((const char *)asset->mapping, asset->mappingSize, sourceHash, sourceSize, scale, lodCell, asset)) {
+			asset->fromCache = true;
+			asset->loadMs = (RtNowNs() - start) / 1.0e6;
+			return true;
+		}
+		FreeMeshAsset(asset);    // stale: built from another file version or settings
+	}
+
+	vector<char> image;
+	if (!BuildMeshImage(stlFile, scale, lodCell, sourceHash, sourceSize, &image)) {
+		return false;
+	}
+	if (havePath && WriteCacheFile(path, image.data(), image.size()) && MapCacheFile(path, &asset->mapping, &asset->mappingSize)
+		&& AttachImage((const char *)asset->mapping, asset->mappingSize, sourceHash, sourceSize, scale, lodCell, asset)) {
+		asset->loadMs = (RtNowNs() - start) / 1.0e6;
+		return true;
+	}
+
+	// no cache directory: keep the image in memory
+	if (asset->mapping != NULL) {
+		munmap(asset->mapping, asset->mappingSize);
+		asset->mapping = NULL;
+	}
+	asset->image.swap(image);
+	AttachImage(asset->image.data(), asset->image.size(), sourceHash, sourceSize, scale, lodCell, asset);
+	asset->loadMs = (RtNowNs() - start) / 1.0e6;
+	return true;
+}
+
+// ---------------------------------------------------------------- export
+
+static bool SaveStlTriangles(const char *fileName, const vector<float> &corners)
+{
+	char header[80];
+	u_word count = (u_word)(corners.size() / 9);
+	vector<char> image(80 + 4 + (size_t)count * 50, 0);
+
+	memset(header, 0, sizeof(header));
+	snprintf(header, sizeof(header), "StreamITP mesh cache export");
+	memcpy(image.data(), header, sizeof(header));
+	memcpy(image.data() + 80, &count, sizeof(count));
+	for (size_t tri = 0; tri < count; tri++) {
+		float facet[12];
+		double n[3];
+		FaceNormal(&corners[tri * 9], &corners[tri * 9 + 3], &corners[tri * 9 + 6], n);
+		double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		for (int axis = 0; axis < 3; axis++) {
+			facet[axis] = (length > 0.0) ? (float)(n[axis] / length) : 0.0f;
+		}
+		for (int k = 0; k < 9; k++) {
+			facet[3 + k] = corners[tri * 9 + k] / 1000.0f;     // back to the exporter's meters
+		}
+		memcpy(image.data() + 84 + tri * 50, facet, sizeof(facet));
+	}
+
+	FILE *fp = fopen(fileName, "wb");
+	if (fp == NULL) {
+		cout << "Cannot write " << fileName << endl;
+		return false;
+	}
+	bool ok = (fwrite(image.data(), 1, image.size(), fp) == image.size());
+	ok = (fclose(fp) == 0) && ok;
+	if (!ok) {
+		cout << "Cannot write " << fileName << endl;
+	}
+	return ok;
+}
+
+bool SaveStlMesh(const char *fileName, const Mesh_T *mesh)
+{
+	vector<float> corners(mesh->triangleCount * 9);
+
+	for (size_t tri = 0; tri < mesh->triangleCount; tri++) {
+		TriangleCorners(mesh, tri, &corners[tri * 9]);
+	}
+	return SaveStlTriangles(fileName, corners);
+}
+
+bool SaveStlHulls(const char *fileName, const MeshAsset_T *asset)
+{
+	vector<float> corners;
+
+	for (int hull = 0; hull < asset->hullCount; hull++) {
+		const ConvexHull_T *h = &asset->hulls[hull];
+		const float *vertices = &asset->hullVertices[(size_t)h->firstVertex * 3];
+		for (size_t idx = 0; idx < (size_t)h->triangleCount * 3; idx++) {
+			const float *v = &vertices[(size_t)asset->hullIndices[h->firstIndex + idx] * 3];
+			corners.insert(corners.end(), v, v + 3);
+		}
+	}
+	return SaveStlTriangles(fileName, corners);
+}
@@ -0,0 +1,103 @@
+//
+// MeshCache.h : preprocessed link meshes, kept in the user cache directory
+//               and mapped straight into memory on later runs
+//
+// One cache file per STL file (meshes/<name>-<path hash>.itpm under the
+// cache directory) holds everything the tools need, so nothing is parsed or
+// built at start:
+//   - the mesh with merged, indexed vertices and its box tree (MeshBvh.h)
+//   - face and vertex normals for display
+//   - a coarse collision mesh (vertices merged on a grid, lodCell mm) and
+//     its box tree
+//   - a convex decomposition: the hull of each of the coarse mesh's
+//     MeshHullParts box tree parts
+// The header keeps the FNV-1a hash and size of the STL file it was built
+// from; a changed STL (or scale, grid, format version) rebuilds the file.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "J519Packet.h"
+#include "MeshBvh.h"
+
+const char MeshCacheMagic[4] = { 'I', 'T', 'P', 'M' };
+const u_word MeshCacheVersion = 1;
+const double DefaultLodCell = 5.0;        // mm
+const int MeshHullParts = 8;
+
+typedef struct MeshSection_T {
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint64_t nodeOffset;
+	u_word vertexCount;
+	u_word triangleCount;
+	u_word nodeCount;
+	u_word reserved;
+} MeshSection_T;
+
+typedef struct ConvexHull_T {
+	u_word firstVertex;       // in the hull vertex array
+	u_word vertexCount;
+	u_word firstIndex;        // in the hull index array, 3 per triangle
+	u_word triangleCount;
+} ConvexHull_T;
+
+typedef struct MeshCacheHeader_T {
+	char magic[4];            // "ITPM"
+	u_word version;
+	u_word headerSize;
+	u_word byteOrder;         // 0x01020304
+	uint64_t sourceHash;      // FNV-1a of the STL file
+	uint64_t sourceSize;
+	double scale;
+	double lodCell;
+	uint64_t fileSize;
+	MeshSection_T full;
+	MeshSection_T lod;
+	uint64_t faceNormalOffset;     // full mesh, 3 floats per triangle
+	uint64_t vertexNormalOffset;   // full mesh, 3 floats per vertex
+	uint64_t hullOffset;           // ConvexHull_T per part
+	uint64_t hullVertexOffset;     // 3 floats per vertex, hull indices are per hull
+	uint64_t hullIndexOffset;
+	u_word hullCount;
+	u_word hullVertexCount;
+	u_word hullIndexCount;
+	u_word reserved;
+} MeshCacheHeader_T;
+
+typedef struct MeshAsset_T {
+	Mesh_T full;
+	Mesh_T lod;
+	const float *faceNormals;
+	const float *vertexNormals;
+	const ConvexHull_T *hulls;
+	const float *hullVertices;
+	const u_word *hullIndices;
+	int hullCount;
+	bool fromCache;           // mapped from an up to date cache file
+	double loadMs;
+
+	void *mapping;            // the mapped cache file, released by FreeMeshAsset
+	size_t mappingSize;
+	std::vector<char> image;  // the file image, when it could not be written and mapped
+} MeshAsset_T;
+
+void InitMeshAsset(MeshAsset_T *asset);
+void FreeMeshAsset(MeshAsset_T *asset);
+
+// cache file of an STL file, the directory is created if needed
+bool MeshCachePath(const char *stlFile, char *path, size_t pathSize);
+
+/*
+ * LoadMeshAsset: map the STL file's cache file, or build it (and write it)
+ *                if missing, stale or rebuild is set. On error prints the
+ *                reason and returns false.
+ */
+bool LoadMeshAsset(const char *stlFile, double scale, double lodCell, bool rebuild, MeshAsset_T *asset);
+
+// binary STL (meters) of a mesh or of the hulls, for display
+bool SaveStlMesh(const char *fileName, const Mesh_T *mesh);
+bool SaveStlHulls(const char *fileName, const MeshAsset_T *asset);
@@ -0,0 +1,579 @@
+//
+// PathRetime.cpp : minimum time resampling of a dense joint trajectory along
+//                  its own path, within velocity / acceleration / jerk limits
+//
+
+#include "stdafx.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <iostream>
+
+#include "PathRetime.h"
+#include "RtUtil.h"
+
+using namespace std;
+
+const double RetimeMinSpeed = 1.0e-6;      // path speed floor for line times, the ends are at rest
+
+// bound on the path acceleration u at path speed^2 x: offset + perX * x
+typedef struct LinearBound_T {
+	double offset;
+	double perX;
+} LinearBound_T;
+
+typedef struct RetimePath_T {
+	int axisCount;
+	int usedAxes[MaxAxisNumber];          // axes that move
+	int usedCount;
+	vector<PositionData_T> points;
+	vector<double> position;              // path parameter of each point
+	vector<double> length;                // of each line, point i to i + 1
+	vector<double> slope;                 // dq/ds of each line, MaxAxisNumber per line
+	vector<double> curve;                 // d2q/ds2 at each point, MaxAxisNumber per point
+	vector<double> accLimit;              // at each point, MaxAxisNumber per point
+	vector<double> cap;                   // highest path speed^2 at each point
+	vector<double> reach;                 // highest path speed^2 the end can be reached from
+	vector<double> speedSq;               // the profile
+	vector<double> profile;               // path parameter at each ITP sample, before smoothing
+	vector<size_t> pieces;                // last profile sample of each stretch between stops
+	vector<double> smoothed;
+	vector<size_t> newest;                // for each smoothed sample
+} RetimePath_T;
+
+void RetimeDefaultConfig(RetimeConfig_T *config)
+{
+	config->cycleNs = 8000000L;
+	config->scale = 0.95;
+	config->maxPasses = 60;
+}
+
+void SetFixedLimits(AxisLimits_T limits[MaxAxisNumber], double velocity, double acceleration, double jerk)
+{
+	const double value[ThresholdTypeCount] = { velocity, acceleration, jerk };
+
+	for (int axisIdx = 0; axisIdx < MaxAxisNumber; axisIdx++) {
+		limits[axisIdx].valid = true;
+		for (int type = 0; type < ThresholdTypeCount; type++) {
+			limits[axisIdx].table[type].interval = 0.0;
+			for (int entry = 0; entry < ThresholdTableSize; entry++) {
+				limits[axisIdx].table[type].value[entry] = value[type];
+			}
+		}
+	}
+}
+
+/*
+ * BuildPath: merge the near repeats, measure the lines (root sum of
+ *            squares of each axis's time at its velocity limit), take the
+ *            slopes and curvature and the highest speed at each point
+ */
+static bool BuildPath(RetimePath_T *path, const PositionData_T *samples, size_t sampleCount, int axisCount,
+	const AxisLimits_T limits[MaxAxisNumber], double scale)
+{
+	path->axisCount = axisCount;
+	path->points.clear();
+	path->points.push_back(samples[0]);
+	for (size_t idx = 1; idx < sampleCount; idx++) {
+		bool moved = false;
+		for (int axisIdx = 0; !moved && (axisIdx < axisCount); axisIdx++) {
+			moved = fabs(samples[idx].data[axisIdx] - path->points.back().data[axisIdx]) > RetimeMinStep;
+		}
+		if (moved) {
+			path->points.push_back(samples[idx]);
+		}
+		else if (idx == sampleCount - 1) {
+			path->points.back() = samples[idx];   // the path ends where the samples do
+		}
+	}
+	size_t pointCount = path->points.size();
+	if (pointCount < 2) {
+		cout << "retime: the trajectory does not move" << endl;
+		return false;
+	}
+
+	double velocity[MaxAxisNumber];
+	path->usedCount = 0;
+	for (int axisIdx = 0; axisIdx < axisCount; axisIdx++) {
+		bool moves = false;
+		for (size_t idx = 1; !moves && (idx < pointCount); idx++) {
+			moves = path->points[idx].data[axisIdx] != path->points[0].data[axisIdx];
+		}
+		if (!moves) {
+			continue;
+		}
+		velocity[axisIdx] = limits[axisIdx].valid ? scale * LowestLimit(&limits[axisIdx].table[ThresholdVelocity], HUGE_VAL) : 0.0;
+		if (!limits[axisIdx].valid || (velocity[axisIdx] <= 0.0)) {
+			cout << "retime: axis " << axisIdx + 1 << " moves but has no limits" << endl;
+			return false;
+		}
+		path->usedAxes[path->usedCount++] = axisIdx;
+	}
+
+	path->position.assign(pointCount, 0.0);
+	path->length.assign(pointCount - 1, 0.0);
+	path->slope.assign((pointCount - 1) * MaxAxisNumber, 0.0);
+	path->curve.assign(pointCount * MaxAxisNumber, 0.0);
+	for (size_t line = 0; line + 1 < pointCount; line++) {
+		double length = 0.0;
+		for (int used = 0; used < path->usedCount; used++) {
+			int axisIdx = path->usedAxes[used];
+			double step = path->points[line + 1].data[axisIdx] - path->points[line].data[axisIdx];
+			length += (step / velocity[axisIdx]) * (step / velocity[axisIdx]);
+		}
+		length = sqrt(length);
+		path->length[line] = length;
+		path->position[line + 1] = path->position[line] + length;
+		for (int used = 0; used < path->usedCount; used++) {
+			int axisIdx = path->usedAxes[used];
+			path->slope[line * MaxAxisNumber + axisIdx] = (path->points[line + 1].data[axisIdx] - path->points[line].data[axisIdx]) / length;
+		}
+	}
+	for (size_t idx = 1; idx + 1 < pointCount; idx++) {
+		double span = (path->length[idx - 1] + path->length[idx]) / 2.0;
+		for (int used = 0; used < path->usedCount; used++) {
+			int axisIdx = path->usedAxes[used];
+			path->curve[idx * MaxAxisNumber + axisIdx] =
+				(path->slope[idx * MaxAxisNumber + axisIdx] - path->slope[(idx - 1) * MaxAxisNumber + axisIdx]) / span;
+		}
+	}
+	path->accLimit.assign(pointCount * MaxAxisNumber, 0.0);
+	// highest speed^2: every axis within its velocity limit on the lines either side
+	path->cap.assign(pointCount, HUGE_VAL);
+	for (size_t line = 0; line + 1 < pointCount; line++) {
+		double most = 0.0;
+		for (int used = 0; used < path->usedCount; used++) {
+			int axisIdx = path->usedAxes[used];
+			most = max(most, fabs(path->slope[line * MaxAxisNumber + axisIdx]) / velocity[axisIdx]);
+		}
+		path->cap[line] = min(path->cap[line], 1.0 / (most * most));
+		path->cap[line + 1] = min(path->cap[line + 1], 1.0 / (most * most));
+	}
+	for (size_t idx = 1; idx + 1 < pointCount; idx++) {
+		// the path turns back: only passed at rest, the smoothing cannot round it
+		double turn = 0.0;
+		for (int used = 0; used < path->usedCount; used++) {
+			int axisIdx = path->usedAxes[used];
+			turn += path->slope[(idx - 1) * MaxAxisNumber + axisIdx] * path->slope[idx * MaxAxisNumber + axisIdx] / (velocity[axisIdx] * velocity[axisIdx]);
+		}
+		if (turn < 0.0) {
+			path->cap[idx] = 0.0;
+			continue;
+		}
+		// the jerk of the change in curvature alone, d3q/ds3 * speed^3
+		double span = path->position[idx + 1] - path->position[idx - 1];
+		for (int used = 0; used < path->usedCount; used++) {
+			int axisIdx = path->usedAxes[used];
+			double third = fabs(path->curve[(idx + 1) * MaxAxisNumber + axisIdx] - path->curve[(idx - 1) * MaxAxisNumber + axisIdx]) / span;
+			if (third > 0.0) {
+				double jerk = scale * LowestLimit(&limits[axisIdx].table[ThresholdJerk], HUGE_VAL);
+				path->cap[idx] = min(path->cap[idx], pow(jerk / third, 2.0 / 3.0));
+			}
+		}
+	}
+	path->reach.assign(pointCount, 0.0);
+	path->speedSq = path->cap;
+	return true;
+}
+
+// acceleration limits at the joint speeds of the last profile
+static void SetAccelerationLimits(RetimePath_T *path, const AxisLimits_T limits[MaxAxisNumber], double scale)
+{
+	size_t pointCount = path->points.size();
+
+	for (size_t idx = 0; idx < pointCount; idx++) {
+		size_t line = min(idx, pointCount - 2);
+		double speed = sqrt(path->speedSq[idx]);
+		for (int used = 0; used < path->usedCount; used++) {
+			int axisIdx = path->usedAxes[used];
+			double jointSpeed = fabs(path->slope[line * MaxAxisNumber + axisIdx]) * speed;
+			path->accLimit[idx * MaxAxisNumber + axisIdx] = scale * InterpolateLimit(&limits[axisIdx].table[ThresholdAcceleration], jointSpeed);
+		}
+	}
+}
+
+/*
+ * AccelerationBounds: bounds on the path acceleration at the point from
+ *                     each axis's limit, -a <= q' u + q'' x <= a. An axis
+ *                     with no slope there only bounds x (lowered in *xLimit).
+ */
+static int AccelerationBounds(const RetimePath_T *path, size_t idx, LinearBound_T *lower, LinearBound_T *upper, double *xLimit)
+{
+	size_t line = min(idx, path->points.size() - 2);
+	int count = 0;
+
+	for (int used = 0; used < path->usedCount; used++) {
+		int axisIdx = path->usedAxes[used];
+		double slope = path->slope[line * MaxAxisNumber + axisIdx];
+		double curve = path->curve[idx * MaxAxisNumber + axisIdx];
+		double acc = path->accLimit[idx * MaxAxisNumber + axisIdx];
+		if (slope == 0.0) {
+			if (curve != 0.0) {
+				*xLimit = min(*xLimit, acc / fabs(curve));
+			}
+			continue;
+		}
+		double perX = -curve / slope;
+		double first = -acc / slope;
+		double second = acc / slope;
+		lower[count].offset = min(first, second);
+		lower[count].perX = perX;
+		upper[count].offset = max(first, second);
+		upper[count].perX = perX;
+		count++;
+	}
+	return count;
+}
+
+/*
+ * ReachableSpeeds: backward pass, the highest path speed^2 at each point
+ *                  that still lets the path stop at the end
+ */
+static void ReachableSpeeds(RetimePath_T *path)
+{
+	LinearBound_T lower[MaxAxisNumber + 1];
+	LinearBound_T upper[MaxAxisNumber + 1];
+	size_t pointCount = path->points.size();
+
+	path->reach[pointCount - 1] = 0.0;
+	for (size_t idx = pointCount - 1; idx-- > 0;) {
+		double xLimit = path->cap[idx];
+		int count = AccelerationBounds(path, idx, lower, upper, &xLimit);
+		// the line to the next point: its speed^2 x + 2 u ds within 0 .. reach[idx + 1]
+		double perLine = 1.0 / (2.0 * path->length[idx]);
+		lower[count].offset = 0.0;
+		lower[count].perX = -perLine;
+		upper[count].offset = path->reach[idx + 1] * perLine;
+		upper[count].perX = -perLine;
+		count++;
+
+		// every lower bound must stay under every upper bound
+		for (int low = 0; low < count; low++) {
+			for (int up = 0; up < count; up++) {
+				double falling = lower[low].perX - upper[up].perX;
+				if (falling > 0.0) {
+					xLimit = min(xLimit, (upper[up].offset - lower[low].offset) / falling);
+				}
+			}
+		}
+		path->reach[idx] = max(xLimit, 0.0);
+	}
+}
+
+/*
+ * FastestProfile: forward pass from rest, the largest path acceleration at
+ *                 each point that stays within reach of the next one
+ */
+static void FastestProfile(RetimePath_T *path)
+{
+	LinearBound_T lower[MaxAxisNumber + 1];
+	LinearBound_T upper[MaxAxisNumber + 1];
+	size_t pointCount = path->points.size();
+
+	path->speedSq[0] = 0.0;
+	for (size_t idx = 0; idx + 1 < pointCount; idx++) {
+		double x = path->speedSq[idx];
+		double xLimit = HUGE_VAL;
+		int count = AccelerationBounds(path, idx, lower, upper, &xLimit);
+		double accel = (path->reach[idx + 1] - x) / (2.0 * path->length[idx]);
+		double least = -x / (2.0 * path->length[idx]);
+		for (int bound = 0; bound < count; bound++) {
+			accel = min(accel, upper[bound].offset + upper[bound].perX * x);
+			least = max(least, lower[bound].offset + lower[bound].perX * x);
+		}
+		accel = max(accel, least);
+		path->speedSq[idx + 1] = min(max(x + 2.0 * accel * path->length[idx], 0.0), path->reach[idx + 1]);
+	}
+}
+
+/*
+ * SampleProfile: path parameter at every ITP cycle, constant path
+ *                acceleration along each line. Each stretch between stops
+ *                is sampled from its own start, first and last sample on
+ *                its ends, and pieces holds the index of each last sample.
+ */
+static void SampleProfile(RetimePath_T *path, double cycleSec)
+{
+	size_t pointCount = path->points.size();
+	double lineStart = 0.0;
+	size_t sampleIdx = 0;
+
+	path->profile.clear();
+	path->pieces.clear();
+	for (size_t line = 0; line + 1 < pointCount; line++) {
+		double speed = sqrt(path->speedSq[line]);
+		double nextSpeed = sqrt(path->speedSq[line + 1]);
+		double accel = (path->speedSq[line + 1] - path->speedSq[line]) / (2.0 * path->length[line]);
+		double lineTime = 2.0 * path->length[line] / max(speed + nextSpeed, RetimeMinSpeed);
+		for (double t = sampleIdx * cycleSec; t < lineStart + lineTime; t = (++sampleIdx) * cycleSec) {
+			double tau = t - lineStart;
+			double s = path->position[line] + speed * tau + accel * tau * tau / 2.0;
+			path->profile.push_back(min(max(s, path->position[line]), path->position[line + 1]));
+		}
+		lineStart += lineTime;
+		if ((path->speedSq[line + 1] == 0.0) && (line + 2 < pointCount)) {
+			path->profile.push_back(path->position[line + 1]);
+			path->pieces.push_back(path->profile.size() - 1);
+			lineStart = 0.0;
+			sampleIdx = 0;
+		}
+	}
+	path->profile.push_back(path->position[pointCount - 1]);
+	path->pieces.push_back(path->profile.size() - 1);
+}
+
+/*
+ * SmoothProfile: moving average of 2 * half + 1 samples over each piece, at
+ *                rest before its start and after its end, so every piece
+ *                comes out 2 * half longer. newest holds the last profile
+ *                sample each smoothed one was averaged from.
+ */
+static void SmoothProfile(RetimePath_T *path, int half)
+{
+	const vector<double> &profile = path->profile;
+	size_t window = 2 * half + 1;
+	size_t first = 0;
+
+	path->smoothed.clear();
+	path->newest.clear();
+	for (size_t last : path->pieces) {
+		size_t count = last - first + 1;
+		double start = profile[first];
+		double end = profile[last];
+		double sum = 0.0;
+		// extended piece: 2 * half times the start, the piece, 2 * half times the end
+		auto extended = [&](size_t idx) {
+			return (idx < (size_t)(2 * half)) ? start : (idx - 2 * half < count) ? profile[first + idx - 2 * half] : end;
+		};
+		for (size_t idx = 0; idx < window; idx++) {
+			sum += extended(idx);
+		}
+		// a later piece starts on the sample the one before ended on
+		for (size_t idx = 0; idx < count + 2 * half; idx++) {
+			if ((idx > 0) || (first == 0)) {
+				path->smoothed.push_back(sum / window);
+				path->newest.push_back(first + min(idx, count - 1));
+			}
+			sum += extended(idx + window) - extended(idx);
+		}
+		// no rounding left at the ends
+		if (first == 0) {
+			path->smoothed[0] = start;
+		}
+		path->smoothed.back() = end;
+		first = last;
+	}
+}
+
+/*
+ * PointTangent: dq/ds of the axis at the point for the cubic through the
+ *               points: the slopes either side weighted by the other line's
+ *               length, 0 where the axis turns or stops, at most three times
+ *               the lower slope so the cubic does not overshoot (Fritsch-Carlson)
+ */
+static double PointTangent(const RetimePath_T *path, size_t idx, int axisIdx)
+{
+	size_t lineCount = path->points.size() - 1;
+	double before = path->slope[((idx > 0) ? idx - 1 : 0) * MaxAxisNumber + axisIdx];
+	double after = path->slope[min(idx, lineCount - 1) * MaxAxisNumber + axisIdx];
+
+	if ((idx == 0) || (idx == lineCount)) {
+		return (idx == 0) ? after : before;
+	}
+	if (before * after <= 0.0) {
+		return 0.0;
+	}
+	double tangent = (path->length[idx] * before + path->length[idx - 1] * after) / (path->length[idx - 1] + path->length[idx]);
+	double most = 3.0 * min(fabs(before), fabs(after));
+	return (tangent > 0.0) ? min(tangent, most) : max(tangent, -most);
+}
+
+/*
+ * MakeSamples: the points at the smoothed path parameters, on a cubic
+ *              through the points so the joint speed has no steps where
+ *              the samples are closer than the points
+ */
+static void MakeSamples(const RetimePath_T *path, vector<PositionData_T> *result)
+{
+	size_t pointCount = path->points.size();
+	size_t line = 0;
+
+	result->resize(path->smoothed.size());
+	for (size_t idx = 0; idx < path->smoothed.size(); idx++) {
+		double s = path->smoothed[idx];
+		while ((line + 2 < pointCount) && (path->position[line + 1] <= s)) {
+			line++;
+		}
+		double length = path->length[line];
+		double frac = min(max((s - path->position[line]) / length, 0.0), 1.0);
+		double fracSq = frac * frac;
+		double fracCube = fracSq * frac;
+		const PositionData_T *from = &path->points[line];
+		const PositionData_T *to = &path->points[line + 1];
+		PositionData_T *sample = &(*result)[idx];
+		*sample = *from;
+		for (int axisIdx = 0; axisIdx < path->axisCount; axisIdx++) {
+			double start = from->data[axisIdx];
+			double end = to->data[axisIdx];
+			if (start == end) {
+				continue;
+			}
+			sample->data[axisIdx] = (float)((2.0 * fracCube - 3.0 * fracSq + 1.0) * start + (fracCube - 2.0 * fracSq + frac) * length * PointTangent(path, line, axisIdx)
+				+ (-2.0 * fracCube + 3.0 * fracSq) * end + (fracCube - fracSq) * length * PointTangent(path, line + 1, axisIdx));
+		}
+	}
+	result->back() = path->points[pointCount - 1];
+}
+
+/*
+ * LowerSpeeds: the points the sample was made from (the smoothing window
+ *              and the 3 samples of differences) get at most factor times
+ *              their speed^2 of this pass
+ */
+static void LowerSpeeds(RetimePath_T *path, size_t sampleIdx, int half, double factor)
+{
+	size_t oldest = path->newest[(sampleIdx >= 3) ? sampleIdx - 3 : 0];
+	size_t first = (oldest >= (size_t)(2 * half)) ? oldest - 2 * half : 0;
+	size_t last = path->newest[sampleIdx];
+	size_t idx = upper_bound(path->position.begin(), path->position.end(), path->profile[first]) - path->position.begin();
+	idx = (idx > 0) ? idx - 1 : 0;
+	for (; (idx < path->points.size()) && (path->position[idx] <= path->profile[last]); idx++) {
+		path->cap[idx] = min(path->cap[idx], max(path->speedSq[idx] * factor, RetimeMinSpeed * RetimeMinSpeed));
+	}
+}
+
+/*
+ * SampleFactor: backward differences of every used axis at samples[idx]
+ *               against scale times the limits at the sample's speed.
+ *               Returns the factor on speed^2 that would bring it within
+ *               them (1 if it is) and counts the values over in *over.
+ */
+static double SampleFactor(const RetimePath_T *path, const PositionData_T *samples, size_t idx, const AxisLimits_T limits[MaxAxisNumber],
+	double scale, double cycleSec, unsigned long *over)
+{
+	double factor = 1.0;
+
+	for (int used = 0; used < path->usedCount; used++) {
+		int axisIdx = path->usedAxes[used];
+		// the robot is at rest on the first sample
+		double p0 = samples[idx].data[axisIdx];
+		double p1 = samples[idx - 1].data[axisIdx];
+		double p2 = samples[(idx >= 2) ? idx - 2 : 0].data[axisIdx];
+		double p3 = samples[(idx >= 3) ? idx - 3 : 0].data[axisIdx];
+		double vel = fabs(p0 - p1) / cycleSec;
+		double acc = fabs(p0 - 2.0 * p1 + p2) / (cycleSec * cycleSec);
+		double jerk = fabs(p0 - 3.0 * p1 + 3.0 * p2 - p3) / (cycleSec * cycleSec * cycleSec);
+		const LimitTable_T *table = limits[axisIdx].table;
+		double ratio = vel / (scale * InterpolateLimit(&table[ThresholdVelocity], vel));
+		if (ratio > 1.0) {
+			factor = min(factor, 1.0 / (ratio * ratio));
+			(*over)++;
+		}
+		ratio = acc / (scale * InterpolateLimit(&table[ThresholdAcceleration], vel));
+		if (ratio > 1.0) {
+			factor = min(factor, 1.0 / ratio);
+			(*over)++;
+		}
+		ratio = jerk / (scale * InterpolateLimit(&table[ThresholdJerk], vel));
+		if (ratio > 1.0) {
+			factor = min(factor, pow(ratio, -2.0 / 3.0));
+			(*over)++;
+		}
+	}
+	return factor;
+}
+
+/*
+ * CheckSamples: every sample against the limits, lowers the speeds where
+ *               over. Returns the number of values over.
+ */
+static unsigned long CheckSamples(RetimePath_T *path, const vector<PositionData_T> &samples, const AxisLimits_T limits[MaxAxisNumber],
+	double scale, double cycleSec, int half)
+{
+	unsigned long over = 0;
+
+	for (size_t idx = 1; idx < samples.size(); idx++) {
+		double factor = SampleFactor(path, samples.data(), idx, limits, scale, cycleSec, &over);
+		if (factor < 1.0) {
+			LowerSpeeds(path, idx, half, factor * RetimeBackoff);
+		}
+	}
+	return over;
+}
+
+bool RetimeTrajectory(const PositionData_T *samples, size_t sampleCount, int axisCount, const AxisLimits_T limits[MaxAxisNumber],
+	const RetimeConfig_T *config, vector<PositionData_T> *result, RetimeStats_T *stats)
+{
+	RetimePath_T path;
+	int64_t started = RtNowNs();
+	double cycleSec = config->cycleNs / 1.0e9;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->inputSamples = sampleCount;
+	if ((sampleCount == 0) || !BuildPath(&path, samples, sampleCount, axisCount, limits, config->scale)) {
+		return false;
+	}
+	stats->pathPoints = path.points.size();
+
+	// long enough for every axis to swing its acceleration from -max to +max at the jerk limit
+	for (int used = 0; used < path.usedCount; used++) {
+		const LimitTable_T *table = limits[path.usedAxes[used]].table;
+		for (int entry = 0; entry < ThresholdTableSize; entry++) {
+			if (table[ThresholdJerk].value[entry] > 0.0) {
+				stats->smoothingSec = max(stats->smoothingSec, 2.0 * table[ThresholdAcceleration].value[entry] / table[ThresholdJerk].value[entry]);
+			}
+		}
+	}
+	int half = (int)ceil((stats->smoothingSec / cycleSec - 1.0) / 2.0);
+	half = max(half, 0);
+
+	// the first pass takes the tables at the velocity limit
+	do {
+		SetAccelerationLimits(&path, limits, config->scale);
+		ReachableSpeeds(&path);
+		FastestProfile(&path);
+		SampleProfile(&path, cycleSec);
+		SmoothProfile(&path, half);
+		MakeSamples(&path, result);
+		stats->passes++;
+		stats->overLimit = CheckSamples(&path, *result, limits, config->scale, cycleSec, half);
+	} while ((stats->overLimit > 0) && (stats->passes < config->maxPasses));
+
+	// a path already streamed near its limits may not come out faster: then it is kept as it is
+	if ((stats->overLimit > 0) || (result->size() > sampleCount)) {
+		unsigned long inputOver = 0;
+		for (size_t idx = 1; (idx < sampleCount) && (inputOver == 0); idx++) {
+			SampleFactor(&path, samples, idx, limits, config->scale, cycleSec, &inputOver);
+		}
+		if (inputOver == 0) {
+			result->assign(samples, samples + sampleCount);
+			stats->overLimit = 0;
+			stats->keptInput = true;
+		}
+	}
+
+	stats->outputSamples = result->size();
+	stats->elapsedSec = (RtNowNs() - started) / 1.0e9;
+	if (stats->overLimit > 0) {
+		cout << "retime: still " << stats->overLimit << " values over the limits after " << stats->passes << " passes" << endl;
+		return false;
+	}
+	return true;
+}
+
+void WriteRetimeStats(const RetimeStats_T *stats, long cycleNs)
+{
+	double cycleSec = cycleNs / 1.0e9;
+	double before = (stats->inputSamples > 0) ? (stats->inputSamples - 1) * cycleSec : 0.0;
+	double after = (stats->outputSamples > 0) ? (stats->outputSamples - 1) * cycleSec : 0.0;
+
+	printf("retimed: %zu samples (%.3f s) -> %zu samples (%.3f s), %.1f %% of the time\n", stats->inputSamples, before,
+		stats->outputSamples, after, (before > 0.0) ? 100.0 * after / before : 0.0);
+	printf("  %zu path points, %d passes, smoothed over %.1f ms, %.3f s\n", stats->pathPoints, stats->passes,
+		stats->smoothingSec * 1.0e3, stats->elapsedSec);
+	if (stats->keptInput) {
+		printf("  the input is within the limits and was not made faster: kept as it is\n");
+	}
+}
@@ -0,0 +1,76 @@
+//
+// PathRetime.h : minimum time resampling of a dense joint trajectory along
+//                its own path, within velocity / acceleration / jerk limits
+//
+// The samples are taken as points of the path; points closer than
+// RetimeMinStep to the previous one are merged, so stretches where the
+// robot stands (or nearly) take no time. The path parameter is the root sum
+// of squares of the time each axis takes over a line at its velocity limit,
+// so it has no kinks where another axis becomes the slowest. The path speed
+// at each point is capped by every axis's velocity limit, by its jerk limit
+// against the change of curvature alone, and to 0 where the path turns back
+// on itself: no smoothing can round such a point, so the robot stops there.
+//
+// The path speed profile is found in two passes over the points
+// (reachability analysis, as in TOPP-RA): backwards, the highest speed at
+// each point from which the end can still be reached within the
+// acceleration limits; forwards, the fastest profile under those speeds.
+// That profile has steps in its acceleration, so it is sampled at the ITP
+// cycle and smoothed with a moving average as long as the slowest axis
+// takes to ramp its acceleration from -max to +max at the jerk limit, each
+// stretch between stops on its own. The joints are taken on a cubic through
+// the points, so samples closer than the points see no steps in the speed.
+//
+// The result is checked like the controller does (backward differences,
+// limits at the sample's joint speed). Where an axis is over, the speeds
+// around that part of the path are lowered and the profile is made again,
+// until nothing is over or maxPasses is reached. The tables are looked up
+// at the joint speeds of the previous pass. An input already within the
+// limits that comes out no faster is returned as it is.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+#include "J519Packet.h"
+#include "LimitCheck.h"
+
+const double RetimeMinStep = 1.0e-3;       // deg / mm, closer points are merged
+const double RetimeBackoff = 0.95;         // extra speed reduction where a limit was exceeded
+
+typedef struct RetimeConfig_T {
+	long cycleNs;             // ITP cycle of the output
+	double scale;             // share of the limits planned with (0.95)
+	int maxPasses;            // profiles made before giving up (60)
+} RetimeConfig_T;
+
+typedef struct RetimeStats_T {
+	size_t inputSamples;
+	size_t pathPoints;        // after merging
+	size_t outputSamples;
+	int passes;
+	double smoothingSec;      // moving average length
+	unsigned long overLimit;  // values over the planned limits in the last pass, 0 if done
+	bool keptInput;           // the input was within the limits and no slower: result is the input
+	double elapsedSec;
+} RetimeStats_T;
+
+void RetimeDefaultConfig(RetimeConfig_T *config);
+
+/*
+ * SetFixedLimits: the same velocity, acceleration and jerk on every axis,
+ *                 as tables that do not depend on the speed
+ */
+void SetFixedLimits(AxisLimits_T limits[MaxAxisNumber], double velocity, double acceleration, double jerk);
+
+/*
+ * RetimeTrajectory: resample the path of the sampleCount samples at
+ *                   config->cycleNs. Every axis that moves needs valid
+ *                   limits. false (reason printed) if it cannot be done
+ *                   within maxPasses; result then holds the last try.
+ */
+bool RetimeTrajectory(const PositionData_T *samples, size_t sampleCount, int axisCount, const AxisLimits_T limits[MaxAxisNumber],
+	const RetimeConfig_T *config, std::vector<PositionData_T> *result, RetimeStats_T *stats);
+
+void WriteRetimeStats(const RetimeStats_T *stats, long cycleNs);
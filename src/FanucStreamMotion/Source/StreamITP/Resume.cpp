@@ -0,0 +1,313 @@
+//
+// Resume.cpp : the way back onto a trajectory after a controller fault
+//
+
+#include "stdafx.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+
+#include "Resume.h"
+
+using namespace std;
+
+const double PeakVelocity = 1.875;        // max of s'(u), s = 10u^3 - 15u^4 + 6u^5
+const double PeakAcceleration = 5.7735;   // max of |s''(u)|
+const double PeakJerk = 60.0;             // max of |s'''(u)|
+const size_t SpeedWindow = 64;            // samples after the resume point the path speed is taken over
+const double StretchStep = 1.5;
+
+// quintic from rest to rest, 0..1 over u = 0..1
+static double Smooth(double u)
+{
+	return u * u * u * (10.0 + u * (-15.0 + 6.0 * u));
+}
+
+// integral of Smooth from 0 to u, 1/2 at u = 1
+static double SmoothIntegral(double u)
+{
+	double u4 = u * u * u * u;
+	return u4 * (2.5 + u * (-3.0 + u));
+}
+
+static double WrapDegrees(double angle)
+{
+	angle = fmod(angle, 360.0);
+	if (angle > 180.0) {
+		angle -= 360.0;
+	}
+	else if (angle <= -180.0) {
+		angle += 360.0;
+	}
+	return angle;
+}
+
+// w p r of a Cartesian pose, the axes that go the short way round
+static bool IsAngle(int representation, int axisIdx)
+{
+	return (representation == 0) && (axisIdx >= 3) && (axisIdx < 6);
+}
+
+/*
+ * PathPeaks: largest |velocity|, |acceleration| and |jerk| of each axis over
+ *            the whole trajectory
+ */
+static void PathPeaks(const PositionData_T *samples, size_t sampleCount, int axisCount, int representation, double cycleSec,
+	double peak[MaxAxisNumber][ThresholdTypeCount])
+{
+	memset(peak, 0, MaxAxisNumber * sizeof(peak[0]));
+	for (int axisIdx = 0; axisIdx < axisCount; axisIdx++) {
+		double d1prev = 0.0;
+		double d2prev = 0.0;
+		for (size_t idx = 1; idx < sampleCount; idx++) {
+			double d1 = samples[idx].data[axisIdx] - samples[idx - 1].data[axisIdx];
+			if (IsAngle(representation, axisIdx)) {
+				d1 = WrapDegrees(d1);
+			}
+			double d2 = d1 - d1prev;
+			double d3 = d2 - d2prev;
+			peak[axisIdx][ThresholdVelocity] = max(peak[axisIdx][ThresholdVelocity], fabs(d1) / cycleSec);
+			peak[axisIdx][ThresholdAcceleration] = max(peak[axisIdx][ThresholdAcceleration], fabs(d2) / (cycleSec * cycleSec));
+			peak[axisIdx][ThresholdJerk] = max(peak[axisIdx][ThresholdJerk], fabs(d3) / (cycleSec * cycleSec * cycleSec));
+			d1prev = d1;
+			d2prev = d2;
+		}
+	}
+}
+
+/*
+ * ResumeLimits: the thresholds on the joint axes that have them; on the
+ *               others (and on every axis of a Cartesian path) the path's
+ *               own peaks, it was made for this robot, but no lower than the
+ *               ResumeDefault* values. No check past axisCount.
+ */
+static void ResumeLimits(const PositionData_T *samples, size_t sampleCount, int axisCount, int representation,
+	const AxisLimits_T limits[MaxAxisNumber], double cycleSec, AxisLimits_T resume[MaxAxisNumber])
+{
+	const double fallback[ThresholdTypeCount] = { ResumeDefaultVelocity, ResumeDefaultAcceleration, ResumeDefaultJerk };
+	double peak[MaxAxisNumber][ThresholdTypeCount];
+
+	PathPeaks(samples, sampleCount, axisCount, representation, cycleSec, peak);
+	InitAxisLimits(resume);
+	for (int axisIdx = 0; axisIdx < axisCount; axisIdx++) {
+		if ((limits != NULL) && (representation != 0) && limits[axisIdx].valid) {
+			resume[axisIdx] = limits[axisIdx];
+			continue;
+		}
+		resume[axisIdx].valid = true;
+		for (int type = 0; type < ThresholdTypeCount; type++) {
+			double value = max(fallback[type], peak[axisIdx][type]);
+			for (int entry = 0; entry < ThresholdTableSize; entry++) {
+				resume[axisIdx].table[type].value[entry] = value;
+			}
+		}
+	}
+}
+
+/*
+ * ApproachSeconds: shortest quintic from rest to rest over the largest
+ *                  move that keeps every axis within the scaled limits
+ */
+static double ApproachSeconds(const double distance[MaxAxisNumber], int axisCount, const AxisLimits_T limits[MaxAxisNumber])
+{
+	double seconds = 0.0;
+
+	for (int axisIdx = 0; axisIdx < axisCount; axisIdx++) {
+		double d = fabs(distance[axisIdx]);
+		if (d < ResumeMinDistance) {
+			continue;
+		}
+		double v = ResumeLimitScale * LowestLimit(&limits[axisIdx].table[ThresholdVelocity], HUGE_VAL);
+		double a = ResumeLimitScale * LowestLimit(&limits[axisIdx].table[ThresholdAcceleration], HUGE_VAL);
+		double j = ResumeLimitScale * LowestLimit(&limits[axisIdx].table[ThresholdJerk], HUGE_VAL);
+		seconds = max(seconds, PeakVelocity * d / v);
+		seconds = max(seconds, sqrt(PeakAcceleration * d / a));
+		seconds = max(seconds, cbrt(PeakJerk * d / j));
+	}
+	return seconds;
+}
+
+/*
+ * RampSeconds: a time scale rising along Smooth over T adds
+ *              PeakVelocity / T * v of acceleration and PeakAcceleration /
+ *              T^2 * v of jerk to a path moving at v
+ */
+static double RampSeconds(const PositionData_T *samples, size_t sampleCount, int axisCount, int representation, size_t fromSample,
+	const AxisLimits_T limits[MaxAxisNumber], double cycleSec)
+{
+	double seconds = 0.0;
+	size_t last = min(sampleCount - 1, fromSample + SpeedWindow);
+
+	for (int axisIdx = 0; axisIdx < axisCount; axisIdx++) {
+		double v = 0.0;
+		for (size_t idx = fromSample; idx < last; idx++) {
+			double step = samples[idx + 1].data[axisIdx] - samples[idx].data[axisIdx];
+			v = max(v, fabs(IsAngle(representation, axisIdx) ? WrapDegrees(step) : step) / cycleSec);
+		}
+		double a = ResumeLimitScale * LowestLimit(&limits[axisIdx].table[ThresholdAcceleration], HUGE_VAL);
+		double j = ResumeLimitScale * LowestLimit(&limits[axisIdx].table[ThresholdJerk], HUGE_VAL);
+		seconds = max(seconds, PeakVelocity * v / a);
+		seconds = max(seconds, sqrt(PeakAcceleration * v / j));
+	}
+	return seconds;
+}
+
+/*
+ * PathAt: the path at a fractional sample index, a Catmull-Rom cubic
+ *         through the samples: straight lines between them would turn at
+ *         every sample within one cycle, a jerk the slowed path does not have
+ */
+static void PathAt(const PositionData_T *samples, size_t sampleCount, int representation, double tau, PositionData_T *pose)
+{
+	size_t idx = (size_t)tau;
+	if (idx >= sampleCount - 1) {
+		*pose = samples[sampleCount - 1];
+		return;
+	}
+	const PositionData_T *before = &samples[(idx > 0) ? idx - 1 : 0];
+	const PositionData_T *after = &samples[min(idx + 2, sampleCount - 1)];
+	double f = tau - idx;
+	double f2 = f * f;
+	double f3 = f2 * f;
+	for (int axisIdx = 0; axisIdx < MaxAxisNumber; axisIdx++) {
+		// relative to samples[idx], so an angle through 180 stays continuous
+		double p0 = samples[idx].data[axisIdx];
+		double dm = before->data[axisIdx] - p0;
+		double d1 = samples[idx + 1].data[axisIdx] - p0;
+		double d2 = after->data[axisIdx] - p0;
+		if (IsAngle(representation, axisIdx)) {
+			dm = WrapDegrees(dm);
+			d1 = WrapDegrees(d1);
+			d2 = d1 + WrapDegrees(d2 - d1);
+		}
+		double m0 = 0.5 * (d1 - dm);
+		double m1 = 0.5 * (d2);
+		double value = p0 + (f3 - 2.0 * f2 + f) * m0 + (-2.0 * f3 + 3.0 * f2) * d1 + (f3 - f2) * m1;
+		pose->data[axisIdx] = (float)(IsAngle(representation, axisIdx) ? WrapDegrees(value) : value);
+	}
+}
+
+/*
+ * BuildLeadIn: approach over approachCycles (none if 0), then the ramp over
+ *              rampCycles (even), then the rest of the trajectory
+ */
+static void BuildLeadIn(const PositionData_T *samples, size_t sampleCount, int axisCount, int representation, size_t fromSample,
+	const float current[MaxAxisNumber], size_t approachCycles, size_t rampCycles, vector<PositionData_T> *out, vector<size_t> *source,
+	ResumePlan_T *plan)
+{
+	const PositionData_T *target = &samples[fromSample];
+	PositionData_T pose;
+
+	out->clear();
+	source->clear();
+	for (size_t cycle = 1; cycle <= approachCycles; cycle++) {
+		double s = Smooth((double)cycle / approachCycles);
+		pose = *target;
+		for (int axisIdx = 0; (cycle < approachCycles) && (axisIdx < axisCount); axisIdx++) {
+			double d = target->data[axisIdx] - current[axisIdx];
+			if (IsAngle(representation, axisIdx)) {
+				pose.data[axisIdx] = (float)WrapDegrees(current[axisIdx] + s * WrapDegrees(d));
+			}
+			else {
+				pose.data[axisIdx] = (float)(current[axisIdx] + s * d);
+			}
+		}
+		out->push_back(pose);
+		source->push_back(fromSample);
+	}
+	plan->approachSamples = out->size();
+
+	// the time scale integrates to rampCycles / 2 samples of the path
+	size_t rejoin = min(fromSample + rampCycles / 2, sampleCount - 1);
+	for (size_t cycle = 1; cycle < rampCycles; cycle++) {
+		double tau = fromSample + rampCycles * SmoothIntegral((double)cycle / rampCycles);
+		if (tau >= rejoin) {
+			break;
+		}
+		PathAt(samples, sampleCount, representation, tau, &pose);
+		out->push_back(pose);
+		source->push_back((size_t)tau);
+	}
+	plan->rampSamples = out->size() - plan->approachSamples;
+	plan->rejoinSample = rejoin;
+	for (size_t idx = rejoin; idx < sampleCount; idx++) {
+		out->push_back(samples[idx]);
+		source->push_back(idx);
+	}
+	plan->samples = out->size();
+}
+
+/*
+ * CheckLeadIn: the lead in from rest at current and the first samples after
+ *              it, Cartesian angles unwrapped so a turn through 180 is not a jump
+ */
+static bool CheckLeadIn(const vector<PositionData_T> &out, const ResumePlan_T *plan, const float current[MaxAxisNumber], int representation,
+	const AxisLimits_T limits[MaxAxisNumber], long cycleNs, LimitReport_T *report)
+{
+	size_t count = min(out.size(), plan->approachSamples + plan->rampSamples + 4);
+	vector<PositionData_T> check(count + 1);
+
+	memcpy(check[0].data, current, sizeof(check[0].data));
+	for (size_t idx = 0; idx < count; idx++) {
+		check[idx + 1] = out[idx];
+		for (int axisIdx = 3; (representation == 0) && (axisIdx < 6); axisIdx++) {
+			double step = out[idx].data[axisIdx] - check[idx].data[axisIdx];
+			check[idx + 1].data[axisIdx] = (float)(check[idx].data[axisIdx] + WrapDegrees(step));
+		}
+	}
+	return CheckTrajectoryLimits(check.data(), check.size(), cycleNs, limits, report);
+}
+
+bool PlanResume(const PositionData_T *samples, size_t sampleCount, int axisCount, size_t fromSample, const float current[MaxAxisNumber],
+	int representation, const AxisLimits_T limits[MaxAxisNumber], long cycleNs, vector<PositionData_T> *out, vector<size_t> *source,
+	ResumePlan_T *plan)
+{
+	double cycleSec = cycleNs / 1.0e9;
+	AxisLimits_T resumeLimits[MaxAxisNumber];
+	double distance[MaxAxisNumber];
+	LimitReport_T report;
+
+	memset(plan, 0, sizeof(*plan));
+	if ((sampleCount == 0) || (fromSample >= sampleCount)) {
+		cout << "resume: sample " << fromSample << " is not in the trajectory" << endl;
+		return false;
+	}
+	plan->fromSample = fromSample;
+	ResumeLimits(samples, sampleCount, axisCount, representation, limits, cycleSec, resumeLimits);
+	for (int axisIdx = 0; axisIdx < axisCount; axisIdx++) {
+		distance[axisIdx] = samples[fromSample].data[axisIdx] - current[axisIdx];
+		if (IsAngle(representation, axisIdx)) {
+			distance[axisIdx] = WrapDegrees(distance[axisIdx]);
+		}
+		plan->distance = max(plan->distance, fabs(distance[axisIdx]));
+	}
+
+	double approachSec = ApproachSeconds(distance, axisCount, resumeLimits);
+	double rampSec = RampSeconds(samples, sampleCount, axisCount, representation, fromSample, resumeLimits, cycleSec);
+	for (plan->rampTries = 1; plan->rampTries <= MaxRampTries; plan->rampTries++) {
+		size_t approachCycles = (approachSec > 0.0) ? max((size_t)2, (size_t)ceil(approachSec / cycleSec)) : 0;
+		size_t rampCycles = max((size_t)2, (size_t)ceil(rampSec / cycleSec));
+		rampCycles += rampCycles % 2;
+		BuildLeadIn(samples, sampleCount, axisCount, representation, fromSample, current, approachCycles, rampCycles, out, source, plan);
+		if (CheckLeadIn(*out, plan, current, representation, resumeLimits, cycleNs, &report)) {
+			return true;
+		}
+		approachSec *= StretchStep;
+		rampSec = max(rampSec, 2.0 * cycleSec) * StretchStep;
+	}
+	plan->rampTries = MaxRampTries;
+	cout << "resume: the lead in to sample " << fromSample << " is still over the limits after " << MaxRampTries << " tries" << endl;
+	WriteLimitReport(&report);
+	return false;
+}
+
+void WriteResumePlan(const ResumePlan_T *plan, size_t sampleCount, long cycleNs)
+{
+	double cycleMs = cycleNs / 1.0e6;
+
+	printf("resume from sample %zu of %zu: approach %.3f (deg/mm) in %zu samples (%.0f ms), ramp %zu samples (%.0f ms), ",
+		plan->fromSample, sampleCount, plan->distance, plan->approachSamples, plan->approachSamples * cycleMs, plan->rampSamples,
+		plan->rampSamples * cycleMs);
+	printf("on the path again at sample %zu, %zu samples to stream\n", plan->rejoinSample, plan->samples);
+}
@@ -0,0 +1,60 @@
+//
+// Resume.h : the way back onto a trajectory after a controller fault
+//
+// When the controller drops its ready bits in the middle of a motion, the
+// last status it sent tells how many samples were executed. Once the fault
+// is cleared, the trajectory already in memory is streamed again from the
+// last executed sample instead of from its first one, behind a lead in of
+// two parts:
+//   approach  from the pose the controller reports to that sample: a
+//             quintic move from rest to rest, as short as the limits allow
+//             (left out if the robot is already there)
+//   ramp      the path from that sample on, on a time scale rising from 0
+//             to 1 along a quintic, so speed, acceleration and jerk pick up
+//             from rest to the trajectory's own. The ramp ends on a whole
+//             sample: after it the original samples follow unchanged.
+// Both are sized at ResumeLimitScale of the velocity, acceleration and jerk
+// limits: the controller's thresholds where known, else the trajectory's own
+// peaks but no lower than ResumeDefault*. The lead in is then checked like a trajectory, and a ramp
+// over the limits is made longer until it is within them.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+#include "J519Packet.h"
+#include "LimitCheck.h"
+
+const double ResumeLimitScale = 0.5;       // share of the limits the lead in is sized with
+const double ResumeMinDistance = 1.0e-3;   // deg / mm, closer needs no approach
+const double ResumeDefaultVelocity = 20.0;        // deg/s, mm/s, least limits on axes without thresholds
+const double ResumeDefaultAcceleration = 100.0;   // deg/s^2
+const double ResumeDefaultJerk = 1000.0;          // deg/s^3
+const int MaxRampTries = 8;                // ramp lengthened by half each time it is over the limits
+const int MaxResumes = 10;                 // faults resumed from in one run
+const long ResumeStartIntervalNs = 1000000000L;   // start packet repeated while the controller is not ready
+
+typedef struct ResumePlan_T {
+	size_t fromSample;        // last executed sample, the approach goes to it
+	size_t rejoinSample;      // first original sample after the ramp
+	size_t approachSamples;
+	size_t rampSamples;
+	double distance;          // largest axis move of the approach
+	int rampTries;
+	size_t samples;           // lead in + the rest of the trajectory
+} ResumePlan_T;
+
+/*
+ * PlanResume: the samples to stream after a fault: lead in from current
+ *             (the reported pose) to samples[fromSample], then the rest of
+ *             the trajectory. source[i] is the original sample out[i] stands
+ *             for, to map the next fault back. Cartesian: w p r moved the
+ *             short way round. limits may be NULL (no thresholds). false
+ *             (reason printed) if the ramp stays over the limits.
+ */
+bool PlanResume(const PositionData_T *samples, size_t sampleCount, int axisCount, size_t fromSample, const float current[MaxAxisNumber],
+	int representation, const AxisLimits_T limits[MaxAxisNumber], long cycleNs, std::vector<PositionData_T> *out, std::vector<size_t> *source,
+	ResumePlan_T *plan);
+
+void WriteResumePlan(const ResumePlan_T *plan, size_t sampleCount, long cycleNs);
@@ -0,0 +1,490 @@
+//
+// RobotModel.cpp : robot description from the SolidWorks exporter's URDF or
+//                  CSV file (src/v8, src/fanuc_urdf)
+//
+
+#include "stdafx.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "RobotModel.h"
+
+using namespace std;
+
+static bool ReadWholeFile(const char *fileName, string *text)
+{
+	ifstream in(fileName, ios::in | ios::binary);
+	if (!in) {
+		cout << "Cannot open robot model " << fileName << endl;
+		return false;
+	}
+	stringstream buffer;
+	buffer << in.rdbuf();
+	*text = buffer.str();
+	return true;
+}
+
+static void CopyName(char *dest, size_t destSize, const string &src)
+{
+	snprintf(dest, destSize, "%s", src.c_str());
+}
+
+static int ParseNumbers(const string &text, double *values, int maxCount)
+{
+	const char *p = text.c_str();
+	int count = 0;
+	while ((count < maxCount) && (*p != '\0')) {
+		char *end;
+		double value = strtod(p, &end);
+		if (end == p) {
+			break;
+		}
+		values[count++] = value;
+		p = end;
+	}
+	return count;
+}
+
+static int FindLink(const RobotModel_T *model, const string &name)
+{
+	for (int idx = 0; idx < model->linkCount; idx++) {
+		if (name.compare(model->links[idx].name) == 0) {
+			return idx;
+		}
+	}
+	return -1;
+}
+
+// ---------------------------------------------------------------- URDF
+
+typedef struct XmlElement_T {
+	size_t begin;      // '<' of the opening tag
+	size_t tagEnd;     // '>' of the opening tag
+	size_t end;        // past the closing tag (or the opening tag if self closed)
+} XmlElement_T;
+
+/*
+ * FindElement: next <tag ...> between from and to. Elements of the same
+ *              name are not nested in the exporter's files.
+ */
+static bool FindElement(const string &text, size_t from, size_t to, const char *tag, XmlElement_T *element)
+{
+	string open = string("<") + tag;
+	string close = string("</") + tag + ">";
+	size_t pos = from;
+
+	while ((pos = text.find(open, pos)) != string::npos && (pos < to)) {
+		char next = text[pos + open.size()];
+		if (isspace((unsigned char)next) || (next == '>') || (next == '/')) {
+			size_t tagEnd = text.find('>', pos);
+			if ((tagEnd == string::npos) || (tagEnd >= to)) {
+				return false;
+			}
+			element->begin = pos;
+			element->tagEnd = tagEnd;
+			if (text[tagEnd - 1] == '/') {
+				element->end = tagEnd + 1;
+			}
+			else {
+				size_t closePos = text.find(close, tagEnd);
+				element->end = ((closePos == string::npos) || (closePos > to)) ? to : closePos + close.size();
+			}
+			return true;
+		}
+		pos += open.size();
+	}
+	return false;
+}
+
+static bool GetAttribute(const string &text, const XmlElement_T *element, const char *name, string *value)
+{
+	string key = string(name) + "=\"";
+	size_t pos = element->begin;
+
+	while ((pos = text.find(key, pos)) != string::npos && (pos < element->tagEnd)) {
+		if (isspace((unsigned char)text[pos - 1])) {
+			size_t valueEnd = text.find('"', pos + key.size());
+			if (valueEnd == string::npos) {
+				return false;
+			}
+			*value = text.substr(pos + key.size(), valueEnd - pos - key.size());
+			return true;
+		}
+		pos += key.size();
+	}
+	return false;
+}
+
+// attribute of the first <child> element inside element, as numbers
+static int GetChildNumbers(const string &text, const XmlElement_T *element, const char *child, const char *name, double *values, int count)
+{
+	XmlElement_T sub;
+	string value;
+	if (!FindElement(text, element->tagEnd, element->end, child, &sub) || !GetAttribute(text, &sub, name, &value)) {
+		return 0;
+	}
+	return ParseNumbers(value, values, count);
+}
+
+static bool GetChildString(const string &text, const XmlElement_T *element, const char *child, const char *name, string *value)
+{
+	XmlElement_T sub;
+	return FindElement(text, element->tagEnd, element->end, child, &sub) && GetAttribute(text, &sub, name, value);
+}
+
+static bool ParseUrdfLink(const string &text, const XmlElement_T *element, ModelLink_T *link)
+{
+	string value;
+	XmlElement_T part;
+
+	if (!GetAttribute(text, element, "name", &value)) {
+		return false;
+	}
+	CopyName(link->name, sizeof(link->name), value);
+
+	if (FindElement(text, element->tagEnd, element->end, "inertial", &part)) {
+		double mass = 0.0;
+		GetChildNumbers(text, &part, "origin", "xyz", link->com, 3);
+		GetChildNumbers(text, &part, "mass", "value", &mass, 1);
+		link->mass = mass;
+		static const char *inertiaName[6] = { "ixx", "ixy", "ixz", "iyy", "iyz", "izz" };
+		XmlElement_T inertia;
+		if (FindElement(text, part.tagEnd, part.end, "inertia", &inertia)) {
+			for (int idx = 0; idx < 6; idx++) {
+				if (GetAttribute(text, &inertia, inertiaName[idx], &value)) {
+					link->inertia[idx] = atof(value.c_str());
+				}
+			}
+		}
+	}
+	if (FindElement(text, element->tagEnd, element->end, "collision", &part)
+		&& GetChildString(text, &part, "mesh", "filename", &value)) {
+		CopyName(link->mesh, sizeof(link->mesh), value);
+	}
+	return true;
+}
+
+static bool ParseUrdfJoint(const string &text, const XmlElement_T *element, RobotModel_T *model, ModelJoint_T *joint)
+{
+	string value;
+
+	if (!GetAttribute(text, element, "name", &value)) {
+		return false;
+	}
+	CopyName(joint->name, sizeof(joint->name), value);
+	if (GetAttribute(text, element, "type", &value)) {
+		CopyName(joint->type, sizeof(joint->type), value);
+	}
+	GetChildNumbers(text, element, "origin", "xyz", joint->xyz, 3);
+	GetChildNumbers(text, element, "origin", "rpy", joint->rpy, 3);
+	GetChildNumbers(text, element, "axis", "xyz", joint->axis, 3);
+	GetChildNumbers(text, element, "limit", "lower", &joint->lower, 1);
+	GetChildNumbers(text, element, "limit", "upper", &joint->upper, 1);
+	GetChildNumbers(text, element, "limit", "velocity", &joint->velocity, 1);
+	GetChildNumbers(text, element, "limit", "effort", &joint->effort, 1);
+
+	string parent, child;
+	if (!GetChildString(text, element, "parent", "link", &parent) || !GetChildString(text, element, "child", "link", &child)) {
+		cout << model->fileName << ": joint " << joint->name << " has no parent or child link" << endl;
+		return false;
+	}
+	joint->parent = FindLink(model, parent);
+	joint->child = FindLink(model, child);
+	if ((joint->parent < 0) || (joint->child < 0)) {
+		cout << model->fileName << ": joint " << joint->name << " refers to an unknown link" << endl;
+		return false;
+	}
+	return true;
+}
+
+static bool ParseUrdf(const string &text, RobotModel_T *model)
+{
+	XmlElement_T element;
+	size_t pos = 0;
+
+	// links first, joints refer to them by name
+	while (FindElement(text, pos, text.size(), "link", &element)) {
+		if (model->linkCount >= MaxModelLinks) {
+			cout << model->fileName << ": more than " << MaxModelLinks << " links" << endl;
+			return false;
+		}
+		if (!ParseUrdfLink(text, &element, &model->links[model->linkCount])) {
+			cout << model->fileName << ": link without a name" << endl;
+			return false;
+		}
+		model->linkCount++;
+		pos = element.end;
+	}
+	pos = 0;
+	while (FindElement(text, pos, text.size(), "joint", &element)) {
+		if (model->jointCount >= MaxModelLinks) {
+			cout << model->fileName << ": more than " << MaxModelLinks << " joints" << endl;
+			return false;
+		}
+		if (!ParseUrdfJoint(text, &element, model, &model->joints[model->jointCount])) {
+			return false;
+		}
+		model->jointCount++;
+		pos = element.end;
+	}
+	return true;
+}
+
+// ---------------------------------------------------------------- CSV
+
+static void SplitCsvLine(const string &line, vector<string> *fields)
+{
+	fields->clear();
+	string field;
+	bool quoted = false;
+	for (size_t idx = 0; idx < line.size(); idx++) {
+		char c = line[idx];
+		if (c == '"') {
+			quoted = !quoted;
+		}
+		else if ((c == ',') && !quoted) {
+			fields->push_back(field);
+			field.clear();
+		}
+		else if ((c != '\r') && (c != '\n')) {
+			field += c;
+		}
+	}
+	fields->push_back(field);
+}
+
+static bool ParseCsv(const string &text, RobotModel_T *model)
+{
+	static const char *columnName[] = {
+		"Link Name", "Center of Mass X", "Center of Mass Y", "Center of Mass Z", "Mass",
+		"Moment Ixx", "Moment Ixy", "Moment Ixz", "Moment Iyy", "Moment Iyz", "Moment Izz",
+		"Collision Mesh Filename", "Joint Name", "Joint Type",
+		"Joint Origin X", "Joint Origin Y", "Joint Origin Z", "Joint Origin Roll", "Joint Origin Pitch", "Joint Origin Yaw",
+		"Parent", "Joint Axis X", "Joint Axis Y", "Joint Axis Z",
+		"Limit Effort", "Limit Velocity", "Limit Lower", "Limit Upper" };
+	enum { LinkName, ComX, ComY, ComZ, Mass, Ixx, Ixy, Ixz, Iyy, Iyz, Izz, Mesh, JointName, JointType,
+		OriginX, OriginY, OriginZ, OriginRoll, OriginPitch, OriginYaw, Parent, AxisX, AxisY, AxisZ,
+		Effort, Velocity, Lower, Upper, ColumnCount };
+	int column[ColumnCount];
+
+	istringstream in(text);
+	string line;
+	vector<string> fields;
+	if (!getline(in, line)) {
+		cout << model->fileName << ": empty file" << endl;
+		return false;
+	}
+	SplitCsvLine(line, &fields);
+	size_t headerCount = fields.size();
+	for (int idx = 0; idx < ColumnCount; idx++) {
+		column[idx] = -1;
+		for (size_t field = 0; field < fields.size(); field++) {
+			if (fields[field].compare(columnName[idx]) == 0) {
+				column[idx] = (int)field;
+			}
+		}
+		if (column[idx] < 0) {
+			cout << model->fileName << ": no \"" << columnName[idx] << "\" column" << endl;
+			return false;
+		}
+	}
+
+	// one row per link, the joint columns describe the joint to its parent
+	vector< vector<string> > rows;
+	while (getline(in, line)) {
+		SplitCsvLine(line, &fields);
+		if (fields[0].empty()) {
+			continue;
+		}
+		if (fields.size() < headerCount) {
+			fields.resize(headerCount);
+		}
+		rows.push_back(fields);
+	}
+	for (size_t row = 0; row < rows.size(); row++) {
+		if (model->linkCount >= MaxModelLinks) {
+			cout << model->fileName << ": more than " << MaxModelLinks << " links" << endl;
+			return false;
+		}
+		const vector<string> &f = rows[row];
+		ModelLink_T *link = &model->links[model->linkCount++];
+		CopyName(link->name, sizeof(link->name), f[column[LinkName]]);
+		link->com[0] = atof(f[column[ComX]].c_str());
+		link->com[1] = atof(f[column[ComY]].c_str());
+		link->com[2] = atof(f[column[ComZ]].c_str());
+		link->mass = atof(f[column[Mass]].c_str());
+		for (int idx = 0; idx < 6; idx++) {
+			link->inertia[idx] = atof(f[column[Ixx + idx]].c_str());
+		}
+		CopyName(link->mesh, sizeof(link->mesh), f[column[Mesh]]);
+	}
+	for (size_t row = 0; row < rows.size(); row++) {
+		const vector<string> &f = rows[row];
+		if (f[column[JointName]].empty()) {
+			continue;   // root link
+		}
+		ModelJoint_T *joint = &model->joints[model->jointCount++];
+		CopyName(joint->name, sizeof(joint->name), f[column[JointName]]);
+		CopyName(joint->type, sizeof(joint->type), f[column[JointType]]);
+		for (int idx = 0; idx < 3; idx++) {
+			joint->xyz[idx] = atof(f[column[OriginX + idx]].c_str());
+			joint->rpy[idx] = atof(f[column[OriginRoll + idx]].c_str());
+			joint->axis[idx] = atof(f[column[AxisX + idx]].c_str());
+		}
+		joint->effort = atof(f[column[Effort]].c_str());
+		joint->velocity = atof(f[column[Velocity]].c_str());
+		joint->lower = atof(f[column[Lower]].c_str());
+		joint->upper = atof(f[column[Upper]].c_str());
+		joint->child = (int)row;
+		joint->parent = FindLink(model, f[column[Parent]]);
+		if (joint->parent < 0) {
+			cout << model->fileName << ": joint " << joint->name << " refers to an unknown parent link" << endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+// ---------------------------------------------------------------- model
+
+// the exporter writes +-1.5708 and 3.1416; snap those to exact multiples of pi/2
+static double SnapAngle(double angle)
+{
+	double quarter = angle / M_PI_2;
+	double nearest = floor(quarter + 0.5);
+	return (fabs(quarter - nearest) < 1.0e-4) ? nearest * M_PI_2 : angle;
+}
+
+static bool FindChain(RobotModel_T *model)
+{
+	int root = -1;
+	for (int linkIdx = 0; (linkIdx < model->linkCount) && (root < 0); linkIdx++) {
+		bool isChild = false;
+		for (int jointIdx = 0; jointIdx < model->jointCount; jointIdx++) {
+			isChild = isChild || (model->joints[jointIdx].child == linkIdx);
+		}
+		if (!isChild) {
+			root = linkIdx;
+		}
+	}
+	if (root < 0) {
+		cout << model->fileName << ": no root link" << endl;
+		return false;
+	}
+
+	model->chainLength = 0;
+	int link = root;
+	bool more = true;
+	while (more) {
+		more = false;
+		for (int jointIdx = 0; jointIdx < model->jointCount; jointIdx++) {
+			if (model->joints[jointIdx].parent == link) {
+				if (model->chainLength >= MaxAxisNumber) {
+					cout << model->fileName << ": more than " << MaxAxisNumber << " joints in the chain" << endl;
+					return false;
+				}
+				model->chain[model->chainLength++] = jointIdx;
+				link = model->joints[jointIdx].child;
+				more = true;
+				break;
+			}
+		}
+	}
+	if (model->chainLength < 1) {
+		cout << model->fileName << ": no joints" << endl;
+		return false;
+	}
+	return true;
+}
+
+bool LoadRobotModel(const char *fileName, RobotModel_T *model)
+{
+	string text;
+
+	memset(model, 0, sizeof(*model));
+	CopyName(model->fileName, sizeof(model->fileName), fileName);
+	if (!ReadWholeFile(fileName, &text)) {
+		return false;
+	}
+
+	string name(fileName);
+	bool csv = (name.size() > 4) && (strcasecmp(name.c_str() + name.size() - 4, ".csv") == 0);
+	if (!(csv ? ParseCsv(text, model) : ParseUrdf(text, model))) {
+		return false;
+	}
+
+	for (int jointIdx = 0; jointIdx < model->jointCount; jointIdx++) {
+		ModelJoint_T *joint = &model->joints[jointIdx];
+		for (int idx = 0; idx < 3; idx++) {
+			joint->rpy[idx] = SnapAngle(joint->rpy[idx]);
+		}
+		double norm = sqrt(joint->axis[0] * joint->axis[0] + joint->axis[1] * joint->axis[1] + joint->axis[2] * joint->axis[2]);
+		if (norm < 1.0e-9) {
+			joint->axis[0] = 0.0;
+			joint->axis[1] = 0.0;
+			joint->axis[2] = 1.0;
+		}
+		else {
+			for (int idx = 0; idx < 3; idx++) {
+				joint->axis[idx] /= norm;
+			}
+		}
+	}
+	return FindChain(model);
+}
+
+const ModelLink_T *ChainLink(const RobotModel_T *model, int idx)
+{
+	if (idx == 0) {
+		return &model->links[model->joints[model->chain[0]].parent];
+	}
+	return &model->links[model->joints[model->chain[idx - 1]].child];
+}
+
+void ResolveModelPath(const RobotModel_T *model, const char *uri, char *path, size_t pathSize)
+{
+	string file(uri);
+	string prefix("package://");
+
+	if (file.compare(0, prefix.size(), prefix) != 0) {
+		snprintf(path, pathSize, "%s", uri);
+		return;
+	}
+	// package://v8/meshes/x.STL with the model in <pkg>/urdf/v8.urdf -> <pkg>/meshes/x.STL
+	size_t slash = file.find('/', prefix.size());
+	string inPackage = (slash == string::npos) ? "" : file.substr(slash + 1);
+	string modelFile(model->fileName);
+	size_t dirEnd = modelFile.find_last_of('/');
+	string modelDir = (dirEnd == string::npos) ? "." : modelFile.substr(0, dirEnd);
+	snprintf(path, pathSize, "%s/../%s", modelDir.c_str(), inPackage.c_str());
+}
+
+void RpyToMatrix(const double rpy[3], double m[9])
+{
+	double cr = cos(rpy[0]), sr = sin(rpy[0]);
+	double cp = cos(rpy[1]), sp = sin(rpy[1]);
+	double cy = cos(rpy[2]), sy = sin(rpy[2]);
+
+	m[0] = cy * cp;  m[1] = cy * sp * sr - sy * cr;  m[2] = cy * sp * cr + sy * sr;
+	m[3] = sy * cp;  m[4] = sy * sp * sr + cy * cr;  m[5] = sy * sp * cr - cy * sr;
+	m[6] = -sp;      m[7] = cp * sr;                 m[8] = cp * cr;
+}
+
+void WriteRobotModel(const RobotModel_T *model)
+{
+	printf("robot model %s: %d links, chain of %d joints\n", model->fileName, model->linkCount, model->chainLength);
+	for (int idx = 0; idx < model->chainLength; idx++) {
+		const ModelJoint_T *joint = &model->joints[model->chain[idx]];
+		printf(" %d %-10s %-8s %-10s -> %-10s xyz %8.4f %8.4f %8.4f rpy %8.4f %8.4f %8.4f axis %g %g %g\n", idx + 1, joint->name, joint->type,
+			model->links[joint->parent].name, model->links[joint->child].name,
+			joint->xyz[0], joint->xyz[1], joint->xyz[2], joint->rpy[0], joint->rpy[1], joint->rpy[2],
+			joint->axis[0], joint->axis[1], joint->axis[2]);
+	}
+}
@@ -0,0 +1,75 @@
+//
+// RobotModel.h : robot description from the SolidWorks exporter's URDF or
+//                CSV file (src/v8, src/fanuc_urdf)
+//
+// Only what the exporter writes is read: links with their inertial and mesh,
+// joints with origin, parent/child link, axis and limits. Lengths are meters
+// and angles radians, as in the file.
+//
+// The exporter's joints are often "fixed" with a zero axis when the assembly
+// had no reference axes. Every joint on the chain from the root link to the
+// tip is taken as a robot axis whatever its type, turning about its own z
+// axis unless the file gives one.
+//
+
+#pragma once
+
+#include "J519Packet.h"
+
+const int MaxModelLinks = 16;
+const int ModelNameSize = 64;
+const int ModelPathSize = 256;
+
+typedef struct ModelLink_T {
+	char name[ModelNameSize];
+	double mass;
+	double com[3];               // center of mass in the link frame
+	double inertia[6];           // ixx ixy ixz iyy iyz izz about the center of mass
+	char mesh[ModelPathSize];    // collision mesh, package://... as in the file
+} ModelLink_T;
+
+typedef struct ModelJoint_T {
+	char name[ModelNameSize];
+	char type[16];
+	int parent;                  // link index
+	int child;
+	double xyz[3];               // child frame origin in the parent link frame
+	double rpy[3];               // fixed axis roll, pitch, yaw
+	double axis[3];              // unit vector in the child frame, z if the file gives 0 0 0
+	double lower;                // limits, all 0 = not set
+	double upper;
+	double velocity;
+	double effort;
+} ModelJoint_T;
+
+typedef struct RobotModel_T {
+	char fileName[ModelPathSize];
+	int linkCount;
+	ModelLink_T links[MaxModelLinks];
+	int jointCount;
+	ModelJoint_T joints[MaxModelLinks];
+
+	// joints from the root link out to the tip, the robot axes in order
+	int chainLength;
+	int chain[MaxAxisNumber];
+} RobotModel_T;
+
+/*
+ * LoadRobotModel: read a .urdf or exporter .csv file and find the chain.
+ *                 On error prints the reason and returns false.
+ */
+bool LoadRobotModel(const char *fileName, RobotModel_T *model);
+
+// chain link index i (0 = root link)
+const ModelLink_T *ChainLink(const RobotModel_T *model, int idx);
+
+/*
+ * ResolveModelPath: package://<pkg>/<path> -> <package dir>/<path>, the
+ *                   package dir being the parent of the model file's dir.
+ */
+void ResolveModelPath(const RobotModel_T *model, const char *uri, char *path, size_t pathSize);
+
+// 3x3 rotation for URDF rpy: Rz(yaw) * Ry(pitch) * Rx(roll), row major
+void RpyToMatrix(const double rpy[3], double matrix[9]);
+
+void WriteRobotModel(const RobotModel_T *model);
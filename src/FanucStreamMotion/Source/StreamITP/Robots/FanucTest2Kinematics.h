@@ -0,0 +1,197 @@
+//
+// FanucTest2Kinematics.h : fixed kinematics of fanuc_test2.csv, generated by KinGen - do not edit,
+//     run KinGen again when the model changes (FixedMatchesChain tells)
+//
+
+#pragma once
+
+typedef struct FanucTest2Kinematics_T {
+	static constexpr int AxisCount = 6;
+	static constexpr bool J23Coupled = true;
+	static constexpr double WorldHeight = 425.0;
+	static constexpr double Lower[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+	static constexpr double Upper[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+	static constexpr double Frame[6][12] = {
+		{ 1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0 },
+		{ 1.0, 0.0, 0.0, 19.849999999999998, 0.0, 0.0, 1.0, -509.49000000000001, 0.0, -1.0, 0.0, 0.0 },
+		{ -1.0, 0.0, 0.0, 55.149999999999999, 0.0, 1.0, 0.0, -840.0, 0.0, 0.0, -1.0, 98.335000000000008 },
+		{ 0.0, 0.0, 1.0, -286.10000000000002, -1.0, 0.0, 0.0, -215.16999999999999, 0.0, -1.0, 0.0, -406.15000000000003 },
+		{ 0.0, 0.0, 1.0, 1.5339, 0.0, 1.0, 0.0, 0.0, -1.0, 0.0, 0.0, -603.75999999999999 },
+		{ 0.0, 0.0, -1.0, 136.30000000000001, 0.0, -1.0, 0.0, 0.0, -1.0, 0.0, 0.0, 0.0 }
+	};
+	static constexpr double Tool[12] = { -1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 0.0, -1.0, 0.0 };
+
+	// faceplate in the world frame, 3x4 row major (mm); model angles as sin / cos
+	static inline void Forward(const double s[6], const double c[6], double end[12])
+	{
+		// J2
+		const double m0 = c[0] * 19.849999999999998 + s[0] * 509.49000000000001;
+		const double m1 = s[0] * 19.849999999999998 - c[0] * 509.49000000000001;
+		const double m2 = c[1] * c[0];
+		const double m3 = -s[1] * c[0];
+		const double m4 = c[1] * s[0];
+		const double m5 = -s[1] * s[0];
+		// J3
+		const double m6 = m0 + m2 * 55.149999999999999 - m3 * 840.0 - s[0] * 98.335000000000008;
+		const double m7 = m1 + m4 * 55.149999999999999 - m5 * 840.0 + c[0] * 98.335000000000008;
+		const double m8 = -s[1] * 55.149999999999999 + c[1] * 840.0;
+		const double m9 = -c[2] * m2 + s[2] * m3;
+		const double m10 = c[2] * m3 + s[2] * m2;
+		const double m11 = -c[2] * m4 + s[2] * m5;
+		const double m12 = c[2] * m5 + s[2] * m4;
+		const double m13 = c[2] * s[1] - s[2] * c[1];
+		const double m14 = -c[2] * c[1] - s[2] * s[1];
+		// J4
+		const double m15 = m6 - m9 * 286.10000000000002 - m10 * 215.16999999999999 - s[0] * 406.15000000000003;
+		const double m16 = m7 - m11 * 286.10000000000002 - m12 * 215.16999999999999 + c[0] * 406.15000000000003;
+		const double m17 = m8 - m13 * 286.10000000000002 - m14 * 215.16999999999999;
+		const double m18 = -c[3] * m10 - s[3] * s[0];
+		const double m19 = -c[3] * s[0] + s[3] * m10;
+		const double m20 = -c[3] * m12 + s[3] * c[0];
+		const double m21 = c[3] * c[0] + s[3] * m12;
+		const double m22 = -c[3] * m14;
+		const double m23 = s[3] * m14;
+		// J5
+		const double m24 = m15 + m18 * 1.5339 - m9 * 603.75999999999999;
+		const double m25 = m16 + m20 * 1.5339 - m11 * 603.75999999999999;
+		const double m26 = m17 + m22 * 1.5339 - m13 * 603.75999999999999;
+		const double m27 = -c[4] * m9 + s[4] * m19;
+		const double m28 = c[4] * m19 + s[4] * m9;
+		const double m29 = -c[4] * m11 + s[4] * m21;
+		const double m30 = c[4] * m21 + s[4] * m11;
+		const double m31 = -c[4] * m13 + s[4] * m23;
+		const double m32 = c[4] * m23 + s[4] * m13;
+		// J6
+		const double m33 = m24 + m27 * 136.30000000000001;
+		const double m34 = m25 + m29 * 136.30000000000001;
+		const double m35 = m26 + m31 * 136.30000000000001;
+		const double m36 = -c[5] * m18 - s[5] * m28;
+		const double m37 = -c[5] * m28 + s[5] * m18;
+		const double m38 = -c[5] * m20 - s[5] * m30;
+		const double m39 = -c[5] * m30 + s[5] * m20;
+		const double m40 = -c[5] * m22 - s[5] * m32;
+		const double m41 = -c[5] * m32 + s[5] * m22;
+		// faceplate
+		end[0] = -m36;
+		end[1] = m37;
+		end[2] = m27;
+		end[3] = m33;
+		end[4] = -m38;
+		end[5] = m39;
+		end[6] = m29;
+		end[7] = m34;
+		end[8] = -m40;
+		end[9] = m41;
+		end[10] = m31;
+		end[11] = m35;
+	}
+
+	// 6 x AxisCount row major: faceplate velocity (mm/rad) over angular velocity (rad/rad), world frame
+	static inline void Jacobian(const double s[6], const double c[6], double jac[36])
+	{
+		// J2
+		const double m0 = c[0] * 19.849999999999998 + s[0] * 509.49000000000001;
+		const double m1 = s[0] * 19.849999999999998 - c[0] * 509.49000000000001;
+		const double m2 = c[1] * c[0];
+		const double m3 = -s[1] * c[0];
+		const double m4 = c[1] * s[0];
+		const double m5 = -s[1] * s[0];
+		// J3
+		const double m6 = m0 + m2 * 55.149999999999999 - m3 * 840.0 - s[0] * 98.335000000000008;
+		const double m7 = m1 + m4 * 55.149999999999999 - m5 * 840.0 + c[0] * 98.335000000000008;
+		const double m8 = -s[1] * 55.149999999999999 + c[1] * 840.0;
+		const double m9 = -c[2] * m2 + s[2] * m3;
+		const double m10 = c[2] * m3 + s[2] * m2;
+		const double m11 = -c[2] * m4 + s[2] * m5;
+		const double m12 = c[2] * m5 + s[2] * m4;
+		const double m13 = c[2] * s[1] - s[2] * c[1];
+		const double m14 = -c[2] * c[1] - s[2] * s[1];
+		// J4
+		const double m15 = m6 - m9 * 286.10000000000002 - m10 * 215.16999999999999 - s[0] * 406.15000000000003;
+		const double m16 = m7 - m11 * 286.10000000000002 - m12 * 215.16999999999999 + c[0] * 406.15000000000003;
+		const double m17 = m8 - m13 * 286.10000000000002 - m14 * 215.16999999999999;
+		const double m18 = -c[3] * m10 - s[3] * s[0];
+		const double m19 = -c[3] * s[0] + s[3] * m10;
+		const double m20 = -c[3] * m12 + s[3] * c[0];
+		const double m21 = c[3] * c[0] + s[3] * m12;
+		const double m22 = -c[3] * m14;
+		const double m23 = s[3] * m14;
+		// J5
+		const double m24 = m15 + m18 * 1.5339 - m9 * 603.75999999999999;
+		const double m25 = m16 + m20 * 1.5339 - m11 * 603.75999999999999;
+		const double m26 = m17 + m22 * 1.5339 - m13 * 603.75999999999999;
+		const double m27 = -c[4] * m9 + s[4] * m19;
+		const double m29 = -c[4] * m11 + s[4] * m21;
+		const double m31 = -c[4] * m13 + s[4] * m23;
+		// J6
+		const double m33 = m24 + m27 * 136.30000000000001;
+		const double m34 = m25 + m29 * 136.30000000000001;
+		const double m35 = m26 + m31 * 136.30000000000001;
+		// columns
+		jac[0] = -m34;
+		jac[6] = m33;
+		jac[12] = 0.0;
+		jac[18] = 0.0;
+		jac[24] = 0.0;
+		jac[30] = 1.0;
+		const double r42 = m33 - m0;
+		const double r43 = m34 - m1;
+		jac[1] = c[0] * m35;
+		jac[7] = s[0] * m35;
+		jac[13] = -s[0] * r43 - c[0] * r42;
+		jac[19] = -s[0];
+		jac[25] = c[0];
+		jac[31] = 0.0;
+		const double r44 = m33 - m6;
+		const double r45 = m34 - m7;
+		const double r46 = m35 - m8;
+		jac[2] = -c[0] * r46;
+		jac[8] = -s[0] * r46;
+		jac[14] = s[0] * r45 + c[0] * r44;
+		jac[20] = s[0];
+		jac[26] = -c[0];
+		jac[32] = 0.0;
+		const double r47 = m33 - m15;
+		const double r48 = m34 - m16;
+		const double r49 = m35 - m17;
+		jac[3] = m11 * r49 - m13 * r48;
+		jac[9] = m13 * r47 - m9 * r49;
+		jac[15] = m9 * r48 - m11 * r47;
+		jac[21] = m9;
+		jac[27] = m11;
+		jac[33] = m13;
+		const double r50 = m33 - m24;
+		const double r51 = m34 - m25;
+		const double r52 = m35 - m26;
+		jac[4] = m20 * r52 - m22 * r51;
+		jac[10] = m22 * r50 - m18 * r52;
+		jac[16] = m18 * r51 - m20 * r50;
+		jac[22] = m18;
+		jac[28] = m20;
+		jac[34] = m22;
+		jac[5] = 0.0;
+		jac[11] = 0.0;
+		jac[17] = 0.0;
+		jac[23] = -m27;
+		jac[29] = -m29;
+		jac[35] = -m31;
+	}
+
+	// bit i set: model angle i (rad) outside its limits
+	static inline unsigned LimitMask(const double q[6])
+	{
+		unsigned mask = 0;
+		// J1: no limits in the model
+		// J2: no limits in the model
+		// J3: no limits in the model
+		// J4: no limits in the model
+		// J5: no limits in the model
+		// J6: no limits in the model
+		(void)q;
+		return mask;
+	}
+} FanucTest2Kinematics_T;
+
+#ifndef FIXED_ROBOT
+#define FIXED_ROBOT FanucTest2Kinematics_T
+#endif
@@ -0,0 +1,197 @@
+//
+// V8Kinematics.h : fixed kinematics of v8.urdf, generated by KinGen - do not edit,
+//     run KinGen again when the model changes (FixedMatchesChain tells)
+//
+
+#pragma once
+
+typedef struct V8Kinematics_T {
+	static constexpr int AxisCount = 6;
+	static constexpr bool J23Coupled = true;
+	static constexpr double WorldHeight = 425.0;
+	static constexpr double Lower[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+	static constexpr double Upper[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+	static constexpr double Frame[6][12] = {
+		{ 1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0 },
+		{ 1.0, 0.0, 0.0, 75.0, 0.0, 0.0, 1.0, 0.0, 0.0, -1.0, 0.0, 0.0 },
+		{ 1.0, 0.0, 0.0, 0.0, 0.0, -1.0, 0.0, -840.0, 0.0, 0.0, -1.0, 0.0 },
+		{ 0.0, 0.0, -1.0, 0.0, 1.0, 0.0, 0.0, 215.0, 0.0, -1.0, 0.0, 0.0 },
+		{ 1.0, 0.0, 0.0, 0.0, 0.0, 0.0, -1.0, 0.0, 0.0, 1.0, 0.0, -890.0 },
+		{ 1.0, 0.0, 0.0, 0.0, 0.0, 0.0, -1.0, -90.0, 0.0, 1.0, 0.0, 0.0 }
+	};
+	static constexpr double Tool[12] = { 1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0 };
+
+	// faceplate in the world frame, 3x4 row major (mm); model angles as sin / cos
+	static inline void Forward(const double s[6], const double c[6], double end[12])
+	{
+		// J2
+		const double m0 = c[0] * 75.0;
+		const double m1 = s[0] * 75.0;
+		const double m2 = c[1] * c[0];
+		const double m3 = -s[1] * c[0];
+		const double m4 = c[1] * s[0];
+		const double m5 = -s[1] * s[0];
+		// J3
+		const double m6 = m0 - m3 * 840.0;
+		const double m7 = m1 - m5 * 840.0;
+		const double m8 = c[1] * 840.0;
+		const double m9 = c[2] * m2 - s[2] * m3;
+		const double m10 = -c[2] * m3 - s[2] * m2;
+		const double m11 = c[2] * m4 - s[2] * m5;
+		const double m12 = -c[2] * m5 - s[2] * m4;
+		const double m13 = -c[2] * s[1] + s[2] * c[1];
+		const double m14 = c[2] * c[1] + s[2] * s[1];
+		// J4
+		const double m15 = m6 + m10 * 215.0;
+		const double m16 = m7 + m12 * 215.0;
+		const double m17 = m8 + m14 * 215.0;
+		const double m18 = c[3] * m10 - s[3] * s[0];
+		const double m19 = -c[3] * s[0] - s[3] * m10;
+		const double m20 = c[3] * m12 + s[3] * c[0];
+		const double m21 = c[3] * c[0] - s[3] * m12;
+		const double m22 = c[3] * m14;
+		const double m23 = -s[3] * m14;
+		// J5
+		const double m24 = m15 + m9 * 890.0;
+		const double m25 = m16 + m11 * 890.0;
+		const double m26 = m17 + m13 * 890.0;
+		const double m27 = c[4] * m18 - s[4] * m9;
+		const double m28 = -c[4] * m9 - s[4] * m18;
+		const double m29 = c[4] * m20 - s[4] * m11;
+		const double m30 = -c[4] * m11 - s[4] * m20;
+		const double m31 = c[4] * m22 - s[4] * m13;
+		const double m32 = -c[4] * m13 - s[4] * m22;
+		// J6
+		const double m33 = m24 - m28 * 90.0;
+		const double m34 = m25 - m30 * 90.0;
+		const double m35 = m26 - m32 * 90.0;
+		const double m36 = c[5] * m27 - s[5] * m19;
+		const double m37 = -c[5] * m19 - s[5] * m27;
+		const double m38 = c[5] * m29 - s[5] * m21;
+		const double m39 = -c[5] * m21 - s[5] * m29;
+		const double m40 = c[5] * m31 - s[5] * m23;
+		const double m41 = -c[5] * m23 - s[5] * m31;
+		// faceplate
+		end[0] = m36;
+		end[1] = m37;
+		end[2] = -m28;
+		end[3] = m33;
+		end[4] = m38;
+		end[5] = m39;
+		end[6] = -m30;
+		end[7] = m34;
+		end[8] = m40;
+		end[9] = m41;
+		end[10] = -m32;
+		end[11] = m35;
+	}
+
+	// 6 x AxisCount row major: faceplate velocity (mm/rad) over angular velocity (rad/rad), world frame
+	static inline void Jacobian(const double s[6], const double c[6], double jac[36])
+	{
+		// J2
+		const double m0 = c[0] * 75.0;
+		const double m1 = s[0] * 75.0;
+		const double m2 = c[1] * c[0];
+		const double m3 = -s[1] * c[0];
+		const double m4 = c[1] * s[0];
+		const double m5 = -s[1] * s[0];
+		// J3
+		const double m6 = m0 - m3 * 840.0;
+		const double m7 = m1 - m5 * 840.0;
+		const double m8 = c[1] * 840.0;
+		const double m9 = c[2] * m2 - s[2] * m3;
+		const double m10 = -c[2] * m3 - s[2] * m2;
+		const double m11 = c[2] * m4 - s[2] * m5;
+		const double m12 = -c[2] * m5 - s[2] * m4;
+		const double m13 = -c[2] * s[1] + s[2] * c[1];
+		const double m14 = c[2] * c[1] + s[2] * s[1];
+		// J4
+		const double m15 = m6 + m10 * 215.0;
+		const double m16 = m7 + m12 * 215.0;
+		const double m17 = m8 + m14 * 215.0;
+		const double m18 = c[3] * m10 - s[3] * s[0];
+		const double m19 = -c[3] * s[0] - s[3] * m10;
+		const double m20 = c[3] * m12 + s[3] * c[0];
+		const double m21 = c[3] * c[0] - s[3] * m12;
+		const double m22 = c[3] * m14;
+		const double m23 = -s[3] * m14;
+		// J5
+		const double m24 = m15 + m9 * 890.0;
+		const double m25 = m16 + m11 * 890.0;
+		const double m26 = m17 + m13 * 890.0;
+		const double m28 = -c[4] * m9 - s[4] * m18;
+		const double m30 = -c[4] * m11 - s[4] * m20;
+		const double m32 = -c[4] * m13 - s[4] * m22;
+		// J6
+		const double m33 = m24 - m28 * 90.0;
+		const double m34 = m25 - m30 * 90.0;
+		const double m35 = m26 - m32 * 90.0;
+		// columns
+		jac[0] = -m34;
+		jac[6] = m33;
+		jac[12] = 0.0;
+		jac[18] = 0.0;
+		jac[24] = 0.0;
+		jac[30] = 1.0;
+		const double r42 = m33 - m0;
+		const double r43 = m34 - m1;
+		jac[1] = c[0] * m35;
+		jac[7] = s[0] * m35;
+		jac[13] = -s[0] * r43 - c[0] * r42;
+		jac[19] = -s[0];
+		jac[25] = c[0];
+		jac[31] = 0.0;
+		const double r44 = m33 - m6;
+		const double r45 = m34 - m7;
+		const double r46 = m35 - m8;
+		jac[2] = -c[0] * r46;
+		jac[8] = -s[0] * r46;
+		jac[14] = s[0] * r45 + c[0] * r44;
+		jac[20] = s[0];
+		jac[26] = -c[0];
+		jac[32] = 0.0;
+		const double r47 = m33 - m15;
+		const double r48 = m34 - m16;
+		const double r49 = m35 - m17;
+		jac[3] = -m11 * r49 + m13 * r48;
+		jac[9] = -m13 * r47 + m9 * r49;
+		jac[15] = -m9 * r48 + m11 * r47;
+		jac[21] = -m9;
+		jac[27] = -m11;
+		jac[33] = -m13;
+		const double r50 = m33 - m24;
+		const double r51 = m34 - m25;
+		const double r52 = m35 - m26;
+		jac[4] = -m21 * r52 + m23 * r51;
+		jac[10] = -m23 * r50 + m19 * r52;
+		jac[16] = -m19 * r51 + m21 * r50;
+		jac[22] = -m19;
+		jac[28] = -m21;
+		jac[34] = -m23;
+		jac[5] = 0.0;
+		jac[11] = 0.0;
+		jac[17] = 0.0;
+		jac[23] = -m28;
+		jac[29] = -m30;
+		jac[35] = -m32;
+	}
+
+	// bit i set: model angle i (rad) outside its limits
+	static inline unsigned LimitMask(const double q[6])
+	{
+		unsigned mask = 0;
+		// J1: no limits in the model
+		// J2: no limits in the model
+		// J3: no limits in the model
+		// J4: no limits in the model
+		// J5: no limits in the model
+		// J6: no limits in the model
+		(void)q;
+		return mask;
+	}
+} V8Kinematics_T;
+
+#ifndef FIXED_ROBOT
+#define FIXED_ROBOT V8Kinematics_T
+#endif
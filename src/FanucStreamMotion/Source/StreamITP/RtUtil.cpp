@@ -0,0 +1,138 @@
+//
+// RtUtil.cpp : POSIX real-time helpers for the stream thread
+//
+
+#include "stdafx.h"
+#include <errno.h>
+#include <string.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <iostream>
+
+#include "RtUtil.h"
+
+using namespace std;
+
+const size_t PrefaultStackSize = 256 * 1024;
+const size_t PrefaultHeapSize = 8 * 1024 * 1024;
+
+void RtDefaultConfig(RtConfig_T *cfg)
+{
+	cfg->cycleNs = DefaultCycleNs;
+	cfg->rtPriority = 0;
+	cfg->cpu = -1;
+	cfg->lockMemory = true;
+}
+
+bool RtPrepareProcess(const RtConfig_T *cfg)
+{
+	if (!cfg->lockMemory) {
+		return true;
+	}
+
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+		cout << "mlockall failed: " << strerror(errno) << " (check RLIMIT_MEMLOCK)" << endl;
+		return false;
+	}
+
+	// keep freed memory in the process and never hand out fresh mmap chunks
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+
+	// touch a block of heap so later allocations come from resident pages
+	char *heap = (char *)malloc(PrefaultHeapSize);
+	if (heap != NULL) {
+		for (size_t idx = 0; idx < PrefaultHeapSize; idx += 4096) {
+			heap[idx] = 0;
+		}
+		free(heap);
+	}
+	return true;
+}
+
+static void PrefaultStack()
+{
+	volatile char stack[PrefaultStackSize];
+	for (size_t idx = 0; idx < PrefaultStackSize; idx += 4096) {
+		stack[idx] = 0;
+	}
+	// the buffer is never read: keep the stores from being dropped
+	asm volatile("" : : "r"(stack) : "memory");
+}
+
+bool RtConfigureThread(const RtConfig_T *cfg)
+{
+	bool ok = true;
+
+	if (cfg->cpu >= 0) {
+		cpu_set_t cpuSet;
+		CPU_ZERO(&cpuSet);
+		CPU_SET(cfg->cpu, &cpuSet);
+		int err = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+		if (err != 0) {
+			cout << "Cannot pin stream thread to CPU " << cfg->cpu << ": " << strerror(err) << endl;
+			ok = false;
+		}
+	}
+
+	if (cfg->rtPriority > 0) {
+		struct sched_param param;
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = cfg->rtPriority;
+		int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+		if (err != 0) {
+			cout << "Cannot set SCHED_FIFO priority " << cfg->rtPriority << ": " << strerror(err) << endl;
+			ok = false;
+		}
+	}
+
+	if (cfg->lockMemory) {
+		PrefaultStack();
+	}
+	return ok;
+}
+
+void RtNow(struct timespec *ts)
+{
+	clock_gettime(CLOCK_MONOTONIC, ts);
+}
+
+void RtAddNs(struct timespec *ts, long ns)
+{
+	ts->tv_sec += ns / NsPerSec;
+	ts->tv_nsec += ns % NsPerSec;
+	if (ts->tv_nsec >= NsPerSec) {
+		ts->tv_sec++;
+		ts->tv_nsec -= NsPerSec;
+	}
+	else if (ts->tv_nsec < 0) {
+		ts->tv_sec--;
+		ts->tv_nsec += NsPerSec;
+	}
+}
+
+int64_t RtDiffNs(const struct timespec *later, const struct timespec *earlier)
+{
+	return (int64_t)(later->tv_sec - earlier->tv_sec) * NsPerSec + (later->tv_nsec - earlier->tv_nsec);
+}
+
+int64_t TimespecNs(const struct timespec *ts)
+{
+	return (int64_t)ts->tv_sec * NsPerSec + ts->tv_nsec;
+}
+
+int64_t RtNowNs()
+{
+	struct timespec now;
+	RtNow(&now);
+	return TimespecNs(&now);
+}
+
+void RtSleepUntil(const struct timespec *deadline)
+{
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL) == EINTR) {
+	}
+}
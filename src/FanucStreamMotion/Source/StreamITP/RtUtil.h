@@ -0,0 +1,45 @@
+//
+// RtUtil.h : POSIX real-time helpers for the stream thread
+//
+
+#pragma once
+
+#include <time.h>
+#include <stdint.h>
+
+const long NsPerMs = 1000000L;
+const long NsPerSec = 1000000000L;
+const long DefaultCycleNs = 8 * NsPerMs;   // J519 ITP, 8 ms (4 ms on some controllers)
+
+// real-time settings for the stream thread
+typedef struct RtConfig_T {
+	long cycleNs;       // J519 cycle period
+	int rtPriority;     // SCHED_FIFO priority 1-99, 0 = keep the default scheduler
+	int cpu;            // CPU to pin the stream thread to, -1 = no pinning
+	bool lockMemory;    // mlockall + prefault heap and stack
+} RtConfig_T;
+
+void RtDefaultConfig(RtConfig_T *cfg);
+
+/*
+ * RtPrepareProcess: lock all current and future pages and stop malloc
+ *                   from giving memory back, so the stream thread never
+ *                   takes a page fault. Call once before the stream starts.
+ */
+bool RtPrepareProcess(const RtConfig_T *cfg);
+
+/*
+ * RtConfigureThread: apply SCHED_FIFO priority and CPU affinity to the
+ *                    calling thread and prefault its stack.
+ */
+bool RtConfigureThread(const RtConfig_T *cfg);
+
+// timespec arithmetic on CLOCK_MONOTONIC
+void RtNow(struct timespec *ts);
+void RtAddNs(struct timespec *ts, long ns);
+int64_t RtDiffNs(const struct timespec *later, const struct timespec *earlier);
+int64_t TimespecNs(const struct timespec *ts);
+int64_t RtNowNs();
+
+// sleep until an absolute CLOCK_MONOTONIC time, restarting on signals
+void RtSleepUntil(const struct timespec *deadline);
@@ -0,0 +1,408 @@
+//
+// SimController.cpp : software model of the J519 side of a robot controller
+//
+
+#include "stdafx.h"
+#include <string.h>
+#include <math.h>
+
+#include "SimController.h"
+
+// M-20iD/25 class axis limits used for the synthetic threshold tables
+static const float SimMaxVelocity[MaxAxisNumber] = { 210.0f, 210.0f, 265.0f, 420.0f, 450.0f, 720.0f, 200.0f, 200.0f, 200.0f };  // deg/s
+static const float SimAccTime = 0.32f;    // s from 0 to max velocity
+static const float SimJerkTime = 0.08f;   // s from 0 to max acceleration
+static const float SimFullPayloadScale = 0.7f;
+static const u_word SimMaxCartesianSpeed = 2000;   // mm/s
+
+// crude motor model: amps per deg/s^2 and per deg/s
+static const float SimCurrentPerAcc = 0.004f;
+static const float SimCurrentPerVel = 0.01f;
+
+void SimDefaultConfig(SimConfig_T *config)
+{
+	config->cycleNs = 8000000L;
+	config->latencyNs = 200000L;
+	config->jitterNs = 0;
+	config->lossRate = 0.0;
+	config->bufferDepth = 10;
+	config->seed = 1;
+	config->axisCount = MaxAxisNumber;
+}
+
+void SimInit(SimController_T *sim, const SimConfig_T *config)
+{
+	memset(sim, 0, sizeof(*sim));
+	sim->config = *config;
+	if (sim->config.bufferDepth < 1) {
+		sim->config.bufferDepth = 1;
+	}
+	if (sim->config.bufferDepth > SimMaxBufferDepth) {
+		sim->config.bufferDepth = SimMaxBufferDepth;
+	}
+	sim->rngState = ((uint64_t)config->seed << 1) | 1;
+}
+
+static uint64_t SimRandom(SimController_T *sim)
+{
+	// xorshift64*
+	sim->rngState ^= sim->rngState >> 12;
+	sim->rngState ^= sim->rngState << 25;
+	sim->rngState ^= sim->rngState >> 27;
+	return sim->rngState * 2685821657736338717ULL;
+}
+
+static double SimUniform(SimController_T *sim)
+{
+	return (SimRandom(sim) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+bool SimDrop(SimController_T *sim)
+{
+	return (sim->config.lossRate > 0.0) && (SimUniform(sim) < sim->config.lossRate);
+}
+
+long SimDelayNs(SimController_T *sim)
+{
+	long delayNs = sim->config.latencyNs;
+	if (sim->config.jitterNs > 0) {
+		delayNs += (long)((SimUniform(sim) * 2.0 - 1.0) * sim->config.jitterNs);
+	}
+	return (delayNs > 0) ? delayNs : 0;
+}
+
+static void StartSession(SimController_T *sim, int64_t nowNs)
+{
+	// the robot stays where the last session left it, and so do its outputs:
+	// config, rngState, joint, position and ioWord are kept
+	sim->running = true;
+	sim->inMotion = false;
+	sim->finished = false;
+	sim->error = false;
+	sim->cmdReceived = false;
+	sim->sequenceNo = 0;
+	sim->startNs = nowNs;
+	sim->lastStatusNs = 0;
+	sim->replyPending = false;
+	sim->haveCommand = false;
+	sim->newestSeq = 0;
+	sim->replyAfterSeq = 0;
+	memset(sim->velocity, 0, sizeof(sim->velocity));
+	memset(sim->current, 0, sizeof(sim->current));
+	sim->readIOType = 0;
+	sim->readIOIndex = 0;
+	sim->readIOMask = 0;
+	memset(sim->buffer, 0, sizeof(sim->buffer));
+	memset(&sim->stats, 0, sizeof(sim->stats));
+	sim->stats.minLeadNs = INT64_MAX;
+}
+
+static void FillThreshold(RobotThresholdPacket_T *reply, u_word axisNumber, u_word thresholdType)
+{
+	int axis = ((axisNumber >= 1) && (axisNumber <= (u_word)MaxAxisNumber)) ? axisNumber - 1 : 0;
+	float maxVel = SimMaxVelocity[axis];
+	float maxAcc = maxVel / SimAccTime;
+	float maxJerk = maxAcc / SimJerkTime;
+	u_word interval = (u_word)ceilf(maxVel / 19.0f);   // deg/s between table entries
+
+	reply->packetType = htonl(3);
+	reply->versionNo = htonl(1);
+	reply->axisNumber = htonl(axisNumber);
+	reply->thresholdType = htonl(thresholdType);
+	reply->maxCartesianSpeed = htonl(SimMaxCartesianSpeed);
+	reply->interval = htonl(interval);
+
+	for (int idx = 0; idx < 20; idx++) {
+		// the motor loses torque at speed: acc and jerk limits fall off along the table
+		float speedScale = 1.0f - 0.5f * idx / 19.0f;
+		float noPayload;
+		float fullPayload;
+		if (thresholdType == 0) {
+			noPayload = maxVel;
+			fullPayload = maxVel;
+		}
+		else if (thresholdType == 1) {
+			noPayload = maxAcc * speedScale;
+			fullPayload = noPayload * SimFullPayloadScale;
+		}
+		else {
+			noPayload = maxJerk * speedScale;
+			fullPayload = noPayload * SimFullPayloadScale;
+		}
+		u_word bits = HostFloatToNet(noPayload);
+		memcpy(&reply->noPayload[idx], &bits, sizeof(bits));
+		bits = HostFloatToNet(fullPayload);
+		memcpy(&reply->fullPayload[idx], &bits, sizeof(bits));
+	}
+}
+
+static void ReceiveCommand(SimController_T *sim, const CommandPacket_T *packet, int64_t nowNs)
+{
+	SimStats_T *stats = &sim->stats;
+	u_word seqNo = ntohl(packet->sequenceNo);
+
+	stats->commandsReceived++;
+	if (!sim->running || sim->error || sim->finished) {
+		stats->lateCommands++;
+		return;
+	}
+
+	int32_t ahead = (int32_t)(seqNo - sim->sequenceNo);
+	if (ahead < 0) {
+		stats->lateCommands++;
+		return;
+	}
+	if (ahead >= sim->config.bufferDepth) {
+		stats->overflows++;
+		sim->error = true;
+		return;
+	}
+
+	// the reply to a status is the first command past the ones held when it
+	// went out: the acknowledged sequence plus the PC's depth, in any stack
+	if (sim->replyPending && (!sim->haveCommand || ((int32_t)(seqNo - sim->replyAfterSeq) > 0))) {
+		int64_t turnaroundNs = nowNs - sim->lastStatusNs;
+		stats->sumTurnaroundNs += turnaroundNs;
+		stats->turnarounds++;
+		if (turnaroundNs > stats->maxTurnaroundNs) {
+			stats->maxTurnaroundNs = turnaroundNs;
+		}
+		sim->replyPending = false;
+	}
+	if (!sim->haveCommand || ((int32_t)(seqNo - sim->newestSeq) > 0)) {
+		sim->newestSeq = seqNo;
+		sim->haveCommand = true;
+	}
+
+	SimCommand_T *slot = &sim->buffer[seqNo % sim->config.bufferDepth];
+	if (slot->valid && (slot->sequenceNo == seqNo)) {
+		stats->duplicates++;
+	}
+	slot->valid = true;
+	slot->sequenceNo = seqNo;
+	slot->lastData = packet->lastData;
+	slot->dataStyle = packet->dataStyle;
+	slot->receivedNs = nowNs;
+	for (int idx = 0; idx < MaxAxisNumber; idx++) {
+		slot->commandPos[idx] = NetToHostFloat(packet->commandPos[idx]);
+	}
+	slot->readIOType = packet->readIOType;
+	slot->readIOIndex = ntohs(packet->readIOIndex);
+	slot->readIOMask = ntohs(packet->readIOMask);
+	slot->writeIOType = packet->writeIOType;
+	slot->writeIOIndex = ntohs(packet->writeIOIndex);
+	slot->writeIOMask = ntohs(packet->writeIOMask);
+	slot->writeIOValue = ntohs(packet->writeIOValue);
+
+	sim->inMotion = true;
+	sim->cmdReceived = true;
+}
+
+int SimReceive(SimController_T *sim, const void *packet_p, int size, int64_t nowNs, void *reply_p, int replyCapacity)
+{
+	u_word packetType;
+
+	if (size < (int)sizeof(u_word) * 2) {
+		return 0;
+	}
+	memcpy(&packetType, packet_p, sizeof(packetType));
+	packetType = ntohl(packetType);
+
+	if ((packetType == 0) && (size == sizeof(StartPacket_T))) {
+		StartSession(sim, nowNs);
+	}
+	else if ((packetType == 2) && (size == sizeof(StopPacket_T))) {
+		sim->running = false;
+	}
+	else if ((packetType == 1) && (size == sizeof(CommandPacket_T))) {
+		CommandPacket_T command;
+		memcpy(&command, packet_p, sizeof(command));
+		ReceiveCommand(sim, &command, nowNs);
+	}
+	else if ((packetType == 3) && (size == sizeof(ThresholdPacket_T)) && (replyCapacity >= (int)sizeof(RobotThresholdPacket_T))) {
+		ThresholdPacket_T request;
+		RobotThresholdPacket_T reply;
+		memcpy(&request, packet_p, sizeof(request));
+		u_word axisNumber = ntohl(request.axisNumber);
+		if ((axisNumber < 1) || (axisNumber > (u_word)sim->config.axisCount)) {
+			return 0;   // no such axis: no reply
+		}
+		FillThreshold(&reply, ntohl(request.axisNumber), ntohl(request.thresholdType));
+		memcpy(reply_p, &reply, sizeof(reply));
+		return sizeof(reply);
+	}
+	return 0;
+}
+
+static bool HaveIoSignals(u_byte type, u_short index, u_short mask)
+{
+	int last = index;
+	for (int bit = 0; bit < 16; bit++) {
+		if ((mask & (1u << bit)) != 0) {
+			last = index + bit;
+		}
+	}
+	return (type < SimIoTypeCount) && (index >= 1) && (last <= SimIoSignalCount);
+}
+
+bool SimIoSignals(const SimController_T *sim, u_byte type, u_short index, u_short mask, u_short *value)
+{
+	*value = 0;
+	if (!HaveIoSignals(type, index, mask)) {
+		return false;
+	}
+	for (int bit = 0; bit < 16; bit++) {
+		int signal = index + bit - 1;
+		if (((mask & (1u << bit)) != 0) && ((sim->ioWord[type][signal / 16] & (1u << (signal % 16))) != 0)) {
+			*value |= (u_short)(1u << bit);
+		}
+	}
+	return true;
+}
+
+// the write of a command, in the cycle it is executed
+static void ExecuteIoWrite(SimController_T *sim, const SimCommand_T *slot)
+{
+	if (slot->writeIOType == 0) {
+		return;
+	}
+	if (!HaveIoSignals(slot->writeIOType, slot->writeIOIndex, slot->writeIOMask)) {
+		sim->stats.ioRejected++;
+		return;
+	}
+	for (int bit = 0; bit < 16; bit++) {
+		if ((slot->writeIOMask & (1u << bit)) == 0) {
+			continue;
+		}
+		int signal = slot->writeIOIndex + bit - 1;
+		u_short *word = &sim->ioWord[slot->writeIOType][signal / 16];
+		if ((slot->writeIOValue & (1u << bit)) != 0) {
+			*word |= (u_short)(1u << (signal % 16));
+		}
+		else {
+			*word &= (u_short)~(1u << (signal % 16));
+		}
+	}
+	sim->stats.ioWrites++;
+}
+
+static void ExecuteCommand(SimController_T *sim, SimCommand_T *slot, int64_t nowNs)
+{
+	float cycleSec = sim->config.cycleNs / 1.0e9f;
+	float *target = (slot->dataStyle == 1) ? sim->joint : sim->position;
+
+	int64_t leadNs = nowNs - slot->receivedNs;
+	if (leadNs < sim->stats.minLeadNs) {
+		sim->stats.minLeadNs = leadNs;
+	}
+
+	for (int idx = 0; idx < MaxAxisNumber; idx++) {
+		float velocity = (slot->commandPos[idx] - target[idx]) / cycleSec;
+		float acceleration = (velocity - sim->velocity[idx]) / cycleSec;
+		sim->current[idx] = SimCurrentPerAcc * acceleration + SimCurrentPerVel * velocity;
+		sim->velocity[idx] = velocity;
+		target[idx] = slot->commandPos[idx];
+	}
+
+	ExecuteIoWrite(sim, slot);
+	sim->readIOType = slot->readIOType;
+	sim->readIOIndex = slot->readIOIndex;
+	sim->readIOMask = slot->readIOMask;
+
+	sim->stats.commandsExecuted++;
+	if (slot->lastData) {
+		sim->finished = true;
+		sim->inMotion = false;
+	}
+	slot->valid = false;
+	sim->sequenceNo++;
+}
+
+static void PutFloat(float *field, float value)
+{
+	u_word bits = HostFloatToNet(value);
+	memcpy(field, &bits, sizeof(bits));
+}
+
+bool SimTick(SimController_T *sim, int64_t nowNs, RobotStatusPacket_T *status_p)
+{
+	bool executed = false;
+
+	if (!sim->running) {
+		return false;
+	}
+
+	if (sim->inMotion && !sim->error) {
+		SimCommand_T *slot = &sim->buffer[sim->sequenceNo % sim->config.bufferDepth];
+		if (slot->valid && (slot->sequenceNo == sim->sequenceNo)) {
+			ExecuteCommand(sim, slot, nowNs);
+			executed = true;
+		}
+		else {
+			sim->stats.underruns++;
+			sim->error = true;
+		}
+	}
+
+	u_byte status = 0;
+	if (!sim->error) {
+		status |= StatusReady | StatusSysReady;
+	}
+	if (sim->cmdReceived) {
+		status |= StatusCmdReceived;
+	}
+	if (executed) {
+		status |= StatusInMotion;
+	}
+	sim->cmdReceived = false;
+
+	memset(status_p, 0, sizeof(*status_p));
+	status_p->packetType = htonl(0);
+	status_p->versionNo = htonl(1);
+	status_p->sequenceNo = htonl(sim->sequenceNo);
+	status_p->status = status;
+	status_p->timeStamp = htonl((u_word)((nowNs - sim->startNs) / 1000000));
+	if (sim->readIOType != 0) {
+		u_short value;
+		if (SimIoSignals(sim, sim->readIOType, sim->readIOIndex, sim->readIOMask, &value)) {
+			status_p->readIOType = sim->readIOType;
+			status_p->readIOIndex = htons(sim->readIOIndex);
+			status_p->readIOMask = htons(sim->readIOMask);
+			status_p->readIOValue = htons(value);
+		}
+		else if (executed) {
+			sim->stats.ioRejected++;
+		}
+	}
+	for (int idx = 0; idx < MaxAxisNumber; idx++) {
+		PutFloat(&status_p->position[idx], sim->position[idx]);
+		status_p->jontAngle[idx] = HostFloatToNet(sim->joint[idx]);
+		PutFloat(&status_p->current[idx], sim->current[idx]);
+	}
+
+	sim->lastStatusNs = nowNs;
+	sim->replyPending = true;
+	sim->replyAfterSeq = sim->newestSeq;
+	sim->stats.statusSent++;
+	return true;
+}
+
+void WriteSimStats(const SimController_T *sim)
+{
+	const SimStats_T *stats = &sim->stats;
+
+	printf("status sent: %lu, commands received: %lu, executed: %lu\n", stats->statusSent, stats->commandsReceived, stats->commandsExecuted);
+	printf("duplicates: %lu, late: %lu, overflows: %lu, underruns: %lu, dropped: %lu\n",
+		stats->duplicates, stats->lateCommands, stats->overflows, stats->underruns, stats->dropped);
+	if (stats->turnarounds > 0) {
+		printf("PC turnaround: avg %.3f ms, max %.3f ms over %lu replies\n", stats->sumTurnaroundNs / 1.0e6 / stats->turnarounds,
+			stats->maxTurnaroundNs / 1.0e6, stats->turnarounds);
+	}
+	if (stats->commandsExecuted > 0) {
+		printf("closest command lead before its cycle: %.3f ms\n", stats->minLeadNs / 1.0e6);
+	}
+	if ((stats->ioWrites > 0) || (stats->ioRejected > 0)) {
+		printf("I/O writes: %lu, rejected: %lu\n", stats->ioWrites, stats->ioRejected);
+	}
+	printf("result: %s\n", sim->error ? "ERROR" : (sim->finished ? "completed" : "incomplete"));
+}
@@ -0,0 +1,136 @@
+//
+// SimController.h : software model of the J519 side of a robot controller
+//
+// The model is transport free: the caller hands it every datagram it
+// receives and calls SimTick once per ITP cycle to get the status packet
+// for that cycle. The UDP simulator (J519Sim) and in-process tests share it.
+//
+// Sequence handling follows the controller:
+//   - after the start packet the status packets carry sequence 0 until the
+//     first command arrives
+//   - every cycle in motion the command with the status sequence number is
+//     executed and the sequence number advances by one
+//   - commands may be sent ahead up to the buffer depth; a command for an
+//     already executed sequence number is late, one beyond the buffer overflows
+//   - a missing command in motion is an underrun; any error drops the
+//     ready (0x1) and SYSRDY (0x4) status bits until the next start packet
+//
+// I/O: the simulator keeps SimIoSignalCount signals of each type code below
+// SimIoTypeCount, kept across sessions like the pose. A command's write is
+// done when it is executed, and the status of that cycle returns the signals
+// the command asked to read.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include "J519Packet.h"
+
+const int SimMaxBufferDepth = 64;
+const int SimIoTypeCount = 64;
+const int SimIoSignalCount = 1024;   // signals 1 .. SimIoSignalCount of each type
+
+// status bits reported in RobotStatusPacket_T.status
+const u_byte StatusReady = 0x1;       // ready to receive command
+const u_byte StatusCmdReceived = 0x2; // command received since the last status
+const u_byte StatusSysReady = 0x4;    // servo power on, no alarm
+const u_byte StatusInMotion = 0x8;    // a command was executed this cycle
+
+typedef struct SimConfig_T {
+	long cycleNs;       // ITP cycle
+	long latencyNs;     // one way network + controller latency
+	long jitterNs;      // +/- uniform jitter added to latency
+	double lossRate;    // probability a datagram is dropped, each direction
+	int bufferDepth;    // commands the controller can hold ahead, 1 = lock step
+	uint32_t seed;      // random seed for loss and jitter
+	int axisCount;      // axes answering threshold requests, the others get no reply
+} SimConfig_T;
+
+typedef struct SimStats_T {
+	unsigned long statusSent;
+	unsigned long commandsReceived;
+	unsigned long commandsExecuted;
+	unsigned long duplicates;       // same sequence number received again
+	unsigned long lateCommands;     // arrived after its cycle was executed
+	unsigned long overflows;        // beyond the buffer depth
+	unsigned long underruns;        // nothing to execute in motion
+	unsigned long dropped;          // lost on purpose (loss rate)
+	int64_t minLeadNs;              // closest a command arrived before its cycle
+	int64_t sumTurnaroundNs;        // status sent -> first command sent in reply to it received
+	int64_t maxTurnaroundNs;
+	unsigned long turnarounds;
+	unsigned long ioWrites;         // commands executed with an I/O write
+	unsigned long ioRejected;       // write or read of a type or signal the simulator does not have
+} SimStats_T;
+
+typedef struct SimCommand_T {
+	bool valid;
+	u_word sequenceNo;
+	u_byte lastData;
+	u_byte dataStyle;
+	float commandPos[MaxAxisNumber];
+	int64_t receivedNs;
+	u_byte readIOType;       // host order from here on
+	u_short readIOIndex;
+	u_short readIOMask;
+	u_byte writeIOType;
+	u_short writeIOIndex;
+	u_short writeIOMask;
+	u_short writeIOValue;
+} SimCommand_T;
+
+typedef struct SimController_T {
+	SimConfig_T config;
+	bool running;        // between start and stop packet
+	bool inMotion;       // first command received, lastData not executed yet
+	bool finished;       // lastData executed
+	bool error;
+	bool cmdReceived;
+	u_word sequenceNo;   // sequence number of the next cycle to execute
+	int64_t startNs;
+	int64_t lastStatusNs;
+	bool replyPending;   // the last status has not been answered yet
+	bool haveCommand;
+	u_word newestSeq;    // highest command sequence number received
+	u_word replyAfterSeq;   // newestSeq when the last status went out: its reply tops the buffer up past it
+	uint64_t rngState;
+
+	float joint[MaxAxisNumber];
+	float position[MaxAxisNumber];
+	float velocity[MaxAxisNumber];
+	float current[MaxAxisNumber];
+	u_short ioWord[SimIoTypeCount][SimIoSignalCount / 16];   // signal n is bit (n - 1) % 16 of word (n - 1) / 16
+	u_byte readIOType;       // read of the last command executed
+	u_short readIOIndex;
+	u_short readIOMask;
+
+	SimCommand_T buffer[SimMaxBufferDepth];   // indexed by sequenceNo % bufferDepth
+	SimStats_T stats;
+} SimController_T;
+
+void SimDefaultConfig(SimConfig_T *config);
+void SimInit(SimController_T *sim, const SimConfig_T *config);
+
+/*
+ * SimReceive: handle one datagram from the PC. A threshold request gets its
+ *             reply written to reply_p; returns the reply size, 0 for none.
+ */
+int SimReceive(SimController_T *sim, const void *packet_p, int size, int64_t nowNs, void *reply_p, int replyCapacity);
+
+/*
+ * SimTick: advance one ITP cycle and fill in the status packet for it.
+ *          returns false when no status is due (not started or stopped).
+ */
+bool SimTick(SimController_T *sim, int64_t nowNs, RobotStatusPacket_T *status_p);
+
+/*
+ * SimIoSignals: 16 signals of a type from index on under mask, as a status
+ *               returns them. false if the simulator does not have them.
+ */
+bool SimIoSignals(const SimController_T *sim, u_byte type, u_short index, u_short mask, u_short *value);
+
+// random draws for the transport: drop this datagram? how long to delay it?
+bool SimDrop(SimController_T *sim);
+long SimDelayNs(SimController_T *sim);
+
+void WriteSimStats(const SimController_T *sim);
@@ -0,0 +1,233 @@
+//
+// SocketIo.cpp : receive modes and socket settings of the J519 UDP session
+//
+
+#include "stdafx.h"
+#include <errno.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <iostream>
+
+#include "SocketIo.h"
+
+using namespace std;
+
+static const char *IoModeNames[] = { "wait", "spin", "busy-poll" };
+
+void IoDefaultConfig(IoConfig_T *cfg)
+{
+	cfg->mode = IoWait;
+	cfg->spinNs = DefaultSpinNs;
+	cfg->busyPollUs = DefaultBusyPollUs;
+	cfg->batch = false;
+	cfg->priority = -1;
+	cfg->dscp = -1;
+	cfg->readyTimeoutNs = DefaultReadyTimeoutNs;
+	cfg->statusTimeoutNs = DefaultStatusTimeoutNs;
+	cfg->drainTimeoutNs = DefaultDrainTimeoutNs;
+}
+
+bool ParseIoMode(const char *name, int *mode)
+{
+	for (int idx = IoWait; idx <= IoBusyPoll; idx++) {
+		if (strcmp(name, IoModeNames[idx]) == 0) {
+			*mode = idx;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char *IoModeName(int mode)
+{
+	return ((mode >= IoWait) && (mode <= IoBusyPoll)) ? IoModeNames[mode] : "?";
+}
+
+bool ConfigureSocketIo(int socketID, const IoConfig_T *cfg, long cycleNs)
+{
+	bool ok = true;
+
+	if ((cfg->priority >= 0) && (setsockopt(socketID, SOL_SOCKET, SO_PRIORITY, &cfg->priority, sizeof(cfg->priority)) != 0)) {
+		cout << "Cannot set socket priority " << cfg->priority << ": " << strerror(errno) << endl;
+		ok = false;
+	}
+	if (cfg->dscp >= 0) {
+		int tos = cfg->dscp << 2;
+		if (setsockopt(socketID, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) != 0) {
+			cout << "Cannot set DSCP " << cfg->dscp << ": " << strerror(errno) << endl;
+			ok = false;
+		}
+	}
+	if (cfg->mode == IoBusyPoll) {
+		if (setsockopt(socketID, SOL_SOCKET, SO_BUSY_POLL, &cfg->busyPollUs, sizeof(cfg->busyPollUs)) != 0) {
+			cout << "Cannot set SO_BUSY_POLL to " << cfg->busyPollUs << " us: " << strerror(errno) << " (needs CAP_NET_ADMIN)" << endl;
+			ok = false;
+		}
+		// the blocking read returns every cycle to check its deadline
+		struct timeval timeout;
+		timeout.tv_sec = cycleNs / NsPerSec;
+		timeout.tv_usec = (cycleNs % NsPerSec) / 1000;
+		setsockopt(socketID, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	}
+	return ok;
+}
+
+/*
+ * ReadStatuses: read what is queued (blocking: wait for the first datagram
+ *               up to the socket's receive time out). 1 if *status holds a
+ *               status packet, 0 if there was none, -1 on socket error.
+ */
+static int ReadStatuses(int socketID, const IoConfig_T *cfg, bool blocking, RobotStatusPacket_T *status, const StaleStatusSink_T *stale)
+{
+	if (!cfg->batch) {
+		int receiveSize = recv(socketID, (char *)status, sizeof(*status), blocking ? 0 : MSG_DONTWAIT);
+		if (receiveSize == sizeof(*status)) {
+			return 1;
+		}
+		if ((receiveSize < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+			return -1;
+		}
+		return 0;   // nothing queued, or a short, unrelated datagram
+	}
+
+	RobotStatusPacket_T packets[IoBatchSize];
+	struct mmsghdr messages[IoBatchSize];
+	struct iovec vectors[IoBatchSize];
+	memset(messages, 0, sizeof(messages));
+	for (int idx = 0; idx < IoBatchSize; idx++) {
+		vectors[idx].iov_base = &packets[idx];
+		vectors[idx].iov_len = sizeof(packets[idx]);
+		messages[idx].msg_hdr.msg_iov = &vectors[idx];
+		messages[idx].msg_hdr.msg_iovlen = 1;
+	}
+
+	// the first call waits for one datagram if blocking, the rest only drain the queue
+	int flags = blocking ? MSG_WAITFORONE : MSG_DONTWAIT;
+	int found = 0;
+	while (true) {
+		int received = recvmmsg(socketID, messages, IoBatchSize, flags, NULL);
+		if (received < 0) {
+			if ((found == 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+				return -1;
+			}
+			break;
+		}
+		int64_t receiveNs = RtNowNs();
+		for (int idx = 0; idx < received; idx++) {
+			// threshold replies are longer than a status: truncated, not ours
+			if ((messages[idx].msg_len != sizeof(RobotStatusPacket_T)) || ((messages[idx].msg_hdr.msg_flags & MSG_TRUNC) != 0)) {
+				continue;
+			}
+			if (found > 0) {
+				// reordered, older than the one kept: dropped itself
+				bool older = (int32_t)(ntohl(packets[idx].sequenceNo) - ntohl(status->sequenceNo)) < 0;
+				(*stale->count)++;
+				if (stale->record != NULL) {
+					stale->record(stale->context, older ? &packets[idx] : status, receiveNs);
+				}
+				if (older) {
+					continue;
+				}
+			}
+			*status = packets[idx];
+			found++;
+		}
+		if (received < IoBatchSize) {
+			break;
+		}
+		flags = MSG_DONTWAIT;
+	}
+	return (found > 0) ? 1 : 0;
+}
+
+int ReceiveStatusPacket(int socketID, const IoConfig_T *cfg, const struct timespec *deadline, RobotStatusPacket_T *status,
+	bool *waited, const StaleStatusSink_T *stale)
+{
+	struct pollfd pfd;
+	pfd.fd = socketID;
+	pfd.events = POLLIN;
+	*waited = false;
+
+	int result = ReadStatuses(socketID, cfg, false, status, stale);
+	if (result != 0) {
+		return result;
+	}
+
+	struct timespec spinEnd;
+	RtNow(&spinEnd);
+	RtAddNs(&spinEnd, cfg->spinNs);
+	while (true) {
+		struct timespec now;
+		RtNow(&now);
+		int64_t leftNs = RtDiffNs(deadline, &now);
+		if (leftNs <= 0) {
+			return 0;
+		}
+		*waited = true;
+
+		if ((cfg->mode == IoSpin) && (RtDiffNs(&spinEnd, &now) > 0)) {
+			result = ReadStatuses(socketID, cfg, false, status, stale);
+		}
+		else if (cfg->mode == IoBusyPoll) {
+			// the kernel busy polls, then sleeps up to one cycle (SO_RCVTIMEO)
+			result = ReadStatuses(socketID, cfg, true, status, stale);
+		}
+		else {
+			struct timespec remaining;
+			remaining.tv_sec = leftNs / NsPerSec;
+			remaining.tv_nsec = leftNs % NsPerSec;
+			int ready = ppoll(&pfd, 1, &remaining, NULL);
+			if ((ready < 0) && (errno != EINTR)) {
+				return -1;
+			}
+			if (ready == 0) {
+				return 0;
+			}
+			result = ReadStatuses(socketID, cfg, false, status, stale);
+		}
+		if (result != 0) {
+			return result;
+		}
+	}
+}
+
+int ReadQueuedStatus(int socketID, const IoConfig_T *cfg, RobotStatusPacket_T *status, const StaleStatusSink_T *stale)
+{
+	return ReadStatuses(socketID, cfg, false, status, stale);
+}
+
+int SendCommandPackets(int socketID, const IoConfig_T *cfg, const CommandPacket_T *packets, int count)
+{
+	int sent = 0;
+
+	if (!cfg->batch || (count == 1)) {
+		for (; sent < count; sent++) {
+			if (send(socketID, (const char *)&packets[sent], sizeof(packets[sent]), 0) < 0) {
+				return (sent > 0) ? sent : -1;
+			}
+		}
+		return sent;
+	}
+
+	struct mmsghdr messages[IoBatchSize];
+	struct iovec vectors[IoBatchSize];
+	while (sent < count) {
+		int batch = (count - sent < IoBatchSize) ? count - sent : IoBatchSize;
+		memset(messages, 0, sizeof(messages[0]) * batch);
+		for (int idx = 0; idx < batch; idx++) {
+			vectors[idx].iov_base = (void *)&packets[sent + idx];
+			vectors[idx].iov_len = sizeof(CommandPacket_T);
+			messages[idx].msg_hdr.msg_iov = &vectors[idx];
+			messages[idx].msg_hdr.msg_iovlen = 1;
+		}
+		int result = sendmmsg(socketID, messages, batch, 0);
+		if (result <= 0) {
+			return (sent > 0) ? sent : -1;
+		}
+		sent += result;
+	}
+	return sent;
+}
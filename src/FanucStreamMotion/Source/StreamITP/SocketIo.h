@@ -0,0 +1,103 @@
+//
+// SocketIo.h : receive modes and socket settings of the J519 UDP session
+//
+// The stream thread sleeps until a guard time before each status is due
+// and then waits for the packet in one of three ways:
+//   IoWait      ppoll until it arrives (the default)
+//   IoSpin      non-blocking reads in a loop for up to spinNs, then ppoll.
+//               Burns the core for that part of every cycle and saves the
+//               wake-up from a sleep in the kernel.
+//   IoBusyPoll  SO_BUSY_POLL on the socket and a blocking read: the kernel
+//               polls the network device queue for busyPollUs before it
+//               puts the thread to sleep. Needs a NIC driver with busy poll
+//               support; raising it needs CAP_NET_ADMIN.
+//
+// With batch the socket is read with recvmmsg. If the PC fell behind and
+// several statuses are queued, all of them are read in one call and only
+// the newest is answered: its sequence number acknowledges everything the
+// older ones did, answering them would only put the reply further behind.
+// The commands topping up the controller buffer go out with one sendmmsg.
+//
+// Every wait has a deadline: the ready handshake, the statuses while
+// moving and the acknowledgement of the last command each have their own
+// time out.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "J519Packet.h"
+#include "RtUtil.h"
+
+enum IoMode_T {
+	IoWait = 0,
+	IoSpin,
+	IoBusyPoll
+};
+
+const int IoBatchSize = 16;                          // datagrams per recvmmsg / sendmmsg
+const long DefaultSpinNs = 2 * NsPerMs;
+const int DefaultBusyPollUs = 50;
+const long DefaultReadyTimeoutNs = 5000 * NsPerMs;   // start packet -> ready status
+const long DefaultStatusTimeoutNs = 1000 * NsPerMs;  // give up on the controller after 1 s of silence
+const long DefaultDrainTimeoutNs = 1000 * NsPerMs;   // lastData sent -> acknowledged
+
+typedef struct IoConfig_T {
+	int mode;                 // IoMode_T
+	long spinNs;              // IoSpin: non-blocking reads this long before sleeping in ppoll
+	int busyPollUs;           // IoBusyPoll: SO_BUSY_POLL of the socket
+	bool batch;               // recvmmsg / sendmmsg, only the newest queued status is answered
+	int priority;             // SO_PRIORITY 0-6, -1 = leave as is
+	int dscp;                 // DSCP of the outgoing packets (IP_TOS), -1 = leave as is
+	long readyTimeoutNs;
+	long statusTimeoutNs;
+	long drainTimeoutNs;
+} IoConfig_T;
+
+void IoDefaultConfig(IoConfig_T *cfg);
+
+// "wait", "spin", "busy-poll"
+bool ParseIoMode(const char *name, int *mode);
+const char *IoModeName(int mode);
+
+/*
+ * ConfigureSocketIo: priority, DSCP and busy poll of the socket; for
+ *                    IoBusyPoll also a receive time out of one cycle, so a
+ *                    blocking read comes back to check its deadline. A
+ *                    setting the system refuses is reported and left out:
+ *                    false, the socket is still usable.
+ */
+bool ConfigureSocketIo(int socketID, const IoConfig_T *cfg, long cycleNs);
+
+// where a batched read puts the statuses it drops for a newer one
+typedef struct StaleStatusSink_T {
+	unsigned long *count;
+	// called with each one (receiveNs: CLOCK_MONOTONIC of the read), NULL to only count them
+	void (*record)(void *context, const RobotStatusPacket_T *status, int64_t receiveNs);
+	void *context;
+} StaleStatusSink_T;
+
+/*
+ * ReceiveStatusPacket: wait for a status packet until the absolute deadline,
+ *                      the way cfg->mode says. With batch every queued status
+ *                      is read and the newest is kept; the ones dropped go to
+ *                      stale. returns 1 if *status holds a new packet, 0 on
+ *                      timeout, -1 on socket error. *waited tells if the packet
+ *                      was not already queued.
+ */
+int ReceiveStatusPacket(int socketID, const IoConfig_T *cfg, const struct timespec *deadline, RobotStatusPacket_T *status,
+	bool *waited, const StaleStatusSink_T *stale);
+
+/*
+ * ReadQueuedStatus: a status that is already queued, without waiting (with
+ *                   batch the newest). 1 if read, 0 if none, -1 on error.
+ */
+int ReadQueuedStatus(int socketID, const IoConfig_T *cfg, RobotStatusPacket_T *status, const StaleStatusSink_T *stale);
+
+/*
+ * SendCommandPackets: count command packets, with batch in one sendmmsg.
+ *                     returns the number sent, -1 on socket error.
+ */
+int SendCommandPackets(int socketID, const IoConfig_T *cfg, const CommandPacket_T *packets, int count);
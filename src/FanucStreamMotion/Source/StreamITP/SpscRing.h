@@ -0,0 +1,92 @@
+//
+// SpscRing.h : bounded wait-free single producer / single consumer ring
+//
+// One thread may call Push, one other thread may call Pop. Both are a
+// handful of loads and stores with no locks, no allocation and no retry
+// loop, so the stream thread can drain it inside its cycle.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <atomic>
+
+const size_t CacheLineSize = 64;
+
+template <typename T>
+struct SpscRing_T {
+	T *slots;
+	size_t mask;                // capacity - 1, capacity is a power of two
+
+	// producer side
+	alignas(CacheLineSize) std::atomic<size_t> head;
+	size_t tailCache;           // last tail seen by the producer
+
+	// consumer side
+	alignas(CacheLineSize) std::atomic<size_t> tail;
+	size_t headCache;           // last head seen by the consumer
+};
+
+/*
+ * InitSpscRing: capacity is rounded up to a power of two
+ */
+template <typename T>
+bool InitSpscRing(SpscRing_T<T> *ring, size_t capacity)
+{
+	size_t size = 2;
+	while (size < capacity) {
+		size <<= 1;
+	}
+	ring->slots = (T *)aligned_alloc(CacheLineSize, ((size * sizeof(T) + CacheLineSize - 1) / CacheLineSize) * CacheLineSize);
+	ring->mask = size - 1;
+	ring->head.store(0, std::memory_order_relaxed);
+	ring->tail.store(0, std::memory_order_relaxed);
+	ring->tailCache = 0;
+	ring->headCache = 0;
+	return ring->slots != NULL;
+}
+
+template <typename T>
+void FreeSpscRing(SpscRing_T<T> *ring)
+{
+	free(ring->slots);
+	ring->slots = NULL;
+}
+
+template <typename T>
+bool SpscPush(SpscRing_T<T> *ring, const T *item)
+{
+	size_t head = ring->head.load(std::memory_order_relaxed);
+	if (head - ring->tailCache > ring->mask) {
+		ring->tailCache = ring->tail.load(std::memory_order_acquire);
+		if (head - ring->tailCache > ring->mask) {
+			return false;   // full
+		}
+	}
+	ring->slots[head & ring->mask] = *item;
+	ring->head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+template <typename T>
+bool SpscPop(SpscRing_T<T> *ring, T *item)
+{
+	size_t tail = ring->tail.load(std::memory_order_relaxed);
+	if (tail == ring->headCache) {
+		ring->headCache = ring->head.load(std::memory_order_acquire);
+		if (tail == ring->headCache) {
+			return false;   // empty
+		}
+	}
+	*item = ring->slots[tail & ring->mask];
+	ring->tail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+// number of queued items, exact for the calling side only
+template <typename T>
+size_t SpscCount(SpscRing_T<T> *ring)
+{
+	return ring->head.load(std::memory_order_acquire) - ring->tail.load(std::memory_order_acquire);
+}
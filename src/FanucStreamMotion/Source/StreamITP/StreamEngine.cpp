@@ -0,0 +1,521 @@
+//
+// StreamEngine.cpp : J519 stream motion cycle, run on a dedicated real-time thread
+//
+// The controller paces the exchange: it sends one status packet per ITP and
+// expects the command for that sequence number back before its next ITP.
+// The stream thread keeps an absolute CLOCK_MONOTONIC grid of the expected
+// status arrival times, sleeps with clock_nanosleep(TIMER_ABSTIME) until a
+// guard time before each one, answers the status as soon as it is read and
+// nudges the grid towards the observed arrivals to follow the controller
+// clock. A command sent later than half a cycle after its grid point is a
+// missed deadline; it is counted and logged, and a cycle that overran whole
+// periods moves the grid forward by those periods instead of drifting.
+//
+// Flow control: a status packet's sequence number is the next command the
+// controller will execute, so it acknowledges everything before it. With a
+// packet stack the stream thread keeps that many commands sent ahead of the
+// acknowledgement (topping the buffer up after every status, more than one
+// command if a status was lost) and after lastData keeps reading statuses
+// until its sequence number is acknowledged before sending the stop packet.
+//
+// How the status is waited for and read, the socket settings and the time
+// outs of the handshake, the motion and the drain are in SocketIo.h.
+//
+
+#include "stdafx.h"
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <iostream>
+#include <thread>
+
+#include "StreamEngine.h"
+#include "CommandEncoder.h"
+#include "IoEvents.h"
+
+using namespace std;
+
+
+void InitStreamSession(StreamSession_T *session)
+{
+	memset(session, 0, sizeof(*session));
+	session->socketID = -1;
+	RtDefaultConfig(&session->rt);
+	IoDefaultConfig(&session->io);
+	session->representation = 1;
+	session->doDataExchange = true;
+}
+
+void ResetStreamState(StreamSession_T *session)
+{
+	memset(&session->curJoint, 0, sizeof(*session) - offsetof(StreamSession_T, curJoint));
+	session->doDataExchange = true;
+}
+
+static void UpdateCurrentJoint(StreamSession_T *session)
+{
+	for (int idx = 0; idx < 6; idx++) {
+		session->curJoint[idx] = NetToHostFloat(session->statusPacket.jontAngle[idx]);
+	}
+}
+
+bool ReadyStatus(StreamSession_T *session)
+{
+	// check to see if robot is ready to receive a command position
+	if ((session->statusPacket.status & 1) == 0) {
+		return false;
+	}
+	UpdateCurrentJoint(session);
+	if (session->metrics != NULL) {
+		struct timespec now;
+		RtNow(&now);
+		MetricsStatus(session->metrics, &session->statusPacket, TimespecNs(&now));
+	}
+	return true;
+}
+
+/*
+ * WaitRobotReady: read statuses until one says the controller is ready.
+ *                 1 if it is, 0 if not within the ready time out, -1 on
+ *                 socket error (nothing listening at the address, ...)
+ */
+static int WaitRobotReady(StreamSession_T *session)
+{
+	struct timespec giveUp;
+	unsigned long dropped = 0;   // statuses before the ready one do not count as stale
+	StaleStatusSink_T stale = { &dropped, NULL, NULL };
+
+	RtNow(&giveUp);
+	RtAddNs(&giveUp, session->io.readyTimeoutNs);
+	while (true) { // wait for the robot controller be ready
+		bool waited;
+		int received = ReceiveStatusPacket(session->socketID, &session->io, &giveUp, &session->statusPacket, &waited, &stale);
+		if (received <= 0) {
+			return received;
+		}
+
+		// Received a packet, check to see if robot is ready to receive a command position
+		if (ReadyStatus(session)) {
+			return 1;
+		}
+	} // end of of waiting for the status bit
+}
+
+void ReportedPose(const StreamSession_T *session, float pose[MaxAxisNumber])
+{
+	for (int idx = 0; idx < MaxAxisNumber; idx++) {
+		if (session->representation == 1) {
+			pose[idx] = NetToHostFloat(session->statusPacket.jontAngle[idx]);
+		}
+		else {
+			pose[idx] = NetFloatField(session->statusPacket.position[idx]);
+		}
+	}
+}
+
+static bool HaveMoreCommands(const StreamSession_T *session, size_t nextPos)
+{
+	return (session->pipeline != NULL) || (nextPos < session->packetCount);
+}
+
+/*
+ * NextCommand: the packet for the next sequence number, from the encoded
+ *              array or the pipeline. If the pipeline runs dry while the
+ *              controller still holds commands (canWait) there is nothing
+ *              to send yet: NULL. With an empty controller buffer the last
+ *              pose is sent again; if the producer gave up the held pose
+ *              ends the motion.
+ */
+static CommandPacket_T *NextCommand(StreamSession_T *session, size_t *nextPos, bool canWait)
+{
+	if (session->pipeline == NULL) {
+		return &session->packets[(*nextPos)++];
+	}
+
+	CommandPacket_T *hold = &session->holdPacket;
+	if (PipelinePop(session->pipeline, hold)) {
+		(*nextPos)++;
+		return hold;
+	}
+	if (session->pipeline->producerDone.load(memory_order_acquire)) {
+		// the last push may have landed right before the done flag
+		if (PipelinePop(session->pipeline, hold)) {
+			(*nextPos)++;
+			return hold;
+		}
+		session->sourceFailed = true;
+		hold->lastData = 1;
+		ClearIoWrite(hold);
+		return hold;
+	}
+	if (canWait) {
+		return NULL;
+	}
+	session->stats.underruns++;
+	hold->lastData = 0;
+	ClearIoWrite(hold);   // the pose is repeated, the write is not
+	return hold;
+}
+
+static void RecordMiss(RtStats_T *stats, u_word seqID, int64_t lateNs)
+{
+	if (stats->missedDeadlines < MaxMissLog) {
+		stats->missLog[stats->missedDeadlines].sequenceNo = seqID;
+		stats->missLog[stats->missedDeadlines].lateNs = lateNs;
+	}
+	stats->missedDeadlines++;
+	if (lateNs > stats->maxLateNs) {
+		stats->maxLateNs = lateNs;
+	}
+}
+
+void BeginMotion(StreamSession_T *session, const struct timespec *now)
+{
+	session->depth = (session->packetStack > 0) ? session->packetStack : 1;
+	session->stats.minBuffered = session->depth;
+
+	// until the pipeline delivers, hold the robot where it is
+	float pose[MaxAxisNumber];
+	ReportedPose(session, pose);
+	InitCommandPacket(&session->holdPacket, 0, pose, session->representation, 0);
+
+	// the status sequence number is the next one the controller executes:
+	// everything before it is acknowledged, nextSeq - acked is still buffered
+	session->nextPos = 0;
+	session->acked = ntohl(session->statusPacket.sequenceNo);
+	session->nextSeq = session->acked + session->startSeqID;
+	session->firstSeq = session->nextSeq;
+	session->lastSeq = 0;
+	session->seqID = 0;
+	session->lastSent = false;
+
+	// grid point of the status packet being answered; the ready status just came in
+	session->expected = *now;
+	session->statusTime = *now;
+	session->lastSendTime = *now;
+	session->doDataExchange = true;
+}
+
+/*
+ * EndCommand: the last command sent again as lastData, to end the motion
+ *             where it is
+ */
+static CommandPacket_T *EndCommand(StreamSession_T *session)
+{
+	CommandPacket_T *hold = &session->holdPacket;
+	if ((session->pipeline == NULL) && (session->nextPos > 0)) {
+		*hold = session->packets[session->nextPos - 1];
+	}
+	hold->lastData = 1;
+	ClearIoWrite(hold);
+	return hold;
+}
+
+int SendCommands(StreamSession_T *session, struct timespec *wakeup)
+{
+	RtStats_T *stats = &session->stats;
+	long cycleNs = session->rt.cycleNs;
+
+	// keep the controller buffer at the target depth; the first status fills it
+	int32_t outstanding = (int32_t)(session->nextSeq - session->acked);
+	int sent = 0;
+	int queued = 0;
+	CommandPacket_T written;      // the first I/O write of the reply, for the telemetry
+	written.writeIOType = IoTypeNone;
+	while (!session->lastSent && (outstanding < session->depth) && (session->endRequest || HaveMoreCommands(session, session->nextPos))) {
+		CommandPacket_T *packet = session->endRequest ? EndCommand(session) : NextCommand(session, &session->nextPos, outstanding > 0);
+		if (packet == NULL) {
+			break;
+		}
+		// pre-encoded, lastData included: only the sequence number is left to fill in
+		PatchSequenceNo(packet, session->nextSeq);
+		if (session->correction != NULL) {
+			packet = CorrectCommand(session->correction, &session->statusPacket, TimespecNs(&session->statusTime), packet);
+		}
+
+		// send the command packet out; batched, the hold packet is reused for the next one
+		if (session->io.batch) {
+			session->outbox[queued++] = *packet;
+			if (queued == IoBatchSize) {
+				SendCommandPackets(session->socketID, &session->io, session->outbox, queued);
+				queued = 0;
+			}
+		}
+		else {
+			send(session->socketID, (char *)packet, sizeof(*packet), 0);
+		}
+		if ((packet->writeIOType != IoTypeNone) && (written.writeIOType == IoTypeNone)) {
+			written = *packet;
+		}
+		session->seqID = session->nextSeq++;
+		outstanding++;
+		sent++;
+		if (packet->lastData != 0) {
+			session->lastSent = true;
+			session->lastSeq = session->seqID;
+		}
+	}
+	if (queued > 0) {
+		SendCommandPackets(session->socketID, &session->io, session->outbox, queued);
+	}
+	if (!session->lastSent && (outstanding == 0) && !HaveMoreCommands(session, session->nextPos)) {
+		// no lastData in the source and nothing left to wait for
+		session->lastSent = true;
+		session->lastSeq = session->nextSeq - 1;
+	}
+
+	// the command is due half a cycle after its status
+	struct timespec now;
+	RtNow(&now);
+	if (sent > 0) {
+		session->lastSendTime = now;
+		if (session->metrics != NULL) {
+			MetricsSend(session->metrics, TimespecNs(&now));
+		}
+	}
+	if (session->telemetry != NULL) {
+		// after the send: the copy into the ring is not on the reply path
+		RecordStatus(session->telemetry, &session->statusPacket, TimespecNs(&session->statusTime),
+			(sent > 0) ? (int32_t)RtDiffNs(&now, &session->statusTime) : -1, (sent > 0) ? session->seqID : 0,
+			(written.writeIOType != IoTypeNone) ? &written : NULL);
+	}
+	if ((session->dynamics != NULL) && (MonitorStatus(session->dynamics, &session->statusPacket) != 0) && session->dynamics->stopOnFlag) {
+		// the reply is out: the motion ends with the next command
+		session->endRequest = true;
+	}
+	int64_t lateNs = RtDiffNs(&now, &session->expected) - cycleNs / 2;
+	if ((sent > 0) && (lateNs > 0)) {
+		RecordMiss(stats, session->seqID, lateNs);
+	}
+
+	// next status: skip the grid points this cycle overran
+	RtAddNs(&session->expected, cycleNs);
+	*wakeup = session->expected;
+	RtAddNs(wakeup, -(cycleNs / 8));   // wake up this long before a status is due
+	while (RtDiffNs(&now, wakeup) > 0) {
+		stats->skippedPeriods++;
+		RtAddNs(&session->expected, cycleNs);
+		RtAddNs(wakeup, cycleNs);
+	}
+	return sent;
+}
+
+void HandleStatus(StreamSession_T *session, bool waited)
+{
+	RtStats_T *stats = &session->stats;
+	long cycleNs = session->rt.cycleNs;
+	long phaseGain = 8;                 // follow the controller clock by 1/8 of the error per cycle
+
+	stats->cycles++;
+
+	// a status that was read the moment it arrived tells where the controller's cycle really is
+	struct timespec now;
+	RtNow(&now);
+	session->statusTime = now;
+	if (session->metrics != NULL) {
+		MetricsStatus(session->metrics, &session->statusPacket, TimespecNs(&now));
+	}
+	int64_t phaseNs = RtDiffNs(&now, &session->expected);
+	if (waited && (phaseNs > -cycleNs / 2) && (phaseNs < cycleNs / 2)) {
+		RtAddNs(&session->expected, (long)(phaseNs / phaseGain));
+	}
+
+	// a late, repeated status never moves the acknowledgement back
+	u_word statusSeq = ntohl(session->statusPacket.sequenceNo);
+	if ((int32_t)(statusSeq - session->acked) > 0) {
+		session->acked = statusSeq;
+	}
+	int32_t buffered = (int32_t)(session->nextSeq - session->acked);
+	if (!session->lastSent && (buffered < stats->minBuffered)) {
+		stats->minBuffered = buffered;
+	}
+
+	// check for the status
+	if ((session->statusPacket.status & 5) != 5) {
+		cout << "** CONTROLLER ERROR at sequence ID: " << session->seqID << " **" << endl;
+		session->doDataExchange = false;
+		session->controllerError = true;
+		if (session->telemetry != NULL) {
+			RecordStatus(session->telemetry, &session->statusPacket, TimespecNs(&session->statusTime), -1, 0, NULL);
+		}
+	}
+	else {
+		UpdateCurrentJoint(session);
+	}
+}
+
+// a status dropped for a newer one still goes to the log: it may carry an I/O read
+static void RecordStaleStatus(void *context, const RobotStatusPacket_T *status, int64_t receiveNs)
+{
+	StreamSession_T *session = (StreamSession_T *)context;
+
+	if (session->telemetry != NULL) {
+		RecordStatus(session->telemetry, status, receiveNs, -1, 0, NULL);
+	}
+}
+
+StaleStatusSink_T StaleSink(StreamSession_T *session)
+{
+	StaleStatusSink_T sink = { &session->stats.staleStatuses, RecordStaleStatus, session };
+	return sink;
+}
+
+void EndMotion(StreamSession_T *session)
+{
+	if (session->lastSent && session->doDataExchange) {
+		struct timespec now;
+		RtNow(&now);
+		session->stats.drainNs = RtDiffNs(&now, &session->lastSendTime);
+		if (session->telemetry != NULL) {
+			RecordStatus(session->telemetry, &session->statusPacket, TimespecNs(&session->statusTime), -1, 0, NULL);
+		}
+	}
+
+	// Send the last data
+	StopPacket_T stopPacket;
+	InitStopPacket(&stopPacket);
+	send(session->socketID, (const char *)&stopPacket, sizeof(stopPacket), 0);
+}
+
+static void StreamMotion(StreamSession_T *session)
+{
+	RtConfigureThread(&session->rt);
+
+	int ready = WaitRobotReady(session);
+	if (ready <= 0) {
+		if (ready < 0) {
+			cout << "** NO CONTROLLER: " << strerror(errno) << " **" << endl;
+		}
+		else {
+			cout << "** CONTROLLER NOT READY within " << session->io.readyTimeoutNs / NsPerMs << " ms **" << endl;
+		}
+		session->doDataExchange = false;
+		EndMotion(session);
+		return;
+	}
+
+	struct timespec now;
+	RtNow(&now);
+	BeginMotion(session, &now);
+	StaleStatusSink_T stale = StaleSink(session);
+
+	// Start to send the command packets, until the last one is acknowledged
+	while (!MotionDone(session)) {
+		struct timespec wakeup;
+		SendCommands(session, &wakeup);
+		if (MotionDone(session)) {
+			break;
+		}
+		RtSleepUntil(&wakeup);
+
+		RtNow(&now);
+		int64_t wakeupNs = RtDiffNs(&now, &wakeup);
+		if (wakeupNs > session->stats.maxWakeupNs) {
+			session->stats.maxWakeupNs = wakeupNs;
+		}
+		if (session->metrics != NULL) {
+			MetricsWakeup(session->metrics, wakeupNs);
+		}
+
+		// the controller had its time to execute the last command
+		if (session->lastSent && (RtDiffNs(&now, &session->lastSendTime) > session->io.drainTimeoutNs)) {
+			cout << "** LAST COMMAND NOT ACKNOWLEDGED within " << session->io.drainTimeoutNs / NsPerMs << " ms, sequence ID: " << session->lastSeq << " **" << endl;
+			session->doDataExchange = false;
+			break;
+		}
+
+		// Wait for the robot status packet
+		struct timespec giveUp = session->expected;
+		RtAddNs(&giveUp, session->io.statusTimeoutNs);
+		bool waited;
+		int received = ReceiveStatusPacket(session->socketID, &session->io, &giveUp, &session->statusPacket, &waited, &stale);
+		if (received <= 0) {
+			cout << "** NO STATUS FROM CONTROLLER at sequence ID: " << session->seqID << " **" << endl;
+			session->doDataExchange = false;
+			break;
+		}
+		HandleStatus(session, waited);
+	}
+
+	EndMotion(session);
+}
+
+bool RunStreamSession(StreamSession_T *session)
+{
+	if (!RtPrepareProcess(&session->rt)) {
+		cout << "Continue without locked memory" << endl;
+	}
+
+	thread streamThread(StreamMotion, session);
+	streamThread.join();
+
+	if (session->sourceFailed) {
+		cout << "** TRAJECTORY SOURCE FAILED, motion stopped at the held pose **" << endl;
+	}
+	return session->doDataExchange && !session->sourceFailed;
+}
+
+void WriteStreamStats(const StreamSession_T *session)
+{
+	const RtStats_T *stats = &session->stats;
+
+	printf("cycles: %lu, missed deadlines: %lu, skipped periods: %lu\n", stats->cycles, stats->missedDeadlines, stats->skippedPeriods);
+	printf("worst overrun: %.3f ms, worst wake-up latency: %.3f ms\n", stats->maxLateNs / 1.0e6, stats->maxWakeupNs / 1.0e6);
+	if (session->pipeline != NULL) {
+		printf("pipeline underruns (last pose held): %lu\n", stats->underruns);
+	}
+	if (session->packetStack > 0) {
+		printf("controller buffer: %d commands ahead, fewest held %d\n", session->packetStack, stats->minBuffered);
+	}
+	if (stats->drainNs > 0) {
+		printf("last command executed %.3f ms after it was sent\n", stats->drainNs / 1.0e6);
+	}
+	if ((session->io.mode != IoWait) || session->io.batch) {
+		printf("socket I/O: %s%s, stale statuses dropped: %lu\n", IoModeName(session->io.mode), session->io.batch ? ", batched" : "", stats->staleStatuses);
+	}
+	unsigned long logged = (stats->missedDeadlines < MaxMissLog) ? stats->missedDeadlines : MaxMissLog;
+	for (unsigned long idx = 0; idx < logged; idx++) {
+		printf("  missed deadline at sequence ID %u, late by %.3f ms\n", stats->missLog[idx].sequenceNo, stats->missLog[idx].lateNs / 1.0e6);
+	}
+}
+
+void WriteStreamSummary(FILE *out, const StreamSession_T *session)
+{
+	const RtStats_T *stats = &session->stats;
+
+	fprintf(out, "{\"completed\": %s, \"cycles\": %lu, \"missed_deadlines\": %lu, \"skipped_periods\": %lu,\n",
+		(session->doDataExchange && !session->sourceFailed && !session->endRequest) ? "true" : "false", stats->cycles, stats->missedDeadlines, stats->skippedPeriods);
+	fprintf(out, "\"max_late_us\": %.3f, \"max_wakeup_us\": %.3f, \"underruns\": %lu,\n", stats->maxLateNs / 1.0e3, stats->maxWakeupNs / 1.0e3,
+		stats->underruns);
+	fprintf(out, "\"buffer_depth\": %d, \"min_buffered\": %d, \"drain_us\": %.3f,\n", (session->packetStack > 0) ? session->packetStack : 1,
+		stats->minBuffered, stats->drainNs / 1.0e3);
+	fprintf(out, "\"io_mode\": \"%s\", \"io_batch\": %s, \"stale_statuses\": %lu,\n", IoModeName(session->io.mode), session->io.batch ? "true" : "false",
+		stats->staleStatuses);
+	if (session->metrics != NULL) {
+		WriteMetricsJson(out, session->metrics);
+		fprintf(out, ",\n");
+	}
+	unsigned long logged = (stats->missedDeadlines < MaxMissLog) ? stats->missedDeadlines : MaxMissLog;
+	fprintf(out, "\"missed\": [");
+	for (unsigned long idx = 0; idx < logged; idx++) {
+		fprintf(out, "%s{\"sequence\": %u, \"late_us\": %.3f}", (idx > 0) ? ", " : "", stats->missLog[idx].sequenceNo, stats->missLog[idx].lateNs / 1.0e3);
+	}
+	fprintf(out, "]}");
+}
+
+bool SaveStreamSummary(const char *fileName, const StreamSession_T *session)
+{
+	FILE *out = fopen(fileName, "w");
+
+	if (out == NULL) {
+		cout << "Cannot create " << fileName << ": " << strerror(errno) << endl;
+		return false;
+	}
+	WriteStreamSummary(out, session);
+	fprintf(out, "\n");
+	if (fclose(out) != 0) {
+		cout << "Cannot write " << fileName << endl;
+		return false;
+	}
+	return true;
+}
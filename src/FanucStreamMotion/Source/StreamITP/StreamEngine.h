@@ -0,0 +1,134 @@
+//
+// StreamEngine.h : J519 stream motion cycle, run on a dedicated real-time thread
+//
+
+#pragma once
+
+#include <stddef.h>
+#include "J519Packet.h"
+#include "RtUtil.h"
+#include "StreamPipeline.h"
+#include "Telemetry.h"
+#include "CycleMetrics.h"
+#include "CorrectionHook.h"
+#include "SocketIo.h"
+#include "Dynamics.h"
+
+const int MaxMissLog = 16;   // individual missed deadlines kept for the report
+
+typedef struct MissedDeadline_T {
+	u_word sequenceNo;
+	int64_t lateNs;       // how far past the deadline the command went out
+} MissedDeadline_T;
+
+// timing of the stream cycle, filled in by the stream thread
+typedef struct RtStats_T {
+	unsigned long cycles;
+	unsigned long missedDeadlines;   // commands sent later than half a cycle after their status was due
+	unsigned long skippedPeriods;    // whole cycles lost to overruns
+	int64_t maxLateNs;
+	int64_t maxWakeupNs;             // worst clock_nanosleep wake-up latency
+	unsigned long underruns;         // pipeline empty: last pose held for a cycle
+	int minBuffered;                 // fewest commands held ahead by the controller at a status
+	int64_t drainNs;                 // last command sent -> acknowledged as executed
+	unsigned long staleStatuses;     // read and dropped unanswered, a newer one was queued (io.batch)
+	MissedDeadline_T missLog[MaxMissLog];
+} RtStats_T;
+
+typedef struct StreamSession_T {
+	int socketID;                 // UDP socket, already connected to the controller
+	RtConfig_T rt;
+	IoConfig_T io;
+	CommandPacket_T *packets;     // pre-encoded trajectory (EncodeTrajectory), one per cycle
+	size_t packetCount;
+	StreamPipeline_T *pipeline;   // if set, packets come from here instead of the array
+	TelemetryRecorder_T *telemetry;   // if set, every status is queued to it
+	CycleMetrics_T *metrics;      // if set, latency and status counters of every cycle
+	CorrectionHook_T *correction; // if set, every command passes through it before it is sent
+	DynamicsMonitor_T *dynamics;  // if set, every status is checked against the model's currents
+	u_byte representation;        // Cartesian position = 0, joint angle = 1
+	int packetStack;              // commands kept buffered ahead in the controller, 0 = lock step
+	int startSeqID;
+
+	// results; from here to the end cleared by ResetStreamState
+	float curJoint[MaxAxisNumber];
+	RobotStatusPacket_T statusPacket;
+	bool doDataExchange;          // false once the controller reported an error
+	bool controllerError;         // the controller dropped its ready bits (a fault, not a time out)
+	bool sourceFailed;            // the pipeline producer gave up before lastData
+	CommandPacket_T holdPacket;   // pipeline packet being sent, repeated on underrun
+	CommandPacket_T outbox[IoBatchSize];   // io.batch: commands of one status, sent together
+	RtStats_T stats;
+
+	// stream thread state (BeginMotion)
+	bool endRequest;              // set by the caller: end the motion at the last command sent
+	int depth;                    // commands kept outstanding
+	size_t nextPos;               // next packet of the array / pipeline count
+	u_word acked;                 // status sequence number: every command before it is executed
+	u_word nextSeq;               // sequence number of the next command sent
+	u_word firstSeq;
+	u_word lastSeq;               // sequence number of the lastData command, once lastSent
+	u_word seqID;                 // last command sent
+	bool lastSent;
+	struct timespec expected;     // grid point of the next status
+	struct timespec statusTime;   // when the status being answered was read
+	struct timespec lastSendTime;
+} StreamSession_T;
+
+void InitStreamSession(StreamSession_T *session);
+
+/*
+ * ResetStreamState: clear the results and the stream thread state and keep
+ *                   the set up, to stream the session again (after a resume
+ *                   point the packets are set anew first)
+ */
+void ResetStreamState(StreamSession_T *session);
+
+/*
+ * RunStreamSession: run the ready handshake, motion and stop on the stream thread
+ *                   and wait for it to finish. The start packet must already be sent.
+ */
+bool RunStreamSession(StreamSession_T *session);
+
+void WriteStreamStats(const StreamSession_T *session);
+
+/*
+ * ReportedPose: where the robot is by statusPacket, in the representation
+ *               being streamed
+ */
+void ReportedPose(const StreamSession_T *session, float pose[MaxAxisNumber]);
+
+/*
+ * The cycle in steps, for callers running their own loop over several
+ * sessions (CellStream). statusPacket holds the status being handled.
+ *
+ * ReadyStatus:  true if the status says the controller is ready to start
+ * BeginMotion:  reset the flow control on the ready status read at now
+ * SendCommands: answer the status: top the controller buffer up, account
+ *               the reply and set *wakeup to the guard time before the next
+ *               status is due. returns the number of commands sent.
+ * HandleStatus: a status was read (waited: the moment it arrived), update
+ *               the acknowledgement and check for controller errors
+ * EndMotion:    send the stop packet
+ * StaleSink:    where a batched read puts the statuses it drops: counted
+ *               in stats.staleStatuses and recorded, not answered
+ */
+bool ReadyStatus(StreamSession_T *session);
+void BeginMotion(StreamSession_T *session, const struct timespec *now);
+int SendCommands(StreamSession_T *session, struct timespec *wakeup);
+void HandleStatus(StreamSession_T *session, bool waited);
+void EndMotion(StreamSession_T *session);
+StaleStatusSink_T StaleSink(StreamSession_T *session);
+
+// the controller failed, or the last command is acknowledged
+static inline bool MotionDone(const StreamSession_T *session)
+{
+	return !session->doDataExchange || (session->lastSent && ((int32_t)(session->acked - session->lastSeq) > 0));
+}
+
+/*
+ * SaveStreamSummary: cycle statistics and metrics of the run as one JSON
+ *                    object. On error prints the reason and returns false.
+ */
+bool SaveStreamSummary(const char *fileName, const StreamSession_T *session);
+void WriteStreamSummary(FILE *out, const StreamSession_T *session);
@@ -4,239 +4,41 @@
 
 
 #include "stdafx.h"
-#define _WINSOCK_DEPRECATED_NO_WARNINGS
 #include <stdlib.h>
 #include <stdio.h>
-#include <Winsock2.h>
-#include <WS2tcpip.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include <iostream>
-#include <sstream>
 #include <string>
-#include <fstream>
 #include <vector>
-#include <array>
-#include <queue>
 
+#include "J519Packet.h"
+#include "RtUtil.h"
+#include "StreamEngine.h"
+#include "TrajectoryFile.h"
+#include "CommandEncoder.h"
+#include "StreamPipeline.h"
+#include "LimitCheck.h"
+#include "ThresholdFetch.h"
+#include "CollisionCheck.h"
+#include "CellStream.h"
+#include "DryRun.h"
+#include "CorrectionHook.h"
+#include "Dynamics.h"
+#include "WaypointPath.h"
+#include "Resume.h"
+#include "IoEvents.h"
+#include "SocketIo.h"
 
 
-using namespace std;
-
-// solve for the __imp__htonl problem
-#pragma comment(lib, "Ws2_32.lib")
-typedef unsigned __int8 u_byte;    // replace char for clarity.
-
-// define some constants here
-
-const u_short ROBOT_PORT = 60015;
-const int MaxAxisNumber = 9;  // data file can have  either 9 axis (or xyzwpr ext) data per each position
-const int MinAxisNumber = 6;  // Or can have 6 axis (or xyzwpr) data
-
-
-// store read in position data from data file.
-struct PositionData_T {
-	float data[MaxAxisNumber];
-};
-
-// Data exchange start packet, send to robot controller
-typedef struct StartPacket_T {
-	u_long packetType;
-	u_long versionNo;
-} StartPacket_T;
-
-
-// Motion command packet send to robot controller
-typedef struct CommandPacket_T {
-	u_long packetType;
-	u_long versionNo;
-	u_long sequenceNo;
-	u_byte lastData;
-	u_byte readIOType;
-	u_short readIOIndex;
-	u_short readIOMask;
-	u_byte dataStyle;
-	u_byte writeIOType;
-	u_short writeIOIndex;
-	u_short writeIOMask;
-	u_short writeIOValue;
-	u_short unused;
-	u_long commandPos[MaxAxisNumber];  // could be either cartesian position or joint angle, based on dataStyle
-} CommandPacket_T;
-
-// data exchange complete,s end to robot controller
-typedef struct StopPacket_T {
-	u_long packetType;
-	u_long versionNo;
-} StopPacket_T;
-
-// Receive packet from robot controller
-typedef struct RobotStatusPacket_T {
-	u_long packetType;
-	u_long versionNo;
-	u_long sequenceNo;
-	u_byte status;
-	u_byte readIOType;
-	u_short readIOIndex;
-	u_short readIOMask;
-	u_short readIOValue;
-	u_long timeStamp;
-	float position[MaxAxisNumber];
-	u_long jontAngle[MaxAxisNumber];
-	float current[MaxAxisNumber];
-} RobotStatusPacket_T;
-
-typedef struct RobotThresholdPacket_T {
-	u_long packetType;
-	u_long versionNo;
-	u_long axisNumber;
-	u_long thresholdType;
-	u_long maxCartesianSpeed; 
-	u_long interval;
-
-	float noPayload[20];
-	float fullPayload[20];
-} RobotThresholdPacket_T;
-
-
-// Threshold request packet
-typedef struct ThresholdPacket_T {
-	u_long packetType; /* = 3*/
-	u_long versionNo;  /* = 2 */
-	u_long axisNumber;  /* from 1-9 */
-	u_long thresholdType;  /* 0: velocity, 1: acceleration, 2: Jerk */
-} ThresholdPacket_T;
-
-/* ---------------------------------------------------
- *
- -----------------------------------------------------*/
-static void InitThresholdPacket(ThresholdPacket_T *packet_p, u_long axisNumber, u_long thresholdType) {
-	packet_p->packetType = htonl(3);
-	packet_p->versionNo = htonl(1);
-	packet_p->axisNumber = htonl(axisNumber);
-	packet_p->thresholdType = htonl(thresholdType);
-}
 
-static void InitCommandPacket(CommandPacket_T *packet, u_long seqNo, float commandPos[9], u_byte dStyle, u_byte lastD) {
-	packet->packetType = htonl(1);
-	packet->versionNo = htonl(1);
-	packet->sequenceNo = htonl(seqNo);
-	packet->lastData = lastD;
-	packet->readIOType = 0;
-	packet->readIOIndex = htons(0);
-	packet->readIOMask = htons(0);
-	packet->dataStyle = dStyle;
-	packet->writeIOType = 0;
-	packet->writeIOIndex = htons(0);
-	packet->writeIOMask = htons(0);
-	packet->writeIOValue = htons(0);
-	packet->unused = htons(0);
-	for (int idx = 0; idx < MaxAxisNumber; idx++){
-		packet->commandPos[idx] = htonl(*reinterpret_cast<long *> (&commandPos[idx]));
-	}
-	// printf("seq ID: %d \n", seqNo);
-}
-
-static void InitStartPacket(StartPacket_T *packet) {
-	packet->packetType = htonl(0L);
-	//cout << "StartPacket packtetType (htonl): " << packet->packetType <<endl;
-	packet->versionNo = htonl(1L);
-	//cout << "StartPacket versionNum (htonl): " << packet->versionNo << endl;
-}
-
-static void InitStopPacket(StopPacket_T *packet)
-{
-	packet->packetType = htonl(2L);
-	packet->versionNo = htonl(1L);
-}
+using namespace std;
 
 
-/*
- * ParseString: split the input string into number of tokens based
- *              on the delimiter.
- */
-vector<string> ParseString(string inString, string delimiter) {
-	string token;
-	vector<string> tokens;
-	int pos_start = 0, pos_end;
-	int delim_len = delimiter.length();
-
-	while ((pos_end = inString.find(delimiter, pos_start)) != string::npos) {
-		token = inString.substr(pos_start, pos_end - pos_start);
-		pos_start = pos_end + delim_len;
-		tokens.push_back(token);
-	}
-	tokens.push_back(inString.substr(pos_start));
-	return tokens;
-}
-
-/*
- * CheckDataFile: Check the data file to see if it has valid data: 
- *    Valid data file: each line has either 6 or 9 position data
- *                     each item on a line is seperated by either a tab or a space.
- */
-static int CheckDataFile(string inName, int *lineDataCount, bool *useTab) 
-{
-	int dataCount;
-	int lineCount = 0;  // line count
-	ifstream inFile;
-	string inLine;
-	vector<string> lineString;
-	vector<float> angles;
-
-	*useTab = true;  // by default, use tab as delimiter
-
-	inFile.open(inName);
-	if (!inFile){
-		cout << "Unable to open file: " << inName << endl;
-		return 0;
-	}
-	else { // File exists
-		cout << "reading file: " << inName << endl;
-		while (!inFile.eof()) {
-			getline(inFile, inLine);
-			if (lineCount == 0) {
-				lineString = ParseString(inLine, ",");
-				*lineDataCount = lineString.size();
-				cout << "data size: " << *lineDataCount << endl;
-				if (*lineDataCount == 0) {
-					useTab = false;
-					lineString = ParseString(inLine, " ");
-					*lineDataCount = lineString.size();
-					cout << "data size use space: " << *lineDataCount << endl;
-				}
-
-			    if ((*lineDataCount != MaxAxisNumber) && (*lineDataCount != MinAxisNumber)) {
-					cout << "Invalid data count" << endl;
-					return 0;
-				}
-				lineCount++;
-			} 
-			else {
-				if (useTab) {
-					lineString = ParseString(inLine, ",");
-				}
-				else {
-					lineString = ParseString(inLine, " ");
-				}
-				dataCount = lineString.size();
-				if (dataCount == *lineDataCount){
-					lineCount++;
-				}
-			}
-		
-			// istringstream ss(inLine);
-			// copy(istream_iterator <float>(ss), istream_iterator <float>(), back_inserter(angles));
-			//for (size_t idx = 0; idx < angles.size(); idx++) {
-				//cout << angles[idx] << " , ";
-			//}
-			//cout << "\n";
-			
-		} // end while
-
-		inFile.close();
-		return lineCount;
-	}
-}
-
 /*
  * SetRepresetnation: Check the data representation: either JOINT or CARTESIAN
  *                    default is joint angle.
@@ -272,141 +74,591 @@ static bool CheckThreshold(string thresholdStr)
 }
 #endif
 
-/* 
- * ReadDataFile: Read in the positions from the data file
+static void WriteThresholdData(const RobotThresholdPacket_T *velPkt_p,
+	                           const RobotThresholdPacket_T *accPkt_p,
+	                           const RobotThresholdPacket_T *jerkPkt_p)
+{
+	printf(" axis: %1d, max speed; %d\n", ntohl(velPkt_p->axisNumber), ntohl(velPkt_p->maxCartesianSpeed));
+	printf("Threshold No Payload limits:  Velocity Acceleration Jerk\n");
+	for (int idx = 0; idx < 20; idx++) {
+		printf(" %2d, %f %f %f \n", idx + 1,SwapFloat(velPkt_p->noPayload[idx]), SwapFloat(accPkt_p->noPayload[idx]), SwapFloat(jerkPkt_p->noPayload[idx]));
+	}
+	printf(" Threshold Full Payload limits: Velocity Acceleration Jerk\n");
+	for (int idx = 0; idx < 20; idx++) {
+		printf(" %2d, %f %f %f\n", idx + 1, SwapFloat(velPkt_p->fullPayload[idx]), SwapFloat(accPkt_p->fullPayload[idx]), SwapFloat(jerkPkt_p->fullPayload[idx]));
+	}
+}
+
+/*
+ * WriteThresholdSummary: one line per axis, the zero speed end of each table
+ */
+static void WriteThresholdSummary(const ThresholdSet_T *thresholds)
+{
+	printf("Thresholds (no payload, at zero speed):  Velocity Acceleration Jerk\n");
+	for (int axisIdx = 0; axisIdx < MaxAxisNumber; axisIdx++) {
+		if (HaveThresholds(thresholds, 1u << axisIdx)) {
+			const RobotThresholdPacket_T *tables = thresholds->packet[axisIdx];
+			printf(" axis %d, %f %f %f\n", axisIdx + 1, SwapFloat(tables[ThresholdVelocity].noPayload[0]),
+				SwapFloat(tables[ThresholdAcceleration].noPayload[0]), SwapFloat(tables[ThresholdJerk].noPayload[0]));
+		}
+	}
+}
+
+/*
+ * ParseRtOption: real-time switches that can follow the positional arguments.
+ *                returns the number of argv entries used, 0 if not a valid switch.
  */
+static int ParseRtOption(int argc, char* argv[], int argIdx, RtConfig_T *rtConfig)
+{
+	string option(argv[argIdx]);
 
-static bool ReadDataFile(queue<PositionData_T> *dataQueue, string inName, int dataPerLine, bool tabDelimiter) 
+	if (option.compare("--no-mlock") == 0) {
+		rtConfig->lockMemory = false;
+		return 1;
+	}
+	if (argIdx + 1 >= argc) {
+		return 0;
+	}
+	if (option.compare("--rt-priority") == 0) {
+		rtConfig->rtPriority = atoi(argv[argIdx + 1]);
+		if ((rtConfig->rtPriority < 0) || (rtConfig->rtPriority > 99)) {
+			return 0;
+		}
+		return 2;
+	}
+	if (option.compare("--cpu") == 0) {
+		rtConfig->cpu = atoi(argv[argIdx + 1]);
+		return 2;
+	}
+	if (option.compare("--cycle-ms") == 0) {
+		double cycleMs = atof(argv[argIdx + 1]);
+		if (cycleMs <= 0.0) {
+			return 0;
+		}
+		rtConfig->cycleNs = (long)(cycleMs * NsPerMs);
+		return 2;
+	}
+	return 0;
+}
+
+/*
+ * ParseIoOption: socket I/O switches, same contract as ParseRtOption
+ */
+static int ParseIoOption(int argc, char* argv[], int argIdx, IoConfig_T *ioConfig)
 {
-	ifstream inFile;
-	string inLine;
-	vector<string> tokens;
-	PositionData_T posData ;
-	int axisNum;
-
-	inFile.open(inName);
-	if (!inFile){
-		cout << "Unable to open file: " << inName << endl;
-		return false;
+	string option(argv[argIdx]);
+
+	if (option.compare("--io-batch") == 0) {
+		ioConfig->batch = true;
+		return 1;
+	}
+	if (argIdx + 1 >= argc) {
+		return 0;
 	}
+	const char *value = argv[argIdx + 1];
+	if (option.compare("--io-mode") == 0) {
+		return ParseIoMode(value, &ioConfig->mode) ? 2 : 0;
+	}
+	if (option.compare("--spin-us") == 0) {
+		ioConfig->mode = IoSpin;
+		ioConfig->spinNs = atol(value) * 1000;
+		return (ioConfig->spinNs > 0) ? 2 : 0;
+	}
+	if (option.compare("--busy-poll-us") == 0) {
+		ioConfig->mode = IoBusyPoll;
+		ioConfig->busyPollUs = atoi(value);
+		return (ioConfig->busyPollUs > 0) ? 2 : 0;
+	}
+	if (option.compare("--socket-priority") == 0) {
+		ioConfig->priority = atoi(value);
+		return ((ioConfig->priority >= 0) && (ioConfig->priority <= 6)) ? 2 : 0;
+	}
+	if (option.compare("--dscp") == 0) {
+		ioConfig->dscp = atoi(value);
+		return ((ioConfig->dscp >= 0) && (ioConfig->dscp <= 63)) ? 2 : 0;
+	}
+	if (option.compare("--timeouts-ms") == 0) {
+		double readyMs, statusMs, drainMs;
+		if ((sscanf(value, "%lf,%lf,%lf", &readyMs, &statusMs, &drainMs) != 3) || (readyMs <= 0.0) || (statusMs <= 0.0) || (drainMs <= 0.0)) {
+			return 0;
+		}
+		ioConfig->readyTimeoutNs = (long)(readyMs * NsPerMs);
+		ioConfig->statusTimeoutNs = (long)(statusMs * NsPerMs);
+		ioConfig->drainTimeoutNs = (long)(drainMs * NsPerMs);
+		return 2;
+	}
+	return 0;
+}
+
+/*
+ * OpenRobotSocket: UDP socket connected to the controller's J519 port, -1 on error
+ */
+static int OpenRobotSocket(const char *robotAddress, u_short port, const IoConfig_T *ioConfig, long cycleNs)
+{
+	struct sockaddr_in robot_addr;
+
+	// set up remote robot IP address
+	memset(&robot_addr, 0, sizeof(robot_addr));
+	robot_addr.sin_addr.s_addr = inet_addr(robotAddress);
+	robot_addr.sin_family = AF_INET;
+	robot_addr.sin_port = htons(port);
 
-	// initialize the array
-	for (int idx = 0; idx < MaxAxisNumber; idx++) {
-		posData.data[idx] = 0.0;
+	int socketID = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (socketID < 0) {
+		cout << "Cannot create socket" << endl;
+		return -1;
 	}
+	// every read has its own deadline: no receive time out, unless busy polling
+	ConfigureSocketIo(socketID, ioConfig, cycleNs);
+
+	// do connect: make the UDP socket more efficient
+	connect(socketID, (struct sockaddr *)&robot_addr, sizeof(robot_addr));
+	return socketID;
+}
+
+/*
+ * ReadThresholds: the tables of thresholdAxes, from the controller's cache file
+ *                 if useCache and it holds neededAxes, else queried from the
+ *                 controller (and cached). The start packet must already be sent.
+ */
+static void ReadThresholds(int socketID, const char *robotAddress, u_word thresholdAxes, u_word neededAxes, bool useCache, bool refreshThresholds,
+	ThresholdSet_T *thresholds)
+{
+	char cachePath[1024];
+	bool haveCachePath = useCache && ThresholdCachePath(robotAddress, cachePath, sizeof(cachePath));
+	time_t savedTime;
 
-	// make sure we won't exceed 9 position data per line
-	if (dataPerLine > MaxAxisNumber){
-		axisNum = MaxAxisNumber;
+	if (haveCachePath && !refreshThresholds && LoadThresholdCache(cachePath, robotAddress, thresholds, &savedTime)
+		&& HaveThresholds(thresholds, neededAxes)) {
+		printf("thresholds from %s, saved %.1f h ago (--refresh-thresholds to query again)\n", cachePath, difftime(time(NULL), savedTime) / 3600.0);
 	}
 	else {
-		axisNum = dataPerLine;
+		FetchConfig_T fetchConfig;
+		FetchStats_T fetchStats;
+		FetchDefaultConfig(&fetchConfig);
+		InitThresholdSet(thresholds);
+		FetchThresholds(socketID, thresholdAxes, &fetchConfig, thresholds, &fetchStats);
+		printf("thresholds: %d of %d tables in %.1f ms, %d resent, %d given up\n", fetchStats.received, fetchStats.requested,
+			fetchStats.elapsedNs / 1.0e6, fetchStats.resent, fetchStats.givenUp);
+		if (haveCachePath && (fetchStats.received > 0)) {
+			SaveThresholdCache(cachePath, robotAddress, thresholds);
+		}
 	}
+}
 
-	while (!inFile.eof()) {
-		getline(inFile, inLine);
-	
-		if (tabDelimiter == true) {
-			tokens = ParseString(inLine, "\t");
-		}
-		else {
-			tokens = ParseString(inLine, " ");
-		}
-		if (tokens.size() == dataPerLine) {
-			for (int idx = 0; idx < axisNum; idx++) {
-				posData.data[idx] = (float) stod(tokens[idx]);
-			}
-			dataQueue->push(posData);
-		}
+/*
+ * CheckCollisions: every sample of the joint trajectory against the model's
+ *                  link meshes (and the environment file), stops at the first
+ *                  contact. True if the path is clear.
+ */
+static bool CheckCollisions(const char *modelFile, const char *environmentFile, const Trajectory_T *trajectory)
+{
+	RobotModel_T *model = new RobotModel_T;
+	KinematicChain_T chain;
+	CollisionScene_T *scene = new CollisionScene_T;
+	bool clear = false;
+
+	InitCollisionScene(scene);
+	if (LoadRobotModel(modelFile, model) && BuildKinematicChain(model, &chain) && LoadCollisionScene(model, &chain, false, false, scene)
+		&& ((environmentFile == NULL) || LoadEnvironmentFile(environmentFile, scene))) {
+		CollisionReport_T report;
+		WriteCollisionScene(scene);
+		clear = CheckTrajectoryCollisions(scene, trajectory->samples, trajectory->sampleCount, 0, true, &report);
+		WriteCollisionReport(scene, &report);
+	}
+	FreeCollisionScene(scene);
+	delete scene;
+	delete model;
+	return clear;
+}
 
-	} // end while
+/*
+ * LoadDynamics: dynamics of the model in spec ("ModelFile[,GainsFile]") with
+ *               the payload, and the current gains (the defaults if no file)
+ */
+static bool LoadDynamics(const char *spec, const Payload_T *payload, DynamicsModel_T *dyn, DynamicsGains_T *gains)
+{
+	string modelFile(spec);
+	string gainsFile;
+	size_t comma = modelFile.find(',');
+	if (comma != string::npos) {
+		gainsFile = modelFile.substr(comma + 1);
+		modelFile.erase(comma);
+	}
 
-	inFile.close();
-	return true;
+	RobotModel_T *model = new RobotModel_T;
+	KinematicChain_T chain;
+	bool ok = LoadRobotModel(modelFile.c_str(), model) && BuildKinematicChain(model, &chain) && BuildDynamicsModel(model, &chain, payload, dyn);
+	delete model;
+	DefaultDynamicsGains(gains);
+	if (ok && !gainsFile.empty()) {
+		ok = LoadDynamicsGains(gainsFile.c_str(), gains);
+	}
+	else if (ok) {
+		cout << "dynamics: no gains file, currents from the default gains (fit them with TrajDynamics fit)" << endl;
+	}
+	return ok;
 }
 
-static void DebugQueue(queue<PositionData_T> *posQueue) {
-	while (!posQueue->empty()){
-		PositionData_T pos = posQueue->front();
-		for (int idx = 0; idx < MaxAxisNumber; idx++) {
-			cout << pos.data[idx] << " ";
+/*
+ * CheckDynamics: torques and currents of every sample of the joint
+ *                trajectory. True if no axis is over the model's effort limit.
+ */
+static bool CheckDynamics(const DynamicsModel_T *dyn, const DynamicsGains_T *gains, const Trajectory_T *trajectory, long cycleNs)
+{
+	size_t count = trajectory->sampleCount;
+	vector<PositionData_T> torques(count), currents(count);
+	struct timespec start, end;
+	double cycleSec = cycleNs / 1.0e9;
+
+	RtNow(&start);
+	TrajectoryTorques(dyn, trajectory->samples, count, cycleNs, torques.data(), 0);
+	RtNow(&end);
+	for (size_t idx = 0; idx < count; idx++) {
+		double torque[MaxAxisNumber], speed[MaxAxisNumber], acceleration[MaxAxisNumber], current[MaxAxisNumber];
+		JointMotion(trajectory->samples, idx, dyn->axisCount, cycleSec, speed, acceleration);
+		for (int axis = 0; axis < MaxAxisNumber; axis++) {
+			torque[axis] = torques[idx].data[axis];
+		}
+		PredictCurrents(dyn, gains, torque, speed, current);
+		for (int axis = 0; axis < MaxAxisNumber; axis++) {
+			currents[idx].data[axis] = (float)current[axis];
 		}
-		cout << "\n";
-		posQueue->pop();
 	}
+	printf("dynamics of %zu samples in %.2f ms\n", count, RtDiffNs(&end, &start) / 1.0e6);
+	return WriteDynamicsReport(dyn, torques.data(), currents.data(), count, cycleNs);
 }
 
-static ULONG32 Swap32(ULONG32 x)
+/*
+ * SaveCellSummary: the summary of every robot and the cell statistics as one
+ *                  JSON object
+ */
+static bool SaveCellSummary(const char *fileName, const StreamSession_T *sessions, const vector<CellRobot_T> &robots, const CellStats_T *stats)
 {
-	return static_cast<ULONG32> ((x << 24) | ((x << 8) & 0x00FF0000) | ((x >> 8) & 0x0000FF00) | (x >> 24));
+	FILE *out = fopen(fileName, "w");
+
+	if (out == NULL) {
+		cout << "Cannot create " << fileName << endl;
+		return false;
+	}
+	fprintf(out, "{\"robots\": [\n");
+	for (size_t idx = 0; idx < robots.size(); idx++) {
+		fprintf(out, "{\"address\": \"%s:%u\", \"data_file\": \"%s\", \"summary\": ", robots[idx].address.c_str(), robots[idx].port,
+			robots[idx].dataFile.c_str());
+		WriteStreamSummary(out, &sessions[idx]);
+		fprintf(out, "}%s\n", (idx + 1 < robots.size()) ? "," : "");
+	}
+	fprintf(out, "],\n\"failed_robot\": %d, \"start_spread_us\": %.3f, \"max_skew_us\": %.3f, \"mean_skew_us\": %.3f, \"max_sample_spread\": %d}\n",
+		stats->failedRobot + 1, stats->startSpreadNs / 1.0e3, stats->maxSkewNs / 1.0e3,
+		(stats->skewSamples > 0) ? stats->sumSkewNs / 1.0e3 / stats->skewSamples : 0.0, stats->maxSampleSpread);
+	if (fclose(out) != 0) {
+		cout << "Cannot write " << fileName << endl;
+		return false;
+	}
+	return true;
 }
 
-static float SwapFloat(float x)
+/*
+ * StreamCell: every robot of the cell file, from one thread (--cell). Each
+ *             path is loaded and encoded and, with --thresholds, checked
+ *             against its controller's tables before any robot moves.
+ */
+static int StreamCell(const char *cellFile, const RtConfig_T *rtConfig, const IoConfig_T *ioConfig, bool allThresholds, bool refreshThresholds, bool fullPayload,
+	bool ignoreLimits, const char *metricsFile)
 {
-	union {
-		float f;
-		ULONG32 u32;
-	} swapper;
-	swapper.f = x;
-	swapper.u32 = Swap32(swapper.u32);
-	return swapper.f;
+	vector<CellRobot_T> robots;
+
+	if (!LoadCellFile(cellFile, &robots)) {
+		return 1;
+	}
+	int count = (int)robots.size();
+	vector<Trajectory_T> trajectories(count);
+	vector<EncodedTrajectory_T> encoded(count);
+	vector<u_byte> representations(count);
+	vector<int> sockets(count, -1);
+	bool ok = true;
+
+	for (int idx = 0; idx < count; idx++) {
+		InitTrajectory(&trajectories[idx]);
+		InitEncodedTrajectory(&encoded[idx]);
+	}
+	for (int idx = 0; ok && (idx < count); idx++) {
+		const CellRobot_T *robot = &robots[idx];
+		Trajectory_T *trajectory = &trajectories[idx];
+
+		cout << "robot " << idx + 1 << " (" << robot->address << "): reading file: " << robot->dataFile << endl;
+		ok = LoadTrajectoryFile(robot->dataFile.c_str(), trajectory);
+		if (!ok) {
+			break;
+		}
+		cout << "number of lines read: " << trajectory->sampleCount << " data size: " << trajectory->axisCount << endl;
+		representations[idx] = (robot->representation == 0) ? 0 : 1;
+		if (trajectory->representation != RepresentationUnknown) {
+			if ((robot->representation >= 0) && (trajectory->representation != robot->representation)) {
+				cout << "Data representation does not match the binary data file" << endl;
+				ok = false;
+				break;
+			}
+			representations[idx] = (u_byte)trajectory->representation;
+		}
+		if ((trajectory->cycleNs > 0) && (trajectory->cycleNs != rtConfig->cycleNs)) {
+			printf("Warning: data file was made for a %.3f ms cycle, streaming at %.3f ms\n", trajectory->cycleNs / 1.0e6, rtConfig->cycleNs / 1.0e6);
+		}
+		ok = EncodeTrajectory(&encoded[idx], trajectory->samples, trajectory->sampleCount, representations[idx]);
+	}
+	for (int idx = 0; ok && (idx < count); idx++) {
+		sockets[idx] = OpenRobotSocket(robots[idx].address.c_str(), robots[idx].port, ioConfig, rtConfig->cycleNs);
+		ok = (sockets[idx] >= 0);
+	}
+
+	// all start packets back to back: the controllers start their sessions together
+	StartPacket_T startPacket;
+	InitStartPacket(&startPacket);
+	for (int idx = 0; ok && (idx < count); idx++) {
+		if (send(sockets[idx], (const char *)(&startPacket), sizeof(startPacket), 0) < 0) {
+			cout << "Cannot send start packet to robot " << idx + 1 << endl;
+			ok = false;
+		}
+	}
+
+	// the whole path of every robot before the first command goes out
+	for (int idx = 0; ok && allThresholds && (idx < count); idx++) {
+		ThresholdSet_T thresholds;
+		AxisLimits_T axisLimits[MaxAxisNumber];
+
+		cout << "robot " << idx + 1 << ": ";
+		ReadThresholds(sockets[idx], robots[idx].address.c_str(), AllThresholdAxes, 1u, true, refreshThresholds, &thresholds);
+		SetThresholdLimits(&thresholds, axisLimits, fullPayload);
+		if (representations[idx] != 1) {
+			cout << "limit check skipped: thresholds are per joint, data is Cartesian" << endl;
+			continue;
+		}
+		LimitReport_T limitReport;
+		bool withinLimits = CheckTrajectoryLimits(trajectories[idx].samples, trajectories[idx].sampleCount, rtConfig->cycleNs, axisLimits, &limitReport);
+		WriteLimitReport(&limitReport);
+		if (!withinLimits && !ignoreLimits) {
+			cout << "Trajectory of robot " << idx + 1 << " is over the controller thresholds, cell not streamed (--ignore-limits to stream anyway)" << endl;
+			ok = false;
+		}
+	}
+
+	bool completed = false;
+	if (ok) {
+		StreamSession_T *sessions = new StreamSession_T[count];
+		vector<CycleMetrics_T *> metrics(count);
+		CellStats_T cellStats;
+
+		for (int idx = 0; idx < count; idx++) {
+			StreamSession_T *session = &sessions[idx];
+			InitStreamSession(session);
+			session->socketID = sockets[idx];
+			session->rt = *rtConfig;
+			session->io = *ioConfig;
+			session->packets = encoded[idx].packets;
+			session->packetCount = encoded[idx].count;
+			session->representation = representations[idx];
+			session->packetStack = robots[idx].packetStack;
+			metrics[idx] = new CycleMetrics_T;
+			InitCycleMetrics(metrics[idx], rtConfig->cycleNs);
+			session->metrics = metrics[idx];
+		}
+
+		completed = RunCellSession(sessions, count, &cellStats);
+
+		for (int idx = 0; idx < count; idx++) {
+			cout << "robot " << idx + 1 << " (" << robots[idx].address << "):" << endl;
+			WriteStreamStats(&sessions[idx]);
+			WriteCycleMetrics(metrics[idx]);
+		}
+		WriteCellStats(&cellStats, rtConfig->cycleNs);
+		if (completed) {
+			cout << "Motion Completed" << endl;
+		}
+		if (metricsFile != NULL) {
+			SaveCellSummary(metricsFile, sessions, robots, &cellStats);
+		}
+		for (int idx = 0; idx < count; idx++) {
+			delete metrics[idx];
+		}
+		delete[] sessions;
+	}
+	else {
+		StopPacket_T stopPacket;
+		InitStopPacket(&stopPacket);
+		for (int idx = 0; idx < count; idx++) {
+			if (sockets[idx] >= 0) {
+				send(sockets[idx], (char *)&stopPacket, sizeof(stopPacket), 0);
+			}
+		}
+	}
+
+	// clean up
+	for (int idx = 0; idx < count; idx++) {
+		if (sockets[idx] >= 0) {
+			close(sockets[idx]);
+		}
+		FreeTrajectory(&trajectories[idx]);
+		FreeEncodedTrajectory(&encoded[idx]);
+	}
+	return completed ? 0 : 1;
 }
 
-static void WriteThresholdData(RobotThresholdPacket_T *velPkt_p,
-	                           RobotThresholdPacket_T *accPkt_p,
-	                           RobotThresholdPacket_T *jerkPkt_p)
+/*
+ * DryRunLibrary: every data file of the run file through the stream code
+ *                against the simulated controller, on all cores, without
+ *                waiting for the cycle; a report per file in reportDir.
+ *                The paths are checked against the cached tables of
+ *                thresholdAddress if given, else the simulator's.
+ */
+static int DryRunLibrary(const char *runFile, const RtConfig_T *rtConfig, const IoConfig_T *ioConfig, bool fullPayload, bool ignoreLimits,
+	int threadCount, const char *reportDir, const char *thresholdAddress, double lossRate)
 {
-	printf(" axis: %1d, max speed; %d\n", ntohl(velPkt_p->axisNumber), ntohl(velPkt_p->maxCartesianSpeed));
-	printf("Threshold No Payload limits:  Velocity Acceleration Jerk\n");
-	for (int idx = 0; idx < 20; idx++) {
-		printf(" %2d, %f %f %f \n", idx + 1,SwapFloat(velPkt_p->noPayload[idx]), SwapFloat(accPkt_p->noPayload[idx]), SwapFloat(jerkPkt_p->noPayload[idx]));
+	vector<DryRunJob_T> jobs;
+	vector<DryRunResult_T> results;
+	DryRunConfig_T *config = new DryRunConfig_T;
+
+	if (!LoadDryRunFile(runFile, &jobs)) {
+		delete config;
+		return 1;
 	}
-	printf(" Threshold Full Payload limits: Velocity Acceleration Jerk\n");
-	for (int idx = 0; idx < 20; idx++) {
-		printf(" %2d, %f %f %f\n", idx + 1, SwapFloat(velPkt_p->fullPayload[idx]), SwapFloat(accPkt_p->fullPayload[idx]), SwapFloat(jerkPkt_p->fullPayload[idx]));
+	DryRunDefaultConfig(config);
+	config->cycleNs = rtConfig->cycleNs;
+	config->io = *ioConfig;
+	config->sim.cycleNs = rtConfig->cycleNs;
+	config->sim.lossRate = lossRate;
+	config->fullPayload = fullPayload;
+	config->ignoreLimits = ignoreLimits;
+	config->threadCount = threadCount;
+	config->reportDir = reportDir;
+	if (thresholdAddress != NULL) {
+		char cachePath[1024];
+		time_t savedTime;
+		if (!ThresholdCachePath(thresholdAddress, cachePath, sizeof(cachePath))
+			|| !LoadThresholdCache(cachePath, thresholdAddress, &config->thresholds, &savedTime) || !HaveThresholds(&config->thresholds, 1u)) {
+			cout << "No cached thresholds of " << thresholdAddress << " (run StreamITP against it with --thresholds first)" << endl;
+			delete config;
+			return 1;
+		}
+		printf("thresholds of %s from %s, saved %.1f h ago\n", thresholdAddress, cachePath, difftime(time(NULL), savedTime) / 3600.0);
 	}
+
+	struct timespec start, end;
+	RtNow(&start);
+	bool passed = RunDryRuns(jobs, config, &results);
+	RtNow(&end);
+	WriteDryRunSummary(jobs, results, RtDiffNs(&end, &start));
+	delete config;
+	return passed ? 0 : 1;
+}
+
+/*
+ * WaitControllerReady: after a fault, send the start packet (again every
+ *                      ResumeStartIntervalNs) until a status says the
+ *                      controller is ready and without error. false if not
+ *                      within waitNs.
+ */
+static bool WaitControllerReady(int socketID, const IoConfig_T *ioConfig, int64_t waitNs, RobotStatusPacket_T *statusPacket)
+{
+	StartPacket_T startPacket;
+	struct timespec now, giveUp, nextStart;
+	unsigned long dropped = 0;
+	StaleStatusSink_T stale = { &dropped, NULL, NULL };
+
+	InitStartPacket(&startPacket);
+	RtNow(&now);
+	giveUp = now;
+	RtAddNs(&giveUp, (long)waitNs);
+	nextStart = now;
+	while (RtDiffNs(&giveUp, &now) > 0) {
+		if (RtDiffNs(&now, &nextStart) >= 0) {
+			send(socketID, (const char *)&startPacket, sizeof(startPacket), 0);
+			nextStart = now;
+			RtAddNs(&nextStart, ResumeStartIntervalNs);
+		}
+		struct timespec until = (RtDiffNs(&giveUp, &nextStart) > 0) ? nextStart : giveUp;
+		bool waited;
+		int received = ReceiveStatusPacket(socketID, ioConfig, &until, statusPacket, &waited, &stale);
+		if ((received > 0) && ((statusPacket->status & 5) == 5)) {
+			return true;
+		}
+		if (received < 0) {
+			// nothing listening while the controller restarts
+			RtSleepUntil(&until);
+		}
+		RtNow(&now);
+	}
+	return false;
 }
 
 /* ------------------------------------------------------------------
 * Main routine: Read in ITP level robot motion command data and
 * move the robot using the stream motion option
-* NOTE: This program does not handle I/O setting/reading etc.
+* I/O writes and reads go into the command packets of their samples
+* (--io-events, see IoEvents.h)
 --------------------------------------------------------------------- */
 int main(int argc, char* argv[])
 {
-	int lineCount = 0;
 	u_byte representation = 1;  // Cartesian position = 0, joint angle = 1;
-	u_byte lastData;
-	bool doJointAngle = true;
-	bool readOK = false;
-	bool useTab;
-	int lineDataCount;
+	bool representationGiven = false;
 	int packetStack = 0;
 	int startSeqID = 0;
-	int seqID;
-	int thresholdAxisNumber;
+	int thresholdAxisNumber = 0;
 
 	// socket related 
-	struct sockaddr_in robot_addr;
-	int addr_len = sizeof(robot_addr);
 	int socketID;
-	bool doDataExchange = true;
 	bool doThreshold = false;
 
 	StartPacket_T startPacket;
-	StopPacket_T  stopPacket;
-	RobotStatusPacket_T statusPacket;
-	RobotThresholdPacket_T jerkThresholdPacket;
-	RobotThresholdPacket_T accThresholdPacket;
-	RobotThresholdPacket_T velThresholdPacket;
-	ThresholdPacket_T thresholdPacket;
-
-	CommandPacket_T commandPacket;
+	bool allThresholds = false;       // --thresholds: every axis, through the cache
+	bool refreshThresholds = false;   // --refresh-thresholds: query even if cached
+	ThresholdSet_T thresholds;
+	InitThresholdSet(&thresholds);
 
-	float curJoint[9];
+	StreamSession_T session;
+	RtConfig_T rtConfig;
+	IoConfig_T ioConfig;
 
 	// input data
-	queue<PositionData_T> posDataQueue;
+	Trajectory_T trajectory;
+	EncodedTrajectory_T encoded;
+	InitTrajectory(&trajectory);
+	InitEncodedTrajectory(&encoded);
+	vector<char *> args;
+
+	// --stream-file: read and encode on a producer thread while streaming
+	bool streamFile = false;
+	bool ignoreLimits = false;   // --ignore-limits: report limit violations but stream anyway
+	bool fullPayload = false;    // --full-payload: check against the full payload tables
+	const char *collisionModel = NULL;    // --collision: model whose link meshes the path is checked with
+	const char *environmentFile = NULL;   // --environment: objects around the robot for the collision check
+	const char *telemetryFile = NULL;     // --record: status packet log
+	TelemetryRecorder_T recorder;
+	const char *metricsFile = NULL;       // --metrics: JSON summary of the cycle metrics
+	const char *liveMetricsFile = NULL;   // --metrics-live: JSON line per second, "-" for stdout
+	const char *cellFile = NULL;          // --cell: several robots from one thread
+	const char *dryRunFile = NULL;        // --dry-run: every file of the list against the simulated controller
+	int dryRunJobs = 0;                   // --jobs: worker threads of the dry run, 0 = one per CPU
+	const char *reportDir = NULL;         // --report-dir: a JSON report per dry run file
+	const char *thresholdAddress = NULL;  // --threshold-cache: dry run against the cached tables of this controller
+	double simLoss = 0.0;                 // --sim-loss: datagrams the simulated controller loses
+	const char *correctionMailbox = NULL; // --correction-mailbox: offsets posted by another process
+	const char *correctionPlugin = NULL;  // --correction-plugin: library[,args] called every cycle
+	long correctionBudgetNs = 0;          // --correction-budget-us, default 1/8 cycle
+	bool waypoints = false;               // --waypoints: the data file holds waypoints, samples made while streaming
+	double waypointLimit[ThresholdTypeCount] = { 0.0 };   // --waypoint-limits V,A,J on every axis
+	WaypointPath_T waypointPath;
+	AxisLimits_T axisLimits[MaxAxisNumber];
+	TrajectoryReader_T reader;
+	StreamPipeline_T pipeline;
+	const char *dynamicsSpec = NULL;      // --dynamics: model[,gains] the currents are predicted and monitored with
+	Payload_T payload = {};              // --payload: kg[,x,y,z] on the faceplate
+	double collisionAmps = DefaultCollisionAmps;   // --current-limits C,P
+	double payloadAmps = DefaultPayloadAmps;
+	bool dynamicsStop = false;            // --dynamics-stop: end the motion on the first event
+	double resumeSec = 0.0;               // --resume: after a controller fault, wait this long to stream the rest
+	const char *ioEventFile = NULL;       // --io-events: I/O writes and reads put into the packets of their samples
+	IoEvents_T ioEvents;
+	IoApplyStats_T ioStats;
 
 	/*
 	 * Read in the command line arguments:
@@ -415,19 +667,231 @@ int main(int argc, char* argv[])
 	 * 3rd argument: the command data representation: Joint/Cartesian
 	 * 4th argument: read the axis threshold data. 1-6 is legal axis value.
 	 * 5th argument: use packet stack buffer. (valid value 0-9)
+	 * followed by the optional real-time switches:
+	 *   --rt-priority N  run the stream thread SCHED_FIFO at priority N (1-99)
+	 *   --cpu N          pin the stream thread to CPU N
+	 *   --cycle-ms T     controller ITP cycle in ms (default 8)
+	 *   --no-mlock       do not lock and prefault memory
+	 *   --stream-file    read the data file while streaming instead of loading it first
+	 *   --full-payload   check the trajectory against the full payload thresholds
+	 *   --ignore-limits  stream even if the trajectory is over the thresholds
+	 *   --thresholds     read the thresholds of all axes (cached per controller) and check against them
+	 *   --refresh-thresholds  same, but query the controller even if cached
+	 *   --collision M    check the path for contact with the link meshes of model M (.urdf/.csv)
+	 *   --environment E  objects to check against as well (environment file)
+	 *   --record F       record every status packet to the telemetry log F (.itpt)
+	 *   --metrics F      write the run's latency histograms and status counters to F (JSON)
+	 *   --metrics-live F stream a JSON line of the metrics per second to F (- for stdout)
+	 *   --cell C         stream every robot of the cell file C together (no positional arguments)
+	 *   --correction-mailbox F  apply the offsets / poses posted to the mailbox file F (ItpCorrect)
+	 *   --correction-plugin L   call the correction plugin library L (L,args to pass it arguments) every cycle
+	 *   --correction-budget-us N  time a plugin call may take (default 1/8 cycle)
+	 *   --waypoints      the data file holds sparse waypoints, blended into ITP samples while streaming
+	 *   --waypoint-limits V,A,J  velocity, acceleration and jerk for every axis (per s), tightened to the thresholds
+	 *   --io-mode M      wait for the status with ppoll (wait, default), busy-poll the socket (spin) or SO_BUSY_POLL (busy-poll)
+	 *   --spin-us N      spin mode, busy-poll for up to N us (default 2000) before sleeping
+	 *   --busy-poll-us N busy-poll mode, SO_BUSY_POLL of N us (default 50)
+	 *   --io-batch       read queued statuses with recvmmsg and answer the newest, send commands with sendmmsg
+	 *   --socket-priority N  SO_PRIORITY of the socket (0-6)
+	 *   --dscp N         DSCP of the packets sent (0-63, 46 = expedited forwarding)
+	 *   --timeouts-ms R,S,D  ready handshake, status while moving, last command acknowledged (5000,1000,1000)
+	 *   --dynamics M[,G] predict torques and currents with model M (current gains file G) and check every status against them
+	 *   --payload kg[,x,y,z]  payload mass and center of mass (mm, faceplate frame) for --dynamics
+	 *   --current-limits C,P  residual (A) that flags a collision, and a payload mismatch (2.0,0.5)
+	 *   --dynamics-stop  end the motion at the first collision or payload event
+	 *   --resume S       after a controller fault, wait up to S s for it to be ready again and stream the rest of the path
+	 *   --io-events F    write and read the I/O of the event file F in the command packets of the samples it names
+	 *   --dry-run R      stream every data file of the run file R to the simulated controller, without waiting for the cycle
+	 *   --jobs N         dry run files on N threads (default one per CPU)
+	 *   --report-dir D   write a JSON report per dry run file to D
+	 *   --threshold-cache A  dry run against the cached thresholds of controller A instead of the simulator's
+	 *   --sim-loss RATE  datagrams the dry run's controller loses, each direction
 	 */
+	RtDefaultConfig(&rtConfig);
+	IoDefaultConfig(&ioConfig);
+	bool argsOK = true;
+	for (int argIdx = 1; argIdx < argc; argIdx++) {
+		if (strcmp(argv[argIdx], "--stream-file") == 0) {
+			streamFile = true;
+		}
+		else if (strcmp(argv[argIdx], "--full-payload") == 0) {
+			fullPayload = true;
+		}
+		else if (strcmp(argv[argIdx], "--ignore-limits") == 0) {
+			ignoreLimits = true;
+		}
+		else if (strcmp(argv[argIdx], "--thresholds") == 0) {
+			allThresholds = true;
+		}
+		else if (strcmp(argv[argIdx], "--refresh-thresholds") == 0) {
+			allThresholds = true;
+			refreshThresholds = true;
+		}
+		else if ((strcmp(argv[argIdx], "--collision") == 0) && (argIdx + 1 < argc)) {
+			collisionModel = argv[++argIdx];
+		}
+		else if ((strcmp(argv[argIdx], "--environment") == 0) && (argIdx + 1 < argc)) {
+			environmentFile = argv[++argIdx];
+		}
+		else if ((strcmp(argv[argIdx], "--record") == 0) && (argIdx + 1 < argc)) {
+			telemetryFile = argv[++argIdx];
+		}
+		else if ((strcmp(argv[argIdx], "--metrics") == 0) && (argIdx + 1 < argc)) {
+			metricsFile = argv[++argIdx];
+		}
+		else if ((strcmp(argv[argIdx], "--metrics-live") == 0) && (argIdx + 1 < argc)) {
+			liveMetricsFile = argv[++argIdx];
+		}
+		else if ((strcmp(argv[argIdx], "--cell") == 0) && (argIdx + 1 < argc)) {
+			cellFile = argv[++argIdx];
+		}
+		else if ((strcmp(argv[argIdx], "--dry-run") == 0) && (argIdx + 1 < argc)) {
+			dryRunFile = argv[++argIdx];
+		}
+		else if ((strcmp(argv[argIdx], "--jobs") == 0) && (argIdx + 1 < argc)) {
+			dryRunJobs = atoi(argv[++argIdx]);
+			if (dryRunJobs <= 0) {
+				cout << "--jobs must be above 0" << endl;
+				argsOK = false;
+				break;
+			}
+		}
+		else if ((strcmp(argv[argIdx], "--report-dir") == 0) && (argIdx + 1 < argc)) {
+			reportDir = argv[++argIdx];
+		}
+		else if ((strcmp(argv[argIdx], "--threshold-cache") == 0) && (argIdx + 1 < argc)) {
+			thresholdAddress = argv[++argIdx];
+		}
+		else if ((strcmp(argv[argIdx], "--sim-loss") == 0) && (argIdx + 1 < argc)) {
+			simLoss = atof(argv[++argIdx]);
+			if ((simLoss < 0.0) || (simLoss >= 1.0)) {
+				cout << "--sim-loss takes a rate from 0 to below 1" << endl;
+				argsOK = false;
+				break;
+			}
+		}
+		else if ((strcmp(argv[argIdx], "--correction-mailbox") == 0) && (argIdx + 1 < argc)) {
+			correctionMailbox = argv[++argIdx];
+		}
+		else if ((strcmp(argv[argIdx], "--correction-plugin") == 0) && (argIdx + 1 < argc)) {
+			correctionPlugin = argv[++argIdx];
+		}
+		else if ((strcmp(argv[argIdx], "--correction-budget-us") == 0) && (argIdx + 1 < argc)) {
+			correctionBudgetNs = atol(argv[++argIdx]) * 1000;
+			if (correctionBudgetNs <= 0) {
+				cout << "--correction-budget-us must be above 0" << endl;
+				argsOK = false;
+				break;
+			}
+		}
+		else if (strcmp(argv[argIdx], "--waypoints") == 0) {
+			waypoints = true;
+		}
+		else if ((strcmp(argv[argIdx], "--waypoint-limits") == 0) && (argIdx + 1 < argc)) {
+			waypoints = true;
+			if ((sscanf(argv[++argIdx], "%lf,%lf,%lf", &waypointLimit[ThresholdVelocity], &waypointLimit[ThresholdAcceleration],
+				&waypointLimit[ThresholdJerk]) != 3) || (waypointLimit[ThresholdVelocity] <= 0.0)
+				|| (waypointLimit[ThresholdAcceleration] <= 0.0) || (waypointLimit[ThresholdJerk] <= 0.0)) {
+				cout << "--waypoint-limits takes velocity,acceleration,jerk, all above 0" << endl;
+				argsOK = false;
+				break;
+			}
+		}
+		else if ((strcmp(argv[argIdx], "--dynamics") == 0) && (argIdx + 1 < argc)) {
+			dynamicsSpec = argv[++argIdx];
+		}
+		else if ((strcmp(argv[argIdx], "--payload") == 0) && (argIdx + 1 < argc)) {
+			if (!ParsePayload(argv[++argIdx], &payload)) {
+				cout << "--payload takes kg or kg,x,y,z (mm on the faceplate)" << endl;
+				argsOK = false;
+				break;
+			}
+		}
+		else if ((strcmp(argv[argIdx], "--current-limits") == 0) && (argIdx + 1 < argc)) {
+			if ((sscanf(argv[++argIdx], "%lf,%lf", &collisionAmps, &payloadAmps) != 2) || (collisionAmps <= 0.0) || (payloadAmps <= 0.0)) {
+				cout << "--current-limits takes collision,payload amps, both above 0" << endl;
+				argsOK = false;
+				break;
+			}
+		}
+		else if (strcmp(argv[argIdx], "--dynamics-stop") == 0) {
+			dynamicsStop = true;
+		}
+		else if ((strcmp(argv[argIdx], "--io-events") == 0) && (argIdx + 1 < argc)) {
+			ioEventFile = argv[++argIdx];
+		}
+		else if ((strcmp(argv[argIdx], "--resume") == 0) && (argIdx + 1 < argc)) {
+			resumeSec = atof(argv[++argIdx]);
+			if (resumeSec <= 0.0) {
+				cout << "--resume takes the seconds to wait for the controller, above 0" << endl;
+				argsOK = false;
+				break;
+			}
+		}
+		else if (strncmp(argv[argIdx], "--", 2) == 0) {
+			int used = ParseRtOption(argc, argv, argIdx, &rtConfig);
+			if (used == 0) {
+				used = ParseIoOption(argc, argv, argIdx, &ioConfig);
+			}
+			if (used == 0) {
+				cout << "Invalid option: " << argv[argIdx] << endl;
+				argsOK = false;
+				break;
+			}
+			argIdx += used - 1;
+		}
+		else {
+			args.push_back(argv[argIdx]);
+		}
+	}
 
-	if ((argc < 3) || (argc > 6)) {
-		cout << " Usage: StreamITP DataFileName RobotIPAddress (Optional: DataRepresentation) (Optional: axis Jerk Threshold axis number (1-6)) (Optional: buffer packet number (1-9))" << endl;
-		system("pause");
-		return 0;
+	if (argsOK && (dryRunFile != NULL)) {
+		if (!args.empty() || (cellFile != NULL) || streamFile || (telemetryFile != NULL) || (collisionModel != NULL) || (liveMetricsFile != NULL)
+			|| (metricsFile != NULL) || (correctionMailbox != NULL) || (correctionPlugin != NULL) || waypoints || (dynamicsSpec != NULL)
+			|| (resumeSec > 0.0) || (ioEventFile != NULL)) {
+			cout << "--dry-run takes the data files from the run file; only --cycle-ms, --io-batch, --full-payload, --ignore-limits,"
+			     << " --jobs, --report-dir, --threshold-cache and --sim-loss go with it" << endl;
+			return 1;
+		}
+		return DryRunLibrary(dryRunFile, &rtConfig, &ioConfig, fullPayload, ignoreLimits, dryRunJobs, reportDir, thresholdAddress, simLoss);
+	}
+	if (argsOK && (cellFile != NULL)) {
+		if (!args.empty() || streamFile || (telemetryFile != NULL) || (collisionModel != NULL) || (liveMetricsFile != NULL)
+			|| (correctionMailbox != NULL) || (correctionPlugin != NULL) || waypoints || (dynamicsSpec != NULL) || (resumeSec > 0.0)
+			|| (ioEventFile != NULL)) {
+			cout << "--cell takes the robots and data files from the cell file; --stream-file, --record, --collision, --metrics-live,"
+			     << " the corrections, --waypoints, --dynamics, --resume and --io-events are not available with it" << endl;
+			return 1;
+		}
+		if (ioConfig.mode == IoSpin) {
+			cout << "--cell waits for every robot in epoll, --io-mode spin is not available with it" << endl;
+			return 1;
+		}
+		return StreamCell(cellFile, &rtConfig, &ioConfig, allThresholds, refreshThresholds, fullPayload, ignoreLimits, metricsFile);
+	}
+	if (!argsOK || (args.size() < 2) || (args.size() > 5)) {
+		cout << " Usage: StreamITP DataFileName RobotIPAddress (Optional: DataRepresentation) (Optional: axis Jerk Threshold axis number (1-6)) (Optional: buffer packet number (1-9))"
+		     << " [--rt-priority N] [--cpu N] [--cycle-ms T] [--no-mlock] [--stream-file] [--full-payload] [--ignore-limits] [--thresholds] [--refresh-thresholds]"
+		     << " [--collision ModelFile] [--environment EnvironmentFile] [--record TelemetryFile]"
+		     << " [--metrics SummaryFile] [--metrics-live File|-]"
+		     << " [--correction-mailbox File] [--correction-plugin Library[,args]] [--correction-budget-us N]"
+		     << " [--waypoints] [--waypoint-limits V,A,J]"
+		     << " [--io-mode wait|spin|busy-poll] [--spin-us N] [--busy-poll-us N] [--io-batch] [--socket-priority N] [--dscp N] [--timeouts-ms R,S,D]"
+		     << " [--dynamics ModelFile[,GainsFile]] [--payload kg[,x,y,z]] [--current-limits C,P] [--dynamics-stop] [--resume S] [--io-events EventFile]" << endl;
+		cout << "        StreamITP --cell CellFile [--rt-priority N] [--cpu N] [--cycle-ms T] [--no-mlock] [--thresholds] [--refresh-thresholds]"
+		     << " [--full-payload] [--ignore-limits] [--metrics SummaryFile]"
+		     << " [--io-mode wait|busy-poll] [--busy-poll-us N] [--io-batch] [--socket-priority N] [--dscp N] [--timeouts-ms R,S,D]" << endl;
+		cout << "        StreamITP --dry-run RunFile [--jobs N] [--report-dir Directory] [--cycle-ms T] [--io-batch] [--full-payload] [--ignore-limits]"
+		     << " [--threshold-cache RobotIPAddress] [--sim-loss RATE]" << endl;
+		return 1;
 	}
 
 	// get argument data
-	string inName(argv[1]);
-	string robotIPAddress(argv[2]);
-	if (argc >= 4) { // check the optional argument
-		string dataRepresentation(argv[3]);
+	string inName(args[0]);
+	string robotIPAddress(args[1]);
+	if (args.size() >= 3) { // check the optional argument
+		representationGiven = true;
+		string dataRepresentation(args[2]);
 		if (UseJointRepresentation(dataRepresentation) == false) {
 			representation = 0;  // Data file contains Cartesian position data, xyzwpr & ext1-3
 		}
@@ -435,8 +899,8 @@ int main(int argc, char* argv[])
 			representation = 1;  // Data file contains joint anlge data, j1-j9
 		}
 	}
-	if (argc >= 5) { // check the optional argument for threshold 
-		thresholdAxisNumber = atoi(argv[4]);
+	if (args.size() >= 4) { // check the optional argument for threshold 
+		thresholdAxisNumber = atoi(args[3]);
 		
 		if ((thresholdAxisNumber > 0) && (thresholdAxisNumber <= 6)) {
 			doThreshold = true;
@@ -446,9 +910,9 @@ int main(int argc, char* argv[])
 		}
 	}
 
-	if (argc == 6) {  // check optional buffer stack size
+	if (args.size() == 5) {  // check optional buffer stack size
 		// allow user to fill the buffer before start handshecking 
-		packetStack = atoi(argv[5]);
+		packetStack = atoi(args[4]);
 		if (packetStack >= 10) {
 			packetStack = 9;
 		}
@@ -460,267 +924,384 @@ int main(int argc, char* argv[])
 		cout << "packet stack size : " << packetStack << endl;
 	}
 
-	lineCount = CheckDataFile(inName, &lineDataCount, &useTab);
-	if (lineCount == 0) {
-		// Error should already posted. Just return
-		system("pause");
-		return 0;
+	if (waypoints && streamFile) {
+		cout << "--waypoints loads the (short) waypoint file, it does not go with --stream-file" << endl;
+		return 1;
 	}
-
-	if (ReadDataFile(&posDataQueue, inName, lineDataCount, useTab) == false) {
-		// Error should have been posted. Just return.
-		system("pause");
-		return 0;
+	if ((resumeSec > 0.0) && (streamFile || waypoints)) {
+		cout << "--resume streams the rest of the loaded trajectory, it does not go with --stream-file or --waypoints" << endl;
+		return 1;
 	}
-
-	cout << "number of lines read: " << lineCount << " queue size: " << posDataQueue.size() << endl;
-	// DebugQueue(&posDataQueue);
-
-	// initialize the current joint angle array
-	for (int idx = 0; idx < 9; idx++) {
-		curJoint[idx] = 0.0f;
+	if ((ioEventFile != NULL) && (streamFile || waypoints)) {
+		cout << "--io-events goes into the packets encoded before streaming, it does not go with --stream-file or --waypoints" << endl;
+		return 1;
 	}
-
-	// Now, do data exchange 
-	InitStartPacket(&startPacket);
-	InitStopPacket(&stopPacket);
-
-	// position data reading OK
-	// make connection with robot controller
-	WSADATA wsaData;
-	int iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
-	if (iResult != 0) {
-		cout << "WSAStartup failed: " << iResult << endl;
-		system("pause");
-		return 0;
+	if ((ioEventFile != NULL) && !LoadIoEvents(ioEventFile, &ioEvents)) {
+		return 1;
 	}
 
-	// set up remote robot IP address
-	robot_addr.sin_addr.s_addr = inet_addr(argv[2]);
-	robot_addr.sin_family = AF_INET;
-	robot_addr.sin_port = htons(ROBOT_PORT);
-
-	socketID = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-	DWORD timeout = 1000;
-	int iError = setsockopt(socketID, SOL_SOCKET, SO_RCVTIMEO, (char *)&timeout, sizeof(DWORD));
+	int fileRepresentation;
+	long fileCycleNs;
+	if (streamFile) {
+		if (OpenTrajectoryReader(&reader, inName.c_str()) == false) {
+			return 1;
+		}
+		fileRepresentation = reader.representation;
+		fileCycleNs = reader.cycleNs;
+	}
+	else {
+		if (LoadTrajectoryFile(inName.c_str(), &trajectory) == false) {
+			// Error should have been posted. Just return.
+			return 1;
+		}
+		cout << "number of lines read: " << trajectory.sampleCount << " data size: " << trajectory.axisCount << endl;
+		fileRepresentation = trajectory.representation;
+		fileCycleNs = trajectory.cycleNs;
+	}
 
-	// do connect: make the UDP socket more efficient
-	connect(socketID, (struct sockaddr *)&robot_addr, sizeof(robot_addr));
+	// a binary trajectory knows what it holds
+	if (fileRepresentation != RepresentationUnknown) {
+		if (representationGiven && (fileRepresentation != representation)) {
+			cout << "Data representation does not match the binary data file" << endl;
+			return 1;
+		}
+		representation = (u_byte)fileRepresentation;
+	}
+	if (!waypoints && (fileCycleNs > 0) && (fileCycleNs != rtConfig.cycleNs)) {
+		printf("Warning: data file was made for a %.3f ms cycle, streaming at %.3f ms\n", fileCycleNs / 1.0e6, rtConfig.cycleNs / 1.0e6);
+	}
 
-	// UDP socket does not need to connect to the server, just send the packets
-	// send out the start packet to start data exchange:
-	// if (sendto(socketID, (const char *)(&startPacket), sizeof(startPacket), 0, (struct sockaddr *) &robot_addr, sizeof(robot_addr)) == SOCKET_ERROR) {
-	if (sendto(socketID, (const char *)(&startPacket), sizeof(startPacket), 0, NULL, 0) == SOCKET_ERROR) {
-		cout << "Cannot send start packet" << endl;
-		system("pause");
-		return 0;
+	// contact with the robot's own links or the environment, before anything is sent
+	if (collisionModel != NULL) {
+		if (representation != 1) {
+			cout << "collision check skipped: data is Cartesian (convert it with TrajKinematics ik)" << endl;
+		}
+		else if (streamFile || waypoints) {
+			cout << "collision check skipped: not available with --stream-file or --waypoints" << endl;
+		}
+		else if (!CheckCollisions(collisionModel, environmentFile, &trajectory)) {
+			cout << "Trajectory is not clear of collisions, not streamed" << endl;
+			FreeTrajectory(&trajectory);
+			return 1;
+		}
 	}
 
-	// get threshold one axis at a time
-	// NOTE: set blocking read in recvfrom should work as well.
-	if (doThreshold == true) {
-		/* get this specific axes vel/acc/jerk treashold */
-		InitThresholdPacket(&thresholdPacket, thresholdAxisNumber, 2);
-		sendto(socketID, (char *)&thresholdPacket, sizeof(thresholdPacket), 0, NULL, 0);
-
-		bool waitThreshold = true;
-		while (waitThreshold) {
-			int receiveSize = recvfrom(socketID, (char *)&jerkThresholdPacket, sizeof(jerkThresholdPacket), 0, NULL, 0);
-			if (receiveSize == sizeof(jerkThresholdPacket)) {
-				/* got the threshold data */
-				waitThreshold = false;
+	// torques and currents: the whole trajectory now, every status while streaming
+	DynamicsModel_T *dynamicsModel = NULL;
+	DynamicsMonitor_T *dynamics = NULL;
+	if (dynamicsSpec != NULL) {
+		DynamicsGains_T gains;
+		dynamicsModel = new DynamicsModel_T;
+		bool ok = LoadDynamics(dynamicsSpec, &payload, dynamicsModel, &gains);
+		if (ok && (representation == 1) && !streamFile && !waypoints) {
+			ok = CheckDynamics(dynamicsModel, &gains, &trajectory, rtConfig.cycleNs);
+			if (!ok && ignoreLimits) {
+				cout << "Trajectory is over the model's torque limits, streaming anyway (--ignore-limits)" << endl;
+				ok = true;
+			}
+			else if (!ok) {
+				cout << "Trajectory is over the model's torque limits, not streamed (--ignore-limits to stream anyway)" << endl;
 			}
 		}
-
-		/* get acc trehshold packet */
-		InitThresholdPacket(&thresholdPacket, thresholdAxisNumber, 1);
-		sendto(socketID, (char *)&thresholdPacket, sizeof(thresholdPacket), 0, NULL, 0);
-
-		waitThreshold = true;
-		while (waitThreshold) {
-			int receiveSize = recvfrom(socketID, (char *)&accThresholdPacket, sizeof(accThresholdPacket), 0, NULL, 0);
-			if (receiveSize == sizeof(accThresholdPacket)) {
-				/* got the threshold data */
-				waitThreshold = false;
+		else if (ok && (representation != 1)) {
+			cout << "dynamics: data is Cartesian, the monitor checks the statuses only" << endl;
+		}
+		if (!ok) {
+			delete dynamicsModel;
+			FreeTrajectory(&trajectory);
+			if (streamFile) {
+				CloseTrajectoryReader(&reader);
 			}
+			return 1;
 		}
+		dynamics = new DynamicsMonitor_T;
+		InitDynamicsMonitor(dynamics, dynamicsModel, &gains, rtConfig.cycleNs);
+		dynamics->collisionAmps = collisionAmps;
+		dynamics->payloadAmps = payloadAmps;
+		dynamics->stopOnFlag = dynamicsStop;
+	}
 
-		/* get velocity packet */
-		InitThresholdPacket(&thresholdPacket, thresholdAxisNumber, 0);
-		sendto(socketID, (char *)&thresholdPacket, sizeof(thresholdPacket), 0, NULL, 0);
-
-		waitThreshold = true;
-		while (waitThreshold) {
-			int receiveSize = recvfrom(socketID, (char *)&velThresholdPacket, sizeof(velThresholdPacket), 0, NULL, 0);
-			if (receiveSize == sizeof(velThresholdPacket)) {
-				/* got the threshold data */
-				waitThreshold = false;
+	// corrections: mailbox and plugin ready before the controller is started
+	CorrectionHook_T *correction = NULL;
+	if ((correctionMailbox != NULL) || (correctionPlugin != NULL)) {
+		correction = new CorrectionHook_T;
+		InitCorrectionHook(correction, rtConfig.cycleNs);
+		if (correctionBudgetNs > 0) {
+			correction->budgetNs = correctionBudgetNs;
+		}
+		if (((correctionMailbox != NULL) && ((correction->mailbox = OpenCorrectionMailbox(correctionMailbox, true)) == NULL))
+			|| ((correctionPlugin != NULL) && !LoadCorrectionPlugin(correction, correctionPlugin))) {
+			FreeCorrectionHook(correction);
+			delete correction;
+			FreeTrajectory(&trajectory);
+			if (streamFile) {
+				CloseTrajectoryReader(&reader);
 			}
+			return 1;
 		}
 	}
 
-	bool isRobotReady = false;
-	// TODO: add time out !!
-	while (!isRobotReady) { // wait for the robot controller be ready
-		// int receiveSize = recvfrom(socketID, (char *)&statusPacket, sizeof(statusPacket), 0, (struct sockaddr *)&robot_addr, &addr_len);
-		int receiveSize = recvfrom(socketID, (char *)&statusPacket, sizeof(statusPacket), 0, NULL, 0);
-		//cout << "Status PacketType (RAW): " << statusPacket.packetType << endl;
-		//cout << "Status PacketType (ntohl): " << ntohl(statusPacket.packetType) << endl;
-		//
-		//cout << "Status VersionNum (RAW): " << statusPacket.versionNo << endl;
-		//cout << "Status VersionNum (ntohl): " << ntohl(statusPacket.versionNo) << endl;
-
-		//cout << "Status SeqeunceNum (RAW): " << statusPacket.sequenceNo << endl;
-		//cout << "Status SeqeunceNum (ntohl): " << ntohl(statusPacket.sequenceNo) << endl;
-
-		//cout << "Status status (RAW): " << statusPacket.status << endl;
-		//cout << "Status status (ntohl): " << ntohl(statusPacket.status) << endl;
-
-		//cout << "Status ReadIO (RAW): " << statusPacket.readIOType << endl;
-		//cout << "Status ReadIo (ntohl): " << ntohl(statusPacket.readIOType) << endl;
-
-		//cout << "Status ReadIndex (RAW): " << statusPacket.readIOIndex << endl;
-		//cout << "Status ReadIndex (ntohl): " << ntohl(statusPacket.readIOIndex) << endl;
-
-		//cout << "Status ReadIOMask (RAW): " << statusPacket.readIOMask << endl;
-		//cout << "Status ReadIOMask (ntohl): " << ntohl(statusPacket.readIOMask) << endl;
+	if (streamFile) {
+		// start filling the ring now, the handshake below gives it a head start
+		SampleSource_T source = { &reader, ReadSourceTrajectory };
+		if (StartPipeline(&pipeline, &source, representation, DefaultPipelineCapacity) == false) {
+			CloseTrajectoryReader(&reader);
+			return 1;
+		}
+	}
+	// encode every command packet now, the stream cycle only stamps the sequence number
+	else if (!waypoints && EncodeTrajectory(&encoded, trajectory.samples, trajectory.sampleCount, representation) == false) {
+		return 1;
+	}
+	if (ioEventFile != NULL) {
+		if (!ApplyIoEvents(encoded.packets, encoded.count, &ioEvents, NULL, 0, trajectory.sampleCount, &ioStats)) {
+			FreeTrajectory(&trajectory);
+			FreeEncodedTrajectory(&encoded);
+			return 1;
+		}
+		WriteIoEvents(&ioEvents, &ioStats);
+	}
 
-		//cout << "Status ReadIOValue (RAW): " << statusPacket.readIOValue << endl;
-		//cout << "Status ReadIoValue (ntohl): " << ntohl(statusPacket.readIOValue) << endl;
+	// Now, do data exchange 
+	InitStartPacket(&startPacket);
 
-		//cout << "Status timestamp (RAW): " << statusPacket.timeStamp << endl;
-		//cout << "Status timestamp (ntohl): " << ntohl(statusPacket.timeStamp) << endl;
+	// position data reading OK
+	// make connection with robot controller
+	socketID = OpenRobotSocket(robotIPAddress.c_str(), ROBOT_PORT, &ioConfig, rtConfig.cycleNs);
+	if (socketID < 0) {
+		if (streamFile) {
+			StopPipeline(&pipeline);
+			CloseTrajectoryReader(&reader);
+		}
+		return 1;
+	}
 
-		//cout << "Status ReadIOValue (RAW): " << statusPacket.readIOValue << endl;
-		//cout << "Status ReadIoValue (ntohl): " << ntohl(statusPacket.readIOValue) << endl;
+	// send out the start packet to start data exchange:
+	if (send(socketID, (const char *)(&startPacket), sizeof(startPacket), 0) < 0) {
+		cout << "Cannot send start packet" << endl;
+		close(socketID);
+		if (streamFile) {
+			StopPipeline(&pipeline);
+			CloseTrajectoryReader(&reader);
+		}
+		return 1;
+	}
 
+	// thresholds: all axes from the cache, or one pipelined exchange with the controller
+	// a joint waypoint path is planned, and joint corrections are stepped, within the thresholds of every axis
+	bool planThresholds = (waypoints || (correction != NULL)) && (representation == 1);
+	u_word thresholdAxes = (allThresholds || planThresholds) ? AllThresholdAxes : 0;
+	InitAxisLimits(axisLimits);
+	if (doThreshold == true) {
+		thresholdAxes |= 1u << (thresholdAxisNumber - 1);
+	}
+	if (thresholdAxes != 0) {
+		// a 6 axis robot has no tables for 7-9: axis 1 (and the axis asked for) is enough
+		u_word neededAxes = (doThreshold == true) ? (1u << (thresholdAxisNumber - 1)) | 1u : 1u;
+		ReadThresholds(socketID, robotIPAddress.c_str(), thresholdAxes, neededAxes, allThresholds || planThresholds, refreshThresholds, &thresholds);
+		if (allThresholds) {
+			WriteThresholdSummary(&thresholds);
+		}
 
-		// Received a packet, check to see if robot is ready to receive a command position
-		if ((statusPacket.status & 1) > 0) {
-			for (int idx = 0; idx < 6; idx++) {
-				u_long joint = ntohl(statusPacket.jontAngle[idx]);
-				//cout << "Status Joint (RAW): " << statusPacket.jontAngle[idx] << endl;
-				//cout << "Status Joint (ntohl): " << joint << endl;
-				curJoint[idx] = reinterpret_cast<float &> (joint);
-			}
-			isRobotReady = true;;
-		}
-		//if ((statusPacket.status & 1) > 0) {
-		//	for (int idx = 0; idx < 6; idx++) {
-		//		u_long pos = ntohl(statusPacket.position[idx]);
-		//		cout << "Status Joint (RAW): " << statusPacket.position[idx] << endl;
-		//		cout << "Status Joint (ntohl): " << pos << endl;
-		//		curJoint[idx] = reinterpret_cast<float&> (pos);
-		//	}
-		//	isRobotReady = true;;
-		//}
-		//if ((statusPacket.status & 1) > 0) {
-		//	for (int idx = 0; idx < 6; idx++) {
-		//		u_long curr = ntohl(statusPacket.current[idx]);
-		//		cout << "Status Joint (RAW): " << statusPacket.current[idx] << endl;
-		//		cout << "Status Joint (ntohl): " << curr << endl;
-		//		curJoint[idx] = reinterpret_cast<float&> (curr);
-		//	}
-		//	isRobotReady = true;;
-		//}
-	} // end of of waiting for the status bit
-
-	// send number of packet to controller to fill the packet stack in the controller
-	if (packetStack > 0) {
-		for (int idx = 0; idx < packetStack; idx++) {
-			PositionData_T pos = posDataQueue.front();
-			if (posDataQueue.size() > 1) {
-				lastData = 0;
-			}
-			else {  // this is the last command data sent to robot controller
-				lastData = 1;
+		// check the whole path before the first command goes out
+		SetThresholdLimits(&thresholds, axisLimits, fullPayload);
+		if (representation != 1) {
+			cout << "limit check skipped: thresholds are per joint, data is Cartesian" << endl;
+		}
+		else if (streamFile) {
+			cout << "limit check skipped: not available with --stream-file" << endl;
+		}
+		else if (!waypoints) {
+			LimitReport_T limitReport;
+			bool withinLimits = CheckTrajectoryLimits(trajectory.samples, trajectory.sampleCount, rtConfig.cycleNs, axisLimits, &limitReport);
+			WriteLimitReport(&limitReport);
+			if (!withinLimits && !ignoreLimits) {
+				cout << "Trajectory is over the controller thresholds, not streamed (--ignore-limits to stream anyway)" << endl;
+				StopPacket_T stopPacket;
+				InitStopPacket(&stopPacket);
+				send(socketID, (char *)&stopPacket, sizeof(stopPacket), 0);
+				close(socketID);
+				FreeTrajectory(&trajectory);
+				FreeEncodedTrajectory(&encoded);
+				return 1;
 			}
-
-			// InitCommandPacket(&commandPacket, htonl(statusPacket.sequenceNo), &(pos.data[0]), representation, lastData);
-			InitCommandPacket(&commandPacket, idx + startSeqID, &(curJoint[0]), representation, lastData);
-			posDataQueue.pop();
-
-			// send the command packet out
-			// sendto(socketID, (char *)&commandPacket, sizeof(commandPacket), 0, (struct sockaddr *) &robot_addr, sizeof(robot_addr));
-			sendto(socketID, (char *)&commandPacket, sizeof(commandPacket), 0, NULL, 0);
 		}
 	}
 
-	doDataExchange = true;
-	// Start to send the command packets
-	while (!posDataQueue.empty() && doDataExchange) {
-		PositionData_T pos = posDataQueue.front();
-		if (posDataQueue.size() > 1) {
-			lastData = 0;
+	if (waypoints) {
+		// only the blends are planned now, the producer makes the samples while streaming
+		WaypointLimits_T limits;
+		InitWaypointLimits(&limits, waypointLimit[ThresholdVelocity], waypointLimit[ThresholdAcceleration], waypointLimit[ThresholdJerk]);
+		CapWaypointLimits(&limits, axisLimits, WaypointThresholdScale);
+		bool planned = PlanWaypointPath(&waypointPath, trajectory.samples, trajectory.sampleCount, trajectory.axisCount, &limits, rtConfig.cycleNs);
+		if (planned) {
+			WriteWaypointPlan(&waypointPath, &limits);
+			SampleSource_T source = { &waypointPath, ReadSourceWaypoints };
+			planned = StartPipeline(&pipeline, &source, representation, DefaultPipelineCapacity);
 		}
-		else {  // this is the last command data sent to robot controller
-			lastData = 1;
+		if (!planned) {
+			StopPacket_T stopPacket;
+			InitStopPacket(&stopPacket);
+			send(socketID, (char *)&stopPacket, sizeof(stopPacket), 0);
+			close(socketID);
+			FreeTrajectory(&trajectory);
+			return 1;
 		}
+	}
 
-		if (packetStack > 0) {
-			seqID = ntohl(statusPacket.sequenceNo) + packetStack + startSeqID -1;
+	// stream the motion on the real-time thread
+	InitStreamSession(&session);
+	session.socketID = socketID;
+	session.rt = rtConfig;
+	session.io = ioConfig;
+	session.packets = encoded.packets;
+	session.packetCount = encoded.count;
+	session.pipeline = (streamFile || waypoints) ? &pipeline : NULL;
+	session.representation = representation;
+	session.packetStack = packetStack;
+	session.startSeqID = startSeqID;
+	if (telemetryFile != NULL) {
+		if (StartTelemetry(&recorder, telemetryFile, rtConfig.cycleNs, representation, DefaultTelemetryCapacity)) {
+			session.telemetry = &recorder;
 		}
 		else {
-			seqID = ntohl(statusPacket.sequenceNo);
+			cout << "Continue without recording" << endl;
 		}
+	}
+	// the counters cost a few compares per cycle: always kept, exported on request
+	CycleMetrics_T *metrics = new CycleMetrics_T;
+	InitCycleMetrics(metrics, rtConfig.cycleNs);
+	session.metrics = metrics;
+	if (correction != NULL) {
+		SetCorrectionLimits(correction, axisLimits, representation, rtConfig.cycleNs);
+	}
+	session.correction = correction;
+	session.dynamics = dynamics;
+	bool liveMetrics = false;
+	if (liveMetricsFile != NULL) {
+		liveMetrics = StartLiveMetrics(metrics, liveMetricsFile);
+	}
 
-		// InitCommandPacket(&commandPacket, htonl(statusPacket.sequenceNo), &(pos.data[0]), representation, lastData);
-		// InitCommandPacket(&commandPacket, htonl(statusPacket.sequenceNo), &(curJoint[0]), representation, lastData);
-		InitCommandPacket(&commandPacket, seqID, &(pos.data[0]), representation, lastData);
-		posDataQueue.pop();
-
-
-		// send the command packet out
-		// sendto(socketID, (char *)&commandPacket, sizeof(commandPacket), 0, (struct sockaddr *) &robot_addr, sizeof(robot_addr));
-		sendto(socketID, (char *)&commandPacket, sizeof(commandPacket), 0, NULL, 0);
-
-		// Wait for the robot status packet */
-		// int receiveSize = recvfrom(socketID, (char *)&statusPacket, sizeof(statusPacket), 0, (struct sockaddr *)&robot_addr, &addr_len);
-		int receiveSize = recvfrom(socketID, (char *)&statusPacket, sizeof(statusPacket), 0, NULL, 0);
-		// check for the status
-		if ((statusPacket.status & 5) != 5) {
-			cout << "** CONTROLLER ERROR at sequence ID: " << seqID << " **" << endl;
-			doDataExchange = false;
+	bool completed = RunStreamSession(&session);
+
+	// --resume: after a fault the rest of the trajectory, still in memory, from the last sample executed
+	int resumes = 0;
+	size_t fromSample = 0;
+	size_t ioFirstSample = 0;           // writes of the samples before were executed
+	vector<PositionData_T> resumeSamples;
+	vector<size_t> resumeSource;        // original sample of each packet of the resumed trajectory
+	while (!completed && session.controllerError && (resumeSec > 0.0)) {
+		int32_t executed = (int32_t)(session.acked - session.firstSeq);
+		if (executed > (int32_t)session.packetCount) {
+			executed = (int32_t)session.packetCount;
 		}
-		else {
-			for (int idx = 0; idx < 6; idx++) {
-				u_long joint = ntohl(statusPacket.jontAngle[idx]);
-				curJoint[idx] = reinterpret_cast<float &> (joint);
-			}
+		if (executed > 0) {
+			fromSample = resumeSource.empty() ? (size_t)(executed - 1) : resumeSource[executed - 1];
+			ioFirstSample = fromSample + 1;
+		}
+		if (resumes == MaxResumes) {
+			cout << "** NOT RESUMED: " << MaxResumes << " faults in this run **" << endl;
+			break;
+		}
+		printf("fault at sample %zu of %zu, waiting up to %.0f s for the controller to be ready again\n", fromSample, trajectory.sampleCount, resumeSec);
+		if (!WaitControllerReady(socketID, &ioConfig, (int64_t)(resumeSec * NsPerSec), &session.statusPacket)) {
+			cout << "** CONTROLLER NOT READY AGAIN within " << resumeSec << " s **" << endl;
+			break;
 		}
-	}
 
-	if (packetStack > 0) {
-		// wait for the controller to processed all packets in the buffer before sending the last packet
-		Sleep(packetStack * 8);
+		float current[MaxAxisNumber];
+		ResumePlan_T plan;
+		ReportedPose(&session, current);
+		bool planned = PlanResume(trajectory.samples, trajectory.sampleCount, trajectory.axisCount, fromSample, current, representation,
+			axisLimits, rtConfig.cycleNs, &resumeSamples, &resumeSource, &plan);
+		if (planned) {
+			WriteResumePlan(&plan, trajectory.sampleCount, rtConfig.cycleNs);
+			FreeEncodedTrajectory(&encoded);
+			planned = EncodeTrajectory(&encoded, resumeSamples.data(), resumeSamples.size(), representation);
+		}
+		if (planned && (ioEventFile != NULL)) {
+			planned = ApplyIoEvents(encoded.packets, encoded.count, &ioEvents, resumeSource.data(), ioFirstSample, trajectory.sampleCount, &ioStats);
+			WriteIoEvents(&ioEvents, &ioStats);
+		}
+		if (!planned) {
+			StopPacket_T stopPacket;
+			InitStopPacket(&stopPacket);
+			send(socketID, (char *)&stopPacket, sizeof(stopPacket), 0);
+			break;
+		}
+		session.packets = encoded.packets;
+		session.packetCount = encoded.count;
+		ResetStreamState(&session);
+		resumes++;
+		completed = RunStreamSession(&session);
 	}
 
-	// Send the last data
-	// sendto(socketID, (const char *)&stopPacket, sizeof(stopPacket), 0, (struct sockaddr *) &robot_addr, sizeof(robot_addr));
-	sendto(socketID, (const char *)&stopPacket, sizeof(stopPacket), 0, NULL, 0);
 	// clean up
-	closesocket(socketID);
-	WSACleanup();
+	close(socketID);
+	if (session.telemetry != NULL) {
+		StopTelemetry(&recorder);
+	}
+	if (liveMetrics) {
+		StopLiveMetrics(metrics);
+	}
+	unsigned long streamed = 0;
+	if (streamFile || waypoints) {
+		streamed = pipeline.produced.load();
+		StopPipeline(&pipeline);
+	}
+	if (streamFile) {
+		CloseTrajectoryReader(&reader);
+	}
+	FreeTrajectory(&trajectory);
+	FreeEncodedTrajectory(&encoded);
 
 	// 
 	// cout << "Current Joint Angle: ";
 	// for (int idx = 0; idx < 6; idx++) {
-	//	printf("%12.6f ", curJoint[idx]);
+	//	printf("%12.6f ", session.curJoint[idx]);
 	// }
 	//cout << endl;
 
-	if (doDataExchange != false) {
+	if (completed) {
 		cout << "Motion Completed" << endl;
 	}
+	if (resumes > 0) {
+		cout << "resumed after " << resumes << " controller fault(s), the stream statistics are of the last part" << endl;
+	}
+	if (streamFile) {
+		cout << "samples read while streaming: " << streamed << endl;
+	}
+	if (waypoints) {
+		cout << "samples made from the waypoints while streaming: " << streamed << endl;
+	}
+	WriteStreamStats(&session);
+	if (session.telemetry != NULL) {
+		WriteTelemetryStats(&recorder, telemetryFile);
+	}
+	WriteCycleMetrics(metrics);
+	if (correction != NULL) {
+		WriteCorrectionStats(correction);
+		FreeCorrectionHook(correction);
+		delete correction;
+	}
+	if (dynamics != NULL) {
+		WriteDynamicsMonitor(dynamics);
+		if (dynamics->stopOnFlag && (dynamics->flagged != 0)) {
+			cout << "** MOTION ENDED BY THE DYNAMICS MONITOR **" << endl;
+		}
+		delete dynamics;
+		delete dynamicsModel;
+	}
+	if (metricsFile != NULL) {
+		SaveStreamSummary(metricsFile, &session);
+	}
+	delete metrics;
 
 	// print out threshold data, if set.
-	if (doThreshold == TRUE) {
-		WriteThresholdData(&velThresholdPacket, &accThresholdPacket, &jerkThresholdPacket);
+	if ((doThreshold == true) && HaveThresholds(&thresholds, 1u << (thresholdAxisNumber - 1))) {
+		const RobotThresholdPacket_T *tables = thresholds.packet[thresholdAxisNumber - 1];
+		WriteThresholdData(&tables[ThresholdVelocity], &tables[ThresholdAcceleration], &tables[ThresholdJerk]);
 	}
-	system("pause");
-
-	return 0;
-
 
+	return completed ? 0 : 1;
 }
-
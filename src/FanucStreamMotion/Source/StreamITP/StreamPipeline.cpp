@@ -0,0 +1,112 @@
+//
+// StreamPipeline.cpp : producer thread feeding the stream thread through a
+//                      bounded SPSC ring of encoded command packets
+//
+
+#include "stdafx.h"
+#include <string.h>
+#include <time.h>
+#include <iostream>
+
+#include "StreamPipeline.h"
+#include "CommandEncoder.h"
+#include "TrajectoryFile.h"
+#include "WaypointPath.h"
+
+using namespace std;
+
+const long ProducerBackoffNs = 1000000L;   // sleep while the ring is full
+
+static bool PushPacket(StreamPipeline_T *pipeline, const CommandPacket_T *packet)
+{
+	struct timespec backoff = { 0, ProducerBackoffNs };
+
+	while (!SpscPush(&pipeline->ring, packet)) {
+		if (pipeline->stopRequest.load(memory_order_relaxed)) {
+			return false;
+		}
+		nanosleep(&backoff, NULL);
+	}
+	pipeline->produced.fetch_add(1, memory_order_relaxed);
+	return true;
+}
+
+static void ProduceSamples(StreamPipeline_T *pipeline)
+{
+	static const float zeroPos[MaxAxisNumber] = { 0.0f };
+	PositionData_T samples[PipelineBatch];
+	CommandPacket_T packets[PipelineBatch];
+	CommandPacket_T pending;
+	bool havePending = false;
+	bool ok = true;
+
+	InitCommandPacket(&packets[0], 0, zeroPos, pipeline->dataStyle, 0);
+	for (int idx = 1; idx < PipelineBatch; idx++) {
+		packets[idx] = packets[0];
+	}
+
+	while (ok && !pipeline->stopRequest.load(memory_order_relaxed)) {
+		int count = pipeline->source.read(pipeline->source.context, samples, PipelineBatch);
+		if (count < 0) {
+			pipeline->producerFailed.store(true, memory_order_release);
+			break;
+		}
+		if (count == 0) {
+			// this is the last command data sent to robot controller
+			if (havePending) {
+				pending.lastData = 1;
+				ok = PushPacket(pipeline, &pending);
+			}
+			else {
+				pipeline->producerFailed.store(true, memory_order_release);
+			}
+			break;
+		}
+
+		EncodeCommandPositions(packets, samples, count);
+		for (int idx = 0; (idx < count) && ok; idx++) {
+			if (havePending) {
+				ok = PushPacket(pipeline, &pending);
+			}
+			pending = packets[idx];
+			havePending = true;
+		}
+	}
+	pipeline->producerDone.store(true, memory_order_release);
+}
+
+bool StartPipeline(StreamPipeline_T *pipeline, const SampleSource_T *source, u_byte dataStyle, size_t capacity)
+{
+	if (!InitSpscRing(&pipeline->ring, capacity)) {
+		cout << "Cannot allocate the stream pipeline" << endl;
+		return false;
+	}
+	pipeline->source = *source;
+	pipeline->dataStyle = dataStyle;
+	pipeline->producerDone.store(false);
+	pipeline->producerFailed.store(false);
+	pipeline->stopRequest.store(false);
+	pipeline->produced.store(0);
+
+	pipeline->producer = thread(ProduceSamples, pipeline);
+	return true;
+}
+
+void StopPipeline(StreamPipeline_T *pipeline)
+{
+	pipeline->stopRequest.store(true);
+	if (pipeline->producer.joinable()) {
+		pipeline->producer.join();
+	}
+	FreeSpscRing(&pipeline->ring);
+}
+
+int ReadSourceTrajectory(void *context, PositionData_T *samples, int maxCount)
+{
+	return ReadTrajectorySamples((TrajectoryReader_T *)context, samples, maxCount);
+}
+
+int ReadSourceWaypoints(void *context, PositionData_T *samples, int maxCount)
+{
+	return ReadWaypointSamples((WaypointPath_T *)context, samples, maxCount);
+}
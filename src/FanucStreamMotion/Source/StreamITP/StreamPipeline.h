@@ -0,0 +1,60 @@
+//
+// StreamPipeline.h : producer thread feeding the stream thread through a
+//                    bounded SPSC ring of encoded command packets
+//
+// The producer reads (or generates) samples, encodes them and pushes them
+// into the ring; the stream thread pops one packet per cycle. Memory stays
+// at the ring size however long the path is, and streaming starts as soon
+// as the first samples are in the ring.
+//
+// The producer holds one packet back until it knows whether another one
+// follows, so the packet it pushes last already carries lastData = 1.
+//
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include "J519Packet.h"
+#include "SpscRing.h"
+
+const size_t DefaultPipelineCapacity = 4096;   // packets, 256 KB
+const int PipelineBatch = 256;                 // samples read and encoded per step
+
+/*
+ * SampleSource_T: where the producer gets its samples from.
+ * read returns the number of samples, 0 at the end, -1 on error.
+ */
+typedef struct SampleSource_T {
+	void *context;
+	int (*read)(void *context, PositionData_T *samples, int maxCount);
+} SampleSource_T;
+
+typedef struct StreamPipeline_T {
+	SpscRing_T<CommandPacket_T> ring;
+	SampleSource_T source;
+	u_byte dataStyle;
+
+	std::thread producer;
+	std::atomic<bool> producerDone;     // lastData packet pushed, or gave up
+	std::atomic<bool> producerFailed;   // source error, no lastData packet will come
+	std::atomic<bool> stopRequest;      // consumer is finished, producer should quit
+	std::atomic<unsigned long> produced;
+} StreamPipeline_T;
+
+bool StartPipeline(StreamPipeline_T *pipeline, const SampleSource_T *source, u_byte dataStyle, size_t capacity);
+
+// ask the producer to quit, wait for it and free the ring
+void StopPipeline(StreamPipeline_T *pipeline);
+
+/*
+ * PipelinePop: next packet for the stream thread, false if the ring is empty.
+ */
+static inline bool PipelinePop(StreamPipeline_T *pipeline, CommandPacket_T *packet)
+{
+	return SpscPop(&pipeline->ring, packet);
+}
+
+// adapters for the file reader and the waypoint path generator
+int ReadSourceTrajectory(void *context, PositionData_T *samples, int maxCount);
+int ReadSourceWaypoints(void *context, PositionData_T *samples, int maxCount);
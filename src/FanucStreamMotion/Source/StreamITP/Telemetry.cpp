@@ -0,0 +1,206 @@
+//
+// Telemetry.cpp : full rate recording of the controller's status packets
+//
+
+#include "stdafx.h"
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <iostream>
+
+#include "Telemetry.h"
+#include "RtUtil.h"
+
+using namespace std;
+
+const int TelemetryBatch = 256;            // samples swapped and written at a time
+
+// network order status -> host order sample
+static void SwapEntry(const TelemetryEntry_T *entry, int64_t startNs, TelemetrySample_T *sample)
+{
+	const RobotStatusPacket_T *status = &entry->status;
+
+	memset(sample, 0, sizeof(*sample));
+	sample->receiveNs = entry->receiveNs - startNs;
+	sample->replyNs = entry->replyNs;
+	sample->sequenceNo = ntohl(status->sequenceNo);
+	sample->timeStamp = ntohl(status->timeStamp);
+	sample->commandSeqNo = entry->commandSeqNo;
+	sample->status = status->status;
+	sample->readIOType = status->readIOType;
+	sample->readIOIndex = ntohs(status->readIOIndex);
+	sample->readIOMask = ntohs(status->readIOMask);
+	sample->readIOValue = ntohs(status->readIOValue);
+	sample->writeIOType = entry->writeIOType;
+	sample->writeIOIndex = ntohs(entry->writeIOIndex);
+	sample->writeIOMask = ntohs(entry->writeIOMask);
+	sample->writeIOValue = ntohs(entry->writeIOValue);
+	for (int idx = 0; idx < MaxAxisNumber; idx++) {
+		sample->position[idx] = NetFloatField(status->position[idx]);
+		sample->jointAngle[idx] = NetToHostFloat(status->jontAngle[idx]);
+		sample->current[idx] = NetFloatField(status->current[idx]);
+	}
+}
+
+// everything queued so far to the log, false once a write failed
+static bool DrainTelemetry(TelemetryRecorder_T *recorder, TelemetrySample_T *batch)
+{
+	TelemetryEntry_T entry;
+	bool more = true;
+
+	while (more) {
+		int count = 0;
+		while ((count < TelemetryBatch) && (more = SpscPop(&recorder->ring, &entry))) {
+			SwapEntry(&entry, recorder->startNs, &batch[count++]);
+		}
+		if (count == 0) {
+			break;
+		}
+		if (fwrite(batch, sizeof(TelemetrySample_T), count, recorder->file) != (size_t)count) {
+			return false;
+		}
+		recorder->written += count;
+	}
+	// on disk within one wake-up, so a crash loses little
+	return fflush(recorder->file) == 0;
+}
+
+static void TelemetryWriter(TelemetryRecorder_T *recorder)
+{
+	TelemetrySample_T *batch = new TelemetrySample_T[TelemetryBatch];
+	struct timespec wake = { 0, TelemetryWakeMs * NsPerMs };
+	bool ok = true;
+
+	while (ok && !recorder->stopRequest.load(memory_order_acquire)) {
+		nanosleep(&wake, NULL);
+		ok = DrainTelemetry(recorder, batch);
+	}
+	// the stream thread is done: what is left in the ring is complete
+	if (ok) {
+		ok = DrainTelemetry(recorder, batch);
+	}
+	if (!ok) {
+		recorder->writeFailed.store(true, memory_order_release);
+	}
+	delete[] batch;
+}
+
+bool StartTelemetry(TelemetryRecorder_T *recorder, const char *fileName, long cycleNs, u_byte representation, size_t capacity)
+{
+	TelemetryHeader_T header;
+	struct timespec wallClock;
+
+	recorder->file = fopen(fileName, "wb");
+	if (recorder->file == NULL) {
+		cout << "Cannot create telemetry log " << fileName << ": " << strerror(errno) << endl;
+		return false;
+	}
+	if (!InitSpscRing(&recorder->ring, capacity)) {
+		cout << "Cannot allocate the telemetry ring" << endl;
+		fclose(recorder->file);
+		return false;
+	}
+	// touch the ring now, not on the stream thread's first pushes
+	memset(recorder->ring.slots, 0, (recorder->ring.mask + 1) * sizeof(TelemetryEntry_T));
+
+	clock_gettime(CLOCK_REALTIME, &wallClock);
+	recorder->startNs = RtNowNs();
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TelemetryMagic, sizeof(header.magic));
+	header.version = TelemetryVersion;
+	header.headerSize = sizeof(header);
+	header.sampleSize = sizeof(TelemetrySample_T);
+	header.cycleNs = cycleNs;
+	header.startUnixNs = TimespecNs(&wallClock);
+	header.representation = representation;
+	if ((fwrite(&header, sizeof(header), 1, recorder->file) != 1) || (fflush(recorder->file) != 0)) {
+		cout << "Cannot write telemetry log " << fileName << ": " << strerror(errno) << endl;
+		fclose(recorder->file);
+		FreeSpscRing(&recorder->ring);
+		return false;
+	}
+
+	recorder->stopRequest.store(false);
+	recorder->writeFailed.store(false);
+	recorder->dropped = 0;
+	recorder->written = 0;
+	recorder->writer = thread(TelemetryWriter, recorder);
+	return true;
+}
+
+void StopTelemetry(TelemetryRecorder_T *recorder)
+{
+	recorder->stopRequest.store(true, memory_order_release);
+	if (recorder->writer.joinable()) {
+		recorder->writer.join();
+	}
+	if (recorder->file != NULL) {
+		if (fclose(recorder->file) != 0) {
+			recorder->writeFailed.store(true);
+		}
+		recorder->file = NULL;
+	}
+	FreeSpscRing(&recorder->ring);
+}
+
+void WriteTelemetryStats(const TelemetryRecorder_T *recorder, const char *fileName)
+{
+	printf("telemetry: %lu status packets recorded to %s, %lu dropped (ring full)\n", recorder->written, fileName, recorder->dropped);
+	if (recorder->writeFailed.load()) {
+		printf("** TELEMETRY LOG WRITE FAILED, %s is incomplete **\n", fileName);
+	}
+}
+
+static bool ReadTelemetryHeader(FILE *file, const char *fileName, TelemetryHeader_T *header)
+{
+	if ((fread(header, sizeof(*header), 1, file) != 1) || (memcmp(header->magic, TelemetryMagic, sizeof(header->magic)) != 0)) {
+		cout << fileName << " is not a telemetry log" << endl;
+		return false;
+	}
+	if ((header->version != TelemetryVersion) || (header->sampleSize != sizeof(TelemetrySample_T)) || (header->headerSize != sizeof(*header))) {
+		cout << fileName << ": telemetry log version " << header->version << " is not supported, record it again" << endl;
+		return false;
+	}
+	return true;
+}
+
+bool IsTelemetryLog(const char *fileName)
+{
+	TelemetryHeader_T header;
+	FILE *file = fopen(fileName, "rb");
+
+	if (file == NULL) {
+		return false;
+	}
+	// the magic only: a log of another version is still taken as one, and refused when loaded
+	bool isLog = (fread(&header, sizeof(header), 1, file) == 1) && (memcmp(header.magic, TelemetryMagic, sizeof(header.magic)) == 0);
+	fclose(file);
+	return isLog;
+}
+
+bool LoadTelemetryLog(const char *fileName, TelemetryHeader_T *header, vector<TelemetrySample_T> *samples)
+{
+	FILE *file = fopen(fileName, "rb");
+
+	samples->clear();
+	if (file == NULL) {
+		cout << "Cannot open telemetry log " << fileName << ": " << strerror(errno) << endl;
+		return false;
+	}
+	if (!ReadTelemetryHeader(file, fileName, header)) {
+		fclose(file);
+		return false;
+	}
+	// a cut off last sample (log of a crashed run) is left out
+	TelemetrySample_T batch[TelemetryBatch];
+	size_t count;
+	while ((count = fread(batch, sizeof(TelemetrySample_T), TelemetryBatch, file)) > 0) {
+		samples->insert(samples->end(), batch, batch + count);
+	}
+	bool ok = !ferror(file);
+	fclose(file);
+	if (!ok) {
+		cout << "Cannot read telemetry log " << fileName << endl;
+	}
+	return ok;
+}
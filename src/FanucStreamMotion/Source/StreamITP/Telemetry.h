@@ -0,0 +1,129 @@
+//
+// Telemetry.h : full rate recording of the controller's status packets
+//
+// The stream thread copies each status packet (still in network order) with
+// its receive time into a bounded SPSC ring; nothing else happens on the
+// stream thread. A writer thread wakes every TelemetryWakeMs, byte swaps
+// what is queued and appends it to a binary log (.itpt): a header, then one
+// fixed size TelemetrySample_T per status, host (little endian) order. A log
+// cut short by a crash is readable up to its last whole sample. TrajConvert
+// turns a log into CSV. Logs of another version or sample size are refused.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "J519Packet.h"
+#include "SpscRing.h"
+
+const char TelemetryMagic[4] = { 'I', 'T', 'P', 'L' };
+const u_word TelemetryVersion = 3;
+const size_t DefaultTelemetryCapacity = 8192;   // statuses, 33 s at 4 ms
+const long TelemetryWakeMs = 20;
+
+typedef struct TelemetryHeader_T {
+	char magic[4];            // "ITPL"
+	u_word version;
+	u_word headerSize;
+	u_word sampleSize;
+	int64_t cycleNs;
+	int64_t startUnixNs;      // wall clock at the start, receiveNs counts from here
+	u_word representation;    // of the streamed data: Cartesian position = 0, joint angle = 1
+	u_word reserved;
+} TelemetryHeader_T;
+
+typedef struct TelemetrySample_T {
+	int64_t receiveNs;        // status read, since the start of the recording
+	int32_t replyNs;          // status read -> command sent, -1 if not answered
+	u_word sequenceNo;
+	u_word timeStamp;         // controller clock
+	u_word commandSeqNo;      // sequence number of the command sent in reply
+	u_byte status;
+	u_byte readIOType;
+	u_short readIOIndex;
+	u_short readIOMask;
+	u_short readIOValue;
+	float position[MaxAxisNumber];
+	float jointAngle[MaxAxisNumber];
+	float current[MaxAxisNumber];
+	u_word reserved;
+	u_byte writeIOType;       // I/O write of the reply's commands (the first), 0 = none
+	u_byte unused;
+	u_short writeIOIndex;
+	u_short writeIOMask;
+	u_short writeIOValue;
+} TelemetrySample_T;
+
+static_assert(sizeof(TelemetryHeader_T) == 40, "TelemetryHeader_T is 40 bytes on disk");
+static_assert(sizeof(TelemetrySample_T) == 152, "TelemetrySample_T is 152 bytes on disk");
+
+// what the stream thread queues, network order as received
+typedef struct TelemetryEntry_T {
+	RobotStatusPacket_T status;
+	int64_t receiveNs;        // CLOCK_MONOTONIC
+	int32_t replyNs;
+	u_word commandSeqNo;
+	u_byte writeIOType;       // network order as sent
+	u_short writeIOIndex;
+	u_short writeIOMask;
+	u_short writeIOValue;
+} TelemetryEntry_T;
+
+typedef struct TelemetryRecorder_T {
+	SpscRing_T<TelemetryEntry_T> ring;
+	FILE *file;
+	int64_t startNs;          // CLOCK_MONOTONIC at the start
+
+	std::thread writer;
+	std::atomic<bool> stopRequest;
+	std::atomic<bool> writeFailed;
+	unsigned long dropped;    // ring full, stream thread only
+	unsigned long written;    // writer thread only, read after StopTelemetry
+} TelemetryRecorder_T;
+
+/*
+ * StartTelemetry: create the log and start the writer thread. On error
+ *                 prints the reason and returns false.
+ */
+bool StartTelemetry(TelemetryRecorder_T *recorder, const char *fileName, long cycleNs, u_byte representation, size_t capacity);
+
+// write what is still queued, stop the writer and close the log
+void StopTelemetry(TelemetryRecorder_T *recorder);
+
+/*
+ * RecordStatus: queue one status on the stream thread. A full ring drops
+ *               the status and counts it, the stream is never held up.
+ *               written: the reply command carrying an I/O write, or NULL.
+ */
+static inline void RecordStatus(TelemetryRecorder_T *recorder, const RobotStatusPacket_T *status, int64_t receiveNs, int32_t replyNs, u_word commandSeqNo,
+	const CommandPacket_T *written)
+{
+	TelemetryEntry_T entry;
+	entry.status = *status;
+	entry.receiveNs = receiveNs;
+	entry.replyNs = replyNs;
+	entry.commandSeqNo = commandSeqNo;
+	entry.writeIOType = (written != NULL) ? written->writeIOType : 0;
+	entry.writeIOIndex = (written != NULL) ? written->writeIOIndex : 0;
+	entry.writeIOMask = (written != NULL) ? written->writeIOMask : 0;
+	entry.writeIOValue = (written != NULL) ? written->writeIOValue : 0;
+	if (!SpscPush(&recorder->ring, &entry)) {
+		recorder->dropped++;
+	}
+}
+
+void WriteTelemetryStats(const TelemetryRecorder_T *recorder, const char *fileName);
+
+/*
+ * LoadTelemetryLog: header and samples of a log. On error prints the reason
+ *                   and returns false.
+ */
+bool LoadTelemetryLog(const char *fileName, TelemetryHeader_T *header, std::vector<TelemetrySample_T> *samples);
+
+// true if the file starts like a telemetry log
+bool IsTelemetryLog(const char *fileName);
@@ -0,0 +1,307 @@
+//
+// ThresholdFetch.cpp : read the vel/acc/jerk threshold tables of several axes
+//                      in one pipelined exchange, and keep them in a cache file
+//
+
+#include "stdafx.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <iostream>
+#include <vector>
+
+#include "ThresholdFetch.h"
+#include "RtUtil.h"
+#include "CacheFile.h"
+
+using namespace std;
+
+const char ThresholdCacheMagic[4] = { 'I', 'T', 'P', 'T' };
+const u_word ThresholdCacheVersion = 1;
+const size_t CacheAddressSize = 64;
+
+typedef struct ThresholdCacheHeader_T {
+	char magic[4];             // "ITPT"
+	u_word version;
+	u_word byteOrder;          // TrajectoryByteOrder layout check, 0x01020304
+	u_word packetCount;        // RobotThresholdPacket_T that follow
+	int64_t savedTime;         // time(NULL) when written
+	uint64_t checksum;         // FNV-1a of the packets
+	char address[CacheAddressSize];
+} ThresholdCacheHeader_T;
+
+// one outstanding table
+typedef struct FetchRequest_T {
+	int axis;                  // 1 based
+	int type;
+	bool done;
+	bool inFlight;
+	int attempts;
+	int64_t deadlineNs;
+} FetchRequest_T;
+
+static const char *ThresholdShortName[ThresholdTypeCount] = { "vel", "acc", "jerk" };
+
+void FetchDefaultConfig(FetchConfig_T *config)
+{
+	config->timeoutNs = 200 * NsPerMs;
+	config->retries = 3;
+	config->window = MaxAxisNumber * ThresholdTypeCount;
+}
+
+void InitThresholdSet(ThresholdSet_T *set)
+{
+	memset(set, 0, sizeof(*set));
+}
+
+bool HaveThresholds(const ThresholdSet_T *set, u_word axisMask)
+{
+	for (int axisIdx = 0; axisIdx < MaxAxisNumber; axisIdx++) {
+		if ((axisMask & (1u << axisIdx)) == 0) {
+			continue;
+		}
+		for (int type = 0; type < ThresholdTypeCount; type++) {
+			if (!set->have[axisIdx][type]) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static bool SendRequest(int socketID, FetchRequest_T *request, const FetchConfig_T *config, int64_t nowNs)
+{
+	ThresholdPacket_T thresholdPacket;
+
+	InitThresholdPacket(&thresholdPacket, request->axis, request->type);
+	if (send(socketID, (char *)&thresholdPacket, sizeof(thresholdPacket), 0) < 0) {
+		cout << "Cannot send threshold request: " << strerror(errno) << endl;
+		return false;
+	}
+	request->inFlight = true;
+	request->attempts++;
+	request->deadlineNs = nowNs + config->timeoutNs;
+	return true;
+}
+
+/*
+ * MatchReply: store a threshold reply in the set if it answers an
+ *             outstanding request. returns the request, NULL if none.
+ */
+static FetchRequest_T *MatchReply(FetchRequest_T *requests, int requestCount, const RobotThresholdPacket_T *reply, ThresholdSet_T *set, int *inFlight)
+{
+	int axis = (int)ntohl(reply->axisNumber);
+	int type = (int)ntohl(reply->thresholdType);
+
+	for (int idx = 0; idx < requestCount; idx++) {
+		FetchRequest_T *request = &requests[idx];
+		if ((request->axis == axis) && (request->type == type) && !request->done) {
+			set->packet[axis - 1][type] = *reply;
+			set->have[axis - 1][type] = true;
+			request->done = true;
+			if (request->inFlight) {   // a timed out one may still answer before its resend
+				request->inFlight = false;
+				(*inFlight)--;
+			}
+			return request;
+		}
+	}
+	return NULL;   // late duplicate of a resent request, or not ours
+}
+
+bool FetchThresholds(int socketID, u_word axisMask, const FetchConfig_T *config, ThresholdSet_T *set, FetchStats_T *stats)
+{
+	FetchRequest_T requests[MaxAxisNumber * ThresholdTypeCount];
+	int requestCount = 0;
+	int64_t startNs = RtNowNs();
+
+	memset(stats, 0, sizeof(*stats));
+	for (int axisIdx = 0; axisIdx < MaxAxisNumber; axisIdx++) {
+		if ((axisMask & (1u << axisIdx)) == 0) {
+			continue;
+		}
+		// jerk, acc, vel: same order the tables were always read in
+		for (int type = ThresholdTypeCount - 1; type >= 0; type--) {
+			FetchRequest_T *request = &requests[requestCount++];
+			memset(request, 0, sizeof(*request));
+			request->axis = axisIdx + 1;
+			request->type = type;
+		}
+	}
+	stats->requested = requestCount;
+
+	int pending = requestCount;    // neither done nor given up
+	int inFlight = 0;
+	bool sendFailed = false;
+	while ((pending > 0) && !sendFailed) {
+		int64_t nowNs = RtNowNs();
+
+		// time outs: resend, or give up on that table
+		for (int idx = 0; idx < requestCount; idx++) {
+			FetchRequest_T *request = &requests[idx];
+			if (request->inFlight && (nowNs >= request->deadlineNs)) {
+				request->inFlight = false;
+				inFlight--;
+				if (request->attempts > config->retries) {
+					request->done = true;
+					pending--;
+					stats->givenUp++;
+				}
+			}
+		}
+
+		// keep the window full; requests that timed out go again first in order
+		for (int idx = 0; (idx < requestCount) && (inFlight < config->window); idx++) {
+			FetchRequest_T *request = &requests[idx];
+			if (!request->done && !request->inFlight) {
+				if (request->attempts > 0) {
+					stats->resent++;
+				}
+				if (!SendRequest(socketID, request, config, nowNs)) {
+					sendFailed = true;
+					break;
+				}
+				inFlight++;
+			}
+		}
+		if ((pending == 0) || sendFailed) {
+			break;
+		}
+
+		// wait for a reply until the earliest deadline
+		int64_t deadlineNs = INT64_MAX;
+		for (int idx = 0; idx < requestCount; idx++) {
+			if (requests[idx].inFlight && (requests[idx].deadlineNs < deadlineNs)) {
+				deadlineNs = requests[idx].deadlineNs;
+			}
+		}
+		struct pollfd pfd;
+		pfd.fd = socketID;
+		pfd.events = POLLIN;
+		int64_t waitNs = (deadlineNs > nowNs) ? deadlineNs - nowNs : 0;
+		struct timespec timeout;
+		timeout.tv_sec = waitNs / NsPerSec;
+		timeout.tv_nsec = waitNs % NsPerSec;
+		if (ppoll(&pfd, 1, &timeout, NULL) <= 0) {
+			continue;
+		}
+
+		// drain the socket: status packets are skipped, threshold replies matched
+		RobotThresholdPacket_T reply;
+		int receiveSize;
+		while ((receiveSize = recv(socketID, (char *)&reply, sizeof(reply), MSG_DONTWAIT)) > 0) {
+			if ((receiveSize != sizeof(reply)) || (ntohl(reply.packetType) != 3)) {
+				continue;
+			}
+			if (MatchReply(requests, requestCount, &reply, set, &inFlight) != NULL) {
+				stats->received++;
+				pending--;
+			}
+		}
+	}
+
+	stats->elapsedNs = RtNowNs() - startNs;
+	for (int idx = 0; idx < requestCount; idx++) {
+		if (!set->have[requests[idx].axis - 1][requests[idx].type]) {
+			printf("no %s threshold reply for axis %d after %d attempts\n", ThresholdShortName[requests[idx].type], requests[idx].axis, requests[idx].attempts);
+		}
+	}
+	return stats->received == stats->requested;
+}
+
+void SetThresholdLimits(const ThresholdSet_T *set, AxisLimits_T limits[MaxAxisNumber], bool fullPayload)
+{
+	InitAxisLimits(limits);
+	for (int axisIdx = 0; axisIdx < MaxAxisNumber; axisIdx++) {
+		if (HaveThresholds(set, 1u << axisIdx)) {
+			SetAxisLimits(&limits[axisIdx], &set->packet[axisIdx][ThresholdVelocity],
+				&set->packet[axisIdx][ThresholdAcceleration], &set->packet[axisIdx][ThresholdJerk], fullPayload);
+		}
+	}
+}
+
+static uint64_t CacheChecksum(const RobotThresholdPacket_T *packets, int count)
+{
+	return CacheHash(packets, count * sizeof(RobotThresholdPacket_T));
+}
+
+bool ThresholdCachePath(const char *robotAddress, char *path, size_t pathSize)
+{
+	char dir[512];
+
+	if (!CacheDirectory(NULL, dir, sizeof(dir))) {
+		return false;
+	}
+	return snprintf(path, pathSize, "%s/thresholds-%s.bin", dir, robotAddress) < (int)pathSize;
+}
+
+bool LoadThresholdCache(const char *path, const char *robotAddress, ThresholdSet_T *set, time_t *savedTime)
+{
+	ThresholdCacheHeader_T header;
+	RobotThresholdPacket_T packets[MaxAxisNumber * ThresholdTypeCount];
+	FILE *cacheFile = fopen(path, "rb");
+
+	InitThresholdSet(set);
+	if (cacheFile == NULL) {
+		return false;
+	}
+	bool ok = (fread(&header, sizeof(header), 1, cacheFile) == 1)
+		&& (memcmp(header.magic, ThresholdCacheMagic, sizeof(header.magic)) == 0)
+		&& (header.version == ThresholdCacheVersion)
+		&& (header.byteOrder == 0x01020304)
+		&& (header.packetCount <= MaxAxisNumber * ThresholdTypeCount)
+		&& (strncmp(header.address, robotAddress, CacheAddressSize) == 0)
+		&& (fread(packets, sizeof(RobotThresholdPacket_T), header.packetCount, cacheFile) == header.packetCount)
+		&& (CacheChecksum(packets, header.packetCount) == header.checksum);
+	fclose(cacheFile);
+	if (!ok) {
+		cout << "Ignoring threshold cache " << path << ": not readable or not for " << robotAddress << endl;
+		return false;
+	}
+
+	for (u_word idx = 0; idx < header.packetCount; idx++) {
+		u_word axis = ntohl(packets[idx].axisNumber);
+		u_word type = ntohl(packets[idx].thresholdType);
+		if ((axis >= 1) && (axis <= (u_word)MaxAxisNumber) && (type < (u_word)ThresholdTypeCount)) {
+			set->packet[axis - 1][type] = packets[idx];
+			set->have[axis - 1][type] = true;
+		}
+	}
+	if (savedTime != NULL) {
+		*savedTime = (time_t)header.savedTime;
+	}
+	return true;
+}
+
+bool SaveThresholdCache(const char *path, const char *robotAddress, const ThresholdSet_T *set)
+{
+	ThresholdCacheHeader_T header;
+	RobotThresholdPacket_T packets[MaxAxisNumber * ThresholdTypeCount];
+	u_word count = 0;
+
+	for (int axisIdx = 0; axisIdx < MaxAxisNumber; axisIdx++) {
+		for (int type = 0; type < ThresholdTypeCount; type++) {
+			if (set->have[axisIdx][type]) {
+				packets[count++] = set->packet[axisIdx][type];
+			}
+		}
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, ThresholdCacheMagic, sizeof(header.magic));
+	header.version = ThresholdCacheVersion;
+	header.byteOrder = 0x01020304;
+	header.packetCount = count;
+	header.savedTime = (int64_t)time(NULL);
+	header.checksum = CacheChecksum(packets, count);
+	strncpy(header.address, robotAddress, CacheAddressSize - 1);
+
+	vector<char> image(sizeof(header) + count * sizeof(RobotThresholdPacket_T));
+	memcpy(image.data(), &header, sizeof(header));
+	memcpy(image.data() + sizeof(header), packets, count * sizeof(RobotThresholdPacket_T));
+	return WriteCacheFile(path, image.data(), image.size());
+}
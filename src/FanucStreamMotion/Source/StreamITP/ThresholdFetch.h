@@ -0,0 +1,70 @@
+//
+// ThresholdFetch.h : read the vel/acc/jerk threshold tables of several axes
+//                    in one pipelined exchange, and keep them in a cache file
+//
+// Requests are sent up to FetchConfig_T.window at a time without waiting for
+// the replies in between. Replies are matched to their request by axis number
+// and threshold type, whatever order they arrive in; status packets that
+// arrive meanwhile are skipped. A request without a reply within timeoutNs is
+// sent again, up to retries times, after which that table is given up on
+// (axes the robot does not have are never answered by some controllers).
+//
+// The cache file holds the reply packets as received, keyed by the controller
+// address, so a later run against the same controller needs no query.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+#include "J519Packet.h"
+#include "LimitCheck.h"
+
+const u_word AllThresholdAxes = (1u << MaxAxisNumber) - 1;   // axis mask, bit 0 = axis 1
+
+typedef struct FetchConfig_T {
+	long timeoutNs;       // per request attempt
+	int retries;          // resends after the first attempt
+	int window;           // requests in flight at once
+} FetchConfig_T;
+
+typedef struct ThresholdSet_T {
+	bool have[MaxAxisNumber][ThresholdTypeCount];
+	RobotThresholdPacket_T packet[MaxAxisNumber][ThresholdTypeCount];   // network order, as received
+} ThresholdSet_T;
+
+typedef struct FetchStats_T {
+	int requested;
+	int received;
+	int resent;
+	int givenUp;
+	int64_t elapsedNs;
+} FetchStats_T;
+
+void FetchDefaultConfig(FetchConfig_T *config);
+void InitThresholdSet(ThresholdSet_T *set);
+
+// true if all three tables of every axis in axisMask are present
+bool HaveThresholds(const ThresholdSet_T *set, u_word axisMask);
+
+/*
+ * FetchThresholds: request every table of the axes in axisMask over the
+ *                  connected socket (start packet already sent). returns
+ *                  true if all of them arrived.
+ */
+bool FetchThresholds(int socketID, u_word axisMask, const FetchConfig_T *config, ThresholdSet_T *set, FetchStats_T *stats);
+
+/*
+ * SetThresholdLimits: decode every complete axis of the set into limits.
+ */
+void SetThresholdLimits(const ThresholdSet_T *set, AxisLimits_T limits[MaxAxisNumber], bool fullPayload);
+
+/*
+ * ThresholdCachePath: $XDG_CACHE_HOME/StreamITP (or ~/.cache/StreamITP)
+ *                     /thresholds-<address>.bin, directory created if needed.
+ */
+bool ThresholdCachePath(const char *robotAddress, char *path, size_t pathSize);
+
+// savedTime may be NULL
+bool LoadThresholdCache(const char *path, const char *robotAddress, ThresholdSet_T *set, time_t *savedTime);
+bool SaveThresholdCache(const char *path, const char *robotAddress, const ThresholdSet_T *set);
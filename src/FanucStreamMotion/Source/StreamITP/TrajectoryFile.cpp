@@ -0,0 +1,547 @@
+//
+// TrajectoryFile.cpp : load ITP level trajectory files
+//
+
+#include "stdafx.h"
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <charconv>
+#include <iostream>
+
+#include "TrajectoryFile.h"
+
+using namespace std;
+
+static bool IsBlank(char c)
+{
+	return (c == ' ') || (c == '\t');
+}
+
+static void ParseError(const char *fileName, size_t lineNo, size_t column, const char *reason)
+{
+	printf("%s:%zu:%zu: %s\n", fileName, lineNo, column, reason);
+}
+
+/*
+ * DetectDelimiter: tab or comma if the line has one, space otherwise
+ */
+static char DetectDelimiter(const char *begin, const char *end)
+{
+	if (memchr(begin, '\t', end - begin) != NULL) {
+		return '\t';
+	}
+	if (memchr(begin, ',', end - begin) != NULL) {
+		return ',';
+	}
+	return ' ';
+}
+
+/*
+ * ParseLine: parse up to MaxAxisNumber values of one line into posData.
+ *            returns the number of values, -1 on a syntax error (*errorAt set).
+ */
+static int ParseLine(const char *begin, const char *end, char delimiter, PositionData_T *posData, const char **errorAt)
+{
+	const char *p = begin;
+	int count = 0;
+
+	while (true) {
+		while ((p < end) && IsBlank(*p) && (*p != delimiter || delimiter == ' ')) {
+			p++;
+		}
+		if (count == MaxAxisNumber) {
+			*errorAt = p;
+			return -1;
+		}
+		if ((p < end) && (*p == '+')) {
+			p++;
+		}
+		float value;
+		from_chars_result result = from_chars(p, end, value);
+		if (result.ec != errc()) {
+			*errorAt = p;
+			return -1;
+		}
+		posData->data[count++] = value;
+		p = result.ptr;
+
+		if (delimiter != ' ') {
+			while ((p < end) && IsBlank(*p) && (*p != delimiter)) {
+				p++;
+			}
+		}
+		if (p == end) {
+			return count;
+		}
+		if (*p != delimiter) {
+			*errorAt = p;
+			return -1;
+		}
+		p++;
+		if (delimiter == ' ') {
+			// runs of spaces (or trailing spaces) are one delimiter
+			while ((p < end) && IsBlank(*p)) {
+				p++;
+			}
+			if (p == end) {
+				return count;
+			}
+		}
+	}
+}
+
+void InitTrajectory(Trajectory_T *trajectory)
+{
+	trajectory->positions.clear();
+	trajectory->samples = NULL;
+	trajectory->sampleCount = 0;
+	trajectory->axisCount = 0;
+	trajectory->delimiter = '\t';
+	trajectory->representation = RepresentationUnknown;
+	trajectory->cycleNs = 0;
+	trajectory->mapping = NULL;
+	trajectory->mappingSize = 0;
+}
+
+void FreeTrajectory(Trajectory_T *trajectory)
+{
+	if (trajectory->mapping != NULL) {
+		munmap(trajectory->mapping, trajectory->mappingSize);
+	}
+	InitTrajectory(trajectory);
+	trajectory->positions.shrink_to_fit();
+}
+
+/*
+ * TrajectoryChecksum: FNV-1a over the 32-bit words of the sample array
+ */
+uint64_t TrajectoryChecksumUpdate(uint64_t hash, const PositionData_T *samples, size_t sampleCount)
+{
+	const uint32_t *word = (const uint32_t *)samples;
+	size_t wordCount = sampleCount * (sizeof(PositionData_T) / sizeof(uint32_t));
+
+	for (size_t idx = 0; idx < wordCount; idx++) {
+		hash ^= word[idx];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+uint64_t TrajectoryChecksum(const PositionData_T *samples, size_t sampleCount)
+{
+	return TrajectoryChecksumUpdate(TrajectoryChecksumBasis, samples, sampleCount);
+}
+
+static bool IsBinaryTrajectory(const char *data, size_t fileSize)
+{
+	return (fileSize >= sizeof(TrajectoryHeader_T)) && (memcmp(data, TrajectoryMagic, sizeof(TrajectoryMagic)) == 0);
+}
+
+/*
+ * CheckTrajectoryHeader: validate a binary header against the file size
+ */
+static bool CheckTrajectoryHeader(const char *fileName, const TrajectoryHeader_T *header, size_t fileSize)
+{
+	if (header->byteOrder != TrajectoryByteOrder) {
+		cout << fileName << ": binary trajectory was written with a different byte order" << endl;
+		return false;
+	}
+	if (header->version != TrajectoryVersion) {
+		cout << fileName << ": unsupported binary trajectory version " << header->version << endl;
+		return false;
+	}
+	if ((header->sampleStride != MaxAxisNumber) || (header->headerSize < sizeof(*header)) || (header->headerSize % sizeof(float) != 0) ||
+		((header->axisCount != MaxAxisNumber) && (header->axisCount != MinAxisNumber)) ||
+		((header->representation != (u_word)RepresentationCartesian) && (header->representation != (u_word)RepresentationJoint))) {
+		cout << fileName << ": corrupt binary trajectory header" << endl;
+		return false;
+	}
+	if ((header->sampleCount == 0) || (header->headerSize > fileSize) ||
+		(header->sampleCount > (fileSize - header->headerSize) / sizeof(PositionData_T)) ||
+		(header->headerSize + header->sampleCount * sizeof(PositionData_T) != fileSize)) {
+		cout << fileName << ": binary trajectory size does not match its header" << endl;
+		return false;
+	}
+	return true;
+}
+
+/*
+ * MapBinaryTrajectory: check the header and point the trajectory at the mapped samples
+ */
+static bool MapBinaryTrajectory(const char *fileName, const char *data, size_t fileSize, Trajectory_T *trajectory)
+{
+	TrajectoryHeader_T header;
+	memcpy(&header, data, sizeof(header));
+
+	if (!CheckTrajectoryHeader(fileName, &header, fileSize)) {
+		return false;
+	}
+
+	const PositionData_T *samples = (const PositionData_T *)(data + header.headerSize);
+	if (TrajectoryChecksum(samples, header.sampleCount) != header.checksum) {
+		cout << fileName << ": binary trajectory checksum mismatch" << endl;
+		return false;
+	}
+
+	trajectory->samples = samples;
+	trajectory->sampleCount = header.sampleCount;
+	trajectory->axisCount = header.axisCount;
+	trajectory->representation = header.representation;
+	trajectory->cycleNs = (long)header.cycleUs * 1000L;
+	return true;
+}
+
+/*
+ * ParseTextLine: parse one line [p, lineEnd) of a text trajectory. The first
+ *                data line sets the delimiter and axis count.
+ *                returns 1 for a sample, 0 for a blank line, -1 on error.
+ */
+static int ParseTextLine(const char *fileName, size_t lineNo, const char *p, const char *lineEnd,
+	                     int *axisCount, char *delimiter, PositionData_T *posData)
+{
+	const char *end = lineEnd;
+	if ((end > p) && (end[-1] == '\r')) {
+		end--;
+	}
+
+	const char *first = p;
+	while ((first < end) && IsBlank(*first)) {
+		first++;
+	}
+	if (first == end) {
+		return 0;
+	}
+	if (*axisCount == 0) {
+		*delimiter = DetectDelimiter(first, end);
+	}
+
+	const char *errorAt;
+	int count = ParseLine(p, end, *delimiter, posData, &errorAt);
+	if (count < 0) {
+		ParseError(fileName, lineNo, errorAt - p + 1, "invalid number or delimiter");
+		return -1;
+	}
+	if (*axisCount == 0) {
+		if ((count != MaxAxisNumber) && (count != MinAxisNumber)) {
+			ParseError(fileName, lineNo, 1, "Invalid data count, need 6 or 9 values per line");
+			return -1;
+		}
+		*axisCount = count;
+	}
+	else if (count != *axisCount) {
+		ParseError(fileName, lineNo, end - p + 1, "data count differs from the first line");
+		return -1;
+	}
+	return 1;
+}
+
+/*
+ * ParseTextTrajectory: one pass over the mapped text file
+ */
+static bool ParseTextTrajectory(const char *fileName, const char *data, size_t fileSize, Trajectory_T *trajectory)
+{
+	const char *p = data;
+	const char *fileEnd = data + fileSize;
+	size_t lineNo = 0;
+	int result = 0;
+	PositionData_T posData;
+	memset(&posData, 0, sizeof(posData));
+
+	while ((p < fileEnd) && (result >= 0)) {
+		const char *lineEnd = (const char *)memchr(p, '\n', fileEnd - p);
+		if (lineEnd == NULL) {
+			lineEnd = fileEnd;
+		}
+		lineNo++;
+
+		result = ParseTextLine(fileName, lineNo, p, lineEnd, &trajectory->axisCount, &trajectory->delimiter, &posData);
+		if (result > 0) {
+			if (trajectory->positions.capacity() == 0) {
+				// one line per sample: size the array from the first sample line,
+				// no line being shorter than the shortest a sample can have
+				size_t lineBytes = max((size_t)(lineEnd - p + 1), (size_t)(2 * trajectory->axisCount));
+				trajectory->positions.reserve(fileSize / lineBytes + 16);
+			}
+			trajectory->positions.push_back(posData);
+		}
+		p = lineEnd + 1;
+	}
+
+	if ((result >= 0) && trajectory->positions.empty()) {
+		cout << "No position data in file: " << fileName << endl;
+		result = -1;
+	}
+	if (result < 0) {
+		trajectory->positions.clear();
+		return false;
+	}
+	trajectory->samples = trajectory->positions.data();
+	trajectory->sampleCount = trajectory->positions.size();
+	return true;
+}
+
+bool LoadTrajectoryFile(const char *fileName, Trajectory_T *trajectory)
+{
+	FreeTrajectory(trajectory);
+
+	int fd = open(fileName, O_RDONLY);
+	if (fd < 0) {
+		cout << "Unable to open file: " << fileName << endl;
+		return false;
+	}
+	struct stat fileStat;
+	if ((fstat(fd, &fileStat) != 0) || (fileStat.st_size == 0)) {
+		cout << "Empty data file: " << fileName << endl;
+		close(fd);
+		return false;
+	}
+	size_t fileSize = fileStat.st_size;
+	char *data = (char *)mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		cout << "Unable to map file: " << fileName << " (" << strerror(errno) << ")" << endl;
+		return false;
+	}
+
+	cout << "reading file: " << fileName << endl;
+
+	if (IsBinaryTrajectory(data, fileSize)) {
+		// the mapping stays: it is the sample array
+		if (!MapBinaryTrajectory(fileName, data, fileSize, trajectory)) {
+			munmap(data, fileSize);
+			return false;
+		}
+		trajectory->mapping = data;
+		trajectory->mappingSize = fileSize;
+		return true;
+	}
+
+	madvise(data, fileSize, MADV_SEQUENTIAL);
+	bool ok = ParseTextTrajectory(fileName, data, fileSize, trajectory);
+	munmap(data, fileSize);
+	return ok;
+}
+
+bool SaveTrajectoryBinary(const char *fileName, const Trajectory_T *trajectory, int representation, long cycleNs)
+{
+	TrajectoryHeader_T header;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TrajectoryMagic, sizeof(header.magic));
+	header.version = TrajectoryVersion;
+	header.headerSize = sizeof(header);
+	header.byteOrder = TrajectoryByteOrder;
+	header.sampleCount = trajectory->sampleCount;
+	header.checksum = TrajectoryChecksum(trajectory->samples, trajectory->sampleCount);
+	header.axisCount = trajectory->axisCount;
+	header.representation = representation;
+	header.cycleUs = (u_word)(cycleNs / 1000L);
+	header.sampleStride = MaxAxisNumber;
+
+	FILE *outFile = fopen(fileName, "wb");
+	if (outFile == NULL) {
+		cout << "Unable to create file: " << fileName << endl;
+		return false;
+	}
+	bool ok = (fwrite(&header, sizeof(header), 1, outFile) == 1) &&
+		(fwrite(trajectory->samples, sizeof(PositionData_T), trajectory->sampleCount, outFile) == trajectory->sampleCount);
+	if (fclose(outFile) != 0) {
+		ok = false;
+	}
+	if (!ok) {
+		cout << "Unable to write file: " << fileName << endl;
+	}
+	return ok;
+}
+
+bool IsBinaryTrajectoryName(const char *fileName)
+{
+	size_t length = strlen(fileName);
+	return (length > 5) && (strcmp(fileName + length - 5, ".itpb") == 0);
+}
+
+bool SaveTrajectoryText(const char *fileName, const Trajectory_T *trajectory)
+{
+	FILE *outFile = fopen(fileName, "w");
+	if (outFile == NULL) {
+		cout << "Unable to create file: " << fileName << endl;
+		return false;
+	}
+
+	char line[MaxAxisNumber * 32];
+	bool ok = true;
+	for (size_t sampleIdx = 0; (sampleIdx < trajectory->sampleCount) && ok; sampleIdx++) {
+		char *p = line;
+		for (int idx = 0; idx < trajectory->axisCount; idx++) {
+			if (idx > 0) {
+				*p++ = '\t';
+			}
+			p = to_chars(p, line + sizeof(line) - 1, trajectory->samples[sampleIdx].data[idx]).ptr;
+		}
+		*p++ = '\n';
+		ok = (fwrite(line, 1, p - line, outFile) == (size_t)(p - line));
+	}
+	if (fclose(outFile) != 0) {
+		ok = false;
+	}
+	if (!ok) {
+		cout << "Unable to write file: " << fileName << endl;
+	}
+	return ok;
+}
+
+/* ------------------------------------------------------------------
+ * Incremental reader: constant memory, samples come out while the
+ * rest of the file is still on disk.
+ -------------------------------------------------------------------- */
+bool OpenTrajectoryReader(TrajectoryReader_T *reader, const char *fileName)
+{
+	memset(reader, 0, sizeof(*reader));
+	reader->fileName = fileName;
+	reader->representation = RepresentationUnknown;
+	reader->delimiter = '\t';
+
+	reader->fd = open(fileName, O_RDONLY);
+	if (reader->fd < 0) {
+		cout << "Unable to open file: " << fileName << endl;
+		return false;
+	}
+	struct stat fileStat;
+	if ((fstat(reader->fd, &fileStat) != 0) || (fileStat.st_size == 0)) {
+		cout << "Empty data file: " << fileName << endl;
+		CloseTrajectoryReader(reader);
+		return false;
+	}
+	posix_fadvise(reader->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	reader->buffer = (char *)malloc(TrajectoryReadBufferSize);
+	if (reader->buffer == NULL) {
+		CloseTrajectoryReader(reader);
+		return false;
+	}
+
+	TrajectoryHeader_T header;
+	ssize_t headerSize = pread(reader->fd, &header, sizeof(header), 0);
+	if ((headerSize == sizeof(header)) && (memcmp(header.magic, TrajectoryMagic, sizeof(TrajectoryMagic)) == 0)) {
+		if (!CheckTrajectoryHeader(fileName, &header, fileStat.st_size)) {
+			CloseTrajectoryReader(reader);
+			return false;
+		}
+		reader->binary = true;
+		reader->axisCount = header.axisCount;
+		reader->representation = header.representation;
+		reader->cycleNs = (long)header.cycleUs * 1000L;
+		reader->remaining = header.sampleCount;
+		reader->expectedChecksum = header.checksum;
+		reader->checksum = TrajectoryChecksumBasis;
+		lseek(reader->fd, header.headerSize, SEEK_SET);
+	}
+	cout << "streaming file: " << fileName << endl;
+	return true;
+}
+
+static int ReadBinarySamples(TrajectoryReader_T *reader, PositionData_T *samples, int maxCount)
+{
+	if (reader->remaining == 0) {
+		if (reader->checksum != reader->expectedChecksum) {
+			cout << reader->fileName << ": binary trajectory checksum mismatch" << endl;
+			return -1;
+		}
+		return 0;
+	}
+
+	size_t count = ((uint64_t)maxCount < reader->remaining) ? maxCount : reader->remaining;
+	size_t want = count * sizeof(PositionData_T);
+	size_t got = 0;
+	while (got < want) {
+		ssize_t readSize = read(reader->fd, (char *)samples + got, want - got);
+		if (readSize <= 0) {
+			cout << reader->fileName << ": binary trajectory ends early" << endl;
+			return -1;
+		}
+		got += readSize;
+	}
+	reader->checksum = TrajectoryChecksumUpdate(reader->checksum, samples, count);
+	reader->remaining -= count;
+	return (int)count;
+}
+
+static int ReadTextSamples(TrajectoryReader_T *reader, PositionData_T *samples, int maxCount)
+{
+	int count = 0;
+
+	while (count < maxCount) {
+		char *lineStart = reader->buffer + reader->begin;
+		char *lineEnd = (char *)memchr(lineStart, '\n', reader->end - reader->begin);
+
+		if (lineEnd == NULL) {
+			if (reader->eof) {
+				if (reader->begin == reader->end) {
+					break;
+				}
+				lineEnd = reader->buffer + reader->end;   // last line without a newline
+			}
+			else {
+				// keep the partial line and refill behind it
+				if ((reader->begin == 0) && (reader->end == TrajectoryReadBufferSize)) {
+					ParseError(reader->fileName, reader->lineNo + 1, 1, "line too long");
+					return -1;
+				}
+				memmove(reader->buffer, lineStart, reader->end - reader->begin);
+				reader->end -= reader->begin;
+				reader->begin = 0;
+				ssize_t readSize = read(reader->fd, reader->buffer + reader->end, TrajectoryReadBufferSize - reader->end);
+				if (readSize < 0) {
+					cout << "Unable to read file: " << reader->fileName << endl;
+					return -1;
+				}
+				if (readSize == 0) {
+					reader->eof = true;
+				}
+				reader->end += readSize;
+				continue;
+			}
+		}
+
+		reader->lineNo++;
+		int result = ParseTextLine(reader->fileName, reader->lineNo, lineStart, lineEnd, &reader->axisCount, &reader->delimiter, &samples[count]);
+		if (result < 0) {
+			return -1;
+		}
+		count += result;
+		reader->begin = (lineEnd - reader->buffer) + ((lineEnd < reader->buffer + reader->end) ? 1 : 0);
+	}
+
+	if ((count == 0) && (reader->samplesRead == 0)) {
+		cout << "No position data in file: " << reader->fileName << endl;
+		return -1;
+	}
+	return count;
+}
+
+int ReadTrajectorySamples(TrajectoryReader_T *reader, PositionData_T *samples, int maxCount)
+{
+	// unused axes of a 6 axis file stay 0.0
+	memset(samples, 0, maxCount * sizeof(PositionData_T));
+
+	int count = reader->binary ? ReadBinarySamples(reader, samples, maxCount) : ReadTextSamples(reader, samples, maxCount);
+	if (count > 0) {
+		reader->samplesRead += count;
+	}
+	return count;
+}
+
+void CloseTrajectoryReader(TrajectoryReader_T *reader)
+{
+	if (reader->fd >= 0) {
+		close(reader->fd);
+	}
+	free(reader->buffer);
+	reader->fd = -1;
+	reader->buffer = NULL;
+}
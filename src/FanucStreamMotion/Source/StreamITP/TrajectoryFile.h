@@ -0,0 +1,122 @@
+//
+// TrajectoryFile.h : load ITP level trajectory files
+//
+// Text data file: each line has either 6 or 9 position data, separated by
+// tabs, spaces or commas. The delimiter is taken from the first data line
+// and must be the same on every line; blank lines are ignored.
+//
+// Binary data file (.itpb): a 64 byte header followed by the samples as
+// PositionData_T, 9 host order float32 per sample whatever the axis count,
+// so the mapped file is used as the sample array without any parsing.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+#include "J519Packet.h"
+
+const char TrajectoryMagic[4] = { 'I', 'T', 'P', 'B' };
+const u_word TrajectoryVersion = 1;
+const u_word TrajectoryByteOrder = 0x01020304;   // reads back swapped on a big endian host
+
+const int RepresentationCartesian = 0;   // same values as CommandPacket_T.dataStyle
+const int RepresentationJoint = 1;
+const int RepresentationUnknown = -1;
+
+typedef struct TrajectoryHeader_T {
+	char magic[4];            // "ITPB"
+	u_word version;
+	u_word headerSize;        // offset of the sample array
+	u_word byteOrder;         // TrajectoryByteOrder
+	uint64_t sampleCount;
+	uint64_t checksum;        // TrajectoryChecksum of the sample array
+	u_word axisCount;         // meaningful values per sample, 6 or 9
+	u_word representation;    // RepresentationCartesian / RepresentationJoint
+	u_word cycleUs;           // ITP cycle the samples were made for, 0 = not known
+	u_word sampleStride;      // floats per sample, MaxAxisNumber
+	u_word reserved[4];
+} TrajectoryHeader_T;
+
+static_assert(sizeof(TrajectoryHeader_T) == 64, "TrajectoryHeader_T is 64 bytes on disk");
+
+typedef struct Trajectory_T {
+	std::vector<PositionData_T> positions;   // text files are parsed into here, unused axes are 0.0
+	const PositionData_T *samples;           // positions.data() or the mapped binary file
+	size_t sampleCount;
+	int axisCount;                           // values per line, 6 or 9
+	char delimiter;                          // '\t', ' ' or ',' (text files)
+	int representation;                      // from the binary header, RepresentationUnknown for text
+	long cycleNs;                            // from the binary header, 0 if not known
+
+	void *mapping;                           // binary file mapping, released by FreeTrajectory
+	size_t mappingSize;
+} Trajectory_T;
+
+void InitTrajectory(Trajectory_T *trajectory);
+void FreeTrajectory(Trajectory_T *trajectory);
+
+/*
+ * LoadTrajectoryFile: load a binary (.itpb) or text trajectory file.
+ *                     Text files are memory mapped and parsed in one pass.
+ *                     On error prints "file:line:column: reason" and returns false.
+ */
+bool LoadTrajectoryFile(const char *fileName, Trajectory_T *trajectory);
+
+/*
+ * SaveTrajectoryBinary: write the samples as a binary trajectory file.
+ */
+bool SaveTrajectoryBinary(const char *fileName, const Trajectory_T *trajectory, int representation, long cycleNs);
+
+// a .itpb file name: the tools write binary there, text anywhere else
+bool IsBinaryTrajectoryName(const char *fileName);
+
+/*
+ * SaveTrajectoryText: write axisCount tab separated values per line, shortest
+ *                     round-trip float formatting.
+ */
+bool SaveTrajectoryText(const char *fileName, const Trajectory_T *trajectory);
+
+const uint64_t TrajectoryChecksumBasis = 14695981039346656037ULL;
+
+uint64_t TrajectoryChecksum(const PositionData_T *samples, size_t sampleCount);
+uint64_t TrajectoryChecksumUpdate(uint64_t hash, const PositionData_T *samples, size_t sampleCount);
+
+/*
+ * TrajectoryReader: read a text or binary trajectory a block at a time with
+ *                   a fixed size buffer, for paths too long to hold in memory.
+ *                   A binary file's checksum is checked when its end is read.
+ */
+const size_t TrajectoryReadBufferSize = 256 * 1024;
+
+typedef struct TrajectoryReader_T {
+	const char *fileName;
+	int fd;
+	bool binary;
+	int axisCount;            // 0 until the first text line is read
+	char delimiter;
+	int representation;
+	long cycleNs;
+	size_t samplesRead;
+
+	// text file
+	char *buffer;
+	size_t begin;             // unparsed bytes are buffer[begin, end)
+	size_t end;
+	bool eof;
+	size_t lineNo;
+
+	// binary file
+	uint64_t remaining;
+	uint64_t checksum;
+	uint64_t expectedChecksum;
+} TrajectoryReader_T;
+
+bool OpenTrajectoryReader(TrajectoryReader_T *reader, const char *fileName);
+
+/*
+ * ReadTrajectorySamples: returns the number of samples read, 0 at the end
+ *                        of the file, -1 on error (already reported).
+ */
+int ReadTrajectorySamples(TrajectoryReader_T *reader, PositionData_T *samples, int maxCount);
+void CloseTrajectoryReader(TrajectoryReader_T *reader);
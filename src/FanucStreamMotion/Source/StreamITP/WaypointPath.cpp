@@ -0,0 +1,269 @@
+//
+// WaypointPath.cpp : ITP rate samples generated online from sparse waypoints
+//
+
+#include "stdafx.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+
+#include "WaypointPath.h"
+
+using namespace std;
+
+void InitWaypointLimits(WaypointLimits_T *limits, double velocity, double acceleration, double jerk)
+{
+	for (int axisIdx = 0; axisIdx < MaxAxisNumber; axisIdx++) {
+		limits->velocity[axisIdx] = velocity;
+		limits->acceleration[axisIdx] = acceleration;
+		limits->jerk[axisIdx] = jerk;
+	}
+}
+
+static void CapLimit(double *limit, double threshold)
+{
+	if ((threshold > 0.0) && ((*limit <= 0.0) || (threshold < *limit))) {
+		*limit = threshold;
+	}
+}
+
+void CapWaypointLimits(WaypointLimits_T *limits, const AxisLimits_T axisLimits[MaxAxisNumber], double scale)
+{
+	for (int axisIdx = 0; axisIdx < MaxAxisNumber; axisIdx++) {
+		const AxisLimits_T *axis = &axisLimits[axisIdx];
+		if (!axis->valid) {
+			continue;
+		}
+		CapLimit(&limits->velocity[axisIdx], scale * LowestLimit(&axis->table[ThresholdVelocity], HUGE_VAL));
+		double topSpeed = (limits->velocity[axisIdx] > 0.0) ? limits->velocity[axisIdx] : HUGE_VAL;
+		CapLimit(&limits->acceleration[axisIdx], scale * LowestLimit(&axis->table[ThresholdAcceleration], topSpeed));
+		CapLimit(&limits->jerk[axisIdx], scale * LowestLimit(&axis->table[ThresholdJerk], topSpeed));
+	}
+}
+
+/*
+ * BlendTime: length of the blend changing the axis speeds by change[], and
+ *            the share of each end of it spent at constant jerk. The axis
+ *            that needs the longest blend gets its time optimal ramp; the
+ *            others follow the same shape, stretched if it is too steep
+ *            for them.
+ */
+static double BlendTime(const double change[MaxAxisNumber], int axisCount, const WaypointLimits_T *limits, double *ramp)
+{
+	double blend = 0.0;
+
+	*ramp = 0.5;
+	for (int axisIdx = 0; axisIdx < axisCount; axisIdx++) {
+		double dv = fabs(change[axisIdx]);
+		if (dv == 0.0) {
+			continue;
+		}
+		double acc = limits->acceleration[axisIdx];
+		double jerk = limits->jerk[axisIdx];
+		// triangular acceleration if the jerk limit is reached first, else trapezoidal
+		double time = (dv * jerk <= acc * acc) ? 2.0 * sqrt(dv / jerk) : dv / acc + acc / jerk;
+		if (time > blend) {
+			blend = time;
+			*ramp = (dv * jerk <= acc * acc) ? 0.5 : (acc / jerk) / time;
+		}
+	}
+	// the shape's peak acceleration is dv / ((1 - ramp) blend), its jerk dv / (ramp (1 - ramp) blend^2)
+	for (int axisIdx = 0; axisIdx < axisCount; axisIdx++) {
+		double dv = fabs(change[axisIdx]);
+		if (dv == 0.0) {
+			continue;
+		}
+		blend = max(blend, dv / ((1.0 - *ramp) * limits->acceleration[axisIdx]));
+		blend = max(blend, sqrt(dv / (*ramp * (1.0 - *ramp) * limits->jerk[axisIdx])));
+	}
+	return blend;
+}
+
+/*
+ * RampIntegral: integral from 0 to u of the blend's speed ramp (0 -> 1
+ *               over u = 0 .. 1), which is symmetric: ramp(1 - u) = 1 - ramp(u)
+ */
+static double RampIntegral(double u, double ramp)
+{
+	if (u > 0.5) {
+		return u - 0.5 + RampIntegral(1.0 - u, ramp);
+	}
+	double peak = 1.0 / (1.0 - ramp);   // acceleration of the held part
+	if (u <= ramp) {
+		return peak * u * u * u / (6.0 * ramp);
+	}
+	double held = u - ramp;
+	return peak * ramp * ramp / 6.0 + peak * ramp / 2.0 * held + peak * held * held / 2.0;
+}
+
+static const double *LineVelocity(const WaypointPath_T *path, size_t line)
+{
+	static const double atRest[MaxAxisNumber] = { 0.0 };
+
+	// before the first waypoint and after the last one the robot is at rest
+	return (line < path->points.size() - 1) ? &path->velocity[line * MaxAxisNumber] : atRest;
+}
+
+static void SetBlends(WaypointPath_T *path, const WaypointLimits_T *limits)
+{
+	for (size_t idx = 0; idx < path->points.size(); idx++) {
+		const double *before = LineVelocity(path, idx - 1);   // idx 0 wraps around to at rest
+		const double *after = LineVelocity(path, idx);
+		double change[MaxAxisNumber];
+		for (int axisIdx = 0; axisIdx < MaxAxisNumber; axisIdx++) {
+			change[axisIdx] = after[axisIdx] - before[axisIdx];
+		}
+		path->blend[idx] = BlendTime(change, path->axisCount, limits, &path->ramp[idx]);
+	}
+}
+
+bool PlanWaypointPath(WaypointPath_T *path, const PositionData_T *waypoints, size_t count, int axisCount,
+	const WaypointLimits_T *limits, long cycleNs)
+{
+	path->points.clear();
+	path->axisCount = axisCount;
+	path->dropped = 0;
+	path->cycleSec = cycleNs / 1.0e9;
+	path->nextSample = 0;
+	path->cursor = 0;
+
+	for (size_t idx = 0; idx < count; idx++) {
+		bool repeat = !path->points.empty();
+		for (int axisIdx = 0; repeat && (axisIdx < axisCount); axisIdx++) {
+			repeat = fabs(waypoints[idx].data[axisIdx] - path->points.back().data[axisIdx]) <= WaypointRepeatTolerance;
+		}
+		if (repeat) {
+			path->dropped++;
+		}
+		else {
+			path->points.push_back(waypoints[idx]);
+		}
+	}
+	size_t pointCount = path->points.size();
+	if (pointCount < 2) {
+		cout << "waypoints: the path needs at least 2 different waypoints" << endl;
+		return false;
+	}
+
+	// every axis that moves needs all three limits
+	vector<double> lineTime(pointCount - 1, 0.0);
+	for (int axisIdx = 0; axisIdx < axisCount; axisIdx++) {
+		double longest = 0.0;
+		for (size_t line = 0; line + 1 < pointCount; line++) {
+			longest = max(longest, (double)fabs(path->points[line + 1].data[axisIdx] - path->points[line].data[axisIdx]));
+		}
+		if (longest == 0.0) {
+			continue;
+		}
+		if ((limits->velocity[axisIdx] <= 0.0) || (limits->acceleration[axisIdx] <= 0.0) || (limits->jerk[axisIdx] <= 0.0)) {
+			cout << "waypoints: axis " << axisIdx + 1 << " moves but has no velocity / acceleration / jerk limit,"
+			     << " give --waypoint-limits (the thresholds only cover joint data of the robot's axes)" << endl;
+			return false;
+		}
+		for (size_t line = 0; line + 1 < pointCount; line++) {
+			double distance = fabs(path->points[line + 1].data[axisIdx] - path->points[line].data[axisIdx]);
+			lineTime[line] = max(lineTime[line], distance / limits->velocity[axisIdx]);
+		}
+	}
+
+	// stretch the lines whose blends overlap until none do: a few percent a
+	// pass, as a slower line also shortens the blends at both of its ends
+	path->velocity.assign((pointCount - 1) * MaxAxisNumber, 0.0);
+	path->blend.assign(pointCount, 0.0);
+	path->ramp.assign(pointCount, 0.5);
+	bool overlap = true;
+	for (int pass = 0; overlap && (pass < MaxWaypointPlanPasses); pass++) {
+		for (size_t line = 0; line + 1 < pointCount; line++) {
+			for (int axisIdx = 0; axisIdx < axisCount; axisIdx++) {
+				path->velocity[line * MaxAxisNumber + axisIdx] =
+					(path->points[line + 1].data[axisIdx] - path->points[line].data[axisIdx]) / lineTime[line];
+			}
+		}
+		SetBlends(path, limits);
+		overlap = false;
+		for (size_t line = 0; line + 1 < pointCount; line++) {
+			double needed = (path->blend[line] + path->blend[line + 1]) / 2.0;
+			if (needed > lineTime[line] * (1.0 + 1.0e-9)) {
+				lineTime[line] *= min(needed / lineTime[line], WaypointStretchStep);
+				overlap = true;
+			}
+		}
+	}
+	if (overlap) {
+		cout << "waypoints: no blend plan found in " << MaxWaypointPlanPasses << " passes" << endl;
+		return false;
+	}
+
+	path->time.assign(pointCount, 0.0);
+	path->time[0] = path->blend[0] / 2.0;
+	for (size_t line = 0; line + 1 < pointCount; line++) {
+		path->time[line + 1] = path->time[line] + lineTime[line];
+	}
+	path->duration = path->time[pointCount - 1] + path->blend[pointCount - 1] / 2.0;
+	// the last sample is at or past the end: exactly on the last waypoint
+	path->sampleCount = (size_t)ceil(path->duration / path->cycleSec - 1.0e-9) + 1;
+	return true;
+}
+
+void WriteWaypointPlan(const WaypointPath_T *path, const WaypointLimits_T *limits)
+{
+	size_t pointCount = path->points.size();
+	double shortest = path->blend[0];
+	double longest = path->blend[0];
+
+	for (size_t idx = 1; idx < pointCount; idx++) {
+		shortest = min(shortest, path->blend[idx]);
+		longest = max(longest, path->blend[idx]);
+	}
+	printf("waypoint path: %zu waypoints (%zu repeats dropped), %.3f s, %zu samples, blends %.1f - %.1f ms\n", pointCount,
+		path->dropped, path->duration, path->sampleCount, shortest * 1.0e3, longest * 1.0e3);
+	printf("  planned with (per second):  Velocity Acceleration Jerk\n");
+	for (int axisIdx = 0; axisIdx < path->axisCount; axisIdx++) {
+		if (limits->velocity[axisIdx] > 0.0) {
+			printf("  axis %d, %f %f %f\n", axisIdx + 1, limits->velocity[axisIdx], limits->acceleration[axisIdx], limits->jerk[axisIdx]);
+		}
+	}
+}
+
+int ReadWaypointSamples(WaypointPath_T *path, PositionData_T *samples, int maxCount)
+{
+	size_t last = path->points.size() - 1;
+	int count = 0;
+
+	for (; (count < maxCount) && (path->nextSample < path->sampleCount); count++, path->nextSample++) {
+		PositionData_T *sample = &samples[count];
+		double t = path->nextSample * path->cycleSec;
+
+		// past the blend out of the cursor's waypoint: on to the next one
+		while ((path->cursor < last) && (t >= path->time[path->cursor + 1] - path->blend[path->cursor + 1] / 2.0)) {
+			path->cursor++;
+		}
+		size_t idx = path->cursor;
+		const PositionData_T *corner = &path->points[idx];
+		const double *before = LineVelocity(path, idx - 1);
+		const double *after = LineVelocity(path, idx);
+		double blendStart = path->time[idx] - path->blend[idx] / 2.0;
+
+		memset(sample, 0, sizeof(*sample));
+		if ((idx == last) && (t >= path->duration)) {
+			*sample = *corner;
+		}
+		else if (t < blendStart + path->blend[idx]) {
+			// in the blend: the line before plus the ramped change of speed
+			double s = t - blendStart;
+			double shape = path->blend[idx] * RampIntegral(s / path->blend[idx], path->ramp[idx]);
+			for (int axisIdx = 0; axisIdx < path->axisCount; axisIdx++) {
+				sample->data[axisIdx] = (float)(corner->data[axisIdx] + before[axisIdx] * (s - path->blend[idx] / 2.0)
+					+ (after[axisIdx] - before[axisIdx]) * shape);
+			}
+		}
+		else {
+			for (int axisIdx = 0; axisIdx < path->axisCount; axisIdx++) {
+				sample->data[axisIdx] = (float)(corner->data[axisIdx] + after[axisIdx] * (t - path->time[idx]));
+			}
+		}
+	}
+	return count;
+}
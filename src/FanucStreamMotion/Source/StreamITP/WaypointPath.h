@@ -0,0 +1,89 @@
+//
+// WaypointPath.h : ITP rate samples generated online from sparse waypoints
+//
+// The path runs on straight lines from waypoint to waypoint, each axis at a
+// constant speed, and rounds every corner with a blend: around waypoint i
+// the axis speeds change from the line before to the line after along one
+// S shaped ramp (acceleration rising, held and falling back at constant
+// jerk), the same shape for all axes so they stay in step. The blend is
+// centred on the time the lines would meet, so the path leaves a line
+// exactly where it joins the next one; it passes near the waypoint, not
+// through it. The first waypoint is left from rest and the last one is
+// reached and stopped at exactly.
+//
+// Line times are the shortest the slowest axis allows at its velocity
+// limit, stretched where two blends would overlap. Each axis then stays
+// within its velocity, acceleration and jerk limits everywhere; the
+// backward differences the controller checks are averages of these, so
+// they are within the limits as well.
+//
+// Planning only touches the waypoints; the samples are made a block at a
+// time by the stream pipeline's producer, so memory does not grow with the
+// length of the motion.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+#include "J519Packet.h"
+#include "LimitCheck.h"
+
+const double WaypointThresholdScale = 0.9;   // share of the controller thresholds a waypoint path plans with
+const double WaypointRepeatTolerance = 1.0e-6;   // mm / deg, closer waypoints are dropped
+const double WaypointStretchStep = 1.02;   // most a line is stretched per planning pass
+const int MaxWaypointPlanPasses = 2000;
+
+// per axis limits, per second units (deg or mm), 0 = none
+typedef struct WaypointLimits_T {
+	double velocity[MaxAxisNumber];
+	double acceleration[MaxAxisNumber];
+	double jerk[MaxAxisNumber];
+} WaypointLimits_T;
+
+typedef struct WaypointPath_T {
+	std::vector<PositionData_T> points;   // the waypoints, repeats dropped
+	std::vector<double> time;             // s, when the lines meet at waypoint i
+	std::vector<double> blend;            // s, blend around waypoint i
+	std::vector<double> ramp;             // constant jerk part of each end of the blend, share of it
+	std::vector<double> velocity;         // MaxAxisNumber per line, line i from waypoint i to i + 1
+	int axisCount;
+	size_t dropped;                       // repeated waypoints
+	double cycleSec;
+	double duration;                      // s, start to stop
+	size_t sampleCount;
+
+	// producer state
+	size_t nextSample;
+	size_t cursor;                        // waypoint whose part of the path nextSample is in
+} WaypointPath_T;
+
+/*
+ * InitWaypointLimits: the same velocity, acceleration and jerk on every
+ *                     axis (0 = none, taken from the thresholds).
+ */
+void InitWaypointLimits(WaypointLimits_T *limits, double velocity, double acceleration, double jerk);
+
+/*
+ * CapWaypointLimits: tighten to scale times the controller thresholds of
+ *                    every axis that has them. The tables depend on the
+ *                    joint speed: the lowest entry up to the velocity limit
+ *                    is taken.
+ */
+void CapWaypointLimits(WaypointLimits_T *limits, const AxisLimits_T axisLimits[MaxAxisNumber], double scale);
+
+/*
+ * PlanWaypointPath: line times and blends of the path through count
+ *                   waypoints, for cycleNs samples. On error prints the
+ *                   reason and returns false.
+ */
+bool PlanWaypointPath(WaypointPath_T *path, const PositionData_T *waypoints, size_t count, int axisCount,
+	const WaypointLimits_T *limits, long cycleNs);
+
+void WriteWaypointPlan(const WaypointPath_T *path, const WaypointLimits_T *limits);
+
+/*
+ * ReadWaypointSamples: the next samples of the path, 0 after the last one.
+ *                      Always reads from the start after PlanWaypointPath.
+ */
+int ReadWaypointSamples(WaypointPath_T *path, PositionData_T *samples, int maxCount);
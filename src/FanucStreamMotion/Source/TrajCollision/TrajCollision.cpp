@@ -0,0 +1,113 @@
+//
+// TrajCollision.cpp : self-collision and environment check of a joint
+//                     trajectory with the robot model's STL link meshes
+//
+// Build (Linux):
+//   g++ -std=c++17 -O2 -pthread -I../StreamITP -o TrajCollision TrajCollision.cpp ../StreamITP/CollisionCheck.cpp
+//       ../StreamITP/MeshBvh.cpp ../StreamITP/MeshCache.cpp ../StreamITP/CacheFile.cpp ../StreamITP/Kinematics.cpp
+//       ../StreamITP/RobotModel.cpp ../StreamITP/TrajectoryFile.cpp
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+
+#include "TrajectoryFile.h"
+#include "RobotModel.h"
+#include "Kinematics.h"
+#include "CollisionCheck.h"
+
+using namespace std;
+
+static void Usage()
+{
+	cout << " Usage: TrajCollision ModelFile JointFile [--env EnvironmentFile] [--threads N] [--all] [--no-j23] [--lod] [--rebuild-cache]" << endl;
+	cout << "   ModelFile: .urdf or exporter .csv, meshes found through the model's package:// paths" << endl;
+	cout << "   --all: check every sample and list the contact segments instead of stopping at the first" << endl;
+	cout << "   --lod: check the simplified meshes of the mesh cache (quick look, not exact)" << endl;
+	cout << "   --rebuild-cache: build the mesh cache files again" << endl;
+}
+
+/* ------------------------------------------------------------------
+* Main routine
+--------------------------------------------------------------------- */
+int main(int argc, char* argv[])
+{
+	int threadCount = 0;
+	bool j23Coupled = true;
+	bool checkAll = false;
+	bool coarse = false;
+	bool rebuildCache = false;
+	const char *environmentFile = NULL;
+	RobotModel_T model;
+	KinematicChain_T chain;
+	Trajectory_T trajectory;
+
+	if (argc < 3) {
+		Usage();
+		return 1;
+	}
+	for (int argIdx = 3; argIdx < argc; argIdx++) {
+		if ((strcmp(argv[argIdx], "--env") == 0) && (argIdx + 1 < argc)) {
+			environmentFile = argv[++argIdx];
+		}
+		else if ((strcmp(argv[argIdx], "--threads") == 0) && (argIdx + 1 < argc)) {
+			threadCount = atoi(argv[++argIdx]);
+		}
+		else if (strcmp(argv[argIdx], "--all") == 0) {
+			checkAll = true;
+		}
+		else if (strcmp(argv[argIdx], "--no-j23") == 0) {
+			j23Coupled = false;
+		}
+		else if (strcmp(argv[argIdx], "--lod") == 0) {
+			coarse = true;
+		}
+		else if (strcmp(argv[argIdx], "--rebuild-cache") == 0) {
+			rebuildCache = true;
+		}
+		else {
+			cout << "Invalid option: " << argv[argIdx] << endl;
+			Usage();
+			return 1;
+		}
+	}
+
+	if (!LoadRobotModel(argv[1], &model) || !BuildKinematicChain(&model, &chain)) {
+		return 1;
+	}
+	chain.j23Coupled = j23Coupled;
+
+	CollisionScene_T *scene = new CollisionScene_T;
+	InitCollisionScene(scene);
+	if (!LoadCollisionScene(&model, &chain, coarse, rebuildCache, scene) || ((environmentFile != NULL) && !LoadEnvironmentFile(environmentFile, scene))) {
+		FreeCollisionScene(scene);
+		delete scene;
+		return 1;
+	}
+	WriteCollisionScene(scene);
+
+	InitTrajectory(&trajectory);
+	if (!LoadTrajectoryFile(argv[2], &trajectory)) {
+		FreeCollisionScene(scene);
+		delete scene;
+		return 1;
+	}
+	if (trajectory.representation == RepresentationCartesian) {
+		cout << argv[2] << " holds Cartesian data, convert it with TrajKinematics ik first" << endl;
+		FreeTrajectory(&trajectory);
+		FreeCollisionScene(scene);
+		delete scene;
+		return 1;
+	}
+
+	CollisionReport_T report;
+	bool clear = CheckTrajectoryCollisions(scene, trajectory.samples, trajectory.sampleCount, threadCount, !checkAll, &report);
+	WriteCollisionReport(scene, &report);
+
+	FreeTrajectory(&trajectory);
+	FreeCollisionScene(scene);
+	delete scene;
+	return clear ? 0 : 1;
+}
@@ -0,0 +1,149 @@
+//
+// TrajConvert.cpp : convert ITP text trajectories to the binary (.itpb)
+//                   trajectory format StreamITP maps without parsing, and back.
+//                   Telemetry logs (StreamITP --record) are converted to CSV.
+//
+// Build: make TrajConvert, in Source
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "TrajectoryFile.h"
+#include "Telemetry.h"
+
+using namespace std;
+
+static int ParseRepresentation(string rep)
+{
+	for (size_t idx = 0; idx < rep.size(); idx++) {
+		rep.at(idx) = toupper(rep.at(idx));
+	}
+	if (rep.compare("CARTESIAN") == 0) {
+		return RepresentationCartesian;
+	}
+	if (rep.compare("JOINT") == 0) {
+		return RepresentationJoint;
+	}
+	return RepresentationUnknown;
+}
+
+/*
+ * ConvertTelemetry: one CSV line per recorded status, times in ms from the
+ *                   start of the recording
+ */
+static bool ConvertTelemetry(const char *inName, const char *outName)
+{
+	TelemetryHeader_T header;
+	vector<TelemetrySample_T> samples;
+
+	if (!LoadTelemetryLog(inName, &header, &samples)) {
+		return false;
+	}
+	FILE *out = fopen(outName, "w");
+	if (out == NULL) {
+		cout << "Cannot create " << outName << endl;
+		return false;
+	}
+	printf("%zu status packets, %.3f ms cycle, %s data streamed -> CSV\n", samples.size(), header.cycleNs / 1.0e6,
+		(header.representation == 1) ? "joint" : "Cartesian");
+
+	time_t startTime = (time_t)(header.startUnixNs / 1000000000LL);
+	char started[64];
+	strftime(started, sizeof(started), "%Y-%m-%d %H:%M:%S", localtime(&startTime));
+	fprintf(out, "# recorded %s, cycle %.3f ms\n", started, header.cycleNs / 1.0e6);
+	fprintf(out, "time_ms,sequence,controller_time,status,reply_ms,command_sequence,io_type,io_index,io_mask,io_value,"
+		"write_type,write_index,write_mask,write_value");
+	static const char *positionNames[MaxAxisNumber] = { "x", "y", "z", "w", "p", "r", "e1", "e2", "e3" };
+	for (int idx = 0; idx < MaxAxisNumber; idx++) {
+		fprintf(out, ",%s", positionNames[idx]);
+	}
+	for (int idx = 0; idx < MaxAxisNumber; idx++) {
+		fprintf(out, ",j%d", idx + 1);
+	}
+	for (int idx = 0; idx < MaxAxisNumber; idx++) {
+		fprintf(out, ",current%d", idx + 1);
+	}
+	fprintf(out, "\n");
+
+	for (size_t sampleIdx = 0; sampleIdx < samples.size(); sampleIdx++) {
+		const TelemetrySample_T *sample = &samples[sampleIdx];
+		fprintf(out, "%.3f,%u,%u,%u,%.3f,%u,%u,%u,%u,%u", sample->receiveNs / 1.0e6, sample->sequenceNo, sample->timeStamp,
+			sample->status, (sample->replyNs >= 0) ? sample->replyNs / 1.0e6 : -1.0, sample->commandSeqNo,
+			sample->readIOType, sample->readIOIndex, sample->readIOMask, sample->readIOValue);
+		fprintf(out, ",%u,%u,%u,%u", sample->writeIOType, sample->writeIOIndex, sample->writeIOMask, sample->writeIOValue);
+		for (int idx = 0; idx < MaxAxisNumber; idx++) {
+			fprintf(out, ",%.4f", sample->position[idx]);
+		}
+		for (int idx = 0; idx < MaxAxisNumber; idx++) {
+			fprintf(out, ",%.4f", sample->jointAngle[idx]);
+		}
+		for (int idx = 0; idx < MaxAxisNumber; idx++) {
+			fprintf(out, ",%.3f", sample->current[idx]);
+		}
+		fprintf(out, "\n");
+	}
+	bool ok = (fclose(out) == 0);
+	if (!ok) {
+		cout << "Cannot write " << outName << endl;
+	}
+	return ok;
+}
+
+/* ------------------------------------------------------------------
+* Main routine: text in -> binary out, binary in -> text out
+--------------------------------------------------------------------- */
+int main(int argc, char* argv[])
+{
+	int representation = RepresentationJoint;
+	long cycleNs = 8000000L;
+	Trajectory_T trajectory;
+
+	if ((argc != 3) && (argc != 4) && (argc != 6)) {
+		cout << " Usage: TrajConvert InFile OutFile (Optional: Joint/Cartesian) (Optional: --cycle-ms T)" << endl;
+		cout << "        TrajConvert TelemetryLog.itpt OutFile.csv" << endl;
+		return 1;
+	}
+	if ((argc == 3) && IsTelemetryLog(argv[1])) {
+		return ConvertTelemetry(argv[1], argv[2]) ? 0 : 1;
+	}
+	if (argc >= 4) {
+		representation = ParseRepresentation(argv[3]);
+		if (representation == RepresentationUnknown) {
+			cout << "Data representation must be Joint or Cartesian" << endl;
+			return 1;
+		}
+	}
+	if (argc == 6) {
+		double cycleMs = atof(argv[5]);
+		if ((strcmp(argv[4], "--cycle-ms") != 0) || (cycleMs <= 0.0)) {
+			cout << "Invalid option: " << argv[4] << endl;
+			return 1;
+		}
+		cycleNs = (long)(cycleMs * 1000000.0);
+	}
+
+	InitTrajectory(&trajectory);
+	if (!LoadTrajectoryFile(argv[1], &trajectory)) {
+		return 1;
+	}
+
+	bool ok;
+	if (trajectory.representation != RepresentationUnknown) {
+		printf("%zu samples, %d axes, %s, %.3f ms cycle -> text\n", trajectory.sampleCount, trajectory.axisCount,
+			(trajectory.representation == RepresentationJoint) ? "joint" : "Cartesian", trajectory.cycleNs / 1.0e6);
+		ok = SaveTrajectoryText(argv[2], &trajectory);
+	}
+	else {
+		printf("%zu samples, %d axes -> binary\n", trajectory.sampleCount, trajectory.axisCount);
+		ok = SaveTrajectoryBinary(argv[2], &trajectory, representation, cycleNs);
+	}
+
+	FreeTrajectory(&trajectory);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,334 @@
+//
+// TrajDynamics.cpp : joint torques and motor currents of whole trajectories,
+//                    current gains fitted from telemetry, offline residual
+//                    check of a recording
+//
+// Build (Linux):
+//   g++ -std=c++17 -O2 -pthread -I../StreamITP -o TrajDynamics TrajDynamics.cpp
+//       ../StreamITP/Dynamics.cpp ../StreamITP/Kinematics.cpp ../StreamITP/RobotModel.cpp
+//       ../StreamITP/TrajectoryFile.cpp ../StreamITP/Telemetry.cpp ../StreamITP/J519Packet.cpp ../StreamITP/RtUtil.cpp
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "TrajectoryFile.h"
+#include "RobotModel.h"
+#include "Kinematics.h"
+#include "Dynamics.h"
+#include "Telemetry.h"
+#include "RtUtil.h"
+
+using namespace std;
+
+const size_t MinFitSamples = 100;     // statuses in motion an axis needs for a fit
+
+static void Usage()
+{
+	cout << " Usage: TrajDynamics torques ModelFile JointFile OutFile [--payload kg[,x,y,z]] [--gains File] [--currents] [--threads N] [--cycle-ms T]" << endl;
+	cout << "        TrajDynamics fit ModelFile TelemetryLog GainsFile [--payload kg[,x,y,z]]" << endl;
+	cout << "        TrajDynamics check ModelFile TelemetryLog [--payload kg[,x,y,z]] [--gains File] [--current-limits C,P]" << endl;
+	cout << "   ModelFile: .urdf or exporter .csv, OutFile: text or .itpb (N m, or A with --currents)" << endl;
+	cout << "   --payload: mass and center of mass (mm, faceplate frame) of the tool and part" << endl;
+}
+
+/*
+ * RunTorques: torques (or currents) of every sample of a joint trajectory
+ */
+static int RunTorques(const DynamicsModel_T *dyn, const DynamicsGains_T *gains, const char *inName, const char *outName,
+                      bool currents, int threadCount, long cycleNs)
+{
+	Trajectory_T joints;
+	Trajectory_T result;
+
+	InitTrajectory(&joints);
+	InitTrajectory(&result);
+	if (!LoadTrajectoryFile(inName, &joints)) {
+		return 1;
+	}
+	if (joints.representation == RepresentationCartesian) {
+		cout << inName << " holds Cartesian data (convert it with TrajKinematics ik)" << endl;
+		FreeTrajectory(&joints);
+		return 1;
+	}
+	if (joints.cycleNs > 0) {
+		cycleNs = joints.cycleNs;
+	}
+
+	vector<PositionData_T> torques(joints.sampleCount), predicted(joints.sampleCount);
+	int64_t start = RtNowNs();
+	TrajectoryTorques(dyn, joints.samples, joints.sampleCount, cycleNs, torques.data(), threadCount);
+	double elapsed = (RtNowNs() - start) / 1.0e9;
+	printf("%zu samples in %.3f ms, %.1f million samples/s\n", joints.sampleCount, elapsed * 1.0e3, joints.sampleCount / elapsed / 1.0e6);
+
+	for (size_t idx = 0; idx < joints.sampleCount; idx++) {
+		double torque[MaxAxisNumber], speed[MaxAxisNumber], acceleration[MaxAxisNumber], current[MaxAxisNumber];
+		JointMotion(joints.samples, idx, dyn->axisCount, cycleNs / 1.0e9, speed, acceleration);
+		for (int axis = 0; axis < MaxAxisNumber; axis++) {
+			torque[axis] = torques[idx].data[axis];
+		}
+		PredictCurrents(dyn, gains, torque, speed, current);
+		for (int axis = 0; axis < MaxAxisNumber; axis++) {
+			predicted[idx].data[axis] = (float)current[axis];
+		}
+	}
+	bool withinLimits = WriteDynamicsReport(dyn, torques.data(), predicted.data(), joints.sampleCount, cycleNs);
+
+	result.positions = currents ? predicted : torques;
+	result.samples = result.positions.data();
+	result.sampleCount = result.positions.size();
+	result.axisCount = dyn->axisCount;
+	result.delimiter = (joints.delimiter != '\0') ? joints.delimiter : '\t';
+	bool ok = IsBinaryTrajectoryName(outName) ? SaveTrajectoryBinary(outName, &result, RepresentationJoint, cycleNs) : SaveTrajectoryText(outName, &result);
+	FreeTrajectory(&joints);
+	return (ok && withinLimits) ? 0 : 1;
+}
+
+/*
+ * MotionState: speed and acceleration at status idx of the log, from the
+ *              measured angles of it and the two before, all in motion and
+ *              one controller cycle apart. false if they are not.
+ */
+static bool MotionState(const vector<TelemetrySample_T> &samples, size_t idx, long cycleNs, int axisCount,
+                        double joints[MaxAxisNumber], double speed[MaxAxisNumber], double acceleration[MaxAxisNumber])
+{
+	long cycleMs = (cycleNs + NsPerMs / 2) / NsPerMs;
+	double cycleSec = cycleNs / 1.0e9;
+
+	if ((idx < 2) || (cycleMs < 1)) {
+		return false;
+	}
+	for (size_t back = 0; back < 3; back++) {
+		if ((samples[idx - back].status & MotionStatusBit) == 0) {
+			return false;
+		}
+		if ((back < 2) && (((long)(u_word)(samples[idx - back].timeStamp - samples[idx - back - 1].timeStamp) * 2 + cycleMs) / (2 * cycleMs) != 1)) {
+			return false;
+		}
+	}
+	const float *now = samples[idx].jointAngle;
+	const float *prev = samples[idx - 1].jointAngle;
+	const float *prev2 = samples[idx - 2].jointAngle;
+	for (int axis = 0; axis < MaxAxisNumber; axis++) {
+		joints[axis] = now[axis];
+		speed[axis] = (axis < axisCount) ? ((double)now[axis] - prev[axis]) / cycleSec : 0.0;
+		acceleration[axis] = (axis < axisCount) ? ((double)now[axis] - 2.0 * prev[axis] + prev2[axis]) / (cycleSec * cycleSec) : 0.0;
+	}
+	return true;
+}
+
+/*
+ * SolveNormal4: least squares solution of the 4x4 normal equations by
+ *               Gauss elimination with partial pivoting. false if singular.
+ */
+static bool SolveNormal4(double a[4][4], double b[4], double x[4])
+{
+	for (int col = 0; col < 4; col++) {
+		int pivot = col;
+		for (int row = col + 1; row < 4; row++) {
+			if (fabs(a[row][col]) > fabs(a[pivot][col])) {
+				pivot = row;
+			}
+		}
+		if (fabs(a[pivot][col]) < 1.0e-12) {
+			return false;
+		}
+		for (int idx = 0; idx < 4; idx++) {
+			double swap = a[col][idx];
+			a[col][idx] = a[pivot][idx];
+			a[pivot][idx] = swap;
+		}
+		double swap = b[col];
+		b[col] = b[pivot];
+		b[pivot] = swap;
+		for (int row = col + 1; row < 4; row++) {
+			double factor = a[row][col] / a[col][col];
+			for (int idx = col; idx < 4; idx++) {
+				a[row][idx] -= factor * a[col][idx];
+			}
+			b[row] -= factor * b[col];
+		}
+	}
+	for (int row = 3; row >= 0; row--) {
+		double sum = b[row];
+		for (int idx = row + 1; idx < 4; idx++) {
+			sum -= a[row][idx] * x[idx];
+		}
+		x[row] = sum / a[row][row];
+	}
+	return true;
+}
+
+/*
+ * RunFit: current = torque / torquePerAmp + coulomb * sign(speed) +
+ *         viscous * speed + offset, least squares per axis over the
+ *         statuses of the log that were in motion. Axes the log does not
+ *         excite keep the defaults.
+ */
+static int RunFit(const DynamicsModel_T *dyn, const char *logName, const char *gainsName)
+{
+	TelemetryHeader_T header;
+	vector<TelemetrySample_T> samples;
+	DynamicsGains_T gains;
+	double normal[MaxAxisNumber][4][4];
+	double right[MaxAxisNumber][4];
+	size_t used = 0;
+
+	if (!LoadTelemetryLog(logName, &header, &samples)) {
+		return 1;
+	}
+	memset(normal, 0, sizeof(normal));
+	memset(right, 0, sizeof(right));
+	for (size_t idx = 0; idx < samples.size(); idx++) {
+		double joints[MaxAxisNumber], speed[MaxAxisNumber], acceleration[MaxAxisNumber], torque[MaxAxisNumber];
+		if (!MotionState(samples, idx, (long)header.cycleNs, dyn->axisCount, joints, speed, acceleration)) {
+			continue;
+		}
+		JointTorques(dyn, joints, speed, acceleration, torque);
+		for (int axis = 0; axis < dyn->axisCount; axis++) {
+			double direction = (speed[axis] > FrictionDeadband) ? 1.0 : ((speed[axis] < -FrictionDeadband) ? -1.0 : 0.0);
+			double row[4] = { torque[axis], direction, speed[axis], 1.0 };
+			for (int i = 0; i < 4; i++) {
+				for (int j = 0; j < 4; j++) {
+					normal[axis][i][j] += row[i] * row[j];
+				}
+				right[axis][i] += row[i] * samples[idx].current[axis];
+			}
+		}
+		used++;
+	}
+	printf("%zu of %zu statuses in motion used\n", used, samples.size());
+	if (used < MinFitSamples) {
+		cout << logName << ": too little motion to fit the gains" << endl;
+		return 1;
+	}
+
+	DefaultDynamicsGains(&gains);
+	printf("axis  torque_per_amp  coulomb  viscous   offset\n");
+	for (int axis = 0; axis < dyn->axisCount; axis++) {
+		double coef[4];
+		if (!SolveNormal4(normal[axis], right[axis], coef) || (coef[0] <= 0.0)) {
+			printf("  J%d  not excited by the log, defaults kept\n", axis + 1);
+			continue;
+		}
+		gains.torquePerAmp[axis] = 1.0 / coef[0];
+		gains.coulomb[axis] = coef[1];
+		gains.viscous[axis] = coef[2];
+		gains.offset[axis] = coef[3];
+		printf("  J%d %14.3f %8.3f %8.5f %8.3f\n", axis + 1, gains.torquePerAmp[axis], gains.coulomb[axis], gains.viscous[axis], gains.offset[axis]);
+	}
+	return SaveDynamicsGains(gainsName, &gains, dyn->axisCount) ? 0 : 1;
+}
+
+/*
+ * RunCheck: the streaming monitor over every status of a recording
+ */
+static int RunCheck(DynamicsMonitor_T *monitor, const char *logName)
+{
+	TelemetryHeader_T header;
+	vector<TelemetrySample_T> samples;
+
+	if (!LoadTelemetryLog(logName, &header, &samples)) {
+		return 1;
+	}
+	monitor->cycleNs = (long)header.cycleNs;
+	for (size_t idx = 0; idx < samples.size(); idx++) {
+		MonitorSample(monitor, samples[idx].sequenceNo, samples[idx].timeStamp, samples[idx].status, samples[idx].jointAngle, samples[idx].current);
+	}
+	WriteDynamicsMonitor(monitor);
+	return (monitor->flagged != 0) ? 1 : 0;
+}
+
+/* ------------------------------------------------------------------
+* Main routine
+--------------------------------------------------------------------- */
+int main(int argc, char* argv[])
+{
+	int threadCount = 0;
+	long cycleNs = DefaultCycleNs;
+	bool currents = false;
+	const char *gainsFile = NULL;
+	double collisionAmps = DefaultCollisionAmps;
+	double payloadAmps = DefaultPayloadAmps;
+	Payload_T payload = {};
+	RobotModel_T model;
+	KinematicChain_T chain;
+	DynamicsModel_T dyn;
+	DynamicsGains_T gains;
+
+	if (argc < 4) {
+		Usage();
+		return 1;
+	}
+	string mode(argv[1]);
+	int firstOption = (mode.compare("check") == 0) ? 4 : 5;
+	if (argc < firstOption) {
+		Usage();
+		return 1;
+	}
+	for (int argIdx = firstOption; argIdx < argc; argIdx++) {
+		if ((strcmp(argv[argIdx], "--payload") == 0) && (argIdx + 1 < argc)) {
+			if (!ParsePayload(argv[++argIdx], &payload)) {
+				cout << "--payload takes kg or kg,x,y,z (mm on the faceplate)" << endl;
+				return 1;
+			}
+		}
+		else if ((strcmp(argv[argIdx], "--gains") == 0) && (argIdx + 1 < argc)) {
+			gainsFile = argv[++argIdx];
+		}
+		else if (strcmp(argv[argIdx], "--currents") == 0) {
+			currents = true;
+		}
+		else if ((strcmp(argv[argIdx], "--threads") == 0) && (argIdx + 1 < argc)) {
+			threadCount = atoi(argv[++argIdx]);
+		}
+		else if ((strcmp(argv[argIdx], "--cycle-ms") == 0) && (argIdx + 1 < argc)) {
+			cycleNs = (long)(atof(argv[++argIdx]) * 1.0e6);
+			if (cycleNs <= 0) {
+				cout << "--cycle-ms must be above 0" << endl;
+				return 1;
+			}
+		}
+		else if ((strcmp(argv[argIdx], "--current-limits") == 0) && (argIdx + 1 < argc)) {
+			if ((sscanf(argv[++argIdx], "%lf,%lf", &collisionAmps, &payloadAmps) != 2) || (collisionAmps <= 0.0) || (payloadAmps <= 0.0)) {
+				cout << "--current-limits takes collision,payload amps, both above 0" << endl;
+				return 1;
+			}
+		}
+		else {
+			cout << "Invalid option: " << argv[argIdx] << endl;
+			Usage();
+			return 1;
+		}
+	}
+
+	if (!LoadRobotModel(argv[2], &model) || !BuildKinematicChain(&model, &chain) || !BuildDynamicsModel(&model, &chain, &payload, &dyn)) {
+		return 1;
+	}
+	DefaultDynamicsGains(&gains);
+	if ((gainsFile != NULL) && !LoadDynamicsGains(gainsFile, &gains)) {
+		return 1;
+	}
+
+	if (mode.compare("torques") == 0) {
+		return RunTorques(&dyn, &gains, argv[3], argv[4], currents, threadCount, cycleNs);
+	}
+	if (mode.compare("fit") == 0) {
+		return RunFit(&dyn, argv[3], argv[4]);
+	}
+	if (mode.compare("check") == 0) {
+		DynamicsMonitor_T monitor;
+		InitDynamicsMonitor(&monitor, &dyn, &gains, cycleNs);
+		monitor.collisionAmps = collisionAmps;
+		monitor.payloadAmps = payloadAmps;
+		return RunCheck(&monitor, argv[3]);
+	}
+	Usage();
+	return 1;
+}
@@ -0,0 +1,296 @@
+//
+// TrajKinematics.cpp : joint <-> Cartesian conversion of whole trajectories
+//                      with the robot model from the URDF / exporter CSV
+//
+// Build: make TrajKinematics, in Source
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "TrajectoryFile.h"
+#include "RobotModel.h"
+#include "Kinematics.h"
+#include "RtUtil.h"
+
+using namespace std;
+
+static bool SaveResult(const char *fileName, const Trajectory_T *result, int representation, long cycleNs)
+{
+	if (IsBinaryTrajectoryName(fileName)) {
+		return SaveTrajectoryBinary(fileName, result, representation, cycleNs);
+	}
+	return SaveTrajectoryText(fileName, result);
+}
+
+static void Usage()
+{
+	cout << " Usage: TrajKinematics fk ModelFile JointFile OutFile [--threads N] [--no-j23]" << endl;
+	cout << "        TrajKinematics ik ModelFile PoseFile OutFile [--threads N] [--no-j23] [--seed J1,..,J6]" << endl;
+	cout << "                                                  [--max-step deg] [--singular sigma] [--si]" << endl;
+	cout << "   ModelFile: .urdf or exporter .csv, OutFile: text or .itpb" << endl;
+}
+
+static bool ParseSeed(const char *text, float seed[MaxAxisNumber])
+{
+	const char *p = text;
+	char *end;
+
+	for (int idx = 0; idx < 6; idx++) {
+		seed[idx] = strtof(p, &end);
+		if (end == p) {
+			return false;
+		}
+		p = end;
+		if (idx < 5) {
+			if (*p != ',') {
+				return false;
+			}
+			p++;
+		}
+	}
+	return *p == '\0';
+}
+
+/*
+ * RunForward: joint trajectory -> faceplate x y z w p r
+ */
+static int RunForward(const KinematicChain_T *chain, const char *inName, const char *outName, int threadCount)
+{
+	Trajectory_T joints;
+	Trajectory_T poses;
+
+	InitTrajectory(&joints);
+	InitTrajectory(&poses);
+	if (!LoadTrajectoryFile(inName, &joints)) {
+		return 1;
+	}
+	if (joints.representation == RepresentationCartesian) {
+		cout << inName << " holds Cartesian data" << endl;
+		FreeTrajectory(&joints);
+		return 1;
+	}
+
+	poses.positions.resize(joints.sampleCount);
+	poses.samples = poses.positions.data();
+	poses.sampleCount = joints.sampleCount;
+	poses.axisCount = joints.axisCount;
+
+	int64_t start = RtNowNs();
+	ForwardKinematicsBatch(chain, joints.samples, joints.sampleCount, poses.positions.data(), threadCount);
+	double elapsed = (RtNowNs() - start) / 1.0e9;
+	printf("%zu poses in %.3f ms, %.1f million poses/s\n", joints.sampleCount, elapsed * 1.0e3, joints.sampleCount / elapsed / 1.0e6);
+
+	long cycleNs = (joints.cycleNs > 0) ? joints.cycleNs : 8000000L;
+	bool ok = SaveResult(outName, &poses, RepresentationCartesian, cycleNs);
+	FreeTrajectory(&joints);
+	return ok ? 0 : 1;
+}
+
+static const char *ConfigName(int config)
+{
+	static const char *names[8] = {
+		"J5+ up front", "J5- up front", "J5+ down front", "J5- down front",
+		"J5+ up back", "J5- up back", "J5+ down back", "J5- down back" };
+	return names[config & 7];
+}
+
+/*
+ * WriteIkSegments: runs of samples with the same flag, one line each with
+ *                  the worst error / singular value / step in the run
+ */
+static void WriteIkSegments(const PositionData_T *joints, const IkSample_T *info, size_t count, unsigned char flag, const char *what)
+{
+	const size_t MaxLines = 20;
+	size_t lines = 0, runs = 0;
+
+	for (size_t idx = 0; idx < count; idx++) {
+		if (!(info[idx].flags & flag)) {
+			continue;
+		}
+		size_t first = idx;
+		float worstPosition = 0.0f, worstOrientation = 0.0f, lowestSigma = 1.0e30f, worstStep = 0.0f;
+		for (; (idx < count) && (info[idx].flags & flag); idx++) {
+			worstPosition = (info[idx].positionError > worstPosition) ? info[idx].positionError : worstPosition;
+			worstOrientation = (info[idx].orientationError > worstOrientation) ? info[idx].orientationError : worstOrientation;
+			lowestSigma = (info[idx].sigma < lowestSigma) ? info[idx].sigma : lowestSigma;
+			for (int axis = 0; (axis < 6) && (idx > 0); axis++) {
+				float step = fabsf(joints[idx].data[axis] - joints[idx - 1].data[axis]);
+				worstStep = (step > worstStep) ? step : worstStep;
+			}
+		}
+		size_t last = idx - 1;
+		runs++;
+		if (lines++ >= MaxLines) {
+			continue;
+		}
+		printf("  %-13s samples %zu-%zu (lines %zu-%zu)", what, first, last, first + 1, last + 1);
+		if (flag == IkUnreachable) {
+			printf(", off by up to %.3f mm / %.3f deg", worstPosition, worstOrientation);
+		}
+		else if (flag == IkSingular) {
+			printf(", sigma down to %.2f", lowestSigma);
+		}
+		else if (flag == IkConfigChange) {
+			printf(", %s -> %s", ConfigName(info[first - 1].config), ConfigName(info[first].config));
+		}
+		else if (flag == IkJointJump) {
+			printf(", up to %.2f deg per sample", worstStep);
+		}
+		printf("\n");
+	}
+	if (runs > MaxLines) {
+		printf("  %-13s ... %zu segments in all\n", what, runs);
+	}
+}
+
+/*
+ * RunInverse: Cartesian trajectory -> joints, flagged segments listed.
+ *             The joints are written even with unreachable samples (the
+ *             closest joints found), the exit code is 1 then.
+ */
+static int RunInverse(const KinematicChain_T *chain, const char *inName, const char *outName, const float seed[MaxAxisNumber],
+                      const IkConfig_T *config, bool siUnits)
+{
+	Trajectory_T poses;
+	Trajectory_T joints;
+	vector<PositionData_T> converted;
+	vector<IkSample_T> info;
+	IkStats_T stats;
+
+	InitTrajectory(&poses);
+	InitTrajectory(&joints);
+	if (!LoadTrajectoryFile(inName, &poses)) {
+		return 1;
+	}
+	if (poses.representation == RepresentationJoint) {
+		cout << inName << " holds joint data" << endl;
+		FreeTrajectory(&poses);
+		return 1;
+	}
+
+	// meters / radians in the model's base frame (ROS) -> mm / deg in the world frame
+	const PositionData_T *input = poses.samples;
+	if (siUnits) {
+		converted.assign(poses.samples, poses.samples + poses.sampleCount);
+		for (size_t idx = 0; idx < converted.size(); idx++) {
+			float *data = converted[idx].data;
+			for (int axis = 0; axis < 3; axis++) {
+				data[axis] *= 1000.0f;
+				data[3 + axis] *= (float)(180.0 / M_PI);
+			}
+			data[2] -= (float)chain->worldHeight;
+		}
+		input = converted.data();
+	}
+
+	joints.positions.resize(poses.sampleCount);
+	joints.samples = joints.positions.data();
+	joints.sampleCount = poses.sampleCount;
+	joints.axisCount = poses.axisCount;
+	info.resize(poses.sampleCount);
+
+	int64_t start = RtNowNs();
+	if (!InverseKinematicsBatch(chain, input, poses.sampleCount, seed, config, joints.positions.data(), info.data(), &stats)) {
+		FreeTrajectory(&poses);
+		return 1;
+	}
+	double elapsed = (RtNowNs() - start) / 1.0e9;
+	printf("%zu poses in %.3f ms, %.2f million poses/s, %d chunks (%d solved again), %.2f iterations per pose\n",
+	       poses.sampleCount, elapsed * 1.0e3, poses.sampleCount / elapsed / 1.0e6, stats.chunks, stats.chunksRedone,
+	       (poses.sampleCount > 0) ? (double)stats.iterations / poses.sampleCount : 0.0);
+	if (poses.sampleCount > 0) {
+		printf("configuration: %s\n", ConfigName(info[0].config));
+	}
+
+	static const char *names[IkFlagCount] = { "unreachable", "singular", "config change", "joint limit", "joint jump" };
+	bool flagged = false;
+	for (int bit = 0; bit < IkFlagCount; bit++) {
+		if (stats.flagged[bit] > 0) {
+			printf("%zu samples %s\n", stats.flagged[bit], names[bit]);
+			WriteIkSegments(joints.samples, info.data(), poses.sampleCount, (unsigned char)(1 << bit), names[bit]);
+			flagged = true;
+		}
+	}
+	if (!flagged) {
+		printf("all poses reached, no singular or flagged samples\n");
+	}
+
+	long cycleNs = (poses.cycleNs > 0) ? poses.cycleNs : 8000000L;
+	bool ok = SaveResult(outName, &joints, RepresentationJoint, cycleNs);
+	FreeTrajectory(&poses);
+	if (ok && (stats.flagged[0] > 0)) {
+		cout << "** NOT ALL POSES REACHABLE, closest joints written" << endl;
+		return 1;
+	}
+	return ok ? 0 : 1;
+}
+
+/* ------------------------------------------------------------------
+* Main routine
+--------------------------------------------------------------------- */
+int main(int argc, char* argv[])
+{
+	int threadCount = 0;
+	bool j23Coupled = true;
+	bool siUnits = false;
+	float seed[MaxAxisNumber] = { 0.0f, 0.0f, 0.0f, 0.0f, -90.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+	IkConfig_T ikConfig = IkDefaultConfig();
+	RobotModel_T model;
+	KinematicChain_T chain;
+
+	if (argc < 5) {
+		Usage();
+		return 1;
+	}
+	for (int argIdx = 5; argIdx < argc; argIdx++) {
+		if ((strcmp(argv[argIdx], "--threads") == 0) && (argIdx + 1 < argc)) {
+			threadCount = atoi(argv[++argIdx]);
+		}
+		else if (strcmp(argv[argIdx], "--no-j23") == 0) {
+			j23Coupled = false;
+		}
+		else if ((strcmp(argv[argIdx], "--seed") == 0) && (argIdx + 1 < argc)) {
+			if (!ParseSeed(argv[++argIdx], seed)) {
+				cout << "Invalid seed: " << argv[argIdx] << " (J1,J2,J3,J4,J5,J6 in deg)" << endl;
+				return 1;
+			}
+		}
+		else if ((strcmp(argv[argIdx], "--max-step") == 0) && (argIdx + 1 < argc)) {
+			ikConfig.maxJointStep = atof(argv[++argIdx]);
+		}
+		else if ((strcmp(argv[argIdx], "--singular") == 0) && (argIdx + 1 < argc)) {
+			ikConfig.singularLimit = atof(argv[++argIdx]);
+		}
+		else if (strcmp(argv[argIdx], "--si") == 0) {
+			siUnits = true;
+		}
+		else {
+			cout << "Invalid option: " << argv[argIdx] << endl;
+			Usage();
+			return 1;
+		}
+	}
+
+	if (!LoadRobotModel(argv[2], &model) || !BuildKinematicChain(&model, &chain)) {
+		return 1;
+	}
+	chain.j23Coupled = j23Coupled;
+
+	string mode(argv[1]);
+	if (mode.compare("fk") == 0) {
+		return RunForward(&chain, argv[3], argv[4], threadCount);
+	}
+	if (mode.compare("ik") == 0) {
+		ikConfig.threadCount = threadCount;
+		return RunInverse(&chain, argv[3], argv[4], seed, &ikConfig, siUnits);
+	}
+	Usage();
+	return 1;
+}
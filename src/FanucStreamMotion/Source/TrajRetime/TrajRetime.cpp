@@ -0,0 +1,160 @@
+//
+// TrajRetime.cpp : resample a dense joint trajectory to the shortest time its
+//                  path allows within the controller's thresholds
+//
+// Build: make TrajRetime, in Source
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "TrajectoryFile.h"
+#include "LimitCheck.h"
+#include "ThresholdFetch.h"
+#include "PathRetime.h"
+
+using namespace std;
+
+static void Usage()
+{
+	cout << " Usage: TrajRetime InFile OutFile --robot Address|--limits V,A,J [--full-payload] [--scale F] [--cycle-ms T] [--passes N]" << endl;
+	cout << "   --robot: the thresholds StreamITP --thresholds cached for that controller" << endl;
+	cout << "   --limits: velocity, acceleration and jerk of every axis (deg/s, deg/s^2, deg/s^3)" << endl;
+	cout << "   InFile: joint data, text or .itpb; OutFile: text or .itpb" << endl;
+}
+
+/*
+ * LoadCachedLimits: the threshold tables cached for the controller at address
+ */
+static bool LoadCachedLimits(const char *address, bool fullPayload, AxisLimits_T limits[MaxAxisNumber])
+{
+	char cachePath[1024];
+	ThresholdSet_T thresholds;
+	time_t savedTime;
+
+	if (!ThresholdCachePath(address, cachePath, sizeof(cachePath))) {
+		cout << "No cache directory for the thresholds" << endl;
+		return false;
+	}
+	if (!LoadThresholdCache(cachePath, address, &thresholds, &savedTime) || !HaveThresholds(&thresholds, 1u)) {
+		cout << "No thresholds cached for " << address << ": run StreamITP with --thresholds against it first" << endl;
+		return false;
+	}
+	printf("thresholds of %s from %s, saved %.1f h ago\n", address, cachePath, difftime(time(NULL), savedTime) / 3600.0);
+	SetThresholdLimits(&thresholds, limits, fullPayload);
+	return true;
+}
+
+/* ------------------------------------------------------------------
+* Main routine
+--------------------------------------------------------------------- */
+int main(int argc, char* argv[])
+{
+	const char *robotAddress = NULL;
+	double fixed[ThresholdTypeCount] = { 0.0 };
+	bool haveFixed = false;
+	bool fullPayload = false;
+	RetimeConfig_T config;
+	AxisLimits_T limits[MaxAxisNumber];
+
+	RetimeDefaultConfig(&config);
+	if (argc < 3) {
+		Usage();
+		return 1;
+	}
+	for (int argIdx = 3; argIdx < argc; argIdx++) {
+		if ((strcmp(argv[argIdx], "--robot") == 0) && (argIdx + 1 < argc)) {
+			robotAddress = argv[++argIdx];
+		}
+		else if ((strcmp(argv[argIdx], "--limits") == 0) && (argIdx + 1 < argc)) {
+			haveFixed = (sscanf(argv[++argIdx], "%lf,%lf,%lf", &fixed[ThresholdVelocity], &fixed[ThresholdAcceleration], &fixed[ThresholdJerk]) == 3)
+				&& (fixed[ThresholdVelocity] > 0.0) && (fixed[ThresholdAcceleration] > 0.0) && (fixed[ThresholdJerk] > 0.0);
+			if (!haveFixed) {
+				cout << "--limits takes velocity,acceleration,jerk, all above 0" << endl;
+				return 1;
+			}
+		}
+		else if (strcmp(argv[argIdx], "--full-payload") == 0) {
+			fullPayload = true;
+		}
+		else if ((strcmp(argv[argIdx], "--scale") == 0) && (argIdx + 1 < argc)) {
+			config.scale = atof(argv[++argIdx]);
+			if ((config.scale <= 0.0) || (config.scale > 1.0)) {
+				cout << "--scale must be above 0 and at most 1" << endl;
+				return 1;
+			}
+		}
+		else if ((strcmp(argv[argIdx], "--cycle-ms") == 0) && (argIdx + 1 < argc)) {
+			config.cycleNs = (long)(atof(argv[++argIdx]) * 1.0e6);
+			if (config.cycleNs <= 0) {
+				cout << "--cycle-ms must be above 0" << endl;
+				return 1;
+			}
+		}
+		else if ((strcmp(argv[argIdx], "--passes") == 0) && (argIdx + 1 < argc)) {
+			config.maxPasses = atoi(argv[++argIdx]);
+		}
+		else {
+			cout << "Invalid option: " << argv[argIdx] << endl;
+			Usage();
+			return 1;
+		}
+	}
+	if ((robotAddress == NULL) == !haveFixed) {
+		cout << "Give either --robot or --limits" << endl;
+		Usage();
+		return 1;
+	}
+
+	Trajectory_T input;
+	InitTrajectory(&input);
+	if (!LoadTrajectoryFile(argv[1], &input)) {
+		return 1;
+	}
+	if ((input.representation == RepresentationCartesian) && (robotAddress != NULL)) {
+		cout << argv[1] << " holds Cartesian data, the thresholds are per joint (use --limits)" << endl;
+		FreeTrajectory(&input);
+		return 1;
+	}
+	if ((input.cycleNs > 0) && (input.cycleNs != config.cycleNs)) {
+		printf("Warning: %s was made for a %.3f ms cycle, retiming for %.3f ms\n", argv[1], input.cycleNs / 1.0e6, config.cycleNs / 1.0e6);
+	}
+	if (haveFixed) {
+		SetFixedLimits(limits, fixed[ThresholdVelocity], fixed[ThresholdAcceleration], fixed[ThresholdJerk]);
+	}
+	else if (!LoadCachedLimits(robotAddress, fullPayload, limits)) {
+		FreeTrajectory(&input);
+		return 1;
+	}
+
+	Trajectory_T output;
+	RetimeStats_T stats;
+	InitTrajectory(&output);
+	bool retimed = RetimeTrajectory(input.samples, input.sampleCount, input.axisCount, limits, &config, &output.positions, &stats);
+	WriteRetimeStats(&stats, config.cycleNs);
+	output.samples = output.positions.data();
+	output.sampleCount = output.positions.size();
+	output.axisCount = input.axisCount;
+	output.delimiter = (input.delimiter != '\0') ? input.delimiter : '\t';
+
+	// the same check StreamITP does before streaming, against the full limits
+	LimitReport_T report;
+	CheckTrajectoryLimits(output.samples, output.sampleCount, config.cycleNs, limits, &report);
+	WriteLimitReport(&report);
+
+	bool ok = retimed;
+	if (retimed) {
+		int representation = (input.representation != RepresentationUnknown) ? input.representation : RepresentationJoint;
+		ok = IsBinaryTrajectoryName(argv[2]) ? SaveTrajectoryBinary(argv[2], &output, representation, config.cycleNs) : SaveTrajectoryText(argv[2], &output);
+	}
+	else {
+		cout << "** NOT RETIMED, " << argv[2] << " not written" << endl;
+	}
+	FreeTrajectory(&input);
+	return ok ? 0 : 1;
+}